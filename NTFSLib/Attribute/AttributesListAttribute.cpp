@@ -19,4 +19,26 @@ AdditionalRecordRefs AttributesListAttribute::getAdditionalMFTReferences() const
 	}
 
 	return mftRefs;
+}
+
+AttributeListEntries AttributesListAttribute::getEntries() const {
+	AttributeListEntries entries;
+	Buffer listData((size_t)m_attribute->getDataSize());
+	m_attribute->getData(listData.data(), 0, (DWORD)listData.size());
+
+	size_t offset = 0;
+	while (offset + sizeof(ATTRIBUTE_LIST) <= listData.size()) {
+		PATTRIBUTE_LIST entry = (PATTRIBUTE_LIST)(listData.data() + offset);
+		if (entry->RecordSize < sizeof(ATTRIBUTE_LIST) || offset + entry->RecordSize > listData.size()) {
+			break;
+		}
+		wstring name;
+		if (entry->NameLength > 0 && entry->NameOffset + entry->NameLength * sizeof(WCHAR) <= entry->RecordSize) {
+			name.assign((const WCHAR*)((PBYTE)entry + entry->NameOffset), entry->NameLength);
+		}
+		entries.push_back({ (ATTR_TYPE)entry->AttributeType, name, entry->LowestVCN, MFT_REF(entry->MFTReference) });
+		offset += entry->RecordSize;
+	}
+
+	return entries;
 }
\ No newline at end of file
@@ -2,14 +2,36 @@
 #define _NTFSLIB_ATTRIBUTES_LIST_ATTRIBUTE_H
 
 #include <set>
+#include <string>
+#include <vector>
 
 #include "..\Misc\Defs.h"
 #include "Base\AttributeRecord.h"
 
 using std::set;
+using std::vector;
+using std::wstring;
 
 typedef set<ULONGLONG> AdditionalRecordRefs;
 
+/**
+ * A single entry of the attributes list: where (a single extent of) an attribute is kept.
+ */
+struct AttributeListEntry {
+	// Type of the attribute.
+	ATTR_TYPE Type;
+
+	// Name of the attribute, empty if unnamed.
+	wstring Name;
+
+	// Lowest VCN of this extent of the attribute, 0 for the first (or only) extent.
+	ULONGLONG LowestVCN;
+
+	// Number of the MFT record holding this extent.
+	ULONGLONG RecordNumber;
+};
+typedef vector<AttributeListEntry> AttributeListEntries;
+
 /**
  * Every MFT attribute is limited to MFT_RECORD_SIZE bytes (mostly 1024 bytes). Whenever the record owns a lot
  * of attributes, it splits the remainder of the attributes on additional MFT records, and instead
@@ -25,6 +47,11 @@ public:
 	 */
 	AdditionalRecordRefs getAdditionalMFTReferences() const;
 
+	/**
+	 * Returns all the list's entries, including the ones of attributes kept in our MFT record.
+	 */
+	AttributeListEntries getEntries() const;
+
 private:
 	FORBID_COPY_AND_ASSIGN(AttributesListAttribute);
 };
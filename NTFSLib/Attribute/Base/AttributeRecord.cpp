@@ -11,6 +11,13 @@ AttributeRecord::AttributeRecord(NTFSVolume& ntfsVolume, const PCOMMON_ATTR_RECO
 	// Left blank.
 }
 
+AttributeRecord::AttributeRecord(NTFSVolume& ntfsVolume, const vector<PCOMMON_ATTR_RECORD>& extents) :
+	m_attribute(extents.size() == 1 && !extents[0]->NonResident ?
+		(CommonAttribute*)new ResidentAttribute(ntfsVolume, extents[0]) :
+		(CommonAttribute*)new NonResidentAttribute(ntfsVolume, extents)) {
+	// Left blank.
+}
+
 AttributeRecord::~AttributeRecord() {
 	delete m_attribute;
 }
\ No newline at end of file
@@ -1,10 +1,14 @@
 #ifndef _NTFSLIB_ATTRIBUTE_RECORD_H
 #define _NTFSLIB_ATTRIBUTE_RECORD_H
 
+#include <vector>
+
 #include "CommonAttribute.h"
 #include "..\..\NTFSVolume.h"
 #include "..\..\Types\NTFSTypes.h"
 
+using std::vector;
+
 /**
  * Defines the base of every attribute record.
  */
@@ -12,6 +16,12 @@ class AttributeRecord {
 public:
 	AttributeRecord(NTFSVolume& ntfsVolume, const PCOMMON_ATTR_RECORD attribute);
 
+	/**
+	 * Creates a record out of all the <extents> of a non-resident attribute (see: NonResidentAttribute).
+	 * A single extent may also be resident.
+	 */
+	AttributeRecord(NTFSVolume& ntfsVolume, const vector<PCOMMON_ATTR_RECORD>& extents);
+
 	virtual ~AttributeRecord();
 
 protected:
@@ -42,6 +42,13 @@ public:
 	 */
 	virtual PBYTE getDataPointer() const = 0;
 
+	/**
+	 * Returns a pointer to <length> bytes of the attribute's data starting at <offset>, without copying them.
+	 * Returns nullptr if the range can not be handed out in place (e.g. it crosses data runs, or the
+	 * volume's device does not support mapping). Throws OutOfBoundsError like getData.
+	 */
+	virtual PBYTE mapData(ULONGLONG offset, DWORD length) = 0;
+
 	/**
 	 * Returns a reference to the volume related to this attribute.
 	 */
@@ -1,17 +1,46 @@
-#include <algorithm>
-
 #include "NonResidentAttribute.h"
 #include "..\..\Misc\NTFSLibError.h"
-
-using std::min;
+#include "..\..\Misc\ReadPlanner.h"
 
 NonResidentAttribute::NonResidentAttribute(NTFSVolume& ntfsVolume, const PCOMMON_ATTR_RECORD attribute) :
-	CommonAttribute(ntfsVolume, attribute),
-	m_nonResident((PNONRESIDENT_ATTR_RECORD)attribute){
+	NonResidentAttribute(ntfsVolume, vector<PCOMMON_ATTR_RECORD>(1, attribute)) {
+	// Left blank.
+}
+
+NonResidentAttribute::NonResidentAttribute(NTFSVolume& ntfsVolume, const vector<PCOMMON_ATTR_RECORD>& extents) :
+	CommonAttribute(ntfsVolume, findFirstExtent(extents)),
+	m_nonResident((PNONRESIDENT_ATTR_RECORD)m_attribute) {
+	NTFSLIB_ASSERT(
+		m_nonResident != nullptr,
+		UnexpectedActionError
+	);
+	DataRunList dataRuns;
+	for (PCOMMON_ATTR_RECORD extent : extents) {
+		decodeDataRuns((PNONRESIDENT_ATTR_RECORD)extent, dataRuns);
+	}
+
+	NTFSLIB_ASSERT(
+		!dataRuns.empty(),
+		EmptyDataRunError
+	);
+	// Every extent starts its own VCN range, sorting the data runs is enough to merge them.
+	m_extents = ExtentMap(dataRuns, m_ntfsVolume.getClusterSize(), m_nonResident->DataSize);
+}
+
+PCOMMON_ATTR_RECORD NonResidentAttribute::findFirstExtent(const vector<PCOMMON_ATTR_RECORD>& extents) {
+	for (PCOMMON_ATTR_RECORD extent : extents) {
+		if (((PNONRESIDENT_ATTR_RECORD)extent)->LowestLCN == 0) {
+			return extent;
+		}
+	}
+	return nullptr;
+}
+
+void NonResidentAttribute::decodeDataRuns(const PNONRESIDENT_ATTR_RECORD extent, DataRunList& dataRuns) {
 	// Parsing non-resident data runs. For an explanation about the data run structure, see DataRun structure in NTFSTypes.h
-	PBYTE dataRunBuffer = (PBYTE)m_nonResident + m_nonResident->DataRunOffset;
-	// VCN = FILE offset, LCN = DISK offset.
-	ULONGLONG VCN = 0, LCN = 0;
+	PBYTE dataRunBuffer = (PBYTE)extent + extent->DataRunOffset;
+	// VCN = FILE offset, LCN = DISK offset. Each extent's data runs start at its own lowest VCN, relative to LCN 0.
+	ULONGLONG VCN = extent->LowestLCN, LCN = 0;
 	while (*dataRunBuffer) {
 		DataRun dataRunEntry = { 0 };
 
@@ -37,60 +66,34 @@ NonResidentAttribute::NonResidentAttribute(NTFSVolume& ntfsVolume, const PCOMMON
 		}
 		dataRunEntry.StartVCN = VCN;
 		VCN += dataRunEntry.NumOfClusters;
-		m_dataRuns.push_back(dataRunEntry);
+		dataRuns.push_back(dataRunEntry);
 
 		dataRunBuffer += numOfLengthBytes + numOfOffsetBytes + 1;
 	}
-
-	NTFSLIB_ASSERT(
-		!m_dataRuns.empty(),
-		EmptyDataRunError
-	);
 }
 
 void NonResidentAttribute::getData(PVOID buffer, ULONGLONG offset, DWORD length) {
+	// Heavily fragmented streams would otherwise cost a read per data run.
+	ReadPlanner planner(m_extents, m_ntfsVolume.getClusterSize(), m_ntfsVolume.getReadGapTolerance());
+	m_ntfsVolume.readPlan(buffer, planner.plan(offset, length));
+}
+
+PBYTE NonResidentAttribute::mapData(ULONGLONG offset, DWORD length) {
 	NTFSLIB_ASSERT(
-		offset + length <= getDataSize(), 
+		offset + length <= getDataSize(),
 		OutOfBoundsError
 	);
-	
-	WORD clusterSize = m_ntfsVolume.getClusterSize();
-	// First cluster we're going to read, relative to the file (NOT to the actual disk).
-	ULONGLONG currentVC = offset / clusterSize;
-	// By calculating the last cluster we're going like to read, we can figure out how many clusters we're going to read.
-	ULONGLONG clustersLeftToRead = (offset + length + clusterSize - 1) / clusterSize - currentVC;
-	// Initializing a buffer big enough for all the data we're going to read.
-	Buffer fullBuffer((DWORD)clustersLeftToRead * clusterSize);
-	size_t bufferIndex = 0;
-	for (const DataRun& dataRun : m_dataRuns) {
-		// If the current file-relative cluster is found between this data run, lets read from it.
-		if (currentVC >= dataRun.StartVCN && currentVC < dataRun.StartVCN + dataRun.NumOfClusters) {
-			// The difference between the current file cluster to the starting file cluster of this data run.
-			ULONGLONG currentOffset = currentVC - dataRun.StartVCN;
-			// Figuring out if this data run is enough for our needs, or we'll have more clusters to read afterwards.
-			ULONGLONG clustersToRead = min<ULONGLONG>(clustersLeftToRead, dataRun.NumOfClusters - currentOffset);
-			// Reading the clusters with the same relative offset we've already calculated.
-			DWORD bytesRead = m_ntfsVolume.readClusters(fullBuffer.data() + bufferIndex, dataRun.StartLCN + currentOffset, (DWORD)clustersToRead, dataRun.IsSparse);
-			NTFSLIB_ASSERT(
-				bytesRead == clustersToRead * clusterSize,
-				BadSizeError
-			);
-			clustersLeftToRead -= clustersToRead;
-			if (clustersLeftToRead == 0) {
-				break;
-			}
-			currentVC += clustersToRead;
-			bufferIndex += bytesRead;
-		}
+
+	// Only ranges found entirely inside a single, non-sparse data run are contiguous on the disk.
+	ULONGLONG diskOffset = 0;
+	if (!m_extents.translate(offset, length, diskOffset)) {
+		return nullptr;
 	}
-	NTFSLIB_ASSERT(
-		clustersLeftToRead == 0, 
-		BadSizeError
-	);
+	return m_ntfsVolume.mapBytes(diskOffset, length);
+}
 
-	// We read full clusters, but the user asked for a specific offset and length.
-	WORD startIndex = offset % clusterSize;
-	memcpy(buffer, fullBuffer.data() + startIndex, length);
+const DataRunList& NonResidentAttribute::getDataRuns() const {
+	return m_extents.getDataRuns();
 }
 
 ULONGLONG NonResidentAttribute::getDataSize() const {
@@ -4,18 +4,29 @@
 #include <vector>
 
 #include "CommonAttribute.h"
+#include "..\..\Misc\ExtentMap.h"
 
 using std::vector;
 
 /**
  * An attribute which its data is saved out of the attribute's body (because it's too big), in a form called "data runs".
  * A data run is a range of clusters on the disk, containing all or part of the attribute's data.
+ * Attributes too fragmented for a single record are split into several extents (each in its own record,
+ * covering its own VCN range), which are merged here into a single data run list.
  */
 class NonResidentAttribute : public CommonAttribute {
 public:
 	NonResidentAttribute(NTFSVolume& ntfsVolume, const PCOMMON_ATTR_RECORD attribute);
 
+	/**
+	 * Creates an attribute out of all its <extents>, in any order.
+	 * Throws UnexpectedActionError if the first extent (the one carrying the attribute's size) is not one of them.
+	 */
+	NonResidentAttribute(NTFSVolume& ntfsVolume, const vector<PCOMMON_ATTR_RECORD>& extents);
+
 	// see: CommonAttribute.getData
+	// The read is planned with a ReadPlanner: whole clusters are read straight into <buffer>, and data runs
+	// which are close on the disk are read together.
 	virtual void getData(PVOID buffer, ULONGLONG offset, DWORD length) override;
 
 	// see: CommonAttribute.getDataSize
@@ -24,14 +35,32 @@ public:
 	// see: CommonAttribute.getDataPointer
 	virtual PBYTE getDataPointer() const override;
 
+	// see: CommonAttribute.mapData
+	virtual PBYTE mapData(ULONGLONG offset, DWORD length) override;
+
+	/**
+	 * Returns the attribute's decoded data runs, of all its extents, sorted by VCN.
+	 */
+	const DataRunList& getDataRuns() const;
+
 private:
 	FORBID_COPY_AND_ASSIGN(NonResidentAttribute);
 
-	// Non-resident record.
+	/**
+	 * Returns the first extent of <extents>, nullptr if it is not one of them.
+	 */
+	static PCOMMON_ATTR_RECORD findFirstExtent(const vector<PCOMMON_ATTR_RECORD>& extents);
+
+	/**
+	 * Decodes the data runs of <extent> and appends them to <dataRuns>.
+	 */
+	static void decodeDataRuns(const PNONRESIDENT_ATTR_RECORD extent, DataRunList& dataRuns);
+
+	// Non-resident record (the first extent).
 	const PNONRESIDENT_ATTR_RECORD m_nonResident;
 
 	// Attribute's data runs. Each data run represents a chunk of the attribute's data.
-	DataRunList m_dataRuns;
+	ExtentMap m_extents;
 };
 
 #endif // _NTFSLIB_NON_RESIDENT_ATTRIBUTE_H
@@ -16,6 +16,15 @@ void ResidentAttribute::getData(PVOID buffer, ULONGLONG offset, DWORD length) {
 	memcpy(buffer, getDataPointer() + offset, length);
 }
 
+PBYTE ResidentAttribute::mapData(ULONGLONG offset, DWORD length) {
+	NTFSLIB_ASSERT(
+		offset + length <= getDataSize(),
+		OutOfBoundsError
+	);
+
+	return getDataPointer() + offset;
+}
+
 ULONGLONG ResidentAttribute::getDataSize() const {
 	return m_resident->ValueLength;
 }
@@ -19,6 +19,9 @@ public:
 	// see: CommonAttribute.getDataPointer
 	virtual PBYTE getDataPointer() const override;
 
+	// see: CommonAttribute.mapData
+	virtual PBYTE mapData(ULONGLONG offset, DWORD length) override;
+
 private:
 	FORBID_COPY_AND_ASSIGN(ResidentAttribute);
 
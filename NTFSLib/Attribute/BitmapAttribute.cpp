@@ -0,0 +1,23 @@
+#include "BitmapAttribute.h"
+
+BitmapAttribute::BitmapAttribute(NTFSVolume& ntfsVolume, const PCOMMON_ATTR_RECORD attribute):
+	AttributeRecord(ntfsVolume, attribute) {
+	// Left blank.
+}
+
+ULONGLONG BitmapAttribute::getSize() const {
+	return m_attribute->getDataSize();
+}
+
+Buffer BitmapAttribute::getBitmap() const {
+	Buffer bitmap((size_t)getSize());
+	if (!bitmap.empty()) {
+		m_attribute->getData(bitmap.data(), 0, (DWORD)bitmap.size());
+	}
+	return bitmap;
+}
+
+bool BitmapAttribute::isBitSet(const Buffer& bitmap, ULONGLONG index) {
+	ULONGLONG byteIndex = index / 8;
+	return byteIndex < bitmap.size() && (bitmap[(size_t)byteIndex] & (1 << (index % 8))) != 0;
+}
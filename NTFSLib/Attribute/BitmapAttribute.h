@@ -0,0 +1,34 @@
+#ifndef _NTFSLIB_BITMAP_ATTRIBUTE_H
+#define _NTFSLIB_BITMAP_ATTRIBUTE_H
+
+#include "..\Misc\Defs.h"
+#include "Base\AttributeRecord.h"
+
+/**
+ * A bit per allocation unit, set if the unit is in use.
+ * The MFT's bitmap tracks its records, an index's bitmap tracks its index records.
+ */
+class BitmapAttribute : public AttributeRecord {
+public:
+	BitmapAttribute(NTFSVolume& ntfsVolume, const PCOMMON_ATTR_RECORD attribute);
+
+	/**
+	 * Returns the size in bytes of the bitmap.
+	 */
+	ULONGLONG getSize() const;
+
+	/**
+	 * Reads the whole bitmap.
+	 */
+	Buffer getBitmap() const;
+
+	/**
+	 * Returns true if bit <index> is set in <bitmap>. Bits beyond the bitmap are considered clear.
+	 */
+	static bool isBitSet(const Buffer& bitmap, ULONGLONG index);
+
+private:
+	FORBID_COPY_AND_ASSIGN(BitmapAttribute);
+};
+
+#endif // _NTFSLIB_BITMAP_ATTRIBUTE_H
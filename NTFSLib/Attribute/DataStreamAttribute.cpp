@@ -1,18 +1,39 @@
 #include "DataStreamAttribute.h"
+#include "Base\NonResidentAttribute.h"
+#include "..\Misc\NTFSLibError.h"
+#include "..\Misc\IOStatistics.h"
 
 DataStreamAttribute::DataStreamAttribute(NTFSVolume& ntfsVolume, PCOMMON_ATTR_RECORD attribute) :
 	AttributeRecord(ntfsVolume, attribute) {
 	// Left blank.
 }
 
+DataStreamAttribute::DataStreamAttribute(NTFSVolume& ntfsVolume, const vector<PCOMMON_ATTR_RECORD>& extents) :
+	AttributeRecord(ntfsVolume, extents) {
+	// Left blank.
+}
+
 ULONGLONG DataStreamAttribute::getSize() const {
 	return m_attribute->getDataSize();
 }
 
 void DataStreamAttribute::getData(PVOID buffer, ULONGLONG offset, DWORD length) const {
+	IOSourceScope ioSource(IO_SOURCE::DATA_STREAM);
 	m_attribute->getData(buffer, offset, length);
 }
 
+PBYTE DataStreamAttribute::mapData(ULONGLONG offset, DWORD length) const {
+	return m_attribute->mapData(offset, length);
+}
+
+const DataRunList& DataStreamAttribute::getDataRuns() const {
+	NTFSLIB_ASSERT(
+		!m_attribute->isResident(),
+		UnexpectedActionError
+	);
+	return ((NonResidentAttribute*)m_attribute)->getDataRuns();
+}
+
 wstring DataStreamAttribute::getStreamName() const {
 	return m_attribute->getAttributeName();
 }
@@ -10,6 +10,11 @@ class DataStreamAttribute : public AttributeRecord {
 public:
 	DataStreamAttribute(NTFSVolume& ntfsVolume, PCOMMON_ATTR_RECORD attribute);
 
+	/**
+	 * Creates a data stream out of all its <extents>, which might be kept in several records.
+	 */
+	DataStreamAttribute(NTFSVolume& ntfsVolume, const vector<PCOMMON_ATTR_RECORD>& extents);
+
 	/**
 	 * Returns the size in bytes of this data stream.
 	 */
@@ -23,6 +28,18 @@ public:
 	 */
 	void getData(PVOID buffer, ULONGLONG offset, DWORD length) const;
 
+	/**
+	 * Returns a pointer to <length> bytes of this data stream starting at <offset>, without copying them,
+	 * or nullptr if this range can not be handed out in place (see: CommonAttribute.mapData).
+	 */
+	PBYTE mapData(ULONGLONG offset, DWORD length) const;
+
+	/**
+	 * Returns the data runs of this data stream (of all its extents), sorted by VCN.
+	 * Throws UnexpectedActionError if the data stream is resident.
+	 */
+	const DataRunList& getDataRuns() const;
+
 	/**
 	 * Returns the data stream's name.
 	 */
@@ -1,6 +1,7 @@
 #include "IndexAllocationAttribute.h"
 #include "..\Misc\StringResource.h"
 #include "..\Misc\NTFSLibError.h"
+#include "..\Misc\IOStatistics.h"
 
 using std::make_shared;
 
@@ -10,6 +11,7 @@ IndexAllocationAttribute::IndexAllocationAttribute(NTFSVolume& ntfsVolume, const
 }
 
 shared_ptr<IndexRecord> IndexAllocationAttribute::readIndexRecord(ULONGLONG indexRecordNumber) {
+	IOSourceScope ioSource(IO_SOURCE::INDEX);
 	WORD indexRecordSize = m_attribute->getVolume().getIndexRecordSize();
 	INDEX_RECORD indexRecord;
 
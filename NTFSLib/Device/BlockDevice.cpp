@@ -0,0 +1,33 @@
+#include "BlockDevice.h"
+#include "..\Misc\NTFSLibError.h"
+
+BlockDevice::BlockDevice() {
+	// Left blank.
+}
+
+BlockDevice::~BlockDevice() {
+	// Left blank.
+}
+
+void BlockDevice::readBatch(DeviceReadList& reads) {
+	for (DeviceRead& read : reads) {
+		read.BytesRead = readAt(read.Buffer, read.Offset, read.Length);
+	}
+}
+
+DWORD BlockDevice::sendIoctl(DWORD code, PVOID /* inBuffer */, DWORD /* inBufferSize */, PVOID /* outBuffer */, DWORD /* outBufferSize */) {
+	NTFSLIB_ERROR(
+		UnexpectedActionError,
+		NTFSLIB_DEFAULT_ERROR_CODE,
+		"IOCTL %#lx is not supported by this block device",
+		code
+	);
+}
+
+PBYTE BlockDevice::map(ULONGLONG /* offset */, DWORD /* length */) {
+	return nullptr;
+}
+
+bool BlockDevice::isImmutable() const {
+	return false;
+}
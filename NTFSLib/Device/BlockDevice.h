@@ -0,0 +1,77 @@
+#ifndef _NTFSLIB_BLOCK_DEVICE_H
+#define _NTFSLIB_BLOCK_DEVICE_H
+
+#include <vector>
+
+#include "..\Misc\Defs.h"
+#include "..\Misc\Win32\Win32.h"
+
+using std::vector;
+
+/**
+ * A single read of a batch (see: BlockDevice.readBatch).
+ */
+typedef struct {
+	PVOID Buffer;
+	ULONGLONG Offset;
+	DWORD Length;
+	// Filled by readBatch, like the return value of readAt.
+	DWORD BytesRead;
+} DeviceRead;
+typedef vector<DeviceRead> DeviceReadList;
+
+/**
+ * A source of raw volume bytes. NTFSVolume reads everything through a block device,
+ * so the same parser can run on a live volume or on an acquired image.
+ * Reads are positional (there is no shared file pointer), so implementations
+ * must allow readAt() to be called concurrently from several threads.
+ */
+class BlockDevice {
+public:
+	BlockDevice();
+
+	virtual ~BlockDevice();
+
+	/**
+	 * Reads <bytesToRead> bytes starting at <offset> (relative to the beginning of the device) into <buffer>.
+	 * Returns the actual bytes read (less than <bytesToRead> only at the end of the device).
+	 */
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) = 0;
+
+	/**
+	 * Performs all the <reads>, in any order, and sets the BytesRead of each one of them.
+	 * The default implementation issues them one by one with readAt. Devices which can keep several
+	 * reads in flight should override it.
+	 */
+	virtual void readBatch(DeviceReadList& reads);
+
+	/**
+	 * Returns the size of the device in bytes.
+	 */
+	virtual ULONGLONG getSize() const = 0;
+
+	/**
+	 * Sends an IOCTL to the device. Input is defined by <inBuffer>, and output will be placed in <outBuffer>.
+	 * Only live volumes understand IOCTLs, the default implementation throws an UnexpectedActionError.
+	 */
+	virtual DWORD sendIoctl(DWORD code, PVOID inBuffer, DWORD inBufferSize, PVOID outBuffer, DWORD outBufferSize);
+
+	/**
+	 * Returns a pointer to <length> bytes of the device starting at <offset>, without copying them,
+	 * or nullptr if the device can not hand out pointers (the default). The memory stays valid for the
+	 * lifetime of the device, is read-only and shared by all the readers of the device.
+	 * It should be copied with NTFSUtils.copyMappedMemory, which reports a failure to page it in.
+	 */
+	virtual PBYTE map(ULONGLONG offset, DWORD length);
+
+	/**
+	 * Returns true if the device's bytes never change while it is read (e.g. an acquired image),
+	 * so whatever was read from it can be cached. The default is false (e.g. a live volume).
+	 */
+	virtual bool isImmutable() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(BlockDevice);
+};
+
+#endif // _NTFSLIB_BLOCK_DEVICE_H
@@ -0,0 +1,84 @@
+#include "MappedImageDevice.h"
+#include "..\NTFSUtils.h"
+#include "..\Misc\NTFSLibError.h"
+
+MappedImageDevice::MappedImageDevice(const wstring& imagePath) :
+	m_imagePath(imagePath),
+	m_imageHandle(INVALID_HANDLE_VALUE),
+	m_mappingHandle(NULL),
+	m_imageSize(0),
+	m_view(nullptr) {
+	TRACE(DEBUG_LEVEL::INFO, "Mapping raw image: %ws", m_imagePath.c_str());
+	m_imageHandle = CreateFile(
+		m_imagePath.c_str(),								// File name
+		GENERIC_READ,										// Desired access
+		FILE_SHARE_READ,									// Share mode
+		NULL,												// Security attributes
+		OPEN_EXISTING,										// Creation disposition
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,	// Flags & Attributes
+		NULL												// Template file
+	);
+	WIN32_ASSERT(m_imageHandle != INVALID_HANDLE_VALUE);
+
+	try {
+		LARGE_INTEGER imageSize;
+		WIN32_ASSERT(GetFileSizeEx(m_imageHandle, &imageSize));
+		m_imageSize = (ULONGLONG)imageSize.QuadPart;
+		NTFSLIB_ASSERT(
+			m_imageSize > 0 && m_imageSize <= (SIZE_T)-1,
+			BadSizeError
+		);
+
+		// Read-only view, nothing is ever written to the mapped memory (records are fixed up in copies).
+		m_mappingHandle = CreateFileMapping(m_imageHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		WIN32_ASSERT(m_mappingHandle != NULL);
+		m_view = (PBYTE)MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+		WIN32_ASSERT(m_view != nullptr);
+	}
+	catch (NTFSLibError&) {
+		if (m_mappingHandle != NULL) {
+			CloseHandle(m_mappingHandle);
+		}
+		CloseHandle(m_imageHandle);
+		throw;
+	}
+}
+
+MappedImageDevice::~MappedImageDevice() {
+	if (!UnmapViewOfFile(m_view)) {
+		TRACE_WITH_ERROR_CODE(DEBUG_LEVEL::CRITICAL, GetLastError(), "Could not unmap image: %ws", m_imagePath.c_str());
+	}
+	if (!CloseHandle(m_mappingHandle)) {
+		TRACE_WITH_ERROR_CODE(DEBUG_LEVEL::CRITICAL, GetLastError(), "Could not close mapping of image: %ws", m_imagePath.c_str());
+	}
+	if (!CloseHandle(m_imageHandle)) {
+		TRACE_WITH_ERROR_CODE(DEBUG_LEVEL::CRITICAL, GetLastError(), "Could not close handle to image: %ws", m_imagePath.c_str());
+	}
+}
+
+DWORD MappedImageDevice::readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	if (offset >= m_imageSize) {
+		return 0;
+	}
+	if (bytesToRead > m_imageSize - offset) {
+		bytesToRead = (DWORD)(m_imageSize - offset);
+	}
+	NTFSUtils::copyMappedMemory(buffer, m_view + offset, bytesToRead);
+	return bytesToRead;
+}
+
+ULONGLONG MappedImageDevice::getSize() const {
+	return m_imageSize;
+}
+
+bool MappedImageDevice::isImmutable() const {
+	return true;
+}
+
+PBYTE MappedImageDevice::map(ULONGLONG offset, DWORD length) {
+	NTFSLIB_ASSERT(
+		offset <= m_imageSize && length <= m_imageSize - offset,
+		OutOfBoundsError
+	);
+	return m_view + offset;
+}
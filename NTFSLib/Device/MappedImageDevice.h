@@ -0,0 +1,54 @@
+#ifndef _NTFSLIB_MAPPED_IMAGE_DEVICE_H
+#define _NTFSLIB_MAPPED_IMAGE_DEVICE_H
+
+#include <string>
+
+#include "BlockDevice.h"
+
+using std::wstring;
+
+/**
+ * Block device backed by a raw image of a single NTFS volume, mapped as a whole into memory.
+ * The view is read-only, so records are copied out of it before they are fixed up (see: NTFSUtils.USARecordFixup),
+ * and every reader (mapped or not) sees the image's bytes. The image is paged in as it is accessed, so a failure to
+ * read it surfaces as a fault rather than a failed read (see: NTFSUtils.copyMappedMemory).
+ * NOTICE: The whole image must fit in the address space, so this device is meant for 64-bit builds.
+ */
+class MappedImageDevice : public BlockDevice {
+public:
+	MappedImageDevice(const wstring& imagePath);
+
+	~MappedImageDevice();
+
+	// see: BlockDevice.readAt
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override;
+
+	// see: BlockDevice.getSize
+	virtual ULONGLONG getSize() const override;
+
+	// see: BlockDevice.map
+	virtual PBYTE map(ULONGLONG offset, DWORD length) override;
+
+	// see: BlockDevice.isImmutable
+	virtual bool isImmutable() const override;
+
+private:
+	FORBID_COPY_AND_ASSIGN(MappedImageDevice);
+
+	// Image's path.
+	const wstring m_imagePath;
+
+	// Image's file handle.
+	HANDLE m_imageHandle;
+
+	// Handle to the file mapping object.
+	HANDLE m_mappingHandle;
+
+	// Image's size in bytes.
+	ULONGLONG m_imageSize;
+
+	// Base address of the mapped view.
+	PBYTE m_view;
+};
+
+#endif // _NTFSLIB_MAPPED_IMAGE_DEVICE_H
@@ -0,0 +1,71 @@
+#include <algorithm>
+
+#include "PartitionDevice.h"
+#include "..\Misc\NTFSLibError.h"
+
+using std::min;
+
+PartitionDevice::PartitionDevice(shared_ptr<BlockDevice> disk, ULONGLONG offset, ULONGLONG size) :
+	m_disk(disk),
+	m_offset(offset),
+	m_size(size) {
+	NTFSLIB_ASSERT(
+		m_disk != nullptr,
+		UnexpectedActionError
+	);
+	NTFSLIB_ASSERT(
+		m_offset <= m_disk->getSize() && m_size <= m_disk->getSize() - m_offset,
+		OutOfBoundsError
+	);
+}
+
+PartitionDevice::~PartitionDevice() {
+	// Left blank.
+}
+
+DWORD PartitionDevice::readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	DWORD bytesInPartition = clampLength(offset, bytesToRead);
+	if (bytesInPartition == 0) {
+		return 0;
+	}
+	return m_disk->readAt(buffer, m_offset + offset, bytesInPartition);
+}
+
+void PartitionDevice::readBatch(DeviceReadList& reads) {
+	DeviceReadList diskReads;
+	diskReads.reserve(reads.size());
+	for (const DeviceRead& read : reads) {
+		// Reads beyond the end of the partition are kept (with nothing to read), so the lists stay aligned.
+		diskReads.push_back({ read.Buffer, m_offset + min(read.Offset, m_size), clampLength(read.Offset, read.Length), 0 });
+	}
+	m_disk->readBatch(diskReads);
+	for (size_t i = 0; i < reads.size(); ++i) {
+		reads[i].BytesRead = diskReads[i].BytesRead;
+	}
+}
+
+ULONGLONG PartitionDevice::getSize() const {
+	return m_size;
+}
+
+PBYTE PartitionDevice::map(ULONGLONG offset, DWORD length) {
+	if (offset > m_size || length > m_size - offset) {
+		return nullptr;
+	}
+	return m_disk->map(m_offset + offset, length);
+}
+
+bool PartitionDevice::isImmutable() const {
+	return m_disk->isImmutable();
+}
+
+ULONGLONG PartitionDevice::getOffset() const {
+	return m_offset;
+}
+
+DWORD PartitionDevice::clampLength(ULONGLONG offset, DWORD length) const {
+	if (offset >= m_size) {
+		return 0;
+	}
+	return (DWORD)min<ULONGLONG>(length, m_size - offset);
+}
@@ -0,0 +1,62 @@
+#ifndef _NTFSLIB_PARTITION_DEVICE_H
+#define _NTFSLIB_PARTITION_DEVICE_H
+
+#include <memory>
+
+#include "BlockDevice.h"
+
+using std::shared_ptr;
+
+/**
+ * Block device of a single partition of a disk (e.g. a whole-disk image), byte 0 being the partition's first byte.
+ * Reads are shifted by the partition's offset and never go beyond its end.
+ * Any number of partitions can share the same disk device, and be read concurrently (see: PartitionTable).
+ */
+class PartitionDevice : public BlockDevice {
+public:
+	/**
+	 * Opens the <size> bytes of <disk> starting at <offset>.
+	 */
+	PartitionDevice(shared_ptr<BlockDevice> disk, ULONGLONG offset, ULONGLONG size);
+
+	~PartitionDevice();
+
+	// see: BlockDevice.readAt
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override;
+
+	// see: BlockDevice.readBatch
+	virtual void readBatch(DeviceReadList& reads) override;
+
+	// see: BlockDevice.getSize
+	virtual ULONGLONG getSize() const override;
+
+	// see: BlockDevice.map
+	virtual PBYTE map(ULONGLONG offset, DWORD length) override;
+
+	// see: BlockDevice.isImmutable
+	virtual bool isImmutable() const override;
+
+	/**
+	 * Returns the partition's offset on the disk in bytes.
+	 */
+	ULONGLONG getOffset() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(PartitionDevice);
+
+	/**
+	 * Returns how many of the <length> bytes starting at <offset> are within the partition.
+	 */
+	DWORD clampLength(ULONGLONG offset, DWORD length) const;
+
+	// The disk the partition is found on.
+	shared_ptr<BlockDevice> m_disk;
+
+	// Partition's offset on the disk in bytes.
+	const ULONGLONG m_offset;
+
+	// Partition's size in bytes.
+	const ULONGLONG m_size;
+};
+
+#endif // _NTFSLIB_PARTITION_DEVICE_H
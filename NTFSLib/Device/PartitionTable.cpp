@@ -0,0 +1,201 @@
+#include "PartitionTable.h"
+#include "PartitionDevice.h"
+#include "..\Misc\NTFSLibError.h"
+#include "..\Misc\StringResource.h"
+
+using std::make_shared;
+
+PartitionTable::PartitionTable(shared_ptr<BlockDevice> disk) :
+	m_disk(disk),
+	m_scheme(PARTITION_SCHEME::NONE),
+	m_sectorSize(PARTITION_DEFAULT_SECTOR_SIZE) {
+	NTFSLIB_ASSERT(
+		m_disk != nullptr,
+		UnexpectedActionError
+	);
+
+	// NTFS boot sectors end with the same signature as an MBR, so they are looked for first.
+	if (isNTFS(0)) {
+		PartitionInfo partition = {};
+		partition.Number = 1;
+		partition.Size = m_disk->getSize();
+		partition.IsNTFS = true;
+		m_partitions.push_back(partition);
+		return;
+	}
+
+	MASTER_BOOT_RECORD mbr;
+	NTFSLIB_ASSERT(
+		m_disk->readAt(&mbr, 0, sizeof(MASTER_BOOT_RECORD)) == sizeof(MASTER_BOOT_RECORD),
+		BadSizeError
+	);
+	NTFSLIB_ASSERT(
+		mbr.Signature == MBR_SIGNATURE,
+		BadRecordHeaderError
+	);
+	for (const MBR_PARTITION_ENTRY& entry : mbr.Partitions) {
+		if (entry.PartitionType == MBR_TYPE_GPT_PROTECTIVE) {
+			m_scheme = PARTITION_SCHEME::GPT;
+			readGPT();
+			return;
+		}
+	}
+	m_scheme = PARTITION_SCHEME::MBR;
+	readMBR(mbr);
+}
+
+PartitionTable::~PartitionTable() {
+	// Left blank.
+}
+
+PARTITION_SCHEME PartitionTable::getScheme() const {
+	return m_scheme;
+}
+
+WORD PartitionTable::getSectorSize() const {
+	return m_sectorSize;
+}
+
+const PartitionList& PartitionTable::getPartitions() const {
+	return m_partitions;
+}
+
+PartitionList PartitionTable::getNTFSPartitions() const {
+	PartitionList ntfsPartitions;
+	for (const PartitionInfo& partition : m_partitions) {
+		if (partition.IsNTFS) {
+			ntfsPartitions.push_back(partition);
+		}
+	}
+	return ntfsPartitions;
+}
+
+shared_ptr<BlockDevice> PartitionTable::openPartition(const PartitionInfo& partition) const {
+	return make_shared<PartitionDevice>(m_disk, partition.Offset, partition.Size);
+}
+
+void PartitionTable::readMBR(const MASTER_BOOT_RECORD& mbr) {
+	DWORD nextLogicalNumber = MBR_FIRST_LOGICAL_PARTITION_NUMBER;
+	for (DWORD i = 0; i < MBR_NUM_OF_PARTITIONS; ++i) {
+		const MBR_PARTITION_ENTRY& entry = mbr.Partitions[i];
+		if (entry.PartitionType == MBR_TYPE_EMPTY) {
+			continue;
+		}
+		if (isExtended(entry.PartitionType)) {
+			readExtendedPartition(entry.StartingLBA, nextLogicalNumber);
+			continue;
+		}
+		PartitionInfo partition = {};
+		partition.Number = i + 1;
+		partition.MBRType = entry.PartitionType;
+		addPartition(partition, entry.StartingLBA, entry.SizeInSectors);
+	}
+}
+
+void PartitionTable::readExtendedPartition(ULONGLONG extendedLBA, DWORD& nextNumber) {
+	ULONGLONG ebrLBA = extendedLBA;
+	// Bounded, since a corrupted chain might loop.
+	for (DWORD i = 0; i < PARTITION_MAX_LOGICAL_PARTITIONS; ++i) {
+		MASTER_BOOT_RECORD ebr;
+		if (m_disk->readAt(&ebr, ebrLBA * m_sectorSize, sizeof(MASTER_BOOT_RECORD)) != sizeof(MASTER_BOOT_RECORD) ||
+			ebr.Signature != MBR_SIGNATURE) {
+			TRACE(DEBUG_LEVEL::INFO, "Bad EBR at LBA %llu, skipping the rest of the extended partition", ebrLBA);
+			return;
+		}
+
+		// The logical partition is relative to its EBR.
+		const MBR_PARTITION_ENTRY& logical = ebr.Partitions[0];
+		if (logical.PartitionType != MBR_TYPE_EMPTY) {
+			PartitionInfo partition = {};
+			partition.Number = nextNumber++;
+			partition.MBRType = logical.PartitionType;
+			addPartition(partition, ebrLBA + logical.StartingLBA, logical.SizeInSectors);
+		}
+
+		// The next EBR is relative to the extended partition.
+		const MBR_PARTITION_ENTRY& next = ebr.Partitions[1];
+		if (!isExtended(next.PartitionType) || next.StartingLBA == 0) {
+			return;
+		}
+		ebrLBA = extendedLBA + next.StartingLBA;
+	}
+}
+
+void PartitionTable::readGPT() {
+	GPT_HEADER header;
+	bool isFound = false;
+	for (WORD sectorSize : PARTITION_GPT_SECTOR_SIZES) {
+		if (m_disk->readAt(&header, sectorSize, sizeof(GPT_HEADER)) == sizeof(GPT_HEADER) &&
+			CMP_STR((PCHAR)header.Signature, StringResource::gptSignature)) {
+			m_sectorSize = sectorSize;
+			isFound = true;
+			break;
+		}
+	}
+	NTFSLIB_ASSERT(
+		isFound,
+		BadRecordHeaderError
+	);
+	NTFSLIB_ASSERT(
+		header.SizeOfPartitionEntry >= sizeof(GPT_PARTITION_ENTRY) &&
+		header.SizeOfPartitionEntry <= m_sectorSize &&
+		header.NumberOfPartitionEntries <= PARTITION_MAX_GPT_ENTRIES,
+		BadRecordHeaderError
+	);
+
+	DWORD entriesSize = header.NumberOfPartitionEntries * header.SizeOfPartitionEntry;
+	Buffer entries(entriesSize);
+	NTFSLIB_ASSERT(
+		header.PartitionEntryLBA < m_disk->getSize() / m_sectorSize &&
+		m_disk->readAt(entries.data(), header.PartitionEntryLBA * m_sectorSize, entriesSize) == entriesSize,
+		BadSizeError
+	);
+	static const BYTE unusedType[sizeof(GPT_PARTITION_ENTRY::PartitionTypeGUID)] = { 0 };
+	for (DWORD i = 0; i < header.NumberOfPartitionEntries; ++i) {
+		PGPT_PARTITION_ENTRY entry = (PGPT_PARTITION_ENTRY)(entries.data() + i * header.SizeOfPartitionEntry);
+		if (memcmp(entry->PartitionTypeGUID, unusedType, sizeof(unusedType)) == 0) {
+			continue;
+		}
+		if (entry->EndingLBA < entry->StartingLBA) {
+			TRACE(DEBUG_LEVEL::INFO, "Bad GPT partition entry %lu, skipping", i);
+			continue;
+		}
+		PartitionInfo partition = {};
+		partition.Number = i + 1;
+		memcpy(&partition.GPTType, entry->PartitionTypeGUID, sizeof(GUID));
+		size_t nameLength = 0;
+		while (nameLength < sizeof(entry->PartitionName) / sizeof(WCHAR) && entry->PartitionName[nameLength] != L'\0') {
+			nameLength++;
+		}
+		partition.Name.assign(entry->PartitionName, nameLength);
+		addPartition(partition, entry->StartingLBA, entry->EndingLBA - entry->StartingLBA + 1);
+	}
+}
+
+void PartitionTable::addPartition(PartitionInfo& partition, ULONGLONG startLBA, ULONGLONG numOfSectors) {
+	ULONGLONG diskSectors = m_disk->getSize() / m_sectorSize;
+	if (numOfSectors == 0 || startLBA >= diskSectors) {
+		TRACE(DEBUG_LEVEL::INFO, "Partition %lu is beyond the end of the disk, skipping", partition.Number);
+		return;
+	}
+	if (numOfSectors > diskSectors - startLBA) {
+		TRACE(DEBUG_LEVEL::INFO, "Partition %lu ends beyond the end of the disk, truncating", partition.Number);
+		numOfSectors = diskSectors - startLBA;
+	}
+	partition.Offset = startLBA * m_sectorSize;
+	partition.Size = numOfSectors * m_sectorSize;
+	partition.IsNTFS = isNTFS(partition.Offset);
+	m_partitions.push_back(partition);
+}
+
+bool PartitionTable::isNTFS(ULONGLONG offset) const {
+	NTFS_BOOT_SECTOR bootSector;
+	return m_disk->readAt(&bootSector, offset, sizeof(NTFS_BOOT_SECTOR)) == sizeof(NTFS_BOOT_SECTOR) &&
+		CMP_STR((PCHAR)&bootSector.OEMID, StringResource::ntfsSignature);
+}
+
+bool PartitionTable::isExtended(BYTE partitionType) {
+	return partitionType == MBR_TYPE_EXTENDED_CHS ||
+		partitionType == MBR_TYPE_EXTENDED_LBA ||
+		partitionType == MBR_TYPE_EXTENDED_LINUX;
+}
@@ -0,0 +1,103 @@
+#ifndef _NTFSLIB_PARTITION_TABLE_H
+#define _NTFSLIB_PARTITION_TABLE_H
+
+#include <memory>
+
+#include "BlockDevice.h"
+#include "..\Types\PartitionTypes.h"
+
+using std::shared_ptr;
+
+/**
+ * Partitions of a disk (e.g. a whole-disk image), read from its MBR (including the logical partitions of
+ * extended partitions) or GPT. Partitions which start with an NTFS boot sector are marked as such, and can
+ * be opened as devices of their own, to construct an NTFSVolume / NTFSParser with.
+ * The partition devices share the disk device and keep no state of their own,
+ * so several partitions of the same disk can be parsed concurrently (one parser per partition).
+ * NOTICE: MBR disks are assumed to have 512 bytes sectors. CRCs of GPT disks are not verified.
+ */
+class PartitionTable {
+public:
+	/**
+	 * Reads the partition table of <disk>.
+	 * A disk which starts with an NTFS boot sector is taken as a single volume (see: PARTITION_SCHEME::NONE).
+	 */
+	explicit PartitionTable(shared_ptr<BlockDevice> disk);
+
+	~PartitionTable();
+
+	/**
+	 * Returns how the disk is partitioned.
+	 */
+	PARTITION_SCHEME getScheme() const;
+
+	/**
+	 * Returns the sector size the partition table is expressed in.
+	 */
+	WORD getSectorSize() const;
+
+	/**
+	 * Returns all the partitions, in the order they are found in the partition table.
+	 */
+	const PartitionList& getPartitions() const;
+
+	/**
+	 * Returns the NTFS partitions.
+	 */
+	PartitionList getNTFSPartitions() const;
+
+	/**
+	 * Returns a device of <partition> (one of this table's partitions).
+	 */
+	shared_ptr<BlockDevice> openPartition(const PartitionInfo& partition) const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(PartitionTable);
+
+	/**
+	 * Reads the partitions of <mbr>, and the logical partitions of its extended partitions.
+	 */
+	void readMBR(const MASTER_BOOT_RECORD& mbr);
+
+	/**
+	 * Reads the EBR chain of the extended partition starting at <extendedLBA>.
+	 * Logical partitions are numbered starting from <nextNumber>, which is advanced accordingly.
+	 */
+	void readExtendedPartition(ULONGLONG extendedLBA, DWORD& nextNumber);
+
+	/**
+	 * Reads the GPT header (detecting the sector size) and the partition entries array.
+	 */
+	void readGPT();
+
+	/**
+	 * Adds <partition> of <numOfSectors> sectors, starting at <startLBA>.
+	 * Partitions starting beyond the end of the disk are dropped, and the ones ending beyond it are truncated
+	 * (e.g. an image cut short).
+	 */
+	void addPartition(PartitionInfo& partition, ULONGLONG startLBA, ULONGLONG numOfSectors);
+
+	/**
+	 * Returns true if there is an NTFS boot sector at <offset> of the disk.
+	 */
+	bool isNTFS(ULONGLONG offset) const;
+
+	/**
+	 * Returns true if <partitionType> is an MBR extended partition type.
+	 */
+	static bool isExtended(BYTE partitionType);
+
+	// The partitioned disk.
+	shared_ptr<BlockDevice> m_disk;
+
+	// How the disk is partitioned.
+	PARTITION_SCHEME m_scheme;
+
+	// Sector size the partition table is expressed in.
+	WORD m_sectorSize;
+
+	// Partitions found on the disk.
+	PartitionList m_partitions;
+};
+
+#endif // _NTFSLIB_PARTITION_TABLE_H
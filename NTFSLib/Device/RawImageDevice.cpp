@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "RawImageDevice.h"
+#include "..\Misc\NTFSLibError.h"
+#include "..\Misc\Win32\ThreadReadEvent.h"
+
+using std::min;
+using std::unique_ptr;
+using std::vector;
+
+static thread_local ThreadReadEvent threadReadEvent;
+// Batches need an event per read in flight, these are kept for the next batches of the thread.
+static thread_local vector<unique_ptr<ThreadReadEvent>> threadBatchEvents;
+
+RawImageDevice::RawImageDevice(const wstring& imagePath, DWORD queueDepth /* = RAW_IMAGE_DEFAULT_QUEUE_DEPTH */, bool isUnbuffered /* = false */) :
+	m_imagePath(imagePath),
+	m_imageSize(0),
+	m_queueDepth(queueDepth),
+	m_isUnbuffered(isUnbuffered) {
+	NTFSLIB_ASSERT(
+		m_queueDepth > 0,
+		UnexpectedActionError
+	);
+	TRACE(DEBUG_LEVEL::INFO, "Opening raw image: %ws%s", m_imagePath.c_str(), m_isUnbuffered ? " (unbuffered)" : "");
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED;
+	if (m_isUnbuffered) {
+		flags |= FILE_FLAG_NO_BUFFERING;
+	}
+	m_imageHandle = CreateFile(
+		m_imagePath.c_str(),								// File name
+		GENERIC_READ,										// Desired access
+		FILE_SHARE_READ,									// Share mode
+		NULL,												// Security attributes
+		OPEN_EXISTING,										// Creation disposition
+		flags,												// Flags & Attributes
+		NULL												// Template file
+	);
+	WIN32_ASSERT(m_imageHandle != INVALID_HANDLE_VALUE);
+
+	LARGE_INTEGER imageSize;
+	if (!GetFileSizeEx(m_imageHandle, &imageSize)) {
+		DWORD errorCode = GetLastError();
+		CloseHandle(m_imageHandle);
+		NTFSLIB_ERROR(Win32Error, errorCode, "Could not query the size of image: %ws", m_imagePath.c_str());
+	}
+	m_imageSize = (ULONGLONG)imageSize.QuadPart;
+}
+
+RawImageDevice::~RawImageDevice() {
+	if (!CloseHandle(m_imageHandle)) {
+		TRACE_WITH_ERROR_CODE(DEBUG_LEVEL::CRITICAL, GetLastError(), "Could not close handle to image: %ws", m_imagePath.c_str());
+	}
+}
+
+DWORD RawImageDevice::readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	DeviceRead read = { buffer, offset, bytesToRead, 0 };
+	if (!m_isUnbuffered || isAligned(read)) {
+		return readOverlapped(buffer, offset, bytesToRead);
+	}
+	DeviceRead alignedRead = alignRead(read);
+	PooledBuffer alignedBuffer(m_bufferPool, alignedRead.Length);
+	alignedRead.Buffer = alignedBuffer.data();
+	alignedRead.BytesRead = readOverlapped(alignedRead.Buffer, alignedRead.Offset, alignedRead.Length);
+	completeAlignedRead(read, alignedRead);
+	return read.BytesRead;
+}
+
+void RawImageDevice::readBatch(DeviceReadList& reads) {
+	if (!m_isUnbuffered) {
+		readQueued(reads);
+		return;
+	}
+	// Unaligned reads are replaced by aligned ones for the batch, and completed once it is done.
+	DeviceReadList alignedReads(reads);
+	vector<unique_ptr<PooledBuffer>> alignedBuffers(reads.size());
+	for (size_t i = 0; i < reads.size(); ++i) {
+		if (!isAligned(reads[i])) {
+			alignedReads[i] = alignRead(reads[i]);
+			alignedBuffers[i].reset(new PooledBuffer(m_bufferPool, alignedReads[i].Length));
+			alignedReads[i].Buffer = alignedBuffers[i]->data();
+		}
+	}
+	readQueued(alignedReads);
+	for (size_t i = 0; i < reads.size(); ++i) {
+		if (alignedBuffers[i]) {
+			completeAlignedRead(reads[i], alignedReads[i]);
+		}
+		else {
+			reads[i].BytesRead = alignedReads[i].BytesRead;
+		}
+	}
+}
+
+bool RawImageDevice::isAligned(const DeviceRead& read) {
+	return read.Offset % RAW_IMAGE_UNBUFFERED_ALIGNMENT == 0 &&
+		read.Length % RAW_IMAGE_UNBUFFERED_ALIGNMENT == 0 &&
+		(ULONG_PTR)read.Buffer % RAW_IMAGE_UNBUFFERED_ALIGNMENT == 0;
+}
+
+DeviceRead RawImageDevice::alignRead(const DeviceRead& read) {
+	ULONGLONG alignedStart = read.Offset - read.Offset % RAW_IMAGE_UNBUFFERED_ALIGNMENT;
+	ULONGLONG alignedEnd = read.Offset + read.Length + RAW_IMAGE_UNBUFFERED_ALIGNMENT - 1;
+	alignedEnd -= alignedEnd % RAW_IMAGE_UNBUFFERED_ALIGNMENT;
+	NTFSLIB_ASSERT(
+		alignedEnd - alignedStart <= MAXDWORD,
+		BadSizeError
+	);
+	// The buffer is set by the caller.
+	return { nullptr, alignedStart, (DWORD)(alignedEnd - alignedStart), 0 };
+}
+
+void RawImageDevice::completeAlignedRead(DeviceRead& read, const DeviceRead& alignedRead) {
+	DWORD headLength = (DWORD)(read.Offset - alignedRead.Offset);
+	// The image may end anywhere in the read.
+	read.BytesRead = alignedRead.BytesRead > headLength ? min(alignedRead.BytesRead - headLength, read.Length) : 0;
+	memcpy(read.Buffer, (PBYTE)alignedRead.Buffer + headLength, read.BytesRead);
+}
+
+DWORD RawImageDevice::readOverlapped(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	WIN32_ASSERT(threadReadEvent.Handle != NULL);
+
+	OVERLAPPED overlapped = { 0 };
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	overlapped.hEvent = threadReadEvent.Handle;
+
+	DWORD bytesRead = 0;
+	if (!ReadFile(m_imageHandle, buffer, bytesToRead, NULL, &overlapped)) {
+		DWORD errorCode = GetLastError();
+		// Reading past the end of the image is not an error, we just read nothing.
+		if (errorCode == ERROR_HANDLE_EOF) {
+			return 0;
+		}
+		WIN32_ASSERT(errorCode == ERROR_IO_PENDING);
+	}
+	if (!GetOverlappedResult(m_imageHandle, &overlapped, &bytesRead, TRUE)) {
+		WIN32_ASSERT(GetLastError() == ERROR_HANDLE_EOF);
+	}
+	return bytesRead;
+}
+
+void RawImageDevice::readQueued(DeviceReadList& reads) {
+	size_t queueDepth = min<size_t>(m_queueDepth, reads.size());
+	while (threadBatchEvents.size() < queueDepth) {
+		threadBatchEvents.push_back(unique_ptr<ThreadReadEvent>(new ThreadReadEvent()));
+		WIN32_ASSERT(threadBatchEvents.back()->Handle != NULL);
+	}
+
+	// Read i is in flight in slot i % queueDepth. Reads are reaped in order, and every reaped read
+	// makes room for the next one, so the queue stays full.
+	vector<OVERLAPPED> slots(queueDepth);
+	size_t nextRead = 0;
+	size_t reapedRead = 0;
+	try {
+		for (; reapedRead < reads.size(); ++reapedRead) {
+			while (nextRead < reads.size() && nextRead - reapedRead < queueDepth) {
+				submitRead(reads[nextRead], slots[nextRead % queueDepth], threadBatchEvents[nextRead % queueDepth]->Handle);
+				nextRead++;
+			}
+			reapRead(reads[reapedRead], slots[reapedRead % queueDepth]);
+		}
+	}
+	catch (...) {
+		// The reads still in flight write into buffers (and overlapped structures) we are about to leave.
+		for (; reapedRead < nextRead; ++reapedRead) {
+			OVERLAPPED& overlapped = slots[reapedRead % queueDepth];
+			if (overlapped.hEvent != NULL) {
+				DWORD bytesRead = 0;
+				CancelIoEx(m_imageHandle, &overlapped);
+				GetOverlappedResult(m_imageHandle, &overlapped, &bytesRead, TRUE);
+			}
+		}
+		throw;
+	}
+}
+
+void RawImageDevice::submitRead(DeviceRead& read, OVERLAPPED& overlapped, HANDLE event) {
+	ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+	overlapped.Offset = (DWORD)read.Offset;
+	overlapped.OffsetHigh = (DWORD)(read.Offset >> 32);
+	overlapped.hEvent = event;
+	read.BytesRead = 0;
+	if (!ReadFile(m_imageHandle, read.Buffer, read.Length, NULL, &overlapped)) {
+		DWORD errorCode = GetLastError();
+		if (errorCode != ERROR_IO_PENDING) {
+			// Nothing is in flight, nothing to reap.
+			overlapped.hEvent = NULL;
+			// Reading past the end of the image is not an error, we just read nothing.
+			WIN32_ASSERT(errorCode == ERROR_HANDLE_EOF);
+		}
+	}
+}
+
+void RawImageDevice::reapRead(DeviceRead& read, OVERLAPPED& overlapped) {
+	if (overlapped.hEvent == NULL) {
+		return;
+	}
+	BOOL isSuccessful = GetOverlappedResult(m_imageHandle, &overlapped, &read.BytesRead, TRUE);
+	overlapped.hEvent = NULL;
+	if (!isSuccessful) {
+		WIN32_ASSERT(GetLastError() == ERROR_HANDLE_EOF);
+	}
+}
+
+ULONGLONG RawImageDevice::getSize() const {
+	return m_imageSize;
+}
+
+bool RawImageDevice::isImmutable() const {
+	return true;
+}
+
+const wstring& RawImageDevice::getImagePath() const {
+	return m_imagePath;
+}
+
+void RawImageDevice::setQueueDepth(DWORD queueDepth) {
+	NTFSLIB_ASSERT(
+		queueDepth > 0,
+		UnexpectedActionError
+	);
+	m_queueDepth = queueDepth;
+}
+
+DWORD RawImageDevice::getQueueDepth() const {
+	return m_queueDepth;
+}
+
+bool RawImageDevice::isUnbuffered() const {
+	return m_isUnbuffered;
+}
@@ -0,0 +1,125 @@
+#ifndef _NTFSLIB_RAW_IMAGE_DEVICE_H
+#define _NTFSLIB_RAW_IMAGE_DEVICE_H
+
+#include <string>
+
+#include "BlockDevice.h"
+#include "..\Misc\AlignedBufferPool.h"
+
+using std::wstring;
+
+// Default number of reads a batch keeps in flight.
+#define RAW_IMAGE_DEFAULT_QUEUE_DEPTH 32
+// Alignment of unbuffered reads' offsets, lengths and buffers (a multiple of any sector size in use).
+#define RAW_IMAGE_UNBUFFERED_ALIGNMENT 4096
+
+/**
+ * Block device backed by a raw ("dd") image of a single NTFS volume, byte 0 being the boot sector.
+ * The image is opened for overlapped I/O and every read carries its own offset,
+ * so concurrent readers never contend on a file pointer.
+ * Batches keep up to a queue depth of reads in flight at once, which fast storage needs to reach its throughput.
+ * An unbuffered image bypasses the system cache (FILE_FLAG_NO_BUFFERING), so scanning a huge image once does not
+ * evict everything else from memory. Unbuffered reads must be sector aligned: reads which are not (offset, length
+ * or buffer) are read whole sectors at a time into a pooled aligned buffer, and only the asked for bytes are copied.
+ */
+class RawImageDevice : public BlockDevice {
+public:
+	/**
+	 * Opens the image found at <imagePath>, keeping up to <queueDepth> reads of a batch in flight.
+	 * If <isUnbuffered> is true, reads bypass the system cache.
+	 */
+	RawImageDevice(const wstring& imagePath, DWORD queueDepth = RAW_IMAGE_DEFAULT_QUEUE_DEPTH, bool isUnbuffered = false);
+
+	~RawImageDevice();
+
+	// see: BlockDevice.readAt
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override;
+
+	// see: BlockDevice.readBatch
+	virtual void readBatch(DeviceReadList& reads) override;
+
+	// see: BlockDevice.getSize
+	virtual ULONGLONG getSize() const override;
+
+	// see: BlockDevice.isImmutable
+	virtual bool isImmutable() const override;
+
+	/**
+	 * Returns the image's path.
+	 */
+	const wstring& getImagePath() const;
+
+	/**
+	 * Sets the number of reads a batch keeps in flight (at least 1).
+	 * NOTICE: Must not be called while other threads read from the device.
+	 */
+	void setQueueDepth(DWORD queueDepth);
+
+	/**
+	 * Returns the number of reads a batch keeps in flight.
+	 */
+	DWORD getQueueDepth() const;
+
+	/**
+	 * Returns true if reads bypass the system cache.
+	 */
+	bool isUnbuffered() const;
+
+	/**
+	 * Returns true if <read> can be read as is from an unbuffered image.
+	 */
+	static bool isAligned(const DeviceRead& read);
+
+private:
+	FORBID_COPY_AND_ASSIGN(RawImageDevice);
+
+	/**
+	 * Reads <bytesToRead> bytes starting at <offset> into <buffer>, as is.
+	 */
+	DWORD readOverlapped(PVOID buffer, ULONGLONG offset, DWORD bytesToRead);
+
+	/**
+	 * Performs all the <reads> as they are, keeping up to the queue depth of them in flight.
+	 */
+	void readQueued(DeviceReadList& reads);
+
+	/**
+	 * Returns a read of the whole sectors <read> spans. Its buffer is left for the caller to set.
+	 */
+	static DeviceRead alignRead(const DeviceRead& read);
+
+	/**
+	 * Copies the bytes asked for by <read> out of <alignedRead> (see: alignRead), and sets its BytesRead.
+	 */
+	static void completeAlignedRead(DeviceRead& read, const DeviceRead& alignedRead);
+
+	/**
+	 * Starts <read>, signaling <event> once it completes.
+	 */
+	void submitRead(DeviceRead& read, OVERLAPPED& overlapped, HANDLE event);
+
+	/**
+	 * Waits for the submitted <read> to complete, and sets its BytesRead.
+	 */
+	void reapRead(DeviceRead& read, OVERLAPPED& overlapped);
+
+	// Image's path.
+	const wstring m_imagePath;
+
+	// Image's handle (opened with FILE_FLAG_OVERLAPPED, and FILE_FLAG_NO_BUFFERING if unbuffered).
+	HANDLE m_imageHandle;
+
+	// Image's size in bytes.
+	ULONGLONG m_imageSize;
+
+	// Number of reads a batch keeps in flight.
+	DWORD m_queueDepth;
+
+	// Do reads bypass the system cache?
+	const bool m_isUnbuffered;
+
+	// Aligned buffers of unaligned reads (unbuffered images only).
+	AlignedBufferPool m_bufferPool;
+};
+
+#endif // _NTFSLIB_RAW_IMAGE_DEVICE_H
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <exception>
+#include <future>
+
+#include "SegmentedImageDevice.h"
+#include "..\Misc\NTFSLibError.h"
+
+using std::async;
+using std::current_exception;
+using std::exception_ptr;
+using std::future;
+using std::launch;
+using std::min;
+using std::rethrow_exception;
+using std::upper_bound;
+
+SegmentedImageDevice::SegmentedImageDevice(const vector<wstring>& segmentPaths, DWORD queueDepth /* = RAW_IMAGE_DEFAULT_QUEUE_DEPTH */,
+	bool isUnbuffered /* = false */) :
+	m_imageSize(0) {
+	NTFSLIB_ASSERT(
+		!segmentPaths.empty(),
+		UnexpectedActionError
+	);
+	for (const wstring& segmentPath : segmentPaths) {
+		m_segments.push_back(unique_ptr<RawImageDevice>(new RawImageDevice(segmentPath, queueDepth, isUnbuffered)));
+		m_segmentOffsets.push_back(m_imageSize);
+		m_imageSize += m_segments.back()->getSize();
+	}
+}
+
+SegmentedImageDevice::~SegmentedImageDevice() {
+	// Left blank.
+}
+
+DWORD SegmentedImageDevice::readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	if (offset >= m_imageSize) {
+		return 0;
+	}
+	DWORD bytesLeft = (DWORD)min<ULONGLONG>(bytesToRead, m_imageSize - offset);
+	DWORD bytesRead = 0;
+	for (size_t segment = findSegment(offset); bytesLeft > 0; ++segment) {
+		ULONGLONG segmentOffset = offset + bytesRead - m_segmentOffsets[segment];
+		DWORD segmentBytes = (DWORD)min<ULONGLONG>(bytesLeft, m_segments[segment]->getSize() - segmentOffset);
+		DWORD segmentBytesRead = m_segments[segment]->readAt((PBYTE)buffer + bytesRead, segmentOffset, segmentBytes);
+		bytesRead += segmentBytesRead;
+		if (segmentBytesRead < segmentBytes) {
+			break;
+		}
+		bytesLeft -= segmentBytes;
+	}
+	return bytesRead;
+}
+
+void SegmentedImageDevice::readBatch(DeviceReadList& reads) {
+	// The reads are split into one batch per segment, remembering which read every part belongs to.
+	vector<DeviceReadList> segmentReads(m_segments.size());
+	vector<vector<size_t>> segmentReadIndexes(m_segments.size());
+	for (size_t i = 0; i < reads.size(); ++i) {
+		DeviceRead& read = reads[i];
+		read.BytesRead = 0;
+		if (read.Offset >= m_imageSize) {
+			continue;
+		}
+		DWORD bytesLeft = (DWORD)min<ULONGLONG>(read.Length, m_imageSize - read.Offset);
+		DWORD bufferOffset = 0;
+		for (size_t segment = findSegment(read.Offset); bytesLeft > 0; ++segment) {
+			ULONGLONG segmentOffset = read.Offset + bufferOffset - m_segmentOffsets[segment];
+			DWORD segmentBytes = (DWORD)min<ULONGLONG>(bytesLeft, m_segments[segment]->getSize() - segmentOffset);
+			if (segmentBytes > 0) {
+				segmentReads[segment].push_back({ (PBYTE)read.Buffer + bufferOffset, segmentOffset, segmentBytes, 0 });
+				segmentReadIndexes[segment].push_back(i);
+			}
+			bufferOffset += segmentBytes;
+			bytesLeft -= segmentBytes;
+		}
+	}
+
+	// Every segment reads its batch on its own thread, except for the last one, read on this thread.
+	vector<future<void>> segmentCompletions;
+	size_t lastSegment = m_segments.size();
+	for (size_t segment = 0; segment < m_segments.size(); ++segment) {
+		if (segmentReads[segment].empty()) {
+			continue;
+		}
+		if (lastSegment != m_segments.size()) {
+			RawImageDevice* device = m_segments[lastSegment].get();
+			DeviceReadList* deviceReads = &segmentReads[lastSegment];
+			segmentCompletions.push_back(async(launch::async, [device, deviceReads]() {
+				device->readBatch(*deviceReads);
+			}));
+		}
+		lastSegment = segment;
+	}
+	exception_ptr error;
+	if (lastSegment != m_segments.size()) {
+		try {
+			m_segments[lastSegment]->readBatch(segmentReads[lastSegment]);
+		}
+		catch (...) {
+			error = current_exception();
+		}
+	}
+	// All the segments must be done with the buffers before leaving, even if one of them failed.
+	for (future<void>& completion : segmentCompletions) {
+		try {
+			completion.get();
+		}
+		catch (...) {
+			if (!error) {
+				error = current_exception();
+			}
+		}
+	}
+	if (error) {
+		rethrow_exception(error);
+	}
+
+	for (size_t segment = 0; segment < m_segments.size(); ++segment) {
+		for (size_t j = 0; j < segmentReads[segment].size(); ++j) {
+			reads[segmentReadIndexes[segment][j]].BytesRead += segmentReads[segment][j].BytesRead;
+		}
+	}
+}
+
+ULONGLONG SegmentedImageDevice::getSize() const {
+	return m_imageSize;
+}
+
+bool SegmentedImageDevice::isImmutable() const {
+	return true;
+}
+
+size_t SegmentedImageDevice::getNumOfSegments() const {
+	return m_segments.size();
+}
+
+vector<wstring> SegmentedImageDevice::findSegments(const wstring& firstSegmentPath) {
+	vector<wstring> segmentPaths(1, firstSegmentPath);
+	size_t extensionStart = firstSegmentPath.find_last_of(L'.');
+	if (extensionStart == wstring::npos || extensionStart + 1 == firstSegmentPath.size() ||
+		firstSegmentPath.find_first_not_of(L"0123456789", extensionStart + 1) != wstring::npos) {
+		return segmentPaths;
+	}
+	wstring basePath = firstSegmentPath.substr(0, extensionStart + 1);
+	size_t width = firstSegmentPath.size() - basePath.size();
+	ULONGLONG number = std::stoull(firstSegmentPath.substr(basePath.size()));
+	while (true) {
+		wstring extension = std::to_wstring(++number);
+		if (extension.size() < width) {
+			extension.insert(0, width - extension.size(), L'0');
+		}
+		wstring segmentPath = basePath + extension;
+		if (GetFileAttributes(segmentPath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+			return segmentPaths;
+		}
+		segmentPaths.push_back(segmentPath);
+	}
+}
+
+size_t SegmentedImageDevice::findSegment(ULONGLONG offset) const {
+	// The last segment starting at (or before) <offset>. Empty segments are skipped, since the segment
+	// following them starts at the same offset.
+	return upper_bound(m_segmentOffsets.begin(), m_segmentOffsets.end(), offset) - m_segmentOffsets.begin() - 1;
+}
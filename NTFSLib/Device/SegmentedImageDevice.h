@@ -0,0 +1,72 @@
+#ifndef _NTFSLIB_SEGMENTED_IMAGE_DEVICE_H
+#define _NTFSLIB_SEGMENTED_IMAGE_DEVICE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "RawImageDevice.h"
+
+using std::unique_ptr;
+using std::vector;
+using std::wstring;
+
+/**
+ * Block device backed by a raw image split into several segments (e.g. "image.001", "image.002", ...),
+ * presented as a single contiguous device. Every segment is a RawImageDevice of its own.
+ * Reads are dispatched by a table of the segments' offsets, and the parts of a batch which fall into
+ * different segments are read concurrently (segments are often kept on different disks).
+ */
+class SegmentedImageDevice : public BlockDevice {
+public:
+	/**
+	 * Opens the image made of <segmentPaths>, in order. Every segment keeps up to <queueDepth> reads
+	 * of a batch in flight, and bypasses the system cache if <isUnbuffered> is true (see: RawImageDevice).
+	 */
+	SegmentedImageDevice(const vector<wstring>& segmentPaths, DWORD queueDepth = RAW_IMAGE_DEFAULT_QUEUE_DEPTH, bool isUnbuffered = false);
+
+	~SegmentedImageDevice();
+
+	// see: BlockDevice.readAt
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override;
+
+	// see: BlockDevice.readBatch
+	virtual void readBatch(DeviceReadList& reads) override;
+
+	// see: BlockDevice.getSize
+	virtual ULONGLONG getSize() const override;
+
+	// see: BlockDevice.isImmutable
+	virtual bool isImmutable() const override;
+
+	/**
+	 * Returns the number of segments.
+	 */
+	size_t getNumOfSegments() const;
+
+	/**
+	 * Returns the paths of the segments following <firstSegmentPath> (itself included): the path's numeric
+	 * extension is incremented (keeping its width, e.g. ".001", ".002", ...) as long as such a file exists.
+	 * A path without a numeric extension is returned as is.
+	 */
+	static vector<wstring> findSegments(const wstring& firstSegmentPath);
+
+private:
+	FORBID_COPY_AND_ASSIGN(SegmentedImageDevice);
+
+	/**
+	 * Returns the index of the segment <offset> (less than the image's size) falls into.
+	 */
+	size_t findSegment(ULONGLONG offset) const;
+
+	// Image's segments, in order.
+	vector<unique_ptr<RawImageDevice>> m_segments;
+
+	// Offset of every segment in the image, sorted.
+	vector<ULONGLONG> m_segmentOffsets;
+
+	// Image's size in bytes.
+	ULONGLONG m_imageSize;
+};
+
+#endif // _NTFSLIB_SEGMENTED_IMAGE_DEVICE_H
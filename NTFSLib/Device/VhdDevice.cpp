@@ -0,0 +1,125 @@
+#include <stdlib.h>
+
+#include "VhdDevice.h"
+#include "..\Misc\NTFSLibError.h"
+#include "..\Misc\StringResource.h"
+
+VhdDevice::VhdDevice(shared_ptr<BlockDevice> file) :
+	VirtualDiskDevice(file),
+	m_isFixed(false),
+	m_bitmapSize(0) {
+	NTFSLIB_ASSERT(
+		m_file->getSize() >= VHD_FOOTER_SIZE,
+		BadSizeError
+	);
+	VHD_FOOTER footer;
+	readFile(&footer, m_file->getSize() - VHD_FOOTER_SIZE, sizeof(VHD_FOOTER));
+	NTFSLIB_ASSERT(
+		CMP_STR((PCHAR)footer.Cookie, StringResource::vhdFooterCookie),
+		BadRecordHeaderError
+	);
+	m_virtualSize = _byteswap_uint64(footer.CurrentSize);
+
+	DWORD diskType = _byteswap_ulong(footer.DiskType);
+	switch (diskType) {
+	case VHD_DISK_TYPE_FIXED:
+		NTFSLIB_ASSERT(
+			m_virtualSize <= m_file->getSize() - VHD_FOOTER_SIZE,
+			BadSizeError
+		);
+		m_isFixed = true;
+		m_blockSize = VHD_FIXED_BLOCK_SIZE;
+		return;
+	case VHD_DISK_TYPE_DYNAMIC:
+	case VHD_DISK_TYPE_DIFFERENCING:
+		break;
+	default:
+		NTFSLIB_ERROR(BadRecordHeaderError, NTFSLIB_DEFAULT_ERROR_CODE, "Unsupported VHD disk type: %lu", diskType);
+	}
+	m_isDifferencing = diskType == VHD_DISK_TYPE_DIFFERENCING;
+
+	VHD_DYNAMIC_HEADER header;
+	readFile(&header, _byteswap_uint64(footer.DataOffset), sizeof(VHD_DYNAMIC_HEADER));
+	NTFSLIB_ASSERT(
+		CMP_STR((PCHAR)header.Cookie, StringResource::vhdDynamicHeaderCookie),
+		BadRecordHeaderError
+	);
+	m_blockSize = _byteswap_ulong(header.BlockSize);
+	DWORD numOfBlocks = _byteswap_ulong(header.MaxTableEntries);
+	NTFSLIB_ASSERT(
+		m_blockSize >= VHD_SECTOR_SIZE && m_blockSize % VHD_SECTOR_SIZE == 0 &&
+		numOfBlocks <= MAXDWORD / sizeof(DWORD) && (ULONGLONG)numOfBlocks * m_blockSize >= m_virtualSize,
+		BadSizeError
+	);
+
+	// The BAT is read once, and converted to host order.
+	m_blockTable.resize(numOfBlocks);
+	readFile(m_blockTable.data(), _byteswap_uint64(header.TableOffset), numOfBlocks * sizeof(DWORD));
+	for (DWORD& blockSector : m_blockTable) {
+		blockSector = _byteswap_ulong(blockSector);
+	}
+
+	// A bit per sector, padded to a whole sector.
+	DWORD sectorsPerBlock = m_blockSize / VHD_SECTOR_SIZE;
+	m_bitmapSize = ((sectorsPerBlock + 7) / 8 + VHD_SECTOR_SIZE - 1) / VHD_SECTOR_SIZE * VHD_SECTOR_SIZE;
+
+	if (m_isDifferencing) {
+		readParentLocators(header);
+	}
+}
+
+VhdDevice::~VhdDevice() {
+	// Left blank.
+}
+
+bool VhdDevice::isVhd(BlockDevice& file) {
+	VHD_FOOTER footer;
+	return file.getSize() >= VHD_FOOTER_SIZE &&
+		file.readAt(&footer, file.getSize() - VHD_FOOTER_SIZE, sizeof(VHD_FOOTER)) == sizeof(VHD_FOOTER) &&
+		CMP_STR((PCHAR)footer.Cookie, StringResource::vhdFooterCookie);
+}
+
+void VhdDevice::mapBlock(ULONGLONG blockIndex, DWORD blockOffset, DWORD length, VirtualDiskRunList& runs) {
+	if (m_isFixed) {
+		addRun(runs, VIRTUAL_DISK_SOURCE::FILE, blockIndex * m_blockSize + blockOffset, length);
+		return;
+	}
+	NTFSLIB_ASSERT(
+		blockIndex < m_blockTable.size(),
+		OutOfBoundsError
+	);
+	DWORD blockSector = m_blockTable[blockIndex];
+	if (blockSector == VHD_UNALLOCATED_BLOCK) {
+		addRun(runs, m_isDifferencing ? VIRTUAL_DISK_SOURCE::PARENT : VIRTUAL_DISK_SOURCE::ZERO, 0, length);
+		return;
+	}
+	ULONGLONG bitmapOffset = (ULONGLONG)blockSector * VHD_SECTOR_SIZE;
+	ULONGLONG dataOffset = bitmapOffset + m_bitmapSize;
+	if (!m_isDifferencing) {
+		addRun(runs, VIRTUAL_DISK_SOURCE::FILE, dataOffset + blockOffset, length);
+		return;
+	}
+	addBitmapRuns(*readBitmap(bitmapOffset, m_bitmapSize), true, dataOffset, blockOffset, length, runs);
+}
+
+void VhdDevice::readParentLocators(const VHD_DYNAMIC_HEADER& header) {
+	for (const VHD_PARENT_LOCATOR& locator : header.ParentLocators) {
+		DWORD platformCode = _byteswap_ulong(locator.PlatformCode);
+		DWORD locationLength = _byteswap_ulong(locator.PlatformDataLength);
+		if ((platformCode != VHD_PLATFORM_CODE_RELATIVE_PATH && platformCode != VHD_PLATFORM_CODE_ABSOLUTE_PATH) ||
+			locationLength == 0 || locationLength > MAX_PATH * sizeof(WCHAR)) {
+			continue;
+		}
+		Buffer locationData(locationLength);
+		readFile(locationData.data(), _byteswap_uint64(locator.PlatformDataOffset), locationLength);
+		wstring location((PWCHAR)locationData.data(), locationLength / sizeof(WCHAR));
+		location.resize(location.find(L'\0') == wstring::npos ? location.size() : location.find(L'\0'));
+		// Relative paths survive moving the whole chain, they are tried first.
+		if (platformCode == VHD_PLATFORM_CODE_RELATIVE_PATH) {
+			m_parentLocations.insert(m_parentLocations.begin(), location);
+		}
+		else {
+			m_parentLocations.push_back(location);
+		}
+	}
+}
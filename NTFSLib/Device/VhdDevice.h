@@ -0,0 +1,51 @@
+#ifndef _NTFSLIB_VHD_DEVICE_H
+#define _NTFSLIB_VHD_DEVICE_H
+
+#include "VirtualDiskDevice.h"
+
+// Fixed disks have no blocks, they are read in chunks of this size.
+#define VHD_FIXED_BLOCK_SIZE (2 * 1024 * 1024)
+
+/**
+ * Virtual disk held in a VHD file (fixed, dynamic or differencing).
+ * Allocated blocks of dynamic disks are read as a whole (sectors are zeroed when their block is allocated),
+ * so only differencing disks consult the sector bitmaps.
+ * NOTICE: Checksums are not verified.
+ */
+class VhdDevice : public VirtualDiskDevice {
+public:
+	/**
+	 * Reads the VHD held in <file>.
+	 */
+	explicit VhdDevice(shared_ptr<BlockDevice> file);
+
+	~VhdDevice();
+
+	/**
+	 * Returns true if <file> ends with a VHD footer.
+	 */
+	static bool isVhd(BlockDevice& file);
+
+protected:
+	// see: VirtualDiskDevice.mapBlock
+	virtual void mapBlock(ULONGLONG blockIndex, DWORD blockOffset, DWORD length, VirtualDiskRunList& runs) override;
+
+private:
+	FORBID_COPY_AND_ASSIGN(VhdDevice);
+
+	/**
+	 * Reads the Windows paths of the parent disk out of <header>'s parent locators.
+	 */
+	void readParentLocators(const VHD_DYNAMIC_HEADER& header);
+
+	// Is the data stored as is (before the footer)?
+	bool m_isFixed;
+
+	// First sector of every block, VHD_UNALLOCATED_BLOCK for unallocated blocks.
+	vector<DWORD> m_blockTable;
+
+	// Size of the sector bitmap preceding every block, in bytes.
+	DWORD m_bitmapSize;
+};
+
+#endif // _NTFSLIB_VHD_DEVICE_H
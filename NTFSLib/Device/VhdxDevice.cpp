@@ -0,0 +1,232 @@
+#include "VhdxDevice.h"
+#include "..\Misc\NTFSLibError.h"
+#include "..\Misc\StringResource.h"
+
+// Regions.
+static const GUID batRegionGuid = { 0x2dc27766, 0xf623, 0x4200, { 0x9d, 0x64, 0x11, 0x5e, 0x9b, 0xfd, 0x4a, 0x08 } };
+static const GUID metadataRegionGuid = { 0x8b7ca206, 0x4790, 0x4b9a, { 0xb8, 0xfe, 0x57, 0x5f, 0x05, 0x0f, 0x88, 0x6e } };
+
+// Metadata items.
+static const GUID fileParametersGuid = { 0xcaa16737, 0xfa36, 0x4d43, { 0xb3, 0xb6, 0x33, 0xf0, 0xaa, 0x44, 0xe7, 0x6b } };
+static const GUID virtualDiskSizeGuid = { 0x2fa54224, 0xcd1b, 0x4876, { 0xb2, 0x11, 0x5d, 0xbe, 0xd8, 0x3b, 0xf4, 0xb8 } };
+static const GUID logicalSectorSizeGuid = { 0x8141bf1d, 0xa96f, 0x4709, { 0xba, 0x47, 0xf2, 0x33, 0xa8, 0xfa, 0xab, 0x5f } };
+static const GUID parentLocatorGuid = { 0xa8d35f2d, 0xb30b, 0x454d, { 0xab, 0xf7, 0xd3, 0xd8, 0x48, 0x34, 0xab, 0x0c } };
+
+static const GUID emptyGuid = { 0 };
+
+VhdxDevice::VhdxDevice(shared_ptr<BlockDevice> file) :
+	VirtualDiskDevice(file),
+	m_chunkRatio(0) {
+	NTFSLIB_ASSERT(
+		isVhdx(*m_file),
+		BadRecordHeaderError
+	);
+	readHeader();
+
+	ULONGLONG batOffset = 0;
+	DWORD batLength = 0;
+	ULONGLONG metadataOffset = 0;
+	DWORD metadataLength = 0;
+	readRegionTable(batOffset, batLength, metadataOffset, metadataLength);
+	readMetadata(metadataOffset, metadataLength);
+	NTFSLIB_ASSERT(
+		m_blockSize > 0 && m_sectorSize > 0 && m_blockSize % m_sectorSize == 0 &&
+		VHDX_SECTORS_PER_BITMAP_BLOCK * m_sectorSize % m_blockSize == 0,
+		BadRecordHeaderError
+	);
+	m_chunkRatio = (DWORD)(VHDX_SECTORS_PER_BITMAP_BLOCK * m_sectorSize / m_blockSize);
+
+	// The BAT is read once. It must hold an entry for every block of the disk.
+	m_blockTable.resize(batLength / sizeof(ULONGLONG));
+	readFile(m_blockTable.data(), batOffset, (DWORD)(m_blockTable.size() * sizeof(ULONGLONG)));
+	ULONGLONG lastBlock = (m_virtualSize + m_blockSize - 1) / m_blockSize - 1;
+	NTFSLIB_ASSERT(
+		m_virtualSize > 0 && lastBlock + lastBlock / m_chunkRatio < m_blockTable.size(),
+		BadSizeError
+	);
+}
+
+VhdxDevice::~VhdxDevice() {
+	// Left blank.
+}
+
+bool VhdxDevice::isVhdx(BlockDevice& file) {
+	BYTE signature[sizeof(VHDX_FILE_IDENTIFIER::Signature)];
+	return file.readAt(signature, 0, sizeof(signature)) == sizeof(signature) &&
+		CMP_STR((PCHAR)signature, StringResource::vhdxFileSignature);
+}
+
+void VhdxDevice::mapBlock(ULONGLONG blockIndex, DWORD blockOffset, DWORD length, VirtualDiskRunList& runs) {
+	// Every chunk of payload blocks is followed by the entry of its sector bitmap block.
+	ULONGLONG entryIndex = blockIndex + blockIndex / m_chunkRatio;
+	NTFSLIB_ASSERT(
+		entryIndex < m_blockTable.size(),
+		OutOfBoundsError
+	);
+	ULONGLONG entry = m_blockTable[entryIndex];
+	ULONGLONG blockFileOffset = (entry >> VHDX_BAT_FILE_OFFSET_SHIFT) * VHDX_FILE_OFFSET_UNIT;
+	switch (entry & VHDX_BAT_STATE_MASK) {
+	case VHDX_PAYLOAD_BLOCK_FULLY_PRESENT:
+		addRun(runs, VIRTUAL_DISK_SOURCE::FILE, blockFileOffset + blockOffset, length);
+		break;
+	case VHDX_PAYLOAD_BLOCK_PARTIALLY_PRESENT: {
+		NTFSLIB_ASSERT(
+			m_isDifferencing,
+			BadRecordHeaderError
+		);
+		ULONGLONG bitmapEntryIndex = (blockIndex / m_chunkRatio) * (m_chunkRatio + 1) + m_chunkRatio;
+		NTFSLIB_ASSERT(
+			bitmapEntryIndex < m_blockTable.size(),
+			OutOfBoundsError
+		);
+		ULONGLONG bitmapEntry = m_blockTable[bitmapEntryIndex];
+		NTFSLIB_ASSERT(
+			(bitmapEntry & VHDX_BAT_STATE_MASK) == VHDX_SB_BLOCK_PRESENT,
+			BadRecordHeaderError
+		);
+		// The bitmap block holds the bitmaps of the whole chunk, one after the other.
+		DWORD bitmapSize = m_blockSize / m_sectorSize / 8;
+		ULONGLONG bitmapOffset = (bitmapEntry >> VHDX_BAT_FILE_OFFSET_SHIFT) * VHDX_FILE_OFFSET_UNIT +
+			(blockIndex % m_chunkRatio) * bitmapSize;
+		addBitmapRuns(*readBitmap(bitmapOffset, bitmapSize), false, blockFileOffset, blockOffset, length, runs);
+		break;
+	}
+	case VHDX_PAYLOAD_BLOCK_NOT_PRESENT:
+	case VHDX_PAYLOAD_BLOCK_UNDEFINED:
+		addRun(runs, m_isDifferencing ? VIRTUAL_DISK_SOURCE::PARENT : VIRTUAL_DISK_SOURCE::ZERO, 0, length);
+		break;
+	case VHDX_PAYLOAD_BLOCK_ZERO:
+	case VHDX_PAYLOAD_BLOCK_UNMAPPED:
+		addRun(runs, VIRTUAL_DISK_SOURCE::ZERO, 0, length);
+		break;
+	default:
+		NTFSLIB_ERROR(BadRecordHeaderError, NTFSLIB_DEFAULT_ERROR_CODE, "Bad VHDX BAT entry: %#llx", entry);
+	}
+}
+
+void VhdxDevice::readHeader() {
+	VHDX_HEADER headers[2];
+	bool isValid[2];
+	const ULONGLONG headerOffsets[2] = { VHDX_HEADER_OFFSET_1, VHDX_HEADER_OFFSET_2 };
+	for (size_t i = 0; i < 2; ++i) {
+		readFile(&headers[i], headerOffsets[i], sizeof(VHDX_HEADER));
+		isValid[i] = CMP_STR((PCHAR)headers[i].Signature, StringResource::vhdxHeaderSignature);
+	}
+	NTFSLIB_ASSERT(
+		isValid[0] || isValid[1],
+		BadRecordHeaderError
+	);
+	const VHDX_HEADER& header = !isValid[1] || (isValid[0] && headers[0].SequenceNumber > headers[1].SequenceNumber) ?
+		headers[0] : headers[1];
+	if (!IsEqualGUID(header.LogGuid, emptyGuid)) {
+		NTFSLIB_ERROR(UnexpectedActionError, NTFSLIB_DEFAULT_ERROR_CODE, "The VHDX log must be replayed (attach the disk once)");
+	}
+}
+
+void VhdxDevice::readRegionTable(ULONGLONG& batOffset, DWORD& batLength, ULONGLONG& metadataOffset, DWORD& metadataLength) {
+	Buffer table(VHDX_REGION_TABLE_SIZE);
+	readFile(table.data(), VHDX_REGION_TABLE_OFFSET, VHDX_REGION_TABLE_SIZE);
+	PVHDX_REGION_TABLE_HEADER header = (PVHDX_REGION_TABLE_HEADER)table.data();
+	NTFSLIB_ASSERT(
+		CMP_STR((PCHAR)header->Signature, StringResource::vhdxRegionTableSignature) &&
+		header->EntryCount <= VHDX_MAX_REGION_ENTRIES,
+		BadRecordHeaderError
+	);
+
+	PVHDX_REGION_TABLE_ENTRY entries = (PVHDX_REGION_TABLE_ENTRY)(header + 1);
+	for (DWORD i = 0; i < header->EntryCount; ++i) {
+		if (IsEqualGUID(entries[i].Guid, batRegionGuid)) {
+			batOffset = entries[i].FileOffset;
+			batLength = entries[i].Length;
+		}
+		else if (IsEqualGUID(entries[i].Guid, metadataRegionGuid)) {
+			metadataOffset = entries[i].FileOffset;
+			metadataLength = entries[i].Length;
+		}
+		else if ((entries[i].Required & VHDX_REGION_IS_REQUIRED) != 0) {
+			NTFSLIB_ERROR(UnexpectedActionError, NTFSLIB_DEFAULT_ERROR_CODE, "Unknown required VHDX region");
+		}
+	}
+	NTFSLIB_ASSERT(
+		batLength > 0 && metadataLength >= VHDX_METADATA_TABLE_SIZE,
+		BadRecordHeaderError
+	);
+}
+
+void VhdxDevice::readMetadata(ULONGLONG metadataOffset, DWORD metadataLength) {
+	Buffer table(VHDX_METADATA_TABLE_SIZE);
+	readFile(table.data(), metadataOffset, VHDX_METADATA_TABLE_SIZE);
+	PVHDX_METADATA_TABLE_HEADER header = (PVHDX_METADATA_TABLE_HEADER)table.data();
+	NTFSLIB_ASSERT(
+		CMP_STR((PCHAR)header->Signature, StringResource::vhdxMetadataSignature) &&
+		header->EntryCount <= VHDX_MAX_METADATA_ENTRIES,
+		BadRecordHeaderError
+	);
+
+	// Items of no interest here (e.g. the physical sector size) are skipped.
+	PVHDX_METADATA_TABLE_ENTRY entries = (PVHDX_METADATA_TABLE_ENTRY)(header + 1);
+	for (DWORD i = 0; i < header->EntryCount; ++i) {
+		const VHDX_METADATA_TABLE_ENTRY& entry = entries[i];
+		NTFSLIB_ASSERT(
+			(ULONGLONG)entry.Offset + entry.Length <= metadataLength,
+			OutOfBoundsError
+		);
+		ULONGLONG itemOffset = metadataOffset + entry.Offset;
+		if (IsEqualGUID(entry.ItemId, fileParametersGuid) && entry.Length >= sizeof(VHDX_FILE_PARAMETERS)) {
+			VHDX_FILE_PARAMETERS fileParameters;
+			readFile(&fileParameters, itemOffset, sizeof(VHDX_FILE_PARAMETERS));
+			m_blockSize = fileParameters.BlockSize;
+			m_isDifferencing = (fileParameters.Flags & VHDX_HAS_PARENT) != 0;
+		}
+		else if (IsEqualGUID(entry.ItemId, virtualDiskSizeGuid) && entry.Length >= sizeof(ULONGLONG)) {
+			readFile(&m_virtualSize, itemOffset, sizeof(ULONGLONG));
+		}
+		else if (IsEqualGUID(entry.ItemId, logicalSectorSizeGuid) && entry.Length >= sizeof(DWORD)) {
+			readFile(&m_sectorSize, itemOffset, sizeof(DWORD));
+		}
+		else if (IsEqualGUID(entry.ItemId, parentLocatorGuid)) {
+			readParentLocator(itemOffset, entry.Length);
+		}
+	}
+}
+
+void VhdxDevice::readParentLocator(ULONGLONG locatorOffset, DWORD locatorLength) {
+	Buffer locator(locatorLength);
+	readFile(locator.data(), locatorOffset, locatorLength);
+	PVHDX_PARENT_LOCATOR_HEADER header = (PVHDX_PARENT_LOCATOR_HEADER)locator.data();
+	NTFSLIB_ASSERT(
+		locatorLength >= sizeof(VHDX_PARENT_LOCATOR_HEADER) &&
+		sizeof(VHDX_PARENT_LOCATOR_HEADER) + header->KeyValueCount * sizeof(VHDX_PARENT_LOCATOR_ENTRY) <= locatorLength,
+		BadSizeError
+	);
+
+	wstring relativePath;
+	wstring volumePath;
+	wstring absolutePath;
+	PVHDX_PARENT_LOCATOR_ENTRY entries = (PVHDX_PARENT_LOCATOR_ENTRY)(header + 1);
+	for (DWORD i = 0; i < header->KeyValueCount; ++i) {
+		const VHDX_PARENT_LOCATOR_ENTRY& entry = entries[i];
+		NTFSLIB_ASSERT(
+			(ULONGLONG)entry.KeyOffset + entry.KeyLength <= locatorLength &&
+			(ULONGLONG)entry.ValueOffset + entry.ValueLength <= locatorLength,
+			OutOfBoundsError
+		);
+		wstring key((PWCHAR)(locator.data() + entry.KeyOffset), entry.KeyLength / sizeof(WCHAR));
+		wstring value((PWCHAR)(locator.data() + entry.ValueOffset), entry.ValueLength / sizeof(WCHAR));
+		if (key == StringResource::vhdxRelativePathKey) {
+			relativePath = value;
+		}
+		else if (key == StringResource::vhdxVolumePathKey) {
+			volumePath = value;
+		}
+		else if (key == StringResource::vhdxAbsolutePathKey) {
+			absolutePath = value;
+		}
+	}
+	// The order the specification recommends to try them in.
+	for (const wstring* location : { &relativePath, &volumePath, &absolutePath }) {
+		if (!location->empty()) {
+			m_parentLocations.push_back(*location);
+		}
+	}
+}
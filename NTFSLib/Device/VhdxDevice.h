@@ -0,0 +1,60 @@
+#ifndef _NTFSLIB_VHDX_DEVICE_H
+#define _NTFSLIB_VHDX_DEVICE_H
+
+#include "VirtualDiskDevice.h"
+
+/**
+ * Virtual disk held in a VHDX file (fixed, dynamic or differencing).
+ * Files whose log has not been replayed (i.e. not cleanly detached) are refused, since the log can not be
+ * replayed without writing to the file.
+ * NOTICE: Checksums are not verified, nor is the parent linkage of differencing disks.
+ */
+class VhdxDevice : public VirtualDiskDevice {
+public:
+	/**
+	 * Reads the VHDX held in <file>.
+	 */
+	explicit VhdxDevice(shared_ptr<BlockDevice> file);
+
+	~VhdxDevice();
+
+	/**
+	 * Returns true if <file> starts with a VHDX file type identifier.
+	 */
+	static bool isVhdx(BlockDevice& file);
+
+protected:
+	// see: VirtualDiskDevice.mapBlock
+	virtual void mapBlock(ULONGLONG blockIndex, DWORD blockOffset, DWORD length, VirtualDiskRunList& runs) override;
+
+private:
+	FORBID_COPY_AND_ASSIGN(VhdxDevice);
+
+	/**
+	 * Reads the current header, and makes sure the log is empty.
+	 */
+	void readHeader();
+
+	/**
+	 * Finds the BAT and metadata regions in the region table.
+	 */
+	void readRegionTable(ULONGLONG& batOffset, DWORD& batLength, ULONGLONG& metadataOffset, DWORD& metadataLength);
+
+	/**
+	 * Reads the disk's properties out of the metadata region.
+	 */
+	void readMetadata(ULONGLONG metadataOffset, DWORD metadataLength);
+
+	/**
+	 * Reads the paths of the parent disk out of the parent locator item.
+	 */
+	void readParentLocator(ULONGLONG locatorOffset, DWORD locatorLength);
+
+	// BAT entries: payload blocks, with a sector bitmap block following every chunk of them.
+	vector<ULONGLONG> m_blockTable;
+
+	// Number of payload blocks in a chunk (covered by a single sector bitmap block).
+	DWORD m_chunkRatio;
+};
+
+#endif // _NTFSLIB_VHDX_DEVICE_H
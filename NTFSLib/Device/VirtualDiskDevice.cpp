@@ -0,0 +1,265 @@
+#include <algorithm>
+
+#include "VirtualDiskDevice.h"
+#include "RawImageDevice.h"
+#include "VhdDevice.h"
+#include "VhdxDevice.h"
+#include "..\Misc\NTFSLibError.h"
+
+using std::lock_guard;
+using std::make_shared;
+using std::min;
+
+shared_ptr<VirtualDiskDevice> VirtualDiskDevice::open(const wstring& path) {
+	return openChain(path, 0);
+}
+
+VirtualDiskDevice::VirtualDiskDevice(shared_ptr<BlockDevice> file) :
+	m_file(file),
+	m_virtualSize(0),
+	m_blockSize(0),
+	m_sectorSize(VHD_SECTOR_SIZE),
+	m_isDifferencing(false),
+	m_bitmapBytes(0) {
+	NTFSLIB_ASSERT(
+		m_file != nullptr,
+		UnexpectedActionError
+	);
+}
+
+VirtualDiskDevice::~VirtualDiskDevice() {
+	// Left blank.
+}
+
+DWORD VirtualDiskDevice::readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	if (offset >= m_virtualSize) {
+		return 0;
+	}
+	DWORD length = (DWORD)min<ULONGLONG>(bytesToRead, m_virtualSize - offset);
+	VirtualDiskRunList runs;
+	mapRange(offset, length, runs);
+
+	PBYTE output = (PBYTE)buffer;
+	for (const VirtualDiskRun& run : runs) {
+		switch (run.Source) {
+		case VIRTUAL_DISK_SOURCE::FILE:
+			readFile(output, run.FileOffset, run.Length);
+			break;
+		case VIRTUAL_DISK_SOURCE::PARENT:
+			NTFSLIB_ASSERT(
+				m_parent != nullptr,
+				UnexpectedActionError
+			);
+			NTFSLIB_ASSERT(
+				m_parent->readAt(output, offset, run.Length) == run.Length,
+				BadSizeError
+			);
+			break;
+		case VIRTUAL_DISK_SOURCE::ZERO:
+			ZeroMemory(output, run.Length);
+			break;
+		}
+		output += run.Length;
+		offset += run.Length;
+	}
+	return length;
+}
+
+void VirtualDiskDevice::readBatch(DeviceReadList& reads) {
+	// The runs of all the reads are gathered into a single batch for the container, and one for the parent.
+	DeviceReadList fileReads;
+	DeviceReadList parentReads;
+	VirtualDiskRunList runs;
+	for (DeviceRead& read : reads) {
+		read.BytesRead = 0;
+		if (read.Offset >= m_virtualSize) {
+			continue;
+		}
+		DWORD length = (DWORD)min<ULONGLONG>(read.Length, m_virtualSize - read.Offset);
+		runs.clear();
+		mapRange(read.Offset, length, runs);
+
+		PBYTE output = (PBYTE)read.Buffer;
+		ULONGLONG offset = read.Offset;
+		for (const VirtualDiskRun& run : runs) {
+			switch (run.Source) {
+			case VIRTUAL_DISK_SOURCE::FILE:
+				fileReads.push_back({ output, run.FileOffset, run.Length, 0 });
+				break;
+			case VIRTUAL_DISK_SOURCE::PARENT:
+				parentReads.push_back({ output, offset, run.Length, 0 });
+				break;
+			case VIRTUAL_DISK_SOURCE::ZERO:
+				ZeroMemory(output, run.Length);
+				break;
+			}
+			output += run.Length;
+			offset += run.Length;
+		}
+		// Any short run fails the whole batch below.
+		read.BytesRead = length;
+	}
+
+	if (!fileReads.empty()) {
+		m_file->readBatch(fileReads);
+	}
+	if (!parentReads.empty()) {
+		NTFSLIB_ASSERT(
+			m_parent != nullptr,
+			UnexpectedActionError
+		);
+		m_parent->readBatch(parentReads);
+	}
+	for (const DeviceReadList* runReads : { &fileReads, &parentReads }) {
+		for (const DeviceRead& runRead : *runReads) {
+			NTFSLIB_ASSERT(
+				runRead.BytesRead == runRead.Length,
+				BadSizeError
+			);
+		}
+	}
+}
+
+ULONGLONG VirtualDiskDevice::getSize() const {
+	return m_virtualSize;
+}
+
+bool VirtualDiskDevice::isImmutable() const {
+	return m_file->isImmutable() && (m_parent == nullptr || m_parent->isImmutable());
+}
+
+DWORD VirtualDiskDevice::getBlockSize() const {
+	return m_blockSize;
+}
+
+bool VirtualDiskDevice::isDifferencing() const {
+	return m_isDifferencing;
+}
+
+const vector<wstring>& VirtualDiskDevice::getParentLocations() const {
+	return m_parentLocations;
+}
+
+void VirtualDiskDevice::setParent(shared_ptr<BlockDevice> parent) {
+	NTFSLIB_ASSERT(
+		m_isDifferencing && parent != nullptr,
+		UnexpectedActionError
+	);
+	NTFSLIB_ASSERT(
+		parent->getSize() >= m_virtualSize,
+		BadSizeError
+	);
+	m_parent = parent;
+}
+
+void VirtualDiskDevice::addRun(VirtualDiskRunList& runs, VIRTUAL_DISK_SOURCE source, ULONGLONG fileOffset, DWORD length) {
+	if (!runs.empty()) {
+		VirtualDiskRun& lastRun = runs.back();
+		if (lastRun.Source == source &&
+			(source != VIRTUAL_DISK_SOURCE::FILE || lastRun.FileOffset + lastRun.Length == fileOffset)) {
+			lastRun.Length += length;
+			return;
+		}
+	}
+	runs.push_back({ source, fileOffset, length });
+}
+
+void VirtualDiskDevice::addBitmapRuns(const Buffer& bitmap, bool isMSBFirst, ULONGLONG blockFileOffset, DWORD blockOffset,
+	DWORD length, VirtualDiskRunList& runs) const {
+	DWORD position = blockOffset;
+	DWORD end = blockOffset + length;
+	while (position < end) {
+		DWORD sector = position / m_sectorSize;
+		NTFSLIB_ASSERT(
+			sector / 8 < bitmap.size(),
+			OutOfBoundsError
+		);
+		BYTE sectorMask = (BYTE)(isMSBFirst ? 0x80 >> (sector % 8) : 1 << (sector % 8));
+		DWORD runLength = min<DWORD>(end, (sector + 1) * m_sectorSize) - position;
+		if ((bitmap[sector / 8] & sectorMask) != 0) {
+			addRun(runs, VIRTUAL_DISK_SOURCE::FILE, blockFileOffset + position, runLength);
+		}
+		else {
+			addRun(runs, VIRTUAL_DISK_SOURCE::PARENT, 0, runLength);
+		}
+		position += runLength;
+	}
+}
+
+shared_ptr<const Buffer> VirtualDiskDevice::readBitmap(ULONGLONG fileOffset, DWORD length) {
+	{
+		lock_guard<mutex> lock(m_bitmapLock);
+		auto cachedBitmap = m_bitmaps.find(fileOffset);
+		if (cachedBitmap != m_bitmaps.end()) {
+			return cachedBitmap->second;
+		}
+	}
+	shared_ptr<Buffer> bitmap = make_shared<Buffer>(length);
+	readFile(bitmap->data(), fileOffset, length);
+
+	lock_guard<mutex> lock(m_bitmapLock);
+	// Bitmaps are small and cheap to read again, so a full cache simply starts over.
+	if (m_bitmapBytes + length > VIRTUAL_DISK_BITMAP_CACHE_SIZE) {
+		m_bitmaps.clear();
+		m_bitmapBytes = 0;
+	}
+	if (m_bitmaps.emplace(fileOffset, bitmap).second) {
+		m_bitmapBytes += length;
+	}
+	return bitmap;
+}
+
+void VirtualDiskDevice::readFile(PVOID buffer, ULONGLONG fileOffset, DWORD length) {
+	NTFSLIB_ASSERT(
+		m_file->readAt(buffer, fileOffset, length) == length,
+		BadSizeError
+	);
+}
+
+shared_ptr<VirtualDiskDevice> VirtualDiskDevice::openChain(const wstring& path, DWORD depth) {
+	NTFSLIB_ASSERT(
+		depth < VIRTUAL_DISK_MAX_CHAIN_DEPTH,
+		UnexpectedActionError
+	);
+	TRACE(DEBUG_LEVEL::INFO, "Opening virtual disk: %ws", path.c_str());
+	shared_ptr<BlockDevice> file = make_shared<RawImageDevice>(path);
+	shared_ptr<VirtualDiskDevice> disk;
+	if (VhdxDevice::isVhdx(*file)) {
+		disk = make_shared<VhdxDevice>(file);
+	}
+	else if (VhdDevice::isVhd(*file)) {
+		disk = make_shared<VhdDevice>(file);
+	}
+	else {
+		NTFSLIB_ERROR(BadRecordHeaderError, NTFSLIB_DEFAULT_ERROR_CODE, "Not a VHD / VHDX file: %ws", path.c_str());
+	}
+	if (disk->isDifferencing()) {
+		disk->setParent(openChain(findParent(path, disk->getParentLocations()), depth + 1));
+	}
+	return disk;
+}
+
+wstring VirtualDiskDevice::findParent(const wstring& childPath, const vector<wstring>& locations) {
+	size_t separator = childPath.find_last_of(L"\\/");
+	wstring childDirectory = separator == wstring::npos ? L"" : childPath.substr(0, separator + 1);
+	for (const wstring& location : locations) {
+		bool isAbsolute = (!location.empty() && (location[0] == L'\\' || location[0] == L'/')) ||
+			(location.size() > 1 && location[1] == L':');
+		wstring parentPath = isAbsolute ? location : childDirectory + location;
+		if (GetFileAttributes(parentPath.c_str()) != INVALID_FILE_ATTRIBUTES) {
+			return parentPath;
+		}
+	}
+	NTFSLIB_ERROR(Win32Error, ERROR_FILE_NOT_FOUND, "Could not find the parent of: %ws", childPath.c_str());
+}
+
+void VirtualDiskDevice::mapRange(ULONGLONG offset, DWORD length, VirtualDiskRunList& runs) {
+	while (length > 0) {
+		ULONGLONG blockIndex = offset / m_blockSize;
+		DWORD blockOffset = (DWORD)(offset % m_blockSize);
+		DWORD blockLength = min<DWORD>(length, m_blockSize - blockOffset);
+		mapBlock(blockIndex, blockOffset, blockLength, runs);
+		offset += blockLength;
+		length -= blockLength;
+	}
+}
@@ -0,0 +1,178 @@
+#ifndef _NTFSLIB_VIRTUAL_DISK_DEVICE_H
+#define _NTFSLIB_VIRTUAL_DISK_DEVICE_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "BlockDevice.h"
+#include "..\Types\VirtualDiskTypes.h"
+
+using std::mutex;
+using std::shared_ptr;
+using std::unordered_map;
+using std::wstring;
+
+// Byte budget of the sector bitmaps kept in memory (differencing disks only).
+#define VIRTUAL_DISK_BITMAP_CACHE_SIZE (16 * 1024 * 1024)
+// Maximal length of a chain of differencing disks (guards against parents referring back to their children).
+#define VIRTUAL_DISK_MAX_CHAIN_DEPTH 16
+
+// Where the bytes of a range of a virtual disk are found.
+enum class VIRTUAL_DISK_SOURCE {
+	// In the container file.
+	FILE,
+	// In the parent disk (differencing disks only), at the same offset.
+	PARENT,
+	// Nowhere, they read as 0's.
+	ZERO
+};
+
+/**
+ * A range of a virtual disk, found in a single place.
+ */
+typedef struct {
+	VIRTUAL_DISK_SOURCE Source;
+	// Offset in the container file (FILE only).
+	ULONGLONG FileOffset;
+	DWORD Length;
+} VirtualDiskRun;
+typedef vector<VirtualDiskRun> VirtualDiskRunList;
+
+/**
+ * Read-only block device backed by a virtual disk container (VHD / VHDX), whose contents are spread over
+ * blocks of the container file as described by its block allocation table (BAT).
+ * The BAT is read once and kept in memory: unallocated blocks read as 0's without any I/O, and a read only
+ * touches the container where its data actually is. Differencing disks read what they do not hold from
+ * their parent (see: setParent), itself possibly a differencing disk.
+ * Use open() to open a container of any format, along with its parents.
+ */
+class VirtualDiskDevice : public BlockDevice {
+public:
+	/**
+	 * Opens the virtual disk found at <path> (VHD or VHDX), and its chain of parents, if it is a differencing disk.
+	 */
+	static shared_ptr<VirtualDiskDevice> open(const wstring& path);
+
+	virtual ~VirtualDiskDevice();
+
+	// see: BlockDevice.readAt
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override;
+
+	// see: BlockDevice.readBatch
+	virtual void readBatch(DeviceReadList& reads) override;
+
+	// see: BlockDevice.getSize
+	virtual ULONGLONG getSize() const override;
+
+	// see: BlockDevice.isImmutable
+	virtual bool isImmutable() const override;
+
+	/**
+	 * Returns the size of a block in bytes.
+	 */
+	DWORD getBlockSize() const;
+
+	/**
+	 * Returns true if this is a differencing disk.
+	 */
+	bool isDifferencing() const;
+
+	/**
+	 * Returns the paths the parent disk might be found at, as recorded in the container (preferred first).
+	 * Relative paths are relative to the directory of this disk's container.
+	 */
+	const vector<wstring>& getParentLocations() const;
+
+	/**
+	 * Sets the parent disk of a differencing disk. Must be called before it is read.
+	 */
+	void setParent(shared_ptr<BlockDevice> parent);
+
+protected:
+	/**
+	 * Reads the disk out of the container <file>. Subclasses parse its headers and fill the properties below.
+	 */
+	explicit VirtualDiskDevice(shared_ptr<BlockDevice> file);
+
+	/**
+	 * Adds to <runs> where the <length> bytes starting at <blockOffset> of block <blockIndex> are found.
+	 * The range never crosses the end of the block.
+	 */
+	virtual void mapBlock(ULONGLONG blockIndex, DWORD blockOffset, DWORD length, VirtualDiskRunList& runs) = 0;
+
+	/**
+	 * Adds a run to <runs>, merging it with the last run if they are contiguous.
+	 */
+	static void addRun(VirtualDiskRunList& runs, VIRTUAL_DISK_SOURCE source, ULONGLONG fileOffset, DWORD length);
+
+	/**
+	 * Adds the runs of the <length> bytes starting at <blockOffset> of a partially present block, whose data
+	 * starts at <blockFileOffset>: sectors whose bit is set in <bitmap> (the block's sector bitmap) are read
+	 * from the file, the others from the parent. <isMSBFirst> tells whether the first sector of a bitmap byte
+	 * is its most significant bit.
+	 */
+	void addBitmapRuns(const Buffer& bitmap, bool isMSBFirst, ULONGLONG blockFileOffset, DWORD blockOffset,
+		DWORD length, VirtualDiskRunList& runs) const;
+
+	/**
+	 * Returns the <length> bytes of sector bitmap found at <fileOffset>, read once and kept in memory.
+	 */
+	shared_ptr<const Buffer> readBitmap(ULONGLONG fileOffset, DWORD length);
+
+	/**
+	 * Reads exactly <length> bytes of the container starting at <fileOffset>. Throws BadSizeError otherwise.
+	 */
+	void readFile(PVOID buffer, ULONGLONG fileOffset, DWORD length);
+
+	// The container file.
+	shared_ptr<BlockDevice> m_file;
+
+	// Size of the virtual disk in bytes.
+	ULONGLONG m_virtualSize;
+
+	// Size of a block in bytes.
+	DWORD m_blockSize;
+
+	// Size of a sector in bytes (the granularity of sector bitmaps).
+	DWORD m_sectorSize;
+
+	// Is this a differencing disk?
+	bool m_isDifferencing;
+
+	// Where the parent disk might be found.
+	vector<wstring> m_parentLocations;
+
+private:
+	FORBID_COPY_AND_ASSIGN(VirtualDiskDevice);
+
+	/**
+	 * Opens the virtual disk found at <path>, <depth> being the number of children opened before it.
+	 */
+	static shared_ptr<VirtualDiskDevice> openChain(const wstring& path, DWORD depth);
+
+	/**
+	 * Returns the first of <locations> (relative to the directory of <childPath>) which exists.
+	 */
+	static wstring findParent(const wstring& childPath, const vector<wstring>& locations);
+
+	/**
+	 * Adds to <runs> where the <length> bytes starting at <offset> (within the disk) are found.
+	 */
+	void mapRange(ULONGLONG offset, DWORD length, VirtualDiskRunList& runs);
+
+	// The parent disk (differencing disks only).
+	shared_ptr<BlockDevice> m_parent;
+
+	// Guards the sector bitmaps.
+	mutex m_bitmapLock;
+
+	// Sector bitmaps kept in memory, by their file offset.
+	unordered_map<ULONGLONG, shared_ptr<const Buffer>> m_bitmaps;
+
+	// Number of bytes of sector bitmaps kept in memory.
+	ULONGLONG m_bitmapBytes;
+};
+
+#endif // _NTFSLIB_VIRTUAL_DISK_DEVICE_H
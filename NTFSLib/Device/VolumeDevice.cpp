@@ -0,0 +1,21 @@
+#include "VolumeDevice.h"
+
+VolumeDevice::VolumeDevice(WCHAR volumeLetter) :
+	m_volumeFile(volumeLetter),
+	m_volumeSize(0) {
+	GET_LENGTH_INFORMATION lengthInfo = { 0 };
+	m_volumeFile.sendIoctl(IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &lengthInfo, sizeof(lengthInfo));
+	m_volumeSize = (ULONGLONG)lengthInfo.Length.QuadPart;
+}
+
+DWORD VolumeDevice::readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	return m_volumeFile.readAt(buffer, offset, bytesToRead);
+}
+
+ULONGLONG VolumeDevice::getSize() const {
+	return m_volumeSize;
+}
+
+DWORD VolumeDevice::sendIoctl(DWORD code, PVOID inBuffer, DWORD inBufferSize, PVOID outBuffer, DWORD outBufferSize) {
+	return m_volumeFile.sendIoctl(code, inBuffer, inBufferSize, outBuffer, outBufferSize);
+}
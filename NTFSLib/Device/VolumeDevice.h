@@ -0,0 +1,34 @@
+#ifndef _NTFSLIB_VOLUME_DEVICE_H
+#define _NTFSLIB_VOLUME_DEVICE_H
+
+#include "BlockDevice.h"
+#include "..\Misc\Win32\VolumeFile.h"
+
+/**
+ * Block device backed by a live, mounted volume (e.g. "\\.\C:").
+ * This is the only device supporting IOCTLs, hence the Change Journal.
+ */
+class VolumeDevice : public BlockDevice {
+public:
+	VolumeDevice(WCHAR volumeLetter);
+
+	// see: BlockDevice.readAt
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override;
+
+	// see: BlockDevice.getSize
+	virtual ULONGLONG getSize() const override;
+
+	// see: BlockDevice.sendIoctl
+	virtual DWORD sendIoctl(DWORD code, PVOID inBuffer, DWORD inBufferSize, PVOID outBuffer, DWORD outBufferSize) override;
+
+private:
+	FORBID_COPY_AND_ASSIGN(VolumeDevice);
+
+	// Volume's file handle.
+	VolumeFile m_volumeFile;
+
+	// Volume's size in bytes.
+	ULONGLONG m_volumeSize;
+};
+
+#endif // _NTFSLIB_VOLUME_DEVICE_H
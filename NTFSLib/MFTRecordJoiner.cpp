@@ -0,0 +1,149 @@
+#include "MFTRecordJoiner.h"
+#include "Record\MFTRecordView.h"
+
+using std::lock_guard;
+using std::make_shared;
+
+MFTRecordJoiner::MFTRecordJoiner(NTFSVolume& volume, const MFTRecordFactory& createRecord, DWORD maxPendingRecords) :
+	m_volume(volume),
+	m_createRecord(createRecord),
+	m_maxPendingRecords(maxPendingRecords),
+	m_numOfPendingExtensionRecords(0),
+	m_numOfExtensionArrivals(0) {
+	// Left blank.
+}
+
+bool MFTRecordJoiner::addRecord(PMFT_RECORD recordData, JoinedMFTRecords& completedRecords) {
+	MFTRecordView recordView(recordData);
+	shared_ptr<MFTRecord> record = nullptr;
+	bool needsJoin = !recordView.isBaseRecord() || recordView.hasAttributeList();
+	try {
+		// Held records outlive the scan's buffer.
+		record = recordView.isBaseRecord() ? m_createRecord(recordData, needsJoin) : make_shared<MFTRecord>(m_volume, recordData, true);
+	}
+	catch (NTFSLibError&) {
+		// Only the attributes list is parsed here, a malformed one (e.g. bad data runs) makes the record useless.
+		TRACE(DEBUG_LEVEL::VERBOSE, "Could not read the attributes list of record %#llx", recordView.getRecordNumber());
+		return false;
+	}
+	if (!needsJoin) {
+		// The common case, everything is in this record.
+		completeRecord(record, false, completedRecords);
+		return false;
+	}
+
+	bool isHeld = false;
+	shared_ptr<MFTRecord> joinedRecord = nullptr;
+	vector<shared_ptr<MFTRecord>> evictedRecords;
+	{
+		lock_guard<mutex> lock(m_lock);
+		if (!recordView.isBaseRecord()) {
+			ULONGLONG baseRecordNumber = MFT_REF(recordData->BaseFileRecord);
+			auto baseRecord = m_pendingBaseRecords.find(baseRecordNumber);
+			if (baseRecord == m_pendingBaseRecords.end()) {
+				// The base record was not scanned yet.
+				auto extensionRecords = m_pendingExtensionRecords.find(baseRecordNumber);
+				if (extensionRecords == m_pendingExtensionRecords.end()) {
+					extensionRecords = m_pendingExtensionRecords.insert({ baseRecordNumber, { {}, m_numOfExtensionArrivals } }).first;
+					m_extensionArrivals.push_back({ baseRecordNumber, m_numOfExtensionArrivals++ });
+				}
+				extensionRecords->second.Records.push_back(record);
+				m_numOfPendingExtensionRecords++;
+			}
+			else if (baseRecord->second->attachExtensionRecord(record) && !baseRecord->second->hasPendingExtensionRecords()) {
+				joinedRecord = baseRecord->second;
+				m_pendingBaseRecords.erase(baseRecord);
+			}
+		}
+		else {
+			// Some of the extension records might have been scanned already.
+			auto extensionRecords = m_pendingExtensionRecords.find(record->getRecordNumber());
+			if (extensionRecords != m_pendingExtensionRecords.end()) {
+				for (shared_ptr<MFTRecord> extensionRecord : extensionRecords->second.Records) {
+					record->attachExtensionRecord(extensionRecord);
+				}
+				m_numOfPendingExtensionRecords -= (DWORD)extensionRecords->second.Records.size();
+				m_pendingExtensionRecords.erase(extensionRecords);
+				dropStaleArrivals();
+			}
+			if (record->hasPendingExtensionRecords()) {
+				m_pendingBaseRecords[record->getRecordNumber()] = record;
+				isHeld = true;
+			}
+			else {
+				joinedRecord = record;
+			}
+		}
+		evictRecords(evictedRecords);
+	}
+
+	// Loading the metadata outside the lock, it might still read missing extension records.
+	if (joinedRecord != nullptr) {
+		// Held back unless all of its extension records were scanned before it.
+		completeRecord(joinedRecord, joinedRecord != record, completedRecords);
+	}
+	for (shared_ptr<MFTRecord> evictedRecord : evictedRecords) {
+		completeRecord(evictedRecord, true, completedRecords);
+	}
+	return isHeld;
+}
+
+void MFTRecordJoiner::flush(JoinedMFTRecords& completedRecords) {
+	map<ULONGLONG, shared_ptr<MFTRecord>> pendingBaseRecords;
+	{
+		lock_guard<mutex> lock(m_lock);
+		pendingBaseRecords.swap(m_pendingBaseRecords);
+		// Extension records of records that were not scanned (e.g. free base records) are of no use.
+		m_pendingExtensionRecords.clear();
+		m_extensionArrivals.clear();
+		m_numOfPendingExtensionRecords = 0;
+	}
+	for (const auto& pendingBaseRecord : pendingBaseRecords) {
+		completeRecord(pendingBaseRecord.second, true, completedRecords);
+	}
+}
+
+void MFTRecordJoiner::completeRecord(shared_ptr<MFTRecord> record, bool wasHeld, JoinedMFTRecords& completedRecords) {
+	// Records given up on still miss some extension records, reading them now rather than when they are used.
+	NTFSLIB_STATUS status = record->tryLoadExtensionRecords();
+	if (status == NTFSLIB_STATUS::SUCCESS) {
+		status = record->tryLoadMetadata();
+	}
+	if (status != NTFSLIB_STATUS::SUCCESS) {
+		// One of the record's missing extension records is unusable.
+		TRACE(DEBUG_LEVEL::VERBOSE, "Could not load record %#llx (Status: %d)", record->getRecordNumber(), (int)status);
+		if (wasHeld) {
+			completedRecords.push_back({ record->getRecordNumber(), nullptr, true });
+		}
+		return;
+	}
+	completedRecords.push_back({ record->getRecordNumber(), record, wasHeld });
+}
+
+void MFTRecordJoiner::evictRecords(vector<shared_ptr<MFTRecord>>& evictedRecords) {
+	// Extension records are dropped in the order they arrived, their base record might be anywhere in the MFT.
+	while (m_numOfPendingExtensionRecords > 0 &&
+		m_pendingBaseRecords.size() + m_numOfPendingExtensionRecords > m_maxPendingRecords) {
+		// The front group is still held, stale arrivals are always dropped right away.
+		auto extensionRecords = m_pendingExtensionRecords.find(m_extensionArrivals.front().first);
+		m_numOfPendingExtensionRecords -= (DWORD)extensionRecords->second.Records.size();
+		m_pendingExtensionRecords.erase(extensionRecords);
+		m_extensionArrivals.pop_front();
+		dropStaleArrivals();
+	}
+	// Base records are held as they are scanned, and the scan moves forward, so the lowest ones waited the longest.
+	while (m_pendingBaseRecords.size() > m_maxPendingRecords) {
+		evictedRecords.push_back(m_pendingBaseRecords.begin()->second);
+		m_pendingBaseRecords.erase(m_pendingBaseRecords.begin());
+	}
+}
+
+void MFTRecordJoiner::dropStaleArrivals() {
+	while (!m_extensionArrivals.empty()) {
+		auto extensionRecords = m_pendingExtensionRecords.find(m_extensionArrivals.front().first);
+		if (extensionRecords != m_pendingExtensionRecords.end() && extensionRecords->second.Arrival == m_extensionArrivals.front().second) {
+			return;
+		}
+		m_extensionArrivals.pop_front();
+	}
+}
@@ -0,0 +1,142 @@
+#ifndef _NTFSLIB_MFT_RECORD_JOINER_H
+#define _NTFSLIB_MFT_RECORD_JOINER_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "NTFSVolume.h"
+#include "Misc\Defs.h"
+#include "Record\MFTRecord.h"
+#include "Types\NTFSTypes.h"
+
+using std::deque;
+using std::function;
+using std::map;
+using std::mutex;
+using std::pair;
+using std::shared_ptr;
+using std::vector;
+
+/**
+ * Builds a record (without loading its metadata) out of fixed-up <recordData>.
+ * If <copyRecord> is false, the record refers <recordData> directly.
+ */
+typedef function<shared_ptr<MFTRecord>(PMFT_RECORD recordData, bool copyRecord)> MFTRecordFactory;
+
+/**
+ * A record completed by MFTRecordJoiner.
+ */
+struct JoinedMFTRecord {
+	// Number of the record.
+	ULONGLONG RecordNumber;
+
+	// The record, with all its extension records loaded. nullptr if it could not be loaded.
+	shared_ptr<MFTRecord> Record;
+
+	// Was the record held back while waiting for its extension records (see: MFTRecordJoiner.addRecord)?
+	bool WasHeld;
+};
+typedef vector<JoinedMFTRecord> JoinedMFTRecords;
+
+/**
+ * Joins base records with their extension records while the whole MFT is scanned, so extension
+ * records are taken from the scan instead of being read again, one by one, from the disk.
+ * Records which need no join are completed right away. Base records waiting for their extension records,
+ * and extension records waiting for their base record, are copied and held back in a bounded table.
+ * Once the table is full, the held records which waited the longest are given up on: base records are completed
+ * anyway (their missing extension records are read from the disk), and extension records are dropped.
+ * Completed records have all their extension records loaded, so they can be used without throwing
+ * for an unusable extension record, and shared between threads.
+ * Thread-safe, records can be added from several scanning threads at once.
+ */
+class MFTRecordJoiner {
+public:
+	/**
+	 * Creates a joiner holding back up to <maxPendingRecords> records, which builds records with <createRecord>.
+	 */
+	MFTRecordJoiner(NTFSVolume& volume, const MFTRecordFactory& createRecord, DWORD maxPendingRecords);
+
+	/**
+	 * Adds a scanned record, and appends the records completed by it to <completedRecords>: the record itself
+	 * if it needs no join, or base records which were held back (their last extension record just arrived,
+	 * or they were given up on).
+	 * Returns true if the record is a base record which is held back, and is completed later (by adding
+	 * another record, or by flush).
+	 * Completed records which were not held back and can not be loaded are skipped, held ones are always
+	 * reported (with no record), so whoever waits for them can stop waiting.
+	 * Records that do not need a join refer <recordData>, and are only valid as long as it is.
+	 */
+	bool addRecord(PMFT_RECORD recordData, JoinedMFTRecords& completedRecords);
+
+	/**
+	 * Completes all the base records still waiting for extension records (once the scan is over),
+	 * and appends them to <completedRecords>.
+	 */
+	void flush(JoinedMFTRecords& completedRecords);
+
+private:
+	FORBID_COPY_AND_ASSIGN(MFTRecordJoiner);
+
+	/**
+	 * Loads the missing extension records and the metadata of <record>, and appends it to <completedRecords>.
+	 * Records which can not be loaded are appended with no record if they <wereHeld>, skipped otherwise.
+	 */
+	void completeRecord(shared_ptr<MFTRecord> record, bool wasHeld, JoinedMFTRecords& completedRecords);
+
+	/**
+	 * Extension records of a single base record, waiting for it.
+	 */
+	struct PendingExtensionRecords {
+		// The extension records, in the order they arrived.
+		vector<shared_ptr<MFTRecord>> Records;
+
+		// Arrival number of the first one (see: m_extensionArrivals).
+		ULONGLONG Arrival;
+	};
+
+	/**
+	 * Gives up on the held records which waited the longest until the table has room, appending evicted base records
+	 * to <evictedRecords>. Must be called with m_lock held.
+	 */
+	void evictRecords(vector<shared_ptr<MFTRecord>>& evictedRecords);
+
+	/**
+	 * Drops the arrivals of extension records which are no longer held from the front of m_extensionArrivals.
+	 * Must be called with m_lock held.
+	 */
+	void dropStaleArrivals();
+
+	// Volume the records belong to.
+	NTFSVolume& m_volume;
+
+	// Builds the records.
+	const MFTRecordFactory m_createRecord;
+
+	// Maximal number of held records.
+	const DWORD m_maxPendingRecords;
+
+	// Protects the held records.
+	mutex m_lock;
+
+	// Base records waiting for extension records, by record number.
+	map<ULONGLONG, shared_ptr<MFTRecord>> m_pendingBaseRecords;
+
+	// Extension records waiting for their base record, by base record number.
+	map<ULONGLONG, PendingExtensionRecords> m_pendingExtensionRecords;
+
+	// Base record number and arrival number of every group of held extension records, oldest first.
+	// Groups which were joined (or dropped) since are skipped once they reach the front.
+	deque<pair<ULONGLONG, ULONGLONG>> m_extensionArrivals;
+
+	// Number of groups of extension records held so far, numbers their arrivals.
+	ULONGLONG m_numOfExtensionArrivals;
+
+	// Number of held extension records.
+	DWORD m_numOfPendingExtensionRecords;
+};
+
+#endif // _NTFSLIB_MFT_RECORD_JOINER_H
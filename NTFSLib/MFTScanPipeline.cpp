@@ -0,0 +1,277 @@
+#include <map>
+
+#include "MFTScanPipeline.h"
+
+using std::map;
+using std::lock_guard;
+
+MFTScanPipeline::MFTScanPipeline(NTFSVolume& volume, const ExtentMap& mftExtents, const MFTScanOptions& options) :
+	m_scanner(volume, mftExtents, options.ChunkSize),
+	m_numOfParsers(options.NumOfThreads > 0 ? options.NumOfThreads : (thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1)),
+	m_orderedOutput(options.OrderedOutput),
+	m_cancellation(options.Cancellation),
+	m_ioPriority(IOPriorityScope::getCurrent()),
+	m_freeBatches(m_numOfParsers + MFT_PIPELINE_READ_AHEAD_CHUNKS),
+	m_readBatches(m_numOfParsers + MFT_PIPELINE_READ_AHEAD_CHUNKS),
+	m_parsedBatches(m_numOfParsers + MFT_PIPELINE_READ_AHEAD_CHUNKS),
+	m_runningParsers(0),
+	m_stopped(false),
+	m_error(nullptr) {
+	for (DWORD i = 0; i < m_numOfParsers + MFT_PIPELINE_READ_AHEAD_CHUNKS; ++i) {
+		m_batches.push_back(unique_ptr<Batch>(new Batch()));
+		m_freeBatches.push(m_batches.back().get());
+	}
+	m_scanner.setCancellation(m_cancellation);
+}
+
+MFTScanPipeline::~MFTScanPipeline() {
+	stop();
+	joinStages();
+}
+
+void MFTScanPipeline::setRecordsBitmap(shared_ptr<const Buffer> recordsBitmap) {
+	m_scanner.setRecordsBitmap(recordsBitmap);
+}
+
+bool MFTScanPipeline::run(const MFTRecordParser& parser, const MFTOutputSink& sink) {
+	NTFSLIB_ASSERT(
+		m_threads.empty() && !m_stopped,
+		UnexpectedActionError
+	);
+	TRACE(DEBUG_LEVEL::VERBOSE, "Scanning MFT with %lu parsers, %zu batches in flight", m_numOfParsers, m_batches.size());
+	m_runningParsers = m_numOfParsers;
+	m_threads.push_back(thread(&MFTScanPipeline::readerLoop, this));
+	for (DWORD i = 0; i < m_numOfParsers; ++i) {
+		m_threads.push_back(thread(&MFTScanPipeline::parserLoop, this, std::cref(parser)));
+	}
+
+	bool sinkStopped = false;
+	bool cancelled = false;
+	try {
+		// Parsed batches arrive in any order, the ones which came too early wait here.
+		map<size_t, PBatch> earlyBatches;
+		size_t nextSequence = 0;
+		PBatch batch = nullptr;
+		while (m_parsedBatches.pop(batch)) {
+			// Checked once per batch, the parsers and the reader check it on their own.
+			if (isCancelled()) {
+				TRACE(DEBUG_LEVEL::VERBOSE, "MFT scan cancelled, stopping");
+				cancelled = true;
+				stop();
+				break;
+			}
+			if (!m_orderedOutput) {
+				sinkStopped = sinkStopped || !deliverOutputs(batch->Outputs, sink) || !deliverFilledOutputs(sink);
+				m_freeBatches.push(batch);
+			}
+			else {
+				earlyBatches[batch->Sequence] = batch;
+				for (auto it = earlyBatches.find(nextSequence); it != earlyBatches.end(); it = earlyBatches.find(++nextSequence)) {
+					sinkStopped = sinkStopped || !deliverOrderedOutputs(it->second->Outputs, sink);
+					m_freeBatches.push(it->second);
+					earlyBatches.erase(it);
+				}
+				// Reserved outputs might have been filled since, by batches which are not handed over yet.
+				sinkStopped = sinkStopped || !deliverHeldOutputs(sink, false);
+			}
+			if (sinkStopped) {
+				stop();
+			}
+		}
+	}
+	catch (...) {
+		fail(std::current_exception());
+	}
+	joinStages();
+
+	if (m_error != nullptr) {
+		std::rethrow_exception(m_error);
+	}
+	return !sinkStopped && !cancelled;
+}
+
+void MFTScanPipeline::readerLoop() {
+	IOPriorityScope ioPriority(m_ioPriority);
+	try {
+		size_t sequence = 0;
+		ULONGLONG recordIndex = 0;
+		ULONGLONG lastRecord = m_scanner.getNumOfRecords();
+		PBatch batch = nullptr;
+		// Waiting for a free batch is what holds the reader back when the other stages fall behind.
+		while (recordIndex < lastRecord && !m_stopped && !isCancelled() && m_freeBatches.pop(batch)) {
+			recordIndex = m_scanner.readChunk(recordIndex, lastRecord, batch->Chunk);
+			if (batch->Chunk.NumOfRecords == 0) {
+				break;
+			}
+			batch->Sequence = sequence++;
+			if (!m_readBatches.push(batch)) {
+				break;
+			}
+		}
+	}
+	catch (...) {
+		fail(std::current_exception());
+	}
+	m_readBatches.close();
+}
+
+void MFTScanPipeline::parserLoop(const MFTRecordParser& parser) {
+	// Parsing reads too (e.g. extension records which were not scanned).
+	IOPriorityScope ioPriority(m_ioPriority);
+	try {
+		PBatch batch = nullptr;
+		while (!m_stopped && m_readBatches.pop(batch)) {
+			batch->Outputs.Data.clear();
+			batch->Outputs.RecordEnds.clear();
+			batch->Outputs.ReservedOutputs.clear();
+			m_scanner.visitChunk(batch->Chunk, [&](ULONGLONG recordIndex, PMFT_RECORD record) -> bool {
+				parser(recordIndex, record, batch->Outputs);
+				return !m_stopped;
+			});
+			if (!m_parsedBatches.push(batch)) {
+				break;
+			}
+		}
+	}
+	catch (...) {
+		fail(std::current_exception());
+	}
+	if (--m_runningParsers == 0) {
+		m_parsedBatches.close();
+	}
+}
+
+void MFTScanPipeline::reserveOutput(MFTRecordOutputs& outputs, ULONGLONG key) {
+	outputs.ReservedOutputs.push_back({ outputs.RecordEnds.size(), key });
+}
+
+void MFTScanPipeline::fillReservedOutput(ULONGLONG key, MFTRecordOutputs&& outputs) {
+	lock_guard<mutex> lock(m_filledOutputsLock);
+	m_filledOutputs[key] = std::move(outputs);
+}
+
+bool MFTScanPipeline::flushReservedOutputs(const MFTOutputSink& sink) {
+	if (!m_orderedOutput) {
+		return deliverFilledOutputs(sink);
+	}
+	return deliverHeldOutputs(sink, true);
+}
+
+bool MFTScanPipeline::deliverOrderedOutputs(const MFTRecordOutputs& outputs, const MFTOutputSink& sink) {
+	size_t recordStart = 0;
+	auto reservedOutput = outputs.ReservedOutputs.begin();
+	for (size_t i = 0; i <= outputs.RecordEnds.size(); ++i) {
+		for (; reservedOutput != outputs.ReservedOutputs.end() && reservedOutput->first == i; ++reservedOutput) {
+			MFTRecordOutputs filledOutput;
+			if (!m_heldOutputs.empty() || !takeFilledOutput(reservedOutput->second, filledOutput)) {
+				m_heldOutputs.push_back({ true, reservedOutput->second, Buffer() });
+			}
+			else if (!deliverOutputs(filledOutput, sink)) {
+				return false;
+			}
+		}
+		if (i == outputs.RecordEnds.size()) {
+			break;
+		}
+		size_t recordEnd = outputs.RecordEnds[i];
+		if (!m_heldOutputs.empty()) {
+			// The batch is recycled once handed over, so the output is copied.
+			m_heldOutputs.push_back({ false, 0, Buffer(outputs.Data.begin() + recordStart, outputs.Data.begin() + recordEnd) });
+		}
+		else if (!sink((PBYTE)outputs.Data.data() + recordStart, (DWORD)(recordEnd - recordStart))) {
+			return false;
+		}
+		recordStart = recordEnd;
+	}
+	return true;
+}
+
+bool MFTScanPipeline::deliverHeldOutputs(const MFTOutputSink& sink, bool skipUnfilled) {
+	while (!m_heldOutputs.empty()) {
+		HeldOutput& heldOutput = m_heldOutputs.front();
+		if (!heldOutput.IsReserved) {
+			if (!sink((PBYTE)heldOutput.Data.data(), (DWORD)heldOutput.Data.size())) {
+				return false;
+			}
+		}
+		else {
+			MFTRecordOutputs filledOutput;
+			if (takeFilledOutput(heldOutput.Key, filledOutput)) {
+				if (!deliverOutputs(filledOutput, sink)) {
+					return false;
+				}
+			}
+			else if (!skipUnfilled) {
+				return true;
+			}
+		}
+		m_heldOutputs.pop_front();
+	}
+	return true;
+}
+
+bool MFTScanPipeline::deliverFilledOutputs(const MFTOutputSink& sink) {
+	map<ULONGLONG, MFTRecordOutputs> filledOutputs;
+	{
+		lock_guard<mutex> lock(m_filledOutputsLock);
+		filledOutputs.swap(m_filledOutputs);
+	}
+	for (const auto& filledOutput : filledOutputs) {
+		if (!deliverOutputs(filledOutput.second, sink)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MFTScanPipeline::takeFilledOutput(ULONGLONG key, MFTRecordOutputs& outputs) {
+	lock_guard<mutex> lock(m_filledOutputsLock);
+	auto filledOutput = m_filledOutputs.find(key);
+	if (filledOutput == m_filledOutputs.end()) {
+		return false;
+	}
+	outputs = std::move(filledOutput->second);
+	m_filledOutputs.erase(filledOutput);
+	return true;
+}
+
+bool MFTScanPipeline::deliverOutputs(const MFTRecordOutputs& outputs, const MFTOutputSink& sink) {
+	size_t recordStart = 0;
+	for (size_t recordEnd : outputs.RecordEnds) {
+		if (!sink((PBYTE)outputs.Data.data() + recordStart, (DWORD)(recordEnd - recordStart))) {
+			return false;
+		}
+		recordStart = recordEnd;
+	}
+	return true;
+}
+
+void MFTScanPipeline::stop() {
+	m_stopped = true;
+	m_freeBatches.close();
+	m_readBatches.close();
+	m_parsedBatches.close();
+}
+
+void MFTScanPipeline::fail(exception_ptr error) {
+	{
+		lock_guard<mutex> lock(m_errorLock);
+		if (m_error == nullptr) {
+			m_error = error;
+		}
+	}
+	stop();
+}
+
+bool MFTScanPipeline::isCancelled() const {
+	return m_cancellation != nullptr && m_cancellation->isCancelled();
+}
+
+void MFTScanPipeline::joinStages() {
+	for (thread& stage : m_threads) {
+		if (stage.joinable()) {
+			stage.join();
+		}
+	}
+	m_threads.clear();
+}
@@ -0,0 +1,251 @@
+#ifndef _NTFSLIB_MFT_SCAN_PIPELINE_H
+#define _NTFSLIB_MFT_SCAN_PIPELINE_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MFTScanner.h"
+#include "NTFSVolume.h"
+#include "Misc\BoundedQueue.h"
+#include "Misc\Defs.h"
+#include "Misc\ExtentMap.h"
+#include "Misc\IOScheduler.h"
+
+using std::atomic;
+using std::deque;
+using std::exception_ptr;
+using std::function;
+using std::map;
+using std::mutex;
+using std::pair;
+using std::shared_ptr;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+// Number of chunks read ahead of the parsers (on top of a chunk per parser).
+#define MFT_PIPELINE_READ_AHEAD_CHUNKS 4
+
+/**
+ * Output of the records parsed out of a single chunk.
+ */
+struct MFTRecordOutputs {
+	// Output of all the records, one after the other.
+	Buffer Data;
+
+	// Where the output of each record ends in Data.
+	vector<size_t> RecordEnds;
+
+	// Outputs of records completed later, which are handed over here (see: MFTScanPipeline.reserveOutput),
+	// as the number of record ends before each one and its key.
+	vector<pair<size_t, ULONGLONG>> ReservedOutputs;
+};
+
+/**
+ * Invoked on a parser thread for every valid record, with the record's index and its fixed-up data.
+ * Appends whatever it makes of the record to <outputs>, ending each output it appends with a new record end.
+ * A record may produce no output, or the output of several records (e.g. base records it completed).
+ * A record completed later may reserve the place of its output (see: MFTScanPipeline.reserveOutput).
+ */
+typedef function<void(ULONGLONG recordIndex, PMFT_RECORD record, MFTRecordOutputs& outputs)> MFTRecordParser;
+
+/**
+ * Invoked on the calling thread with the output of a single record.
+ * Return false to stop the scan.
+ */
+typedef function<bool(PBYTE output, DWORD outputLength)> MFTOutputSink;
+
+/**
+ * Scans the whole MFT in three decoupled stages, so the disk, the CPUs and the output are all kept busy:
+ * - A reader thread reads chunks of records ahead (see: MFTScanner.readChunk).
+ * - Parser threads fix up and parse the chunks' records (see: MFTScanner.visitChunk).
+ * - The calling thread hands the parsed output over to a sink, in record order if asked to.
+ * The stages are connected by bounded queues, and a fixed ring of batches (each with its own read and
+ * output buffers) is recycled between them, so a slow stage holds the faster ones back instead of
+ * letting buffers pile up.
+ */
+class MFTScanPipeline {
+public:
+	/**
+	 * Creates a pipeline for the MFT described by <mftExtents>, with options.NumOfThreads parsers.
+	 */
+	MFTScanPipeline(NTFSVolume& volume, const ExtentMap& mftExtents, const MFTScanOptions& options);
+
+	/**
+	 * Stops the stages which are still running.
+	 */
+	~MFTScanPipeline();
+
+	/**
+	 * Sets the MFT's bitmap (see: MFTScanner.setRecordsBitmap).
+	 */
+	void setRecordsBitmap(shared_ptr<const Buffer> recordsBitmap);
+
+	/**
+	 * Runs the whole scan, calling <parser> for every valid record and <sink> for every record's output.
+	 * An error in any of the stages stops the scan and is rethrown here.
+	 * Returns false if the sink stopped the scan or it was cancelled (see: MFTScanOptions.Cancellation), true otherwise.
+	 */
+	bool run(const MFTRecordParser& parser, const MFTOutputSink& sink);
+
+	/**
+	 * Reserves the place of an output, after the outputs already in <outputs>, for the record
+	 * identified by <key>. The record's output is handed over there once filled (see: fillReservedOutput),
+	 * so a record completed long after it was scanned keeps its place in the ordered output.
+	 */
+	static void reserveOutput(MFTRecordOutputs& outputs, ULONGLONG key);
+
+	/**
+	 * Fills the output reserved for <key> with <outputs> (no record ends if there is nothing to hand over).
+	 * It may be filled before or after it is reserved, from any thread. Every reserved output must be filled,
+	 * the ordered outputs following it are held back until it is.
+	 */
+	void fillReservedOutput(ULONGLONG key, MFTRecordOutputs&& outputs);
+
+	/**
+	 * Hands over the outputs still held back once run returned true (after the remaining reserved
+	 * outputs were filled), skipping reserved outputs which were never filled.
+	 * Returns false if the sink stopped.
+	 */
+	bool flushReservedOutputs(const MFTOutputSink& sink);
+
+	/**
+	 * Hands every record's output in <outputs> to <sink>, returns false if the sink stopped.
+	 * Reserved outputs are not handed over.
+	 */
+	static bool deliverOutputs(const MFTRecordOutputs& outputs, const MFTOutputSink& sink);
+
+private:
+	FORBID_COPY_AND_ASSIGN(MFTScanPipeline);
+
+	// A chunk of records on its way through the pipeline, recycled once its output is handed over.
+	struct Batch {
+		// Position of the chunk in the MFT (chunks are read in order).
+		size_t Sequence;
+
+		// The chunk's records.
+		MFTChunk Chunk;
+
+		// Output of the chunk's records.
+		MFTRecordOutputs Outputs;
+	};
+	typedef Batch* PBatch;
+
+	// An ordered output held back behind a reserved output which was not filled yet.
+	struct HeldOutput {
+		// Is it a reserved output?
+		bool IsReserved;
+
+		// Key of the reserved output.
+		ULONGLONG Key;
+
+		// Output of the record, if not reserved.
+		Buffer Data;
+	};
+
+	/**
+	 * Reader stage: reads the MFT chunk by chunk into free batches.
+	 */
+	void readerLoop();
+
+	/**
+	 * Parser stage: parses the records of read batches with <parser>.
+	 */
+	void parserLoop(const MFTRecordParser& parser);
+
+	/**
+	 * Hands the outputs in <outputs>, and the reserved outputs among them, over to <sink> in order.
+	 * Once a reserved output which was not filled yet is reached, the following outputs are held back.
+	 * Returns false if the sink stopped.
+	 */
+	bool deliverOrderedOutputs(const MFTRecordOutputs& outputs, const MFTOutputSink& sink);
+
+	/**
+	 * Hands the held back outputs over to <sink>, up to the first reserved output which was not filled yet.
+	 * If <skipUnfilled> is true, reserved outputs which were not filled are skipped instead.
+	 * Returns false if the sink stopped.
+	 */
+	bool deliverHeldOutputs(const MFTOutputSink& sink, bool skipUnfilled);
+
+	/**
+	 * Hands the filled reserved outputs over to <sink> as is, returns false if the sink stopped.
+	 */
+	bool deliverFilledOutputs(const MFTOutputSink& sink);
+
+	/**
+	 * Moves the output filled for <key> into <outputs>, returns false if it was not filled yet.
+	 */
+	bool takeFilledOutput(ULONGLONG key, MFTRecordOutputs& outputs);
+
+	/**
+	 * Stops all the stages: pending batches are dropped and blocked stages return.
+	 */
+	void stop();
+
+	/**
+	 * Stops all the stages because of <error>, which is rethrown by run.
+	 */
+	void fail(exception_ptr error);
+
+	/**
+	 * Waits for the reader and the parsers to return.
+	 */
+	void joinStages();
+
+	/**
+	 * Returns true once the scan's cancellation token (if any) was cancelled.
+	 */
+	bool isCancelled() const;
+
+	// Scanner used by all the stages (reading and visiting chunks do not change it).
+	MFTScanner m_scanner;
+
+	// Number of parser threads.
+	const DWORD m_numOfParsers;
+
+	// Hand the output over in record order?
+	const bool m_orderedOutput;
+
+	// Stops all the stages once cancelled, nullptr if none.
+	const shared_ptr<const CancellationToken> m_cancellation;
+
+	// Priority class of the operation the pipeline was created for, taken by all the stages.
+	const IOOperationPriority m_ioPriority;
+
+	// All the batches.
+	vector<unique_ptr<Batch>> m_batches;
+
+	// Batches waiting to be read into, to be parsed and to be handed over.
+	BoundedQueue<PBatch> m_freeBatches;
+	BoundedQueue<PBatch> m_readBatches;
+	BoundedQueue<PBatch> m_parsedBatches;
+
+	// Number of parsers still running, the last one closes m_parsedBatches.
+	atomic<DWORD> m_runningParsers;
+
+	// Set once the scan was stopped.
+	atomic<bool> m_stopped;
+
+	// First error thrown by one of the stages.
+	mutex m_errorLock;
+	exception_ptr m_error;
+
+	// Reader and parser threads.
+	vector<thread> m_threads;
+
+	// Filled reserved outputs which were not handed over yet, by key.
+	mutex m_filledOutputsLock;
+	map<ULONGLONG, MFTRecordOutputs> m_filledOutputs;
+
+	// Ordered outputs held back behind a reserved output, in order (only used by the calling thread).
+	deque<HeldOutput> m_heldOutputs;
+};
+
+#endif // _NTFSLIB_MFT_SCAN_PIPELINE_H
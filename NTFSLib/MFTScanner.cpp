@@ -0,0 +1,234 @@
+#include <algorithm>
+
+#include "MFTScanner.h"
+#include "NTFSUtils.h"
+#include "Attribute\BitmapAttribute.h"
+#include "Misc\NTFSLibError.h"
+#include "Misc\IOStatistics.h"
+#include "Misc\StringResource.h"
+
+using std::min;
+using std::max;
+
+MFTScanner::MFTScanner(NTFSVolume& volume, const ExtentMap& mftExtents, DWORD chunkSize /* = MFT_SCAN_DEFAULT_CHUNK_SIZE */) :
+	m_volume(volume),
+	m_mftExtents(mftExtents),
+	m_recordsPerChunk(chunkSize / volume.getMFTRecordSize()) {
+	NTFSLIB_ASSERT(
+		m_recordsPerChunk > 0 && chunkSize <= MFT_SCAN_MAX_CHUNK_SIZE,
+		BadSizeError
+	);
+}
+
+void MFTScanner::setRecordsBitmap(shared_ptr<const Buffer> recordsBitmap) {
+	m_recordsBitmap = recordsBitmap;
+}
+
+void MFTScanner::setCancellation(shared_ptr<const CancellationToken> cancellation) {
+	m_cancellation = cancellation;
+}
+
+bool MFTScanner::scan(const MFTScanVisitor& visitor, ULONGLONG firstRecord /* = 0 */, ULONGLONG lastRecord /* = MFT_SCAN_ALL_RECORDS */) {
+	TRACE(DEBUG_LEVEL::VERBOSE, "Scanning MFT records %#llx - %#llx, %lu records per read", firstRecord, lastRecord, m_recordsPerChunk);
+	ULONGLONG recordIndex = firstRecord;
+	while (true) {
+		recordIndex = readChunk(recordIndex, lastRecord, m_chunk);
+		if (m_chunk.NumOfRecords == 0) {
+			return true;
+		}
+		if (!visitChunk(m_chunk, visitor)) {
+			return false;
+		}
+	}
+}
+
+ULONGLONG MFTScanner::readChunk(ULONGLONG recordIndex, ULONGLONG lastRecord, MFTChunk& chunk) {
+	IOSourceScope ioSource(IO_SOURCE::MFT_SCAN);
+	WORD recordSize = m_volume.getMFTRecordSize();
+	WORD clusterSize = m_volume.getClusterSize();
+	lastRecord = min<ULONGLONG>(lastRecord, getNumOfRecords());
+	chunk.NumOfRecords = 0;
+
+	recordIndex = findUsedRecord(recordIndex, lastRecord);
+	while (recordIndex < lastRecord) {
+		ULONGLONG offset = recordIndex * recordSize;
+		ULONGLONG vcn = offset / clusterSize;
+		const DataRun* dataRun = m_mftExtents.findDataRun(vcn);
+		NTFSLIB_ASSERT(
+			dataRun != nullptr,
+			OutOfBoundsError
+		);
+
+		// The chunk ends with the data run, the requested range or the chunk size, whichever comes first.
+		ULONGLONG dataRunEnd = (dataRun->StartVCN + dataRun->NumOfClusters) * clusterSize;
+		ULONGLONG recordsInChunk = min<ULONGLONG>(min<ULONGLONG>((dataRunEnd - offset) / recordSize, lastRecord - recordIndex), m_recordsPerChunk);
+		if (dataRun->IsSparse) {
+			// Nothing is stored there (should never happen in the MFT).
+			recordIndex = findUsedRecord(recordIndex + (recordsInChunk > 0 ? recordsInChunk : 1), lastRecord);
+			continue;
+		}
+		chunk.FirstRecord = recordIndex;
+		if (recordsInChunk == 0) {
+			// The record crosses data runs (clusters smaller than records), it's read on its own.
+			chunk.Data = getStorage(chunk, recordSize);
+			readMFTRange(chunk.Data, offset, recordSize);
+			chunk.IsMapped = false;
+			chunk.NumOfRecords = 1;
+			return findUsedRecord(recordIndex + 1, lastRecord);
+		}
+
+		// No need to read the free records at the end of the chunk.
+		recordsInChunk = getUsedRecordsSpan(recordIndex, recordsInChunk);
+		DWORD chunkLength = (DWORD)recordsInChunk * recordSize;
+		ULONGLONG diskOffset = (dataRun->StartLCN + (vcn - dataRun->StartVCN)) * clusterSize + offset % clusterSize;
+		chunk.Data = m_volume.mapBytes(diskOffset, chunkLength);
+		chunk.IsMapped = chunk.Data != nullptr;
+		if (!chunk.IsMapped) {
+			chunk.Data = getStorage(chunk, chunkLength);
+			NTFSLIB_ASSERT(
+				m_volume.readBytes(chunk.Data, diskOffset, chunkLength) == chunkLength,
+				BadSizeError
+			);
+		}
+		chunk.NumOfRecords = recordsInChunk;
+		return findUsedRecord(recordIndex + recordsInChunk, lastRecord);
+	}
+	return lastRecord;
+}
+
+bool MFTScanner::visitChunk(MFTChunk& chunk, const MFTScanVisitor& visitor) const {
+	WORD recordSize = m_volume.getMFTRecordSize();
+	// Mapped memory is read-only, its records are copied once and fixed up in a private copy, which the visited
+	// records refer (as they refer the chunk's data otherwise), only records outliving the visit copy it again.
+	Buffer recordCopy(chunk.IsMapped ? recordSize : 0);
+	for (ULONGLONG i = 0; i < chunk.NumOfRecords; ++i) {
+		if (m_cancellation != nullptr && m_cancellation->isCancelled()) {
+			TRACE(DEBUG_LEVEL::VERBOSE, "Scan cancelled at record %#llx", chunk.FirstRecord + i);
+			return false;
+		}
+		ULONGLONG recordIndex = chunk.FirstRecord + i;
+		if (!isRecordInUse(recordIndex)) {
+			continue;
+		}
+		PBYTE record = chunk.Data + i * recordSize;
+		if (chunk.IsMapped) {
+			NTFSUtils::copyMappedMemory(recordCopy.data(), record, recordSize);
+			record = recordCopy.data();
+		}
+		if (!visitRecord(visitor, recordIndex, (PMFT_RECORD)record)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+ULONGLONG MFTScanner::getNumOfRecords() const {
+	return m_mftExtents.getDataSize() / m_volume.getMFTRecordSize();
+}
+
+MFTRecordRanges MFTScanner::getRecordRanges() const {
+	WORD recordSize = m_volume.getMFTRecordSize();
+	WORD clusterSize = m_volume.getClusterSize();
+	ULONGLONG numOfRecords = getNumOfRecords();
+	MFTRecordRanges ranges;
+	ULONGLONG recordIndex = 0;
+	for (const DataRun& dataRun : m_mftExtents.getDataRuns()) {
+		// A record crossing into the next data run belongs to the range it starts in.
+		ULONGLONG dataRunEnd = (dataRun.StartVCN + dataRun.NumOfClusters) * clusterSize;
+		ULONGLONG dataRunLastRecord = min<ULONGLONG>((dataRunEnd + recordSize - 1) / recordSize, numOfRecords);
+		while (recordIndex < dataRunLastRecord) {
+			ULONGLONG rangeEnd = min<ULONGLONG>(recordIndex + m_recordsPerChunk, dataRunLastRecord);
+			ranges.push_back({ recordIndex, rangeEnd });
+			recordIndex = rangeEnd;
+		}
+	}
+	return ranges;
+}
+
+void MFTScanner::readMFTRange(PBYTE buffer, ULONGLONG offset, DWORD length) {
+	WORD clusterSize = m_volume.getClusterSize();
+	while (length > 0) {
+		ULONGLONG vcn = offset / clusterSize;
+		const DataRun* dataRun = m_mftExtents.findDataRun(vcn);
+		NTFSLIB_ASSERT(
+			dataRun != nullptr,
+			OutOfBoundsError
+		);
+		ULONGLONG dataRunEnd = (dataRun->StartVCN + dataRun->NumOfClusters) * clusterSize;
+		DWORD bytesToRead = (DWORD)min<ULONGLONG>(length, dataRunEnd - offset);
+		if (dataRun->IsSparse) {
+			memset(buffer, 0, bytesToRead);
+		}
+		else {
+			ULONGLONG diskOffset = (dataRun->StartLCN + (vcn - dataRun->StartVCN)) * clusterSize + offset % clusterSize;
+			NTFSLIB_ASSERT(
+				m_volume.readBytes(buffer, diskOffset, bytesToRead) == bytesToRead,
+				BadSizeError
+			);
+		}
+		buffer += bytesToRead;
+		offset += bytesToRead;
+		length -= bytesToRead;
+	}
+}
+
+PBYTE MFTScanner::getStorage(MFTChunk& chunk, DWORD length) {
+	if (chunk.Storage == nullptr || chunk.Storage->size() < length) {
+		// Released first, so the pool may hand the same buffer out again.
+		chunk.Storage.reset();
+		chunk.Storage.reset(new PooledBuffer(m_volume.getBufferPool(), length));
+	}
+	return chunk.Storage->data();
+}
+
+bool MFTScanner::visitRecord(const MFTScanVisitor& visitor, ULONGLONG recordIndex, PMFT_RECORD record) const {
+	// Records that were never used are not even initialized.
+	if (!CMP_STR((PCHAR)&record->RecordHeader.Magic, StringResource::fileRecordSignature)) {
+		return true;
+	}
+	if (!NTFSUtils::tryUSARecordFixup(&record->RecordHeader, m_volume.getSectorSize())) {
+		// Torn record, we should just skip it.
+		TRACE(DEBUG_LEVEL::VERBOSE, "Bad update sequence array in record %#llx", recordIndex);
+		return true;
+	}
+	return visitor(recordIndex, record);
+}
+
+bool MFTScanner::isRecordInUse(ULONGLONG recordIndex) const {
+	return m_recordsBitmap == nullptr || BitmapAttribute::isBitSet(*m_recordsBitmap, recordIndex);
+}
+
+ULONGLONG MFTScanner::findUsedRecord(ULONGLONG recordIndex, ULONGLONG lastRecord) const {
+	if (m_recordsBitmap == nullptr) {
+		return recordIndex;
+	}
+	ULONGLONG bitmapRecords = (ULONGLONG)m_recordsBitmap->size() * 8;
+	while (recordIndex < lastRecord && recordIndex < bitmapRecords) {
+		// Skipping 8 free records at once.
+		if (recordIndex % 8 == 0 && (*m_recordsBitmap)[(size_t)(recordIndex / 8)] == 0) {
+			recordIndex += 8;
+			continue;
+		}
+		if (isRecordInUse(recordIndex)) {
+			return recordIndex;
+		}
+		recordIndex++;
+	}
+	// Records beyond the bitmap are not in use.
+	return lastRecord;
+}
+
+ULONGLONG MFTScanner::getUsedRecordsSpan(ULONGLONG recordIndex, ULONGLONG maxRecords) const {
+	if (m_recordsBitmap == nullptr) {
+		return maxRecords;
+	}
+	ULONGLONG maxFreeRecords = max<ULONGLONG>(MFT_SCAN_MIN_SKIP_SIZE / m_volume.getMFTRecordSize(), 1);
+	ULONGLONG lastUsedRecord = recordIndex;
+	ULONGLONG spanEnd = recordIndex + maxRecords;
+	for (ULONGLONG i = recordIndex + 1; i < spanEnd && i - lastUsedRecord <= maxFreeRecords; ++i) {
+		if (isRecordInUse(i)) {
+			lastUsedRecord = i;
+		}
+	}
+	return lastUsedRecord - recordIndex + 1;
+}
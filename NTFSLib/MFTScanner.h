@@ -0,0 +1,221 @@
+#ifndef _NTFSLIB_MFT_SCANNER_H
+#define _NTFSLIB_MFT_SCANNER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "NTFSVolume.h"
+#include "Misc\CancellationToken.h"
+#include "Misc\Defs.h"
+#include "Misc\ExtentMap.h"
+#include "Types\NTFSTypes.h"
+
+using std::function;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+
+// Default size of a single MFT read while scanning.
+#define MFT_SCAN_DEFAULT_CHUNK_SIZE (4 * 1024 * 1024)
+// Maximal size of a single MFT read while scanning.
+#define MFT_SCAN_MAX_CHUNK_SIZE (16 * 1024 * 1024)
+// Scan up to the last record of the MFT.
+#define MFT_SCAN_ALL_RECORDS ((ULONGLONG)-1)
+// Free records spanning at least this many bytes are not read, even in the middle of a chunk.
+#define MFT_SCAN_MIN_SKIP_SIZE (256 * 1024)
+// Default number of records held back while waiting for their base or extension records (see: MFTRecordJoiner).
+#define MFT_SCAN_DEFAULT_MAX_PENDING_JOINS 4096
+
+/**
+ * Controls how the MFT is scanned.
+ */
+struct MFTScanOptions {
+	MFTScanOptions() :
+		ChunkSize(MFT_SCAN_DEFAULT_CHUNK_SIZE),
+		IncludeUnusedRecords(false),
+		NumOfThreads(1),
+		OrderedOutput(true),
+		MaxPendingJoins(MFT_SCAN_DEFAULT_MAX_PENDING_JOINS) {
+		// Left blank.
+	}
+
+	// Size in bytes of a single MFT read.
+	DWORD ChunkSize;
+
+	// Also visit records which the MFT's bitmap marks as free (e.g. to recover deleted files).
+	bool IncludeUnusedRecords;
+
+	// Number of threads parsing records, 0 uses all the hardware threads.
+	// A single-threaded NTFSParser.scanMFTRecords parses on the calling thread.
+	DWORD NumOfThreads;
+
+	// Hand the output of a multi-threaded scan over in record order, rather than as soon as it is ready
+	// (see: NTFSParser.processMFTRecords). Base records joined with their extension records keep their place too.
+	bool OrderedOutput;
+
+	// Maximal number of records held back while joining base records with their extension records.
+	// Base records which wait too long read their missing extension records from the disk.
+	DWORD MaxPendingJoins;
+
+	// Stops the scan once cancelled, as if the visitor (or sink) stopped it. nullptr if the scan can not be cancelled.
+	shared_ptr<const CancellationToken> Cancellation;
+};
+
+/**
+ * Records [FirstRecord, LastRecord) of the MFT.
+ */
+typedef struct {
+	ULONGLONG FirstRecord;
+	ULONGLONG LastRecord;
+} MFTRecordRange;
+typedef vector<MFTRecordRange> MFTRecordRanges;
+
+/**
+ * Records read at once from the MFT (see: MFTScanner.readChunk).
+ */
+struct MFTChunk {
+	MFTChunk() :
+		FirstRecord(0),
+		NumOfRecords(0),
+		Data(nullptr),
+		IsMapped(false) {
+		// Left blank.
+	}
+
+	// Index of the first record in the chunk.
+	ULONGLONG FirstRecord;
+
+	// Number of records in the chunk, 0 if there was nothing left to read.
+	ULONGLONG NumOfRecords;
+
+	// The records, pointing either into the volume's mapped memory or into Storage.
+	PBYTE Data;
+
+	// Is Data mapped memory? Mapped records are copied before they are fixed up (see: NTFSUtils.USARecordFixup).
+	bool IsMapped;
+
+	// Read buffer, taken from the volume's pool of aligned buffers (see: NTFSVolume.getBufferPool) and reused
+	// for every chunk read into this one. The chunk must not outlive the volume.
+	unique_ptr<PooledBuffer> Storage;
+};
+
+/**
+ * Invoked for every valid record found during a scan, with the record's index and its fixed-up data.
+ * <record> points into the scanner's read buffer (or a copy of the volume's mapped memory), and is only valid during the call.
+ * Return false to stop the scan.
+ */
+typedef function<bool(ULONGLONG recordIndex, PMFT_RECORD record)> MFTScanVisitor;
+
+/**
+ * Walks the MFT sequentially, following its data runs, in large chunks.
+ * Every chunk is read with a single read (or mapped, if the volume supports it), and the records
+ * in it are verified and fixed up in place (mapped ones in a copy), then handed to a visitor.
+ * Records with a bad signature or a bad update sequence array are skipped, and so are free records
+ * once the MFT's bitmap is set (see: setRecordsBitmap).
+ */
+class MFTScanner {
+public:
+	/**
+	 * Creates a scanner for the MFT described by <mftExtents>, reading up to <chunkSize> bytes at a time.
+	 */
+	MFTScanner(NTFSVolume& volume, const ExtentMap& mftExtents, DWORD chunkSize = MFT_SCAN_DEFAULT_CHUNK_SIZE);
+
+	/**
+	 * Sets the MFT's bitmap (see: BitmapAttribute), so free records are not read nor visited.
+	 * nullptr visits all the records. The bitmap may be shared between scanners.
+	 */
+	void setRecordsBitmap(shared_ptr<const Buffer> recordsBitmap);
+
+	/**
+	 * Sets the token which stops the scan once cancelled, checked before every record (see: MFTScanOptions.Cancellation).
+	 * nullptr scans until the end.
+	 */
+	void setCancellation(shared_ptr<const CancellationToken> cancellation);
+
+	/**
+	 * Scans the records in [<firstRecord>, <lastRecord>), calling <visitor> for each valid record.
+	 * Returns false if the visitor stopped the scan or it was cancelled, true otherwise.
+	 */
+	bool scan(const MFTScanVisitor& visitor, ULONGLONG firstRecord = 0, ULONGLONG lastRecord = MFT_SCAN_ALL_RECORDS);
+
+	/**
+	 * Reads (or maps) the next chunk of used records in [<recordIndex>, <lastRecord>) into <chunk>.
+	 * Returns the record to continue reading from, chunk.NumOfRecords is 0 if no record is left.
+	 * Together with visitChunk, it lets reading and parsing run on different threads.
+	 */
+	ULONGLONG readChunk(ULONGLONG recordIndex, ULONGLONG lastRecord, MFTChunk& chunk);
+
+	/**
+	 * Verifies, fixes up and visits the used records of <chunk>.
+	 * Returns false if the visitor stopped or the scan was cancelled, true otherwise.
+	 */
+	bool visitChunk(MFTChunk& chunk, const MFTScanVisitor& visitor) const;
+
+	/**
+	 * Returns the total number of records in the MFT (used or not).
+	 */
+	ULONGLONG getNumOfRecords() const;
+
+	/**
+	 * Splits the MFT into ranges of at most a chunk each, which never cross data runs
+	 * (except for records crossing them), so every range is scanned with a single read.
+	 * Meant for spreading a scan over several scanners (see: WorkStealingPool).
+	 */
+	MFTRecordRanges getRecordRanges() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(MFTScanner);
+
+	/**
+	 * Reads <length> bytes of the MFT from <offset> into <buffer>, following as many data runs as needed.
+	 */
+	void readMFTRange(PBYTE buffer, ULONGLONG offset, DWORD length);
+
+	/**
+	 * Returns the storage of <chunk>, grown to at least <length> bytes if needed.
+	 */
+	PBYTE getStorage(MFTChunk& chunk, DWORD length);
+
+	/**
+	 * Verifies and fixes up a single record, and hands it to <visitor> if valid.
+	 * Returns the visitor's verdict (true for skipped records).
+	 */
+	bool visitRecord(const MFTScanVisitor& visitor, ULONGLONG recordIndex, PMFT_RECORD record) const;
+
+	/**
+	 * Returns true if <recordIndex> should be visited according to the records bitmap.
+	 */
+	bool isRecordInUse(ULONGLONG recordIndex) const;
+
+	/**
+	 * Returns the first record in use in [<recordIndex>, <lastRecord>), or <lastRecord> if there is none.
+	 */
+	ULONGLONG findUsedRecord(ULONGLONG recordIndex, ULONGLONG lastRecord) const;
+
+	/**
+	 * Returns how many of the (at most <maxRecords>) records starting at the used <recordIndex> are worth reading together.
+	 * The span ends with its last used record, or before a long run of free records.
+	 */
+	ULONGLONG getUsedRecordsSpan(ULONGLONG recordIndex, ULONGLONG maxRecords) const;
+
+	// Related NTFS volume.
+	NTFSVolume& m_volume;
+
+	// MFT's data runs.
+	const ExtentMap& m_mftExtents;
+
+	// Maximal number of records read at once.
+	DWORD m_recordsPerChunk;
+
+	// Chunk read by scan, its buffer is reused for all the chunks.
+	MFTChunk m_chunk;
+
+	// A bit per record, set if the record is in use. nullptr if all the records should be visited.
+	shared_ptr<const Buffer> m_recordsBitmap;
+
+	// Stops the scan once cancelled, nullptr if none.
+	shared_ptr<const CancellationToken> m_cancellation;
+};
+
+#endif // _NTFSLIB_MFT_SCANNER_H
@@ -0,0 +1,79 @@
+#include "AlignedBufferPool.h"
+#include "NTFSLibError.h"
+
+using std::lock_guard;
+
+AlignedBufferPool::AlignedBufferPool(ULONGLONG maxFreeBytes /* = ALIGNED_BUFFER_POOL_DEFAULT_MAX_FREE_BYTES */) :
+	m_maxFreeBytes(maxFreeBytes),
+	m_freeBytes(0) {
+	// Left blank.
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+	for (const auto& sizeBuffers : m_freeBuffers) {
+		for (PBYTE buffer : sizeBuffers.second) {
+			VirtualFree(buffer, 0, MEM_RELEASE);
+		}
+	}
+}
+
+PBYTE AlignedBufferPool::acquire(DWORD size, DWORD& bufferSize) {
+	NTFSLIB_ASSERT(
+		size <= 0x80000000,
+		BadSizeError
+	);
+	bufferSize = ALIGNED_BUFFER_POOL_MIN_SIZE;
+	while (bufferSize < size) {
+		bufferSize *= 2;
+	}
+	{
+		lock_guard<mutex> lock(m_lock);
+		auto sizeBuffers = m_freeBuffers.find(bufferSize);
+		if (sizeBuffers != m_freeBuffers.end() && !sizeBuffers->second.empty()) {
+			PBYTE buffer = sizeBuffers->second.back();
+			sizeBuffers->second.pop_back();
+			m_freeBytes -= bufferSize;
+			return buffer;
+		}
+	}
+	// VirtualAlloc hands out whole pages.
+	PBYTE buffer = (PBYTE)VirtualAlloc(NULL, bufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	WIN32_ASSERT(buffer != NULL);
+	return buffer;
+}
+
+void AlignedBufferPool::release(PBYTE buffer, DWORD bufferSize) {
+	{
+		lock_guard<mutex> lock(m_lock);
+		if (m_freeBytes + bufferSize <= m_maxFreeBytes) {
+			m_freeBuffers[bufferSize].push_back(buffer);
+			m_freeBytes += bufferSize;
+			return;
+		}
+	}
+	VirtualFree(buffer, 0, MEM_RELEASE);
+}
+
+ULONGLONG AlignedBufferPool::getFreeBytes() const {
+	lock_guard<mutex> lock(m_lock);
+	return m_freeBytes;
+}
+
+PooledBuffer::PooledBuffer(AlignedBufferPool& pool, DWORD size) :
+	m_pool(pool),
+	m_size(0),
+	m_data(pool.acquire(size, m_size)) {
+	// Left blank.
+}
+
+PooledBuffer::~PooledBuffer() {
+	m_pool.release(m_data, m_size);
+}
+
+PBYTE PooledBuffer::data() const {
+	return m_data;
+}
+
+DWORD PooledBuffer::size() const {
+	return m_size;
+}
@@ -0,0 +1,102 @@
+#ifndef _NTFSLIB_ALIGNED_BUFFER_POOL_H
+#define _NTFSLIB_ALIGNED_BUFFER_POOL_H
+
+#include <map>
+#include <mutex>
+
+#include "Defs.h"
+
+using std::map;
+using std::mutex;
+
+// Smallest buffer handed out by the pool (smaller requests get one of this size).
+#define ALIGNED_BUFFER_POOL_MIN_SIZE (64 * 1024)
+// Default number of bytes the pool keeps in released buffers.
+#define ALIGNED_BUFFER_POOL_DEFAULT_MAX_FREE_BYTES (32 * 1024 * 1024)
+
+/**
+ * Pool of page aligned buffers (aligned enough for any sector size), as needed by unbuffered I/O.
+ * Buffers come in power of two sizes, and released buffers are kept for the next requests
+ * (up to a byte budget), so hot read paths do not allocate from the system.
+ * Thread-safe.
+ */
+class AlignedBufferPool {
+public:
+	/**
+	 * Creates a pool keeping up to <maxFreeBytes> bytes of released buffers.
+	 */
+	explicit AlignedBufferPool(ULONGLONG maxFreeBytes = ALIGNED_BUFFER_POOL_DEFAULT_MAX_FREE_BYTES);
+
+	/**
+	 * Frees the released buffers. All the acquired buffers must have been released.
+	 */
+	~AlignedBufferPool();
+
+	/**
+	 * Returns a buffer of at least <size> bytes, and sets <bufferSize> to its actual size.
+	 * The buffer must be given back with release.
+	 */
+	PBYTE acquire(DWORD size, DWORD& bufferSize);
+
+	/**
+	 * Gives back <buffer> of <bufferSize> bytes (as set by acquire).
+	 */
+	void release(PBYTE buffer, DWORD bufferSize);
+
+	/**
+	 * Returns the number of bytes kept in released buffers.
+	 */
+	ULONGLONG getFreeBytes() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(AlignedBufferPool);
+
+	// Maximal number of bytes kept in released buffers.
+	const ULONGLONG m_maxFreeBytes;
+
+	// Guards the released buffers.
+	mutable mutex m_lock;
+
+	// Released buffers, by size.
+	map<DWORD, vector<PBYTE>> m_freeBuffers;
+
+	// Number of bytes kept in released buffers.
+	ULONGLONG m_freeBytes;
+};
+
+/**
+ * A buffer acquired from an AlignedBufferPool, released once out of scope.
+ */
+class PooledBuffer {
+public:
+	/**
+	 * Acquires a buffer of at least <size> bytes from <pool>.
+	 */
+	PooledBuffer(AlignedBufferPool& pool, DWORD size);
+
+	~PooledBuffer();
+
+	/**
+	 * Returns the buffer.
+	 */
+	PBYTE data() const;
+
+	/**
+	 * Returns the buffer's actual size.
+	 */
+	DWORD size() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(PooledBuffer);
+
+	// The pool the buffer is released to.
+	AlignedBufferPool& m_pool;
+
+	// Buffer's actual size.
+	DWORD m_size;
+
+	// The buffer.
+	PBYTE m_data;
+};
+
+#endif // _NTFSLIB_ALIGNED_BUFFER_POOL_H
@@ -0,0 +1,98 @@
+#ifndef _NTFSLIB_BOUNDED_QUEUE_H
+#define _NTFSLIB_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <memory>
+
+#include "Defs.h"
+
+using std::atomic;
+using std::unique_ptr;
+
+// Number of failed attempts after which a blocked queue operation starts sleeping instead of yielding.
+#define BOUNDED_QUEUE_SPINS_BEFORE_SLEEP 64
+// Time (in microseconds) a blocked queue operation sleeps between attempts.
+#define BOUNDED_QUEUE_SLEEP_MICROSECONDS 100
+
+/**
+ * Fixed capacity, lock-free queue for any number of producers and consumers (Vyukov's MPMC ring).
+ * Every cell carries a sequence number, telling producers and consumers whose turn it is,
+ * so a push or a pop is a single compare-and-swap on the shared position.
+ * Blocking operations wait for room (back-pressure) or for items, until the queue is closed.
+ */
+template <class T>
+class BoundedQueue {
+public:
+	/**
+	 * Creates a queue of (at least) <capacity> items, rounded up to a power of 2.
+	 */
+	explicit BoundedQueue(size_t capacity);
+
+	/**
+	 * Pushes <item> if there is room for it, returns false otherwise.
+	 */
+	bool tryPush(const T& item);
+
+	/**
+	 * Pops the oldest item into <item> if there is one, returns false otherwise.
+	 */
+	bool tryPop(T& item);
+
+	/**
+	 * Pushes <item>, waiting for room if the queue is full.
+	 * Returns false (without pushing) if the queue was closed.
+	 */
+	bool push(const T& item);
+
+	/**
+	 * Pops the oldest item into <item>, waiting for one if the queue is empty.
+	 * Returns false once the queue was closed and emptied.
+	 */
+	bool pop(T& item);
+
+	/**
+	 * Closes the queue: pushes fail from now on, pops fail once the remaining items are popped.
+	 */
+	void close();
+
+	/**
+	 * Returns true once the queue was closed.
+	 */
+	bool isClosed() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(BoundedQueue);
+
+	// A single slot of the ring.
+	struct Cell {
+		atomic<size_t> Sequence;
+		T Item;
+	};
+
+	/**
+	 * Returns the smallest power of 2 (at least 2) which is not below <capacity>.
+	 */
+	static size_t roundUpCapacity(size_t capacity);
+
+	/**
+	 * Waits a little before attempt number <attempt> of a blocked operation.
+	 */
+	static void backOff(DWORD attempt);
+
+	// Capacity - 1 (capacity is a power of 2).
+	const size_t m_mask;
+
+	// The ring.
+	unique_ptr<Cell[]> m_cells;
+
+	// Next position to push to / pop from. Kept on separate cache lines, so producers and consumers do not contend.
+	alignas(64) atomic<size_t> m_pushPosition;
+	alignas(64) atomic<size_t> m_popPosition;
+
+	// Set once the queue was closed.
+	atomic<bool> m_closed;
+};
+
+#include "BoundedQueue.inl"
+
+#endif // _NTFSLIB_BOUNDED_QUEUE_H
@@ -0,0 +1,120 @@
+#include <chrono>
+#include <thread>
+
+template <class T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) :
+	m_mask(roundUpCapacity(capacity) - 1),
+	m_cells(new Cell[m_mask + 1]),
+	m_pushPosition(0),
+	m_popPosition(0),
+	m_closed(false) {
+	for (size_t i = 0; i <= m_mask; ++i) {
+		m_cells[i].Sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+template <class T>
+bool BoundedQueue<T>::tryPush(const T& item) {
+	size_t position = m_pushPosition.load(std::memory_order_relaxed);
+	while (true) {
+		Cell& cell = m_cells[position & m_mask];
+		size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+		ptrdiff_t turn = (ptrdiff_t)sequence - (ptrdiff_t)position;
+		if (turn == 0) {
+			// The cell is free, claiming it.
+			if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				cell.Item = item;
+				cell.Sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (turn < 0) {
+			// The cell was not popped yet, the queue is full.
+			return false;
+		}
+		else {
+			// Another producer got here first.
+			position = m_pushPosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template <class T>
+bool BoundedQueue<T>::tryPop(T& item) {
+	size_t position = m_popPosition.load(std::memory_order_relaxed);
+	while (true) {
+		Cell& cell = m_cells[position & m_mask];
+		size_t sequence = cell.Sequence.load(std::memory_order_acquire);
+		ptrdiff_t turn = (ptrdiff_t)sequence - (ptrdiff_t)(position + 1);
+		if (turn == 0) {
+			// The cell was pushed, claiming it.
+			if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				item = std::move(cell.Item);
+				cell.Sequence.store(position + m_mask + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (turn < 0) {
+			// The cell was not pushed yet, the queue is empty.
+			return false;
+		}
+		else {
+			// Another consumer got here first.
+			position = m_popPosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template <class T>
+bool BoundedQueue<T>::push(const T& item) {
+	for (DWORD attempt = 0; !m_closed; ++attempt) {
+		if (tryPush(item)) {
+			return true;
+		}
+		backOff(attempt);
+	}
+	return false;
+}
+
+template <class T>
+bool BoundedQueue<T>::pop(T& item) {
+	for (DWORD attempt = 0; ; ++attempt) {
+		if (tryPop(item)) {
+			return true;
+		}
+		if (m_closed) {
+			// Items pushed before the queue was closed must still be popped.
+			return tryPop(item);
+		}
+		backOff(attempt);
+	}
+}
+
+template <class T>
+void BoundedQueue<T>::close() {
+	m_closed = true;
+}
+
+template <class T>
+bool BoundedQueue<T>::isClosed() const {
+	return m_closed;
+}
+
+template <class T>
+size_t BoundedQueue<T>::roundUpCapacity(size_t capacity) {
+	size_t roundedCapacity = 2;
+	while (roundedCapacity < capacity) {
+		roundedCapacity <<= 1;
+	}
+	return roundedCapacity;
+}
+
+template <class T>
+void BoundedQueue<T>::backOff(DWORD attempt) {
+	if (attempt < BOUNDED_QUEUE_SPINS_BEFORE_SLEEP) {
+		std::this_thread::yield();
+	}
+	else {
+		std::this_thread::sleep_for(std::chrono::microseconds(BOUNDED_QUEUE_SLEEP_MICROSECONDS));
+	}
+}
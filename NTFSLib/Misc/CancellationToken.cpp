@@ -0,0 +1,33 @@
+#include "CancellationToken.h"
+#include "IOStatistics.h"
+
+CancellationToken::CancellationToken(shared_ptr<const CancellationToken> parent /* = nullptr */) :
+	m_parent(parent),
+	m_cancelled(false),
+	m_deadline(CANCELLATION_NO_DEADLINE) {
+	// Left blank.
+}
+
+void CancellationToken::cancel() {
+	m_cancelled = true;
+}
+
+void CancellationToken::cancelAfter(DWORD milliseconds) {
+	ULONGLONG deadline = IOStatistics::getTimestamp() + (ULONGLONG)milliseconds * 1000;
+	ULONGLONG currentDeadline = m_deadline;
+	while ((currentDeadline == CANCELLATION_NO_DEADLINE || deadline < currentDeadline) &&
+		!m_deadline.compare_exchange_weak(currentDeadline, deadline)) {
+		// Retrying with the deadline another thread has just set.
+	}
+}
+
+bool CancellationToken::isCancelled() const {
+	if (m_cancelled.load(std::memory_order_relaxed)) {
+		return true;
+	}
+	ULONGLONG deadline = m_deadline.load(std::memory_order_relaxed);
+	if (deadline != CANCELLATION_NO_DEADLINE && IOStatistics::getTimestamp() >= deadline) {
+		return true;
+	}
+	return m_parent != nullptr && m_parent->isCancelled();
+}
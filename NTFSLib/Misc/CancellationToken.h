@@ -0,0 +1,57 @@
+#ifndef _NTFSLIB_CANCELLATION_TOKEN_H
+#define _NTFSLIB_CANCELLATION_TOKEN_H
+
+#include <atomic>
+#include <memory>
+
+#include "Defs.h"
+
+using std::atomic;
+using std::shared_ptr;
+
+// No deadline was set.
+#define CANCELLATION_NO_DEADLINE 0
+
+/**
+ * Lets a single operation (e.g. an MFT scan) be cancelled from any thread, or once a deadline passes.
+ * Checking it is a load of an atomic flag (and a clock read if a deadline was set), cheap enough
+ * for every record of a scan.
+ * A token is also cancelled once its parent is, so an operation can be cancelled both by its caller and
+ * by its owner (see: NTFSParser.stopFullDir).
+ */
+class CancellationToken {
+public:
+	/**
+	 * Creates a token which is cancelled once it, or <parent> (if any), is cancelled.
+	 */
+	CancellationToken(shared_ptr<const CancellationToken> parent = nullptr);
+
+	/**
+	 * Cancels the token (you can call this from any thread).
+	 */
+	void cancel();
+
+	/**
+	 * Cancels the token <milliseconds> from now, unless an earlier deadline was already set.
+	 */
+	void cancelAfter(DWORD milliseconds);
+
+	/**
+	 * Returns true once the token, or its parent, was cancelled.
+	 */
+	bool isCancelled() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(CancellationToken);
+
+	// Token this one is cancelled with, nullptr if none.
+	const shared_ptr<const CancellationToken> m_parent;
+
+	// Set once cancel was called.
+	atomic<bool> m_cancelled;
+
+	// When the token is cancelled (see: IOStatistics.getTimestamp), CANCELLATION_NO_DEADLINE if never.
+	atomic<ULONGLONG> m_deadline;
+};
+
+#endif // _NTFSLIB_CANCELLATION_TOKEN_H
@@ -0,0 +1,105 @@
+#include "ClusterCache.h"
+#include "NTFSLibError.h"
+
+using std::lock_guard;
+
+ClusterCache::ClusterCache(WORD clusterSize, ULONGLONG byteBudget, DWORD numOfShards /* = CLUSTER_CACHE_DEFAULT_SHARDS */) :
+	m_clusterSize(clusterSize),
+	m_byteBudget(byteBudget),
+	m_hits(0),
+	m_misses(0),
+	m_evictions(0),
+	m_cachedClusters(0) {
+	NTFSLIB_ASSERT(
+		m_clusterSize > 0 && numOfShards > 0,
+		BadSizeError
+	);
+	// Every shard gets an equal part of the budget, and can hold at least one cluster.
+	ULONGLONG clustersPerShard = m_byteBudget / m_clusterSize / numOfShards;
+	for (DWORD i = 0; i < numOfShards; ++i) {
+		unique_ptr<Shard> shard(new Shard());
+		shard->Capacity = (DWORD)(clustersPerShard > 0 ? clustersPerShard : 1);
+		shard->Hand = 0;
+		shard->Slots.reserve(shard->Capacity);
+		m_shards.push_back(std::move(shard));
+	}
+}
+
+bool ClusterCache::lookup(ULONGLONG lcn, PVOID buffer) {
+	Shard& shard = getShard(lcn);
+	{
+		lock_guard<mutex> lock(shard.Lock);
+		auto slotIndex = shard.Index.find(lcn);
+		if (slotIndex != shard.Index.end()) {
+			Slot& slot = shard.Slots[slotIndex->second];
+			slot.Referenced = true;
+			memcpy(buffer, slot.Data.data(), m_clusterSize);
+			m_hits++;
+			return true;
+		}
+	}
+	m_misses++;
+	return false;
+}
+
+void ClusterCache::insert(ULONGLONG lcn, const PVOID data) {
+	Shard& shard = getShard(lcn);
+	lock_guard<mutex> lock(shard.Lock);
+	auto slotIndex = shard.Index.find(lcn);
+	if (slotIndex != shard.Index.end()) {
+		// Someone else inserted it in the meanwhile, just refresh it.
+		Slot& slot = shard.Slots[slotIndex->second];
+		memcpy(slot.Data.data(), data, m_clusterSize);
+		slot.Referenced = true;
+		return;
+	}
+
+	DWORD victim;
+	if (shard.Slots.size() < shard.Capacity) {
+		victim = (DWORD)shard.Slots.size();
+		shard.Slots.push_back({ lcn, false, Buffer(m_clusterSize) });
+		m_cachedClusters++;
+	}
+	else {
+		// CLOCK: Sweep the hand, giving every recently referenced cluster a second chance.
+		while (shard.Slots[shard.Hand].Referenced) {
+			shard.Slots[shard.Hand].Referenced = false;
+			shard.Hand = (shard.Hand + 1) % shard.Capacity;
+		}
+		victim = shard.Hand;
+		shard.Hand = (shard.Hand + 1) % shard.Capacity;
+		shard.Index.erase(shard.Slots[victim].LCN);
+		shard.Slots[victim].LCN = lcn;
+		m_evictions++;
+	}
+	// New clusters start unreferenced, so a single pass over them does not push out the hot ones.
+	shard.Slots[victim].Referenced = false;
+	memcpy(shard.Slots[victim].Data.data(), data, m_clusterSize);
+	shard.Index[lcn] = victim;
+}
+
+void ClusterCache::clear() {
+	for (unique_ptr<Shard>& shard : m_shards) {
+		lock_guard<mutex> lock(shard->Lock);
+		m_cachedClusters -= shard->Slots.size();
+		shard->Index.clear();
+		shard->Slots.clear();
+		shard->Hand = 0;
+	}
+}
+
+ClusterCacheStatistics ClusterCache::getStatistics() const {
+	return {
+		m_hits.load(),
+		m_misses.load(),
+		m_evictions.load(),
+		m_cachedClusters.load() * m_clusterSize,
+		m_byteBudget
+	};
+}
+
+ClusterCache::Shard& ClusterCache::getShard(ULONGLONG lcn) {
+	// Fibonacci hashing, so neighboring clusters are spread over different shards.
+	ULONGLONG hash = lcn * 0x9e3779b97f4a7c15ULL;
+	return *m_shards[(size_t)((hash >> 32) % m_shards.size())];
+}
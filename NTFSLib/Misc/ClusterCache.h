@@ -0,0 +1,109 @@
+#ifndef _NTFSLIB_CLUSTER_CACHE_H
+#define _NTFSLIB_CLUSTER_CACHE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Defs.h"
+
+using std::atomic;
+using std::mutex;
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+// Default byte budget of a volume's cluster cache.
+#define CLUSTER_CACHE_DEFAULT_SIZE (16 * 1024 * 1024)
+// Default number of shards (each one has its own lock).
+#define CLUSTER_CACHE_DEFAULT_SHARDS 16
+// Reads longer than this (in clusters) bypass the cache, so bulk reads do not flush the hot clusters.
+#define CLUSTER_CACHE_MAX_READ_CLUSTERS 16
+
+/**
+ * Cluster cache counters.
+ */
+typedef struct {
+	ULONGLONG Hits;
+	ULONGLONG Misses;
+	ULONGLONG Evictions;
+	ULONGLONG CachedBytes;
+	ULONGLONG BudgetBytes;
+} ClusterCacheStatistics;
+
+/**
+ * Bounded cache of whole clusters, keyed by LCN.
+ * The cache is split into shards, each guarded by its own lock, so concurrent readers
+ * rarely contend. Every shard evicts with the CLOCK (second chance) algorithm.
+ */
+class ClusterCache {
+public:
+	/**
+	 * Creates a cache of at most <byteBudget> bytes worth of <clusterSize> bytes clusters.
+	 */
+	ClusterCache(WORD clusterSize, ULONGLONG byteBudget, DWORD numOfShards = CLUSTER_CACHE_DEFAULT_SHARDS);
+
+	/**
+	 * Copies cluster <lcn> into <buffer> (at least one cluster long) and returns true, if cached.
+	 * Returns false otherwise.
+	 */
+	bool lookup(ULONGLONG lcn, PVOID buffer);
+
+	/**
+	 * Caches one cluster worth of <data> as cluster <lcn>, evicting an older cluster if needed.
+	 */
+	void insert(ULONGLONG lcn, const PVOID data);
+
+	/**
+	 * Drops all the cached clusters (the counters are kept).
+	 */
+	void clear();
+
+	/**
+	 * Returns a snapshot of the cache counters.
+	 */
+	ClusterCacheStatistics getStatistics() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(ClusterCache);
+
+	// A single cached cluster.
+	struct Slot {
+		ULONGLONG LCN;
+		bool Referenced;
+		Buffer Data;
+	};
+
+	// Independent part of the cache, guarded by its own lock.
+	struct Shard {
+		mutex Lock;
+		unordered_map<ULONGLONG, DWORD> Index;
+		vector<Slot> Slots;
+		DWORD Capacity;
+		DWORD Hand;
+	};
+
+	/**
+	 * Returns the shard responsible for cluster <lcn>.
+	 */
+	Shard& getShard(ULONGLONG lcn);
+
+	// Size of a single cluster.
+	const WORD m_clusterSize;
+
+	// Maximal number of bytes the cache may hold.
+	const ULONGLONG m_byteBudget;
+
+	// Cache shards.
+	vector<unique_ptr<Shard>> m_shards;
+
+	// Counters.
+	atomic<ULONGLONG> m_hits;
+	atomic<ULONGLONG> m_misses;
+	atomic<ULONGLONG> m_evictions;
+	atomic<ULONGLONG> m_cachedClusters;
+};
+
+#endif // _NTFSLIB_CLUSTER_CACHE_H
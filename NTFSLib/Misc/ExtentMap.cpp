@@ -0,0 +1,64 @@
+#include <algorithm>
+
+#include "ExtentMap.h"
+#include "NTFSLibError.h"
+
+using std::sort;
+using std::upper_bound;
+
+ExtentMap::ExtentMap() :
+	m_clusterSize(0),
+	m_dataSize(0) {
+	// Left blank.
+}
+
+ExtentMap::ExtentMap(const DataRunList& dataRuns, WORD clusterSize, ULONGLONG dataSize) :
+	m_dataRuns(dataRuns),
+	m_clusterSize(clusterSize),
+	m_dataSize(dataSize) {
+	sort(m_dataRuns.begin(), m_dataRuns.end(), [](const DataRun& first, const DataRun& second) {
+		return first.StartVCN < second.StartVCN;
+	});
+}
+
+const DataRun* ExtentMap::findDataRun(ULONGLONG vcn) const {
+	// First data run starting after <vcn>, the one before it is our candidate.
+	auto nextDataRun = upper_bound(m_dataRuns.begin(), m_dataRuns.end(), vcn, [](ULONGLONG value, const DataRun& dataRun) {
+		return value < dataRun.StartVCN;
+	});
+	if (nextDataRun == m_dataRuns.begin()) {
+		return nullptr;
+	}
+	const DataRun& dataRun = *(nextDataRun - 1);
+	return vcn < dataRun.StartVCN + dataRun.NumOfClusters ? &dataRun : nullptr;
+}
+
+bool ExtentMap::translate(ULONGLONG offset, DWORD length, ULONGLONG& diskOffset) const {
+	NTFSLIB_ASSERT(
+		offset + length <= m_dataSize,
+		OutOfBoundsError
+	);
+	ULONGLONG vcn = offset / m_clusterSize;
+	const DataRun* dataRun = findDataRun(vcn);
+	if (dataRun == nullptr || dataRun->IsSparse) {
+		return false;
+	}
+	ULONGLONG lastVCN = (offset + length + m_clusterSize - 1) / m_clusterSize;
+	if (lastVCN > dataRun->StartVCN + dataRun->NumOfClusters) {
+		return false;
+	}
+	diskOffset = (dataRun->StartLCN + (vcn - dataRun->StartVCN)) * m_clusterSize + offset % m_clusterSize;
+	return true;
+}
+
+const DataRunList& ExtentMap::getDataRuns() const {
+	return m_dataRuns;
+}
+
+ULONGLONG ExtentMap::getDataSize() const {
+	return m_dataSize;
+}
+
+bool ExtentMap::isEmpty() const {
+	return m_dataRuns.empty();
+}
@@ -0,0 +1,59 @@
+#ifndef _NTFSLIB_EXTENT_MAP_H
+#define _NTFSLIB_EXTENT_MAP_H
+
+#include "Defs.h"
+#include "..\Types\NTFSTypes.h"
+
+/**
+ * Decoded data runs of a non-resident stream, sorted by VCN.
+ * Translates stream offsets to disk offsets with a binary search, instead of
+ * walking (or worse, decoding again) the whole data run list.
+ */
+class ExtentMap {
+public:
+	ExtentMap();
+
+	/**
+	 * Creates a map of a stream of <dataSize> bytes, stored in <dataRuns> of <clusterSize> bytes clusters.
+	 */
+	ExtentMap(const DataRunList& dataRuns, WORD clusterSize, ULONGLONG dataSize);
+
+	/**
+	 * Returns the data run containing <vcn>, or nullptr if no data run contains it.
+	 */
+	const DataRun* findDataRun(ULONGLONG vcn) const;
+
+	/**
+	 * Translates <length> bytes at stream offset <offset> to a disk offset, placed in <diskOffset>.
+	 * Returns false if the range is not contiguous on the disk (it crosses data runs or it is sparse).
+	 * Throws OutOfBoundsError if the range exceeds the stream.
+	 */
+	bool translate(ULONGLONG offset, DWORD length, ULONGLONG& diskOffset) const;
+
+	/**
+	 * Returns the data runs, sorted by VCN.
+	 */
+	const DataRunList& getDataRuns() const;
+
+	/**
+	 * Returns the size of the stream in bytes.
+	 */
+	ULONGLONG getDataSize() const;
+
+	/**
+	 * Returns true if the map holds no data runs.
+	 */
+	bool isEmpty() const;
+
+private:
+	// Data runs, sorted by VCN.
+	DataRunList m_dataRuns;
+
+	// Size of a single cluster.
+	WORD m_clusterSize;
+
+	// Size of the stream in bytes.
+	ULONGLONG m_dataSize;
+};
+
+#endif // _NTFSLIB_EXTENT_MAP_H
@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+
+#include "IOScheduler.h"
+
+using std::lock_guard;
+using std::min;
+using std::unique_lock;
+
+// Priority class of the operation the calling thread works for (see: IOPriorityScope).
+static thread_local IOOperationPriority currentPriority = { false, IO_PRIORITY::INTERACTIVE };
+
+IOScheduler::IOScheduler() :
+	m_isLimited(false),
+	m_interactiveRequests(0) {
+	for (size_t i = 0; i < IO_NUM_OF_SOURCES; ++i) {
+		IO_SOURCE source = (IO_SOURCE)i;
+		m_priorities[i] = source == IO_SOURCE::MFT_SCAN || source == IO_SOURCE::DATA_STREAM ?
+			IO_PRIORITY::BACKGROUND : IO_PRIORITY::INTERACTIVE;
+	}
+	for (TokenBucket& bucket : m_buckets) {
+		bucket = { { 0, 0 }, 0, 0, IOStatistics::getTimestamp() };
+	}
+}
+
+void IOScheduler::setPriority(IO_SOURCE source, IO_PRIORITY priority) {
+	m_priorities[(size_t)source] = priority;
+}
+
+IO_PRIORITY IOScheduler::getPriority(IO_SOURCE source) const {
+	return m_priorities[(size_t)source];
+}
+
+void IOScheduler::setRateLimit(IO_PRIORITY priority, const IORateLimit& limit) {
+	{
+		lock_guard<mutex> lock(m_lock);
+		// Starting over with a full burst.
+		TokenBucket& bucket = m_buckets[(size_t)priority];
+		bucket.Limit = limit;
+		bucket.Bytes = (double)limit.BytesPerSecond * IO_SCHEDULER_BURST_MILLISECONDS / 1000;
+		bucket.Requests = (double)limit.RequestsPerSecond * IO_SCHEDULER_BURST_MILLISECONDS / 1000;
+		bucket.LastRefill = IOStatistics::getTimestamp();
+
+		bool isLimited = false;
+		for (const TokenBucket& otherBucket : m_buckets) {
+			isLimited |= otherBucket.Limit.BytesPerSecond > 0 || otherBucket.Limit.RequestsPerSecond > 0;
+		}
+		m_isLimited = isLimited;
+	}
+	m_changed.notify_all();
+}
+
+IORateLimit IOScheduler::getRateLimit(IO_PRIORITY priority) const {
+	lock_guard<mutex> lock(m_lock);
+	return m_buckets[(size_t)priority].Limit;
+}
+
+IO_PRIORITY IOScheduler::admit(DWORD numOfRequests, ULONGLONG length) {
+	IO_PRIORITY priority = currentPriority.IsSet ? currentPriority.Priority : getPriority(IOSourceScope::getCurrent());
+	if (priority == IO_PRIORITY::INTERACTIVE) {
+		// Counted while waiting for its own tokens as well, background requests should not get ahead of it.
+		m_interactiveRequests++;
+	}
+	else if (m_interactiveRequests > 0) {
+		unique_lock<mutex> lock(m_lock);
+		m_changed.wait_for(lock, std::chrono::milliseconds(IO_SCHEDULER_MAX_YIELD_MILLISECONDS), [this]() {
+			return m_interactiveRequests == 0;
+		});
+	}
+	if (!m_isLimited) {
+		return priority;
+	}
+
+	unique_lock<mutex> lock(m_lock);
+	TokenBucket& bucket = m_buckets[(size_t)priority];
+	for (;;) {
+		refill(bucket, IOStatistics::getTimestamp());
+		ULONGLONG debtDuration = getDebtDuration(bucket);
+		if (debtDuration == 0) {
+			break;
+		}
+		m_changed.wait_for(lock, std::chrono::microseconds(min<ULONGLONG>(debtDuration, IO_SCHEDULER_POLL_MILLISECONDS * 1000)));
+	}
+	if (bucket.Limit.BytesPerSecond > 0) {
+		bucket.Bytes -= (double)length;
+	}
+	if (bucket.Limit.RequestsPerSecond > 0) {
+		bucket.Requests -= numOfRequests;
+	}
+	return priority;
+}
+
+void IOScheduler::complete(IO_PRIORITY priority) {
+	if (priority != IO_PRIORITY::INTERACTIVE || --m_interactiveRequests > 0) {
+		return;
+	}
+	// Taking the lock, so a background request can not miss the notification between its check and its wait.
+	{
+		lock_guard<mutex> lock(m_lock);
+	}
+	m_changed.notify_all();
+}
+
+void IOScheduler::refill(TokenBucket& bucket, ULONGLONG now) {
+	double elapsedSeconds = (double)(now - bucket.LastRefill) / 1000000;
+	bucket.LastRefill = now;
+	if (bucket.Limit.BytesPerSecond > 0) {
+		double burst = (double)bucket.Limit.BytesPerSecond * IO_SCHEDULER_BURST_MILLISECONDS / 1000;
+		bucket.Bytes = min(bucket.Bytes + bucket.Limit.BytesPerSecond * elapsedSeconds, burst);
+	}
+	if (bucket.Limit.RequestsPerSecond > 0) {
+		double burst = (double)bucket.Limit.RequestsPerSecond * IO_SCHEDULER_BURST_MILLISECONDS / 1000;
+		bucket.Requests = min(bucket.Requests + bucket.Limit.RequestsPerSecond * elapsedSeconds, burst);
+	}
+}
+
+ULONGLONG IOScheduler::getDebtDuration(const TokenBucket& bucket) {
+	double debtSeconds = 0;
+	if (bucket.Limit.BytesPerSecond > 0 && bucket.Bytes < 0) {
+		debtSeconds = -bucket.Bytes / bucket.Limit.BytesPerSecond;
+	}
+	if (bucket.Limit.RequestsPerSecond > 0 && bucket.Requests < 0) {
+		double requestsDebtSeconds = -bucket.Requests / bucket.Limit.RequestsPerSecond;
+		debtSeconds = requestsDebtSeconds > debtSeconds ? requestsDebtSeconds : debtSeconds;
+	}
+	// Rounded up, so a debt is never waited for as 0.
+	return (ULONGLONG)(debtSeconds * 1000000) + (debtSeconds > 0 ? 1 : 0);
+}
+
+IOPriorityScope::IOPriorityScope(IO_PRIORITY priority) :
+	m_previousPriority(currentPriority) {
+	if (!currentPriority.IsSet) {
+		currentPriority = { true, priority };
+	}
+}
+
+IOPriorityScope::IOPriorityScope(const IOOperationPriority& operationPriority) :
+	m_previousPriority(currentPriority) {
+	if (!currentPriority.IsSet) {
+		currentPriority = operationPriority;
+	}
+}
+
+IOPriorityScope::~IOPriorityScope() {
+	currentPriority = m_previousPriority;
+}
+
+IOOperationPriority IOPriorityScope::getCurrent() {
+	return currentPriority;
+}
+
+ScheduledIO::ScheduledIO(IOScheduler& scheduler, DWORD numOfRequests, ULONGLONG length) :
+	m_scheduler(scheduler),
+	m_priority(scheduler.admit(numOfRequests, length)) {
+	// Left blank.
+}
+
+ScheduledIO::~ScheduledIO() {
+	m_scheduler.complete(m_priority);
+}
@@ -0,0 +1,194 @@
+#ifndef _NTFSLIB_IO_SCHEDULER_H
+#define _NTFSLIB_IO_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "Defs.h"
+#include "IOStatistics.h"
+
+using std::atomic;
+using std::condition_variable;
+using std::mutex;
+
+// A rate limited class may burst up to this much time worth of its rate after being idle.
+#define IO_SCHEDULER_BURST_MILLISECONDS 100
+// Background requests wait at most this long for interactive requests in flight, so they are never starved.
+#define IO_SCHEDULER_MAX_YIELD_MILLISECONDS 50
+// Waiters wake up at least this often to recheck (e.g. after a limit was lifted).
+#define IO_SCHEDULER_POLL_MILLISECONDS 10
+
+// Priority classes of volume I/O.
+enum class IO_PRIORITY {
+	// Lookups someone waits for (e.g. NTFSParser.findMFTRecord).
+	INTERACTIVE,
+	// Bulk reads which may be slowed down (e.g. NTFSParser.dumpFullDir or dumpFile).
+	BACKGROUND
+};
+#define IO_NUM_OF_PRIORITIES ((size_t)IO_PRIORITY::BACKGROUND + 1)
+
+/**
+ * Priority class of an operation, as carried over to the threads working for it (see: IOPriorityScope.getCurrent).
+ */
+typedef struct {
+	// Is the operation running at a priority class of its own?
+	bool IsSet;
+	IO_PRIORITY Priority;
+} IOOperationPriority;
+
+/**
+ * Bandwidth cap of a priority class.
+ */
+typedef struct {
+	// Bytes per second, 0 for unlimited.
+	ULONGLONG BytesPerSecond;
+	// Requests per second, 0 for unlimited.
+	DWORD RequestsPerSecond;
+} IORateLimit;
+
+/**
+ * Schedules the I/O of a volume by priority class.
+ * The class of a request is the one of the operation it is made for (see: IOPriorityScope), or else the one of
+ * its source (see: IOSourceScope): by default MFT scans and data streams are BACKGROUND, anything else is INTERACTIVE.
+ * Every class may be capped by a token bucket (of bytes and of requests), which lets a class burst after
+ * being idle, and then holds it to its rate. A request may exceed the tokens left (e.g. a request larger than
+ * the burst), the following requests then wait until the debt is paid back.
+ * BACKGROUND requests also yield to INTERACTIVE requests in flight, up to IO_SCHEDULER_MAX_YIELD_MILLISECONDS.
+ * Nothing is limited by default.
+ */
+class IOScheduler {
+public:
+	IOScheduler();
+
+	/**
+	 * Sets the priority class of the requests of <source>.
+	 */
+	void setPriority(IO_SOURCE source, IO_PRIORITY priority);
+
+	/**
+	 * Returns the priority class of the requests of <source>.
+	 */
+	IO_PRIORITY getPriority(IO_SOURCE source) const;
+
+	/**
+	 * Caps the bandwidth of <priority> to <limit>. Requests already waiting are rescheduled.
+	 */
+	void setRateLimit(IO_PRIORITY priority, const IORateLimit& limit);
+
+	/**
+	 * Returns the bandwidth cap of <priority>.
+	 */
+	IORateLimit getRateLimit(IO_PRIORITY priority) const;
+
+	/**
+	 * Admits <numOfRequests> requests of <length> bytes in all from the calling thread's operation (or source),
+	 * waiting as long as their class requires, and returns their class. They are in flight until complete is called.
+	 * Prefer ScheduledIO, which completes them on any exit.
+	 */
+	IO_PRIORITY admit(DWORD numOfRequests, ULONGLONG length);
+
+	/**
+	 * Ends requests of <priority> admitted together.
+	 */
+	void complete(IO_PRIORITY priority);
+
+private:
+	FORBID_COPY_AND_ASSIGN(IOScheduler);
+
+	// Token bucket of a single class.
+	struct TokenBucket {
+		IORateLimit Limit;
+		// Tokens left, negative while in debt.
+		double Bytes;
+		double Requests;
+		// When the bucket was last refilled (see: IOStatistics.getTimestamp).
+		ULONGLONG LastRefill;
+	};
+
+	/**
+	 * Adds to <bucket> the tokens earned since it was last refilled, up to a burst's worth.
+	 */
+	static void refill(TokenBucket& bucket, ULONGLONG now);
+
+	/**
+	 * Returns how long (in microseconds) <bucket> takes to pay its debt back, 0 if it is not in debt.
+	 */
+	static ULONGLONG getDebtDuration(const TokenBucket& bucket);
+
+	// Priority class of every source, indexed by IO_SOURCE.
+	atomic<IO_PRIORITY> m_priorities[IO_NUM_OF_SOURCES];
+
+	// Is any class rate limited? Spares the lock otherwise.
+	atomic<bool> m_isLimited;
+
+	// Number of INTERACTIVE requests in flight.
+	atomic<DWORD> m_interactiveRequests;
+
+	// Guards the buckets.
+	mutable mutex m_lock;
+
+	// Signaled when a limit changes, or INTERACTIVE requests complete.
+	condition_variable m_changed;
+
+	// Token buckets, indexed by IO_PRIORITY.
+	TokenBucket m_buckets[IO_NUM_OF_PRIORITIES];
+};
+
+/**
+ * Runs all the I/O of the calling thread at a single priority class as long as it lives, whatever its source
+ * (e.g. the extension records and attributes lists read during a background scan). Scopes do not nest, the
+ * outermost one wins. An operation handing work over to other threads takes a scope on each one of them,
+ * with the operation's priority (see: getCurrent).
+ */
+class IOPriorityScope {
+public:
+	explicit IOPriorityScope(IO_PRIORITY priority);
+
+	/**
+	 * Runs the thread's I/O at the priority class of <operationPriority>, if it has one.
+	 */
+	explicit IOPriorityScope(const IOOperationPriority& operationPriority);
+
+	/**
+	 * Restores the priority class the thread was in.
+	 */
+	~IOPriorityScope();
+
+	/**
+	 * Returns the priority class of the operation the calling thread works for (not set outside of any scope).
+	 */
+	static IOOperationPriority getCurrent();
+
+private:
+	FORBID_COPY_AND_ASSIGN(IOPriorityScope);
+
+	// Priority class of the thread before this scope.
+	IOOperationPriority m_previousPriority;
+};
+
+/**
+ * Requests admitted by an IOScheduler, in flight as long as it lives.
+ */
+class ScheduledIO {
+public:
+	/**
+	 * Waits until <scheduler> admits <numOfRequests> requests of <length> bytes in all (see: IOScheduler.admit).
+	 */
+	ScheduledIO(IOScheduler& scheduler, DWORD numOfRequests, ULONGLONG length);
+
+	/**
+	 * Completes the requests.
+	 */
+	~ScheduledIO();
+
+private:
+	FORBID_COPY_AND_ASSIGN(ScheduledIO);
+
+	IOScheduler& m_scheduler;
+
+	// Class of the requests.
+	IO_PRIORITY m_priority;
+};
+
+#endif // _NTFSLIB_IO_SCHEDULER_H
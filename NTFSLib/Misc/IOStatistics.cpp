@@ -0,0 +1,254 @@
+#include <chrono>
+
+#include "IOStatistics.h"
+
+using std::lock_guard;
+using std::unique_lock;
+using std::memory_order_relaxed;
+
+// Source the calling thread is in (see: IOSourceScope).
+static thread_local IO_SOURCE currentSource = IO_SOURCE::OTHER;
+
+static const char* sourceNames[IO_NUM_OF_SOURCES] = {
+	"MFT scan",
+	"MFT record",
+	"Index",
+	"Data stream",
+	"Journal",
+	"Other"
+};
+
+IOStatistics::IOStatistics() :
+	m_lastOffset(0),
+	m_startTime(getTimestamp()),
+	m_isDumpStopped(true) {
+	reset();
+}
+
+IOStatistics::~IOStatistics() {
+	stopPeriodicDump();
+}
+
+void IOStatistics::recordRead(ULONGLONG offset, DWORD length, DWORD bytesRead, ULONGLONG latency) {
+	SourceCounters& counters = getCurrentCounters();
+	countRequest(counters, offset, length, bytesRead);
+	countLatency(counters, latency);
+}
+
+void IOStatistics::recordBatch(const DeviceReadList& reads, ULONGLONG latency) {
+	SourceCounters& counters = getCurrentCounters();
+	for (const DeviceRead& read : reads) {
+		countRequest(counters, read.Offset, read.Length, read.BytesRead);
+	}
+	countLatency(counters, latency);
+}
+
+void IOStatistics::recordControl(DWORD bytesRead, ULONGLONG latency) {
+	SourceCounters& counters = getCurrentCounters();
+	counters.Reads.fetch_add(1, memory_order_relaxed);
+	counters.BytesRead.fetch_add(bytesRead, memory_order_relaxed);
+	countLatency(counters, latency);
+}
+
+void IOStatistics::recordCacheLookups(DWORD hits, DWORD misses) {
+	SourceCounters& counters = getCurrentCounters();
+	if (hits > 0) {
+		counters.CacheHits.fetch_add(hits, memory_order_relaxed);
+	}
+	if (misses > 0) {
+		counters.CacheMisses.fetch_add(misses, memory_order_relaxed);
+	}
+}
+
+IOStatisticsSnapshot IOStatistics::getSnapshot() const {
+	IOStatisticsSnapshot snapshot;
+	snapshot.ElapsedMicroseconds = getTimestamp() - m_startTime.load(memory_order_relaxed);
+	for (size_t i = 0; i < IO_NUM_OF_SOURCES; ++i) {
+		const SourceCounters& counters = m_sources[i];
+		IOSourceStatistics& statistics = snapshot.Sources[i];
+		statistics.Reads = counters.Reads.load(memory_order_relaxed);
+		statistics.BytesRead = counters.BytesRead.load(memory_order_relaxed);
+		statistics.SeekDistance = counters.SeekDistance.load(memory_order_relaxed);
+		statistics.CacheHits = counters.CacheHits.load(memory_order_relaxed);
+		statistics.CacheMisses = counters.CacheMisses.load(memory_order_relaxed);
+		statistics.Calls = counters.Calls.load(memory_order_relaxed);
+		statistics.TotalLatency = counters.TotalLatency.load(memory_order_relaxed);
+		statistics.MaxLatency = counters.MaxLatency.load(memory_order_relaxed);
+		for (DWORD bucket = 0; bucket < IO_LATENCY_NUM_OF_BUCKETS; ++bucket) {
+			statistics.LatencyBuckets[bucket] = counters.LatencyBuckets[bucket].load(memory_order_relaxed);
+		}
+	}
+	return snapshot;
+}
+
+void IOStatistics::reset() {
+	for (SourceCounters& counters : m_sources) {
+		counters.Reads = 0;
+		counters.BytesRead = 0;
+		counters.SeekDistance = 0;
+		counters.CacheHits = 0;
+		counters.CacheMisses = 0;
+		counters.Calls = 0;
+		counters.TotalLatency = 0;
+		counters.MaxLatency = 0;
+		for (atomic<ULONGLONG>& bucket : counters.LatencyBuckets) {
+			bucket = 0;
+		}
+	}
+	m_startTime = getTimestamp();
+}
+
+void IOStatistics::startPeriodicDump(DWORD intervalMilliseconds, const IOStatisticsSink& sink /* = nullptr */) {
+	stopPeriodicDump();
+	m_isDumpStopped = false;
+	IOStatisticsSink dumpSink = sink != nullptr ? sink : IOStatisticsSink(&IOStatistics::trace);
+	m_dumpThread = thread([this, intervalMilliseconds, dumpSink]() {
+		unique_lock<mutex> lock(m_dumpLock);
+		while (!m_dumpStopped.wait_for(lock, std::chrono::milliseconds(intervalMilliseconds), [this]() { return m_isDumpStopped; })) {
+			// The counters are lock-free, there is no need to hold the lock while the sink runs.
+			lock.unlock();
+			dumpSink(getSnapshot());
+			lock.lock();
+		}
+	});
+}
+
+void IOStatistics::stopPeriodicDump() {
+	{
+		lock_guard<mutex> lock(m_dumpLock);
+		m_isDumpStopped = true;
+	}
+	m_dumpStopped.notify_all();
+	if (m_dumpThread.joinable()) {
+		m_dumpThread.join();
+	}
+}
+
+ULONGLONG IOStatistics::getTimestamp() {
+	return (ULONGLONG)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ULONGLONG IOStatistics::getBucketLowerBound(DWORD bucket) {
+	if (bucket < IO_LATENCY_SUB_BUCKETS) {
+		return bucket;
+	}
+	// Bucket groups above the first one cover a power of 2 each, [2^(group + 1), 2^(group + 2)).
+	DWORD group = bucket / IO_LATENCY_SUB_BUCKETS;
+	DWORD subBucket = bucket % IO_LATENCY_SUB_BUCKETS;
+	return (ULONGLONG)(IO_LATENCY_SUB_BUCKETS + subBucket) << (group - 1);
+}
+
+ULONGLONG IOStatistics::getAverageRequestSize(const IOSourceStatistics& statistics) {
+	return statistics.Reads > 0 ? statistics.BytesRead / statistics.Reads : 0;
+}
+
+double IOStatistics::getCacheHitRatio(const IOSourceStatistics& statistics) {
+	ULONGLONG lookups = statistics.CacheHits + statistics.CacheMisses;
+	return lookups > 0 ? (double)statistics.CacheHits / lookups : 0;
+}
+
+ULONGLONG IOStatistics::getLatencyPercentile(const IOSourceStatistics& statistics, double percentile) {
+	if (statistics.Calls == 0) {
+		return 0;
+	}
+	ULONGLONG wantedCalls = (ULONGLONG)(statistics.Calls * percentile / 100);
+	ULONGLONG calls = 0;
+	for (DWORD bucket = 0; bucket < IO_LATENCY_NUM_OF_BUCKETS - 1; ++bucket) {
+		calls += statistics.LatencyBuckets[bucket];
+		if (calls > 0 && calls >= wantedCalls) {
+			// The upper bound of the bucket, which never exceeds the longest call.
+			ULONGLONG upperBound = getBucketLowerBound(bucket + 1) - 1;
+			return upperBound < statistics.MaxLatency ? upperBound : statistics.MaxLatency;
+		}
+	}
+	return statistics.MaxLatency;
+}
+
+IOSourceStatistics IOStatistics::getTotal(const IOStatisticsSnapshot& snapshot) {
+	IOSourceStatistics total = { 0 };
+	for (const IOSourceStatistics& statistics : snapshot.Sources) {
+		total.Reads += statistics.Reads;
+		total.BytesRead += statistics.BytesRead;
+		total.SeekDistance += statistics.SeekDistance;
+		total.CacheHits += statistics.CacheHits;
+		total.CacheMisses += statistics.CacheMisses;
+		total.Calls += statistics.Calls;
+		total.TotalLatency += statistics.TotalLatency;
+		total.MaxLatency = statistics.MaxLatency > total.MaxLatency ? statistics.MaxLatency : total.MaxLatency;
+		for (DWORD bucket = 0; bucket < IO_LATENCY_NUM_OF_BUCKETS; ++bucket) {
+			total.LatencyBuckets[bucket] += statistics.LatencyBuckets[bucket];
+		}
+	}
+	return total;
+}
+
+const char* IOStatistics::getSourceName(IO_SOURCE source) {
+	return sourceNames[(size_t)source];
+}
+
+void IOStatistics::trace(const IOStatisticsSnapshot& snapshot) {
+	TRACE(DEBUG_LEVEL::INFO, "I/O statistics of the last %llu ms:", snapshot.ElapsedMicroseconds / 1000);
+	for (size_t i = 0; i < IO_NUM_OF_SOURCES; ++i) {
+		const IOSourceStatistics& statistics = snapshot.Sources[i];
+		if (statistics.Reads == 0 && statistics.CacheHits == 0) {
+			continue;
+		}
+		TRACE(DEBUG_LEVEL::INFO, "%s: %llu reads, %llu bytes (%llu per read), %llu bytes seeked, %.1f%% cache hits, "
+			"latency (us) p50: %llu, p99: %llu, max: %llu",
+			getSourceName((IO_SOURCE)i), statistics.Reads, statistics.BytesRead, getAverageRequestSize(statistics),
+			statistics.SeekDistance, getCacheHitRatio(statistics) * 100, getLatencyPercentile(statistics, 50),
+			getLatencyPercentile(statistics, 99), statistics.MaxLatency);
+	}
+}
+
+IOStatistics::SourceCounters& IOStatistics::getCurrentCounters() {
+	return m_sources[(size_t)IOSourceScope::getCurrent()];
+}
+
+void IOStatistics::countRequest(SourceCounters& counters, ULONGLONG offset, DWORD length, DWORD bytesRead) {
+	// Concurrent requests interleave, so the distance is only exact for a single reader.
+	ULONGLONG lastOffset = m_lastOffset.exchange(offset + length, memory_order_relaxed);
+	counters.Reads.fetch_add(1, memory_order_relaxed);
+	counters.BytesRead.fetch_add(bytesRead, memory_order_relaxed);
+	counters.SeekDistance.fetch_add(offset > lastOffset ? offset - lastOffset : lastOffset - offset, memory_order_relaxed);
+}
+
+void IOStatistics::countLatency(SourceCounters& counters, ULONGLONG latency) {
+	counters.Calls.fetch_add(1, memory_order_relaxed);
+	counters.TotalLatency.fetch_add(latency, memory_order_relaxed);
+	counters.LatencyBuckets[getBucket(latency)].fetch_add(1, memory_order_relaxed);
+	ULONGLONG maxLatency = counters.MaxLatency.load(memory_order_relaxed);
+	while (latency > maxLatency && !counters.MaxLatency.compare_exchange_weak(maxLatency, latency, memory_order_relaxed)) {
+		// Retrying with the updated maximum.
+	}
+}
+
+DWORD IOStatistics::getBucket(ULONGLONG latency) {
+	if (latency < IO_LATENCY_SUB_BUCKETS) {
+		return (DWORD)latency;
+	}
+	DWORD msb = IO_LATENCY_SUB_BUCKET_BITS;
+	while ((latency >> (msb + 1)) != 0) {
+		++msb;
+	}
+	// The group of the power of 2, and the sub bucket given by the bits following the most significant one.
+	DWORD bucket = (msb - IO_LATENCY_SUB_BUCKET_BITS + 1) * IO_LATENCY_SUB_BUCKETS +
+		(DWORD)((latency >> (msb - IO_LATENCY_SUB_BUCKET_BITS)) & (IO_LATENCY_SUB_BUCKETS - 1));
+	return bucket < IO_LATENCY_NUM_OF_BUCKETS ? bucket : IO_LATENCY_NUM_OF_BUCKETS - 1;
+}
+
+IOSourceScope::IOSourceScope(IO_SOURCE source) :
+	m_previousSource(currentSource) {
+	if (currentSource == IO_SOURCE::OTHER) {
+		currentSource = source;
+	}
+}
+
+IOSourceScope::~IOSourceScope() {
+	currentSource = m_previousSource;
+}
+
+IO_SOURCE IOSourceScope::getCurrent() {
+	return currentSource;
+}
@@ -0,0 +1,256 @@
+#ifndef _NTFSLIB_IO_STATISTICS_H
+#define _NTFSLIB_IO_STATISTICS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Defs.h"
+#include "..\Device\BlockDevice.h"
+
+using std::atomic;
+using std::condition_variable;
+using std::function;
+using std::mutex;
+using std::thread;
+
+// Every power of 2 of the latency histogram is split into 2^IO_LATENCY_SUB_BUCKET_BITS buckets.
+#define IO_LATENCY_SUB_BUCKET_BITS 2
+#define IO_LATENCY_SUB_BUCKETS (1 << IO_LATENCY_SUB_BUCKET_BITS)
+// Enough buckets for latencies of up to 2^33 microseconds (longer ones land in the last bucket).
+#define IO_LATENCY_NUM_OF_BUCKETS 128
+
+// What a volume is read for.
+enum class IO_SOURCE {
+	// Sequential scans of the MFT (see: MFTScanner).
+	MFT_SCAN,
+	// MFT records read one by one (e.g. path lookups, extension records).
+	MFT_RECORD,
+	// Index records walked by directory lookups and listings.
+	INDEX,
+	// Contents of data streams.
+	DATA_STREAM,
+	// Change Journal reads.
+	JOURNAL,
+	// Anything else (e.g. the boot sector, metadata files).
+	OTHER
+};
+#define IO_NUM_OF_SOURCES ((size_t)IO_SOURCE::OTHER + 1)
+
+/**
+ * I/O counters of a single source.
+ */
+typedef struct {
+	// Device requests, and the bytes they returned.
+	ULONGLONG Reads;
+	ULONGLONG BytesRead;
+	// Sum of the distances (in bytes) between the end of the previous request on the volume and the start of
+	// every request. 0 for purely sequential access.
+	ULONGLONG SeekDistance;
+	// Clusters served by the cluster cache, and clusters it had to read.
+	ULONGLONG CacheHits;
+	ULONGLONG CacheMisses;
+	// Latencies of the device calls in microseconds (a batch of reads being a single call).
+	ULONGLONG Calls;
+	ULONGLONG TotalLatency;
+	ULONGLONG MaxLatency;
+	// Number of calls by latency bucket (see: IOStatistics.getBucketLowerBound).
+	ULONGLONG LatencyBuckets[IO_LATENCY_NUM_OF_BUCKETS];
+} IOSourceStatistics;
+
+/**
+ * I/O counters of a volume.
+ */
+typedef struct {
+	// Time covered by the counters (since the volume was opened, or the counters were reset).
+	ULONGLONG ElapsedMicroseconds;
+	// Counters by source, indexed by IO_SOURCE.
+	IOSourceStatistics Sources[IO_NUM_OF_SOURCES];
+} IOStatisticsSnapshot;
+
+/**
+ * Invoked by the periodic dump (see: IOStatistics.startPeriodicDump) with the current counters.
+ */
+typedef function<void(const IOStatisticsSnapshot& snapshot)> IOStatisticsSink;
+
+/**
+ * Counts the I/O of a volume: requests, bytes, seek distances, cache hits, and a latency histogram whose
+ * buckets have a fixed relative precision (25%) over the whole range (HDR style), attributed by source.
+ * The source of a request is the one the calling thread is in (see: IOSourceScope).
+ * Counters are lock-free, so they are always kept.
+ */
+class IOStatistics {
+public:
+	IOStatistics();
+
+	/**
+	 * Stops the periodic dump, if any.
+	 */
+	~IOStatistics();
+
+	/**
+	 * Counts a request of the current source for <length> bytes starting at the volume offset <offset>,
+	 * which returned <bytesRead> bytes after <latency> microseconds.
+	 */
+	void recordRead(ULONGLONG offset, DWORD length, DWORD bytesRead, ULONGLONG latency);
+
+	/**
+	 * Counts a batch of <reads> of the current source, completed after <latency> microseconds.
+	 */
+	void recordBatch(const DeviceReadList& reads, ULONGLONG latency);
+
+	/**
+	 * Counts a control request (e.g. a Change Journal read) of the current source, which returned
+	 * <bytesRead> bytes after <latency> microseconds. Does not move the volume's position.
+	 */
+	void recordControl(DWORD bytesRead, ULONGLONG latency);
+
+	/**
+	 * Counts cluster cache lookups of the current source.
+	 */
+	void recordCacheLookups(DWORD hits, DWORD misses);
+
+	/**
+	 * Returns a copy of the counters. Counters updated concurrently might be off by the requests in flight.
+	 */
+	IOStatisticsSnapshot getSnapshot() const;
+
+	/**
+	 * Zeroes the counters.
+	 */
+	void reset();
+
+	/**
+	 * Calls <sink> with the counters every <intervalMilliseconds> from a background thread, until
+	 * stopPeriodicDump is called. Restarts the dump if it is already running.
+	 * <sink> defaults to tracing a summary of every source (see: trace).
+	 */
+	void startPeriodicDump(DWORD intervalMilliseconds, const IOStatisticsSink& sink = nullptr);
+
+	/**
+	 * Stops the periodic dump, and waits for the background thread.
+	 */
+	void stopPeriodicDump();
+
+	/**
+	 * Returns a monotonic timestamp in microseconds, to measure latencies with.
+	 */
+	static ULONGLONG getTimestamp();
+
+	/**
+	 * Returns the smallest latency (in microseconds) counted in latency bucket <bucket>.
+	 */
+	static ULONGLONG getBucketLowerBound(DWORD bucket);
+
+	/**
+	 * Returns the average request size of <statistics> in bytes.
+	 */
+	static ULONGLONG getAverageRequestSize(const IOSourceStatistics& statistics);
+
+	/**
+	 * Returns the ratio (0 - 1) of the cluster cache lookups of <statistics> which hit.
+	 */
+	static double getCacheHitRatio(const IOSourceStatistics& statistics);
+
+	/**
+	 * Returns the latency (in microseconds) <percentile> percent of the calls of <statistics> took at most.
+	 * Accurate up to the bucket precision.
+	 */
+	static ULONGLONG getLatencyPercentile(const IOSourceStatistics& statistics, double percentile);
+
+	/**
+	 * Returns the counters of all the sources of <snapshot> added up.
+	 */
+	static IOSourceStatistics getTotal(const IOStatisticsSnapshot& snapshot);
+
+	/**
+	 * Returns the name of <source>.
+	 */
+	static const char* getSourceName(IO_SOURCE source);
+
+	/**
+	 * Traces a summary of every source of <snapshot> which did any I/O.
+	 */
+	static void trace(const IOStatisticsSnapshot& snapshot);
+
+private:
+	FORBID_COPY_AND_ASSIGN(IOStatistics);
+
+	// Counters of a single source.
+	struct SourceCounters {
+		atomic<ULONGLONG> Reads;
+		atomic<ULONGLONG> BytesRead;
+		atomic<ULONGLONG> SeekDistance;
+		atomic<ULONGLONG> CacheHits;
+		atomic<ULONGLONG> CacheMisses;
+		atomic<ULONGLONG> Calls;
+		atomic<ULONGLONG> TotalLatency;
+		atomic<ULONGLONG> MaxLatency;
+		atomic<ULONGLONG> LatencyBuckets[IO_LATENCY_NUM_OF_BUCKETS];
+	};
+
+	/**
+	 * Returns the counters of the source the calling thread is in.
+	 */
+	SourceCounters& getCurrentCounters();
+
+	/**
+	 * Counts a request for <length> bytes at <offset> into <counters> (everything but its latency).
+	 */
+	void countRequest(SourceCounters& counters, ULONGLONG offset, DWORD length, DWORD bytesRead);
+
+	/**
+	 * Counts a device call of <latency> microseconds into <counters>.
+	 */
+	static void countLatency(SourceCounters& counters, ULONGLONG latency);
+
+	/**
+	 * Returns the latency bucket <latency> (in microseconds) is counted in.
+	 */
+	static DWORD getBucket(ULONGLONG latency);
+
+	// Counters by source, indexed by IO_SOURCE.
+	SourceCounters m_sources[IO_NUM_OF_SOURCES];
+
+	// Volume offset where the last request ended.
+	atomic<ULONGLONG> m_lastOffset;
+
+	// When the counters were last reset.
+	atomic<ULONGLONG> m_startTime;
+
+	// Periodic dump thread, and what stops it.
+	thread m_dumpThread;
+	mutex m_dumpLock;
+	condition_variable m_dumpStopped;
+	bool m_isDumpStopped;
+};
+
+/**
+ * Attributes the I/O of the calling thread to a source, as long as it lives.
+ * Scopes may nest, the outermost one wins: e.g. the metadata read while loading an MFT record is still
+ * counted as MFT_RECORD, even if it is read through a data stream.
+ */
+class IOSourceScope {
+public:
+	explicit IOSourceScope(IO_SOURCE source);
+
+	/**
+	 * Restores the source the thread was in.
+	 */
+	~IOSourceScope();
+
+	/**
+	 * Returns the source the calling thread is in (OTHER outside of any scope).
+	 */
+	static IO_SOURCE getCurrent();
+
+private:
+	FORBID_COPY_AND_ASSIGN(IOSourceScope);
+
+	// Source of the thread before this scope.
+	IO_SOURCE m_previousSource;
+};
+
+#endif // _NTFSLIB_IO_STATISTICS_H
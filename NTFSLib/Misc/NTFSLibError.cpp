@@ -21,4 +21,21 @@ IMPLEMENT_EXCEPTION(MFTRecordNotFoundError);
 IMPLEMENT_EXCEPTION(BadVolumeCharacterError);
 IMPLEMENT_EXCEPTION(BadPathError);
 IMPLEMENT_EXCEPTION(USAFixupError);
-IMPLEMENT_EXCEPTION(EmptyDataRunError);
\ No newline at end of file
+IMPLEMENT_EXCEPTION(EmptyDataRunError);
+
+void throwStatusError(NTFSLIB_STATUS status) {
+	switch (status) {
+	case NTFSLIB_STATUS::BAD_RECORD_HEADER:
+		NTFSLIB_ERROR(BadRecordHeaderError, NTFSLIB_DEFAULT_ERROR_CODE, "Bad record header");
+	case NTFSLIB_STATUS::USA_FIXUP_FAILED:
+		NTFSLIB_ERROR(USAFixupError, NTFSLIB_DEFAULT_ERROR_CODE, "Bad update sequence array");
+	case NTFSLIB_STATUS::ATTRIBUTE_NOT_FOUND:
+		NTFSLIB_ERROR(AttributeNotFoundError, NTFSLIB_DEFAULT_ERROR_CODE, "Attribute not found");
+	case NTFSLIB_STATUS::OUT_OF_BOUNDS:
+		NTFSLIB_ERROR(OutOfBoundsError, NTFSLIB_DEFAULT_ERROR_CODE, "Out of bounds");
+	case NTFSLIB_STATUS::BAD_PATH:
+		NTFSLIB_ERROR(BadPathError, NTFSLIB_DEFAULT_ERROR_CODE, "Bad path");
+	default:
+		NTFSLIB_ERROR(UnexpectedActionError, NTFSLIB_DEFAULT_ERROR_CODE, "Unexpected status: %d", (int)status);
+	}
+}
@@ -58,6 +58,32 @@ DEFINE_EXCEPTION(BadPathError);
 DEFINE_EXCEPTION(USAFixupError);
 DEFINE_EXCEPTION(EmptyDataRunError);
 
+/**
+ * Result of the non-throwing ("try") variants of the parsing functions, for hot paths where failures
+ * are expected (e.g. torn or unused records during a scan). Every failure matches the exception
+ * thrown by the throwing variant.
+ */
+enum class NTFSLIB_STATUS {
+	SUCCESS,
+	// BadRecordHeaderError.
+	BAD_RECORD_HEADER,
+	// USAFixupError.
+	USA_FIXUP_FAILED,
+	// AttributeNotFoundError.
+	ATTRIBUTE_NOT_FOUND,
+	// OutOfBoundsError.
+	OUT_OF_BOUNDS,
+	// BadPathError.
+	BAD_PATH,
+	// UnexpectedActionError.
+	UNEXPECTED_ACTION
+};
+
+/**
+ * Throws the exception matching a failed <status>.
+ */
+void throwStatusError(NTFSLIB_STATUS status);
+
 // Throw an error with a custom error message.
 #define NTFSLIB_ERROR(errorType, errorCode, errorMessage, ...) \
 	do { \
@@ -82,4 +108,13 @@ DEFINE_EXCEPTION(EmptyDataRunError);
 		} \
 	} while(0)
 
+// Check the result of a non-throwing function, and throw the matching exception if failed.
+#define NTFSLIB_ASSERT_STATUS(status) \
+	do { \
+		NTFSLIB_STATUS assertedStatus = (status); \
+		if (assertedStatus != NTFSLIB_STATUS::SUCCESS) { \
+			throwStatusError(assertedStatus); \
+		} \
+	} while(0)
+
 #endif // _NTFSLIB_NTFS_ERROR_H
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include <algorithm>
+
+#include "ReadPlanner.h"
+#include "NTFSLibError.h"
+
+using std::min;
+
+ReadPlanner::ReadPlanner(const ExtentMap& extents, WORD clusterSize, DWORD gapTolerance /* = READ_PLAN_DEFAULT_GAP_TOLERANCE */) :
+	m_extents(extents),
+	m_clusterSize(clusterSize),
+	m_gapTolerance(gapTolerance) {
+	// Left blank.
+}
+
+ReadPlan ReadPlanner::plan(ULONGLONG offset, DWORD length) const {
+	NTFSLIB_ASSERT(
+		offset + length <= m_extents.getDataSize(),
+		OutOfBoundsError
+	);
+
+	ReadPlan plan;
+	ULONGLONG position = offset;
+	ULONGLONG end = offset + length;
+	while (position < end) {
+		const DataRun* dataRun = m_extents.findDataRun(position / m_clusterSize);
+		// A hole in the extents (e.g. one of them is missing).
+		NTFSLIB_ASSERT(
+			dataRun != nullptr,
+			BadSizeError
+		);
+		ULONGLONG pieceEnd = min<ULONGLONG>(end, (dataRun->StartVCN + dataRun->NumOfClusters) * m_clusterSize);
+		if (dataRun->IsSparse) {
+			DWORD pieceLength = (DWORD)(pieceEnd - position);
+			PlannedIO zeroFill = { true, 0, pieceLength, { { 0, (DWORD)(position - offset), pieceLength } } };
+			addIO(plan, zeroFill);
+			position = pieceEnd;
+			continue;
+		}
+
+		// Partial clusters at the edges are planned on their own, so the whole clusters between them
+		// can still be read in place.
+		ULONGLONG alignedStart = (position + m_clusterSize - 1) / m_clusterSize * m_clusterSize;
+		ULONGLONG alignedEnd = pieceEnd / m_clusterSize * m_clusterSize;
+		if (alignedStart >= alignedEnd) {
+			planClusters(plan, *dataRun, position, pieceEnd, offset);
+		}
+		else {
+			if (position < alignedStart) {
+				planClusters(plan, *dataRun, position, alignedStart, offset);
+			}
+			planClusters(plan, *dataRun, alignedStart, alignedEnd, offset);
+			if (alignedEnd < pieceEnd) {
+				planClusters(plan, *dataRun, alignedEnd, pieceEnd, offset);
+			}
+		}
+		position = pieceEnd;
+	}
+	return plan;
+}
+
+bool ReadPlanner::isDirect(const PlannedIO& io) {
+	return io.Segments.size() == 1 && io.Segments[0].IOOffset == 0 && io.Segments[0].Length == io.Length;
+}
+
+void ReadPlanner::planClusters(ReadPlan& plan, const DataRun& dataRun, ULONGLONG start, ULONGLONG end, ULONGLONG offset) const {
+	ULONGLONG firstVCN = start / m_clusterSize;
+	ULONGLONG lastVCN = (end + m_clusterSize - 1) / m_clusterSize;
+	DWORD ioOffset = (DWORD)(start - firstVCN * m_clusterSize);
+	PlannedIO io = {
+		false,
+		(dataRun.StartLCN + (firstVCN - dataRun.StartVCN)) * m_clusterSize,
+		(DWORD)((lastVCN - firstVCN) * m_clusterSize),
+		{ { ioOffset, (DWORD)(start - offset), (DWORD)(end - start) } }
+	};
+	addIO(plan, io);
+}
+
+void ReadPlanner::addIO(ReadPlan& plan, PlannedIO& io) const {
+	if (plan.empty() || plan.back().IsZeroFill != io.IsZeroFill) {
+		plan.push_back(io);
+		return;
+	}
+	PlannedIO& previousIO = plan.back();
+	if (io.IsZeroFill) {
+		// Consecutive sparse ranges are always consecutive in the output buffer too.
+		previousIO.Length += io.Length;
+		previousIO.Segments.back().Length += io.Length;
+		return;
+	}
+
+	ULONGLONG previousEnd = previousIO.DiskOffset + previousIO.Length;
+	// Only I/Os going forward on the disk are merged.
+	if (io.DiskOffset >= previousEnd) {
+		ULONGLONG gap = io.DiskOffset - previousEnd;
+		if (gap == 0 && isDirect(previousIO) && isDirect(io)) {
+			// Still read in place, no matter how long.
+			previousIO.Length += io.Length;
+			previousIO.Segments.back().Length += io.Length;
+			return;
+		}
+		ULONGLONG mergedLength = io.DiskOffset + io.Length - previousIO.DiskOffset;
+		if (gap <= m_gapTolerance && mergedLength <= READ_PLAN_MAX_MERGED_IO_SIZE) {
+			for (ReadSegment segment : io.Segments) {
+				segment.IOOffset += (DWORD)(io.DiskOffset - previousIO.DiskOffset);
+				previousIO.Segments.push_back(segment);
+			}
+			previousIO.Length = (DWORD)mergedLength;
+			return;
+		}
+	}
+	plan.push_back(io);
+}
@@ -0,0 +1,92 @@
+#ifndef _NTFSLIB_READ_PLANNER_H
+#define _NTFSLIB_READ_PLANNER_H
+
+#include <vector>
+
+#include "Defs.h"
+#include "ExtentMap.h"
+
+using std::vector;
+
+// Default gap (in bytes) between two data runs on the disk, which is read and discarded instead of issuing another I/O.
+#define READ_PLAN_DEFAULT_GAP_TOLERANCE (64 * 1024)
+// I/Os merged over gaps are read through an intermediate buffer, so they are kept this short.
+#define READ_PLAN_MAX_MERGED_IO_SIZE (1024 * 1024)
+
+/**
+ * Part of a planned I/O which goes to the output buffer.
+ */
+typedef struct {
+	// Offset of the segment in the I/O.
+	DWORD IOOffset;
+	// Offset of the segment in the output buffer.
+	DWORD BufferOffset;
+	// Length of the segment in bytes.
+	DWORD Length;
+} ReadSegment;
+
+/**
+ * A single physical I/O (or zero fill) of a read plan.
+ */
+typedef struct {
+	// Is this a sparse range, zero filled without any I/O?
+	bool IsZeroFill;
+	// Volume offset of the I/O (cluster aligned), unused for zero fills.
+	ULONGLONG DiskOffset;
+	// Length of the I/O in bytes (whole clusters, including discarded gaps).
+	DWORD Length;
+	// Parts of the I/O which go to the output buffer, in order. Everything else is discarded.
+	vector<ReadSegment> Segments;
+} PlannedIO;
+typedef vector<PlannedIO> ReadPlan;
+
+/**
+ * Plans the reads of a non-resident stream: turns a stream range into as few physical I/Os as possible.
+ * Data runs which are adjacent on the disk are read with a single I/O, straight into the output buffer.
+ * Short I/Os separated by a small gap on the disk are merged as well, reading and discarding the gap,
+ * since one more I/O costs more than the extra bytes. Sparse data runs become zero fills.
+ * See: NTFSVolume.readPlan, which performs the plan as a single batch.
+ */
+class ReadPlanner {
+public:
+	/**
+	 * Creates a planner for the stream mapped by <extents> (of <clusterSize> bytes clusters),
+	 * merging I/Os which are up to <gapTolerance> bytes apart on the disk.
+	 */
+	ReadPlanner(const ExtentMap& extents, WORD clusterSize, DWORD gapTolerance = READ_PLAN_DEFAULT_GAP_TOLERANCE);
+
+	/**
+	 * Plans the read of <length> bytes starting at stream offset <offset>.
+	 * Throws OutOfBoundsError if the range exceeds the stream, and BadSizeError if part of it is not mapped.
+	 */
+	ReadPlan plan(ULONGLONG offset, DWORD length) const;
+
+	/**
+	 * Returns true if <io> can be read straight into the output buffer (it has no gaps, nor partial clusters).
+	 */
+	static bool isDirect(const PlannedIO& io);
+
+private:
+	FORBID_COPY_AND_ASSIGN(ReadPlanner);
+
+	/**
+	 * Plans the read of stream range [<start>, <end>), found inside the non-sparse <dataRun>.
+	 */
+	void planClusters(ReadPlan& plan, const DataRun& dataRun, ULONGLONG start, ULONGLONG end, ULONGLONG offset) const;
+
+	/**
+	 * Appends <io> to <plan>, merging it into the previous I/O when possible.
+	 */
+	void addIO(ReadPlan& plan, PlannedIO& io) const;
+
+	// Data runs of the stream.
+	const ExtentMap& m_extents;
+
+	// Size of a single cluster.
+	const WORD m_clusterSize;
+
+	// Maximal gap on the disk between merged I/Os.
+	const DWORD m_gapTolerance;
+};
+
+#endif // _NTFSLIB_READ_PLANNER_H
@@ -0,0 +1,106 @@
+#include <algorithm>
+
+#include "Readahead.h"
+
+using std::async;
+using std::launch;
+using std::max;
+using std::min;
+using std::move;
+
+Readahead::Readahead(const StreamReader& reader, ULONGLONG streamSize, DWORD maxWindow /* = READAHEAD_MAX_WINDOW */) :
+	m_reader(reader),
+	m_streamSize(streamSize),
+	m_maxWindow(max<DWORD>(maxWindow, READAHEAD_MIN_WINDOW)),
+	m_window(0),
+	// Streams are mostly read from their beginning, the first read there is already sequential.
+	m_nextOffset(0) {
+	// Left blank.
+}
+
+Readahead::~Readahead() {
+	dropPrefetches();
+}
+
+void Readahead::read(PVOID buffer, ULONGLONG offset, DWORD length) {
+	if (offset == m_nextOffset) {
+		m_window = m_window == 0 ? max<DWORD>(READAHEAD_MIN_WINDOW, length) : m_window * 2;
+		m_window = min<DWORD>(m_window, m_maxWindow);
+	}
+	else {
+		// Random access, whatever was read ahead is useless.
+		m_window = 0;
+		dropPrefetches();
+	}
+	m_nextOffset = offset + length;
+
+	PBYTE output = (PBYTE)buffer;
+	while (length > 0 && !m_prefetches.empty()) {
+		Prefetch& prefetch = *m_prefetches.front();
+		if (offset < prefetch.Offset || offset >= prefetch.Offset + prefetch.Length) {
+			break;
+		}
+		if (prefetch.Completion.valid()) {
+			try {
+				prefetch.Completion.get();
+			}
+			catch (...) {
+				m_window = 0;
+				dropPrefetches();
+				throw;
+			}
+		}
+		DWORD bytesToCopy = (DWORD)min<ULONGLONG>(length, prefetch.Offset + prefetch.Length - offset);
+		memcpy(output, prefetch.Data->data() + (offset - prefetch.Offset), bytesToCopy);
+		output += bytesToCopy;
+		offset += bytesToCopy;
+		length -= bytesToCopy;
+		if (offset == prefetch.Offset + prefetch.Length) {
+			m_prefetches.pop_front();
+		}
+	}
+	if (length > 0) {
+		// Not read ahead (yet).
+		m_reader(output, offset, length);
+	}
+	schedule();
+}
+
+DWORD Readahead::getWindow() const {
+	return m_window;
+}
+
+void Readahead::schedule() {
+	if (m_window == 0) {
+		return;
+	}
+	ULONGLONG aheadOffset = m_prefetches.empty() ? m_nextOffset : m_prefetches.back()->Offset + m_prefetches.back()->Length;
+	while (m_prefetches.size() < READAHEAD_MAX_PREFETCHES && aheadOffset < m_streamSize) {
+		unique_ptr<Prefetch> prefetch(new Prefetch());
+		prefetch->Offset = aheadOffset;
+		prefetch->Length = (DWORD)min<ULONGLONG>(m_window, m_streamSize - aheadOffset);
+		prefetch->Data.reset(new PooledBuffer(m_bufferPool, prefetch->Length));
+		PBYTE data = prefetch->Data->data();
+		ULONGLONG prefetchOffset = prefetch->Offset;
+		DWORD prefetchLength = prefetch->Length;
+		StreamReader reader = m_reader;
+		// Read at the priority class of the operation reading the stream.
+		IOOperationPriority ioPriority = IOPriorityScope::getCurrent();
+		prefetch->Completion = async(launch::async, [reader, data, prefetchOffset, prefetchLength, ioPriority]() {
+			IOPriorityScope priorityScope(ioPriority);
+			reader(data, prefetchOffset, prefetchLength);
+		});
+		aheadOffset += prefetch->Length;
+		m_prefetches.push_back(move(prefetch));
+	}
+}
+
+void Readahead::dropPrefetches() {
+	for (const unique_ptr<Prefetch>& prefetch : m_prefetches) {
+		// Their errors are of no interest anymore.
+		if (prefetch->Completion.valid()) {
+			prefetch->Completion.wait();
+		}
+	}
+	m_prefetches.clear();
+}
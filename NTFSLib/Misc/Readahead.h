@@ -0,0 +1,105 @@
+#ifndef _NTFSLIB_READAHEAD_H
+#define _NTFSLIB_READAHEAD_H
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "Defs.h"
+#include "AlignedBufferPool.h"
+#include "IOScheduler.h"
+
+using std::deque;
+using std::function;
+using std::future;
+using std::unique_ptr;
+
+// Readahead window once sequential access is detected.
+#define READAHEAD_MIN_WINDOW (256 * 1024)
+// The window doubles on every sequential read, up to this size.
+#define READAHEAD_MAX_WINDOW (16 * 1024 * 1024)
+// Number of windows read ahead at once (the one being consumed, and the next one).
+#define READAHEAD_MAX_PREFETCHES 2
+
+/**
+ * Reads <length> bytes of a stream, starting at <offset>, into <buffer>. Throws on failure.
+ */
+typedef function<void(PVOID buffer, ULONGLONG offset, DWORD length)> StreamReader;
+
+/**
+ * Readahead of a single stream (e.g. a data stream being dumped).
+ * Reads continuing where the previous read ended are sequential: the following windows of the stream are
+ * then read in the background, and served from memory once asked for. The window grows as long as the
+ * access stays sequential, and collapses (dropping everything read ahead) on the first random access.
+ * Not thread-safe, a single reader is expected.
+ */
+class Readahead {
+public:
+	/**
+	 * Reads ahead the stream of <streamSize> bytes read by <reader>, with windows of up to <maxWindow> bytes.
+	 * <reader> is also invoked from a background thread.
+	 */
+	Readahead(const StreamReader& reader, ULONGLONG streamSize, DWORD maxWindow = READAHEAD_MAX_WINDOW);
+
+	/**
+	 * Waits for the background reads.
+	 */
+	~Readahead();
+
+	/**
+	 * Reads <length> bytes starting at <offset> into <buffer>, from the windows read ahead when possible.
+	 * Errors of background reads are thrown once their data is asked for.
+	 */
+	void read(PVOID buffer, ULONGLONG offset, DWORD length);
+
+	/**
+	 * Returns the current window size, 0 if the access is not sequential.
+	 */
+	DWORD getWindow() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(Readahead);
+
+	// A window read in the background.
+	struct Prefetch {
+		ULONGLONG Offset;
+		DWORD Length;
+		// Page aligned, so unbuffered devices read the window in place.
+		unique_ptr<PooledBuffer> Data;
+		future<void> Completion;
+	};
+
+	/**
+	 * Starts reading the next windows in the background.
+	 */
+	void schedule();
+
+	/**
+	 * Drops all the windows read ahead, waiting for the ones still being read.
+	 */
+	void dropPrefetches();
+
+	// Reads the stream.
+	const StreamReader m_reader;
+
+	// Size of the stream in bytes.
+	const ULONGLONG m_streamSize;
+
+	// Maximal window size.
+	const DWORD m_maxWindow;
+
+	// Current window size, 0 if the access is not sequential.
+	DWORD m_window;
+
+	// Offset a sequential read would start at.
+	ULONGLONG m_nextOffset;
+
+	// Buffers of the windows, recycled as the windows are consumed.
+	AlignedBufferPool m_bufferPool;
+
+	// Windows read ahead, contiguous and in stream order.
+	deque<unique_ptr<Prefetch>> m_prefetches;
+};
+
+#endif // _NTFSLIB_READAHEAD_H
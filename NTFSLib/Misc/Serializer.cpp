@@ -9,7 +9,7 @@ Serializer::Serializer(DWORD totalLength) :
 
 void Serializer::serialize(PVOID data, DWORD dataLength) {
 	NTFSLIB_ASSERT(
-		m_index + dataLength < m_serializedData.size(),
+		m_index + dataLength <= m_serializedData.size(),
 		OutOfBoundsError
 	);
 	memcpy(m_serializedData.data() + m_index, data, dataLength);
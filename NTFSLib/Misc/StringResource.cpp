@@ -6,12 +6,28 @@ const PCHAR StringResource::fileRecordSignature = "FILE";
 
 const PCHAR StringResource::indexRecordSignature = "INDX";
 
+const PCHAR StringResource::gptSignature = "EFI PART";
+
+const PCHAR StringResource::vhdFooterCookie = "conectix";
+
+const PCHAR StringResource::vhdDynamicHeaderCookie = "cxsparse";
+
+const PCHAR StringResource::vhdxFileSignature = "vhdxfile";
+
+const PCHAR StringResource::vhdxHeaderSignature = "head";
+
+const PCHAR StringResource::vhdxRegionTableSignature = "regi";
+
+const PCHAR StringResource::vhdxMetadataSignature = "metadata";
+
 const PWCHAR StringResource::baseVolumePath = L"\\\\.\\%c:";
 
 const PWCHAR StringResource::windowsPathSeperator = L"\\";
 
 const PWCHAR StringResource::volumePrefix = L":\\";
 
-const PWCHAR StringResource::stopFullDirEventName = L"Global\\{fb26358e-a5c0-4176-9837-daa2f2c092a4}";
+const PWCHAR StringResource::vhdxRelativePathKey = L"relative_path";
+
+const PWCHAR StringResource::vhdxVolumePathKey = L"volume_path";
 
-const PWCHAR StringResource::stopFileDumpEventName = L"Global\\{e926e52e-da50-4edf-8fbf-f57d36bda539}";
+const PWCHAR StringResource::vhdxAbsolutePathKey = L"absolute_win32_path";
@@ -14,16 +14,32 @@ public:
 	const static PCHAR fileRecordSignature;
 	// "INDX"
 	const static PCHAR indexRecordSignature;
+	// "EFI PART"
+	const static PCHAR gptSignature;
+	// "conectix"
+	const static PCHAR vhdFooterCookie;
+	// "cxsparse"
+	const static PCHAR vhdDynamicHeaderCookie;
+	// "vhdxfile"
+	const static PCHAR vhdxFileSignature;
+	// "head"
+	const static PCHAR vhdxHeaderSignature;
+	// "regi"
+	const static PCHAR vhdxRegionTableSignature;
+	// "metadata"
+	const static PCHAR vhdxMetadataSignature;
 	// "\\.\%c:"
 	const static PWCHAR baseVolumePath;
 	// "\"
 	const static PWCHAR windowsPathSeperator;
 	// ":\\"
 	const static PWCHAR volumePrefix;
-	// Global\WinAnnounce_1_Event
-	const static PWCHAR stopFullDirEventName;
-	// Global\WinAnnounce_2_Event
-	const static PWCHAR stopFileDumpEventName;
+	// "relative_path"
+	const static PWCHAR vhdxRelativePathKey;
+	// "volume_path"
+	const static PWCHAR vhdxVolumePathKey;
+	// "absolute_win32_path"
+	const static PWCHAR vhdxAbsolutePathKey;
 };
 
 #define CMP_STR(buffer, resource) (strncmp((buffer), (resource), strlen((resource))) == 0)
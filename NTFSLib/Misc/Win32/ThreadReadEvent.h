@@ -0,0 +1,26 @@
+#ifndef _NTFSLIB_THREAD_READ_EVENT_H
+#define _NTFSLIB_THREAD_READ_EVENT_H
+
+#include "Win32.h"
+
+/**
+ * Overlapped reads on a shared handle must be waited on with a private event,
+ * otherwise a thread might wake up on another thread's completion.
+ * Declared thread_local, every reading thread lazily gets its own manual-reset event.
+ */
+struct ThreadReadEvent {
+	ThreadReadEvent() :
+		Handle(CreateEvent(NULL, TRUE, FALSE, NULL)) {
+		// Left blank.
+	}
+
+	~ThreadReadEvent() {
+		if (Handle != NULL) {
+			CloseHandle(Handle);
+		}
+	}
+
+	HANDLE Handle;
+};
+
+#endif // _NTFSLIB_THREAD_READ_EVENT_H
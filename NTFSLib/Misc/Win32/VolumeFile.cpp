@@ -1,9 +1,14 @@
 #include "VolumeFile.h"
 #include "..\NTFSLibError.h"
 #include "..\StringResource.h"
+#include "ThreadReadEvent.h"
+
+// Overlapped reads and IOCTLs are waited on with the calling thread's event.
+static thread_local ThreadReadEvent threadReadEvent;
 
 VolumeFile::VolumeFile(const WCHAR volumeLetter):
-	m_volumeLetter(volumeLetter) {
+	m_volumeLetter(volumeLetter),
+	m_position(0) {
 	// Checking volume letter.
 	NTFSLIB_ASSERT(
 		(m_volumeLetter >= 'a' && m_volumeLetter <= 'z') || (m_volumeLetter >= 'A' && m_volumeLetter <= 'Z'),
@@ -22,7 +27,7 @@ VolumeFile::VolumeFile(const WCHAR volumeLetter):
 		FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, // Share mode
 		NULL,													// Security attributes
 		OPEN_EXISTING,											// Creation disposition
-		FILE_ATTRIBUTE_NORMAL,									// Flags & Attributes
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,			// Flags & Attributes
 		NULL													// Template file
 	);
 	WIN32_ASSERT(m_volumeHandle != INVALID_HANDLE_VALUE);
@@ -35,41 +40,80 @@ VolumeFile::~VolumeFile() {
 }
 
 ULONGLONG VolumeFile::seek(ULONGLONG position, SEEK_METHOD seekMethod /*= SEEK_METHOD::BEGIN*/) {
-	LARGE_INTEGER largePosition, newPosition;
-	largePosition.QuadPart = (LONGLONG)position;
-	WIN32_ASSERT(SetFilePointerEx(
-		m_volumeHandle,		// File handle
-		largePosition,		// Distance to move
-		&newPosition,		// New file pointer
-		(DWORD)seekMethod	// Move method
-		)!= 0);
-	return (ULONGLONG)newPosition.QuadPart;
+	// Overlapped handles have no file pointer, so the caret is moved here.
+	switch (seekMethod) {
+	case SEEK_METHOD::BEGIN:
+		m_position = position;
+		break;
+	case SEEK_METHOD::CURRENT:
+		m_position += position;
+		break;
+	case SEEK_METHOD::END: {
+		GET_LENGTH_INFORMATION lengthInfo = { 0 };
+		sendIoctl(IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &lengthInfo, sizeof(lengthInfo));
+		m_position = (ULONGLONG)lengthInfo.Length.QuadPart + position;
+		break;
+	}
+	}
+	return m_position;
 }
 
 DWORD VolumeFile::read(PVOID buffer, DWORD bytesToRead) {
+	DWORD bytesRead = readAt(buffer, m_position, bytesToRead);
+	m_position += bytesRead;
+	return bytesRead;
+}
+
+DWORD VolumeFile::readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) {
+	WIN32_ASSERT(threadReadEvent.Handle != NULL);
+
+	OVERLAPPED overlapped = { 0 };
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	overlapped.hEvent = threadReadEvent.Handle;
+
 	DWORD bytesRead = 0;
-	WIN32_ASSERT(ReadFile(
+	if (!ReadFile(
 		m_volumeHandle,	// File handle
 		buffer,			// Buffer
 		bytesToRead,	// Bytes to read
-		&bytesRead,		// Bytes read
-		NULL			// Overlapped
-		));
+		NULL,			// Bytes read (known once the read completes)
+		&overlapped		// Overlapped
+		)) {
+		DWORD errorCode = GetLastError();
+		// Reading past the end of the volume is not an error, we just read nothing.
+		if (errorCode == ERROR_HANDLE_EOF) {
+			return 0;
+		}
+		WIN32_ASSERT(errorCode == ERROR_IO_PENDING);
+	}
+	if (!GetOverlappedResult(m_volumeHandle, &overlapped, &bytesRead, TRUE)) {
+		WIN32_ASSERT(GetLastError() == ERROR_HANDLE_EOF);
+	}
 	return bytesRead;
 }
 
 DWORD VolumeFile::sendIoctl(DWORD code, PVOID inBuffer, DWORD inBufferSize, PVOID outBuffer, DWORD outBufferSize) {
+	WIN32_ASSERT(threadReadEvent.Handle != NULL);
+
+	// IOCTLs on an overlapped handle must be given an OVERLAPPED structure too.
+	OVERLAPPED overlapped = { 0 };
+	overlapped.hEvent = threadReadEvent.Handle;
+
 	DWORD bytesRead = 0;
-	WIN32_ASSERT(DeviceIoControl(
+	if (!DeviceIoControl(
 		m_volumeHandle, // Device 
 		code,			// IO Control Code
 		inBuffer,		// Input buffer
 		inBufferSize,	// Input buffer size
 		outBuffer,		// Output buffer
 		outBufferSize,	// Output buffer size
-		&bytesRead,		// Bytes returned
-		NULL			// Overlapped
-		) != 0);
+		NULL,			// Bytes returned (known once the IOCTL completes)
+		&overlapped		// Overlapped
+		)) {
+		WIN32_ASSERT(GetLastError() == ERROR_IO_PENDING);
+	}
+	WIN32_ASSERT(GetOverlappedResult(m_volumeHandle, &overlapped, &bytesRead, TRUE));
 	return bytesRead;
 }
 
@@ -16,6 +16,8 @@ enum class SEEK_METHOD {
 
 /**
 * Simple volume handle (actually, just a regular file handle) container.
+* The handle is overlapped, so reads from several threads run concurrently instead of one at a time.
+* It has no caret of its own, the caret used by seek and read is kept here, and is not thread-safe.
 */
 class VolumeFile {
 public:
@@ -34,6 +36,12 @@ public:
 	 */
 	DWORD read(PVOID buffer, DWORD bytesToRead);
 
+	/**
+	 * Reads <bytesToRead> bytes from <offset> into <buffer>, returns the actual bytes read.
+	 * The read is positional and does not depend on (nor move) the caret position, so it is thread-safe.
+	 */
+	DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead);
+
 	/**
 	 * Sends an IOCTL to the volume. Input is defined by <inBuffer>, and output will be placed in <outBuffer>.
 	 */
@@ -52,6 +60,9 @@ private:
 
 	// Volume's handle.
 	HANDLE m_volumeHandle;
+
+	// Caret position (see: seek).
+	ULONGLONG m_position;
 };
 
 #endif // _NTFSLIB_VOLUME_FILE_H
@@ -0,0 +1,106 @@
+#include "WorkStealingPool.h"
+#include "NTFSLibError.h"
+
+using std::lock_guard;
+
+WorkStealingPool::WorkStealingPool(DWORD numOfThreads) :
+	m_numOfThreads(numOfThreads > 0 ? numOfThreads : (thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1)),
+	m_cancelled(false),
+	m_error(nullptr) {
+	for (DWORD i = 0; i < m_numOfThreads; ++i) {
+		m_queues.push_back(unique_ptr<WorkerQueue>(new WorkerQueue()));
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	cancel();
+	for (thread& worker : m_threads) {
+		worker.join();
+	}
+}
+
+void WorkStealingPool::start(vector<PoolTask> tasks) {
+	NTFSLIB_ASSERT(
+		m_threads.empty(),
+		UnexpectedActionError
+	);
+	m_cancelled = false;
+	m_error = nullptr;
+
+	// Worker i gets the i-th contiguous share of the batch.
+	size_t numOfTasks = tasks.size();
+	for (DWORD i = 0; i < m_numOfThreads; ++i) {
+		size_t shareStart = numOfTasks * i / m_numOfThreads;
+		size_t shareEnd = numOfTasks * (i + 1) / m_numOfThreads;
+		lock_guard<mutex> lock(m_queues[i]->Lock);
+		for (size_t j = shareStart; j < shareEnd; ++j) {
+			m_queues[i]->Tasks.push_back(std::move(tasks[j]));
+		}
+	}
+	for (DWORD i = 0; i < m_numOfThreads; ++i) {
+		m_threads.push_back(thread(&WorkStealingPool::workerLoop, this, i));
+	}
+}
+
+void WorkStealingPool::wait() {
+	for (thread& worker : m_threads) {
+		worker.join();
+	}
+	m_threads.clear();
+	if (m_error != nullptr) {
+		exception_ptr error = m_error;
+		m_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void WorkStealingPool::cancel() {
+	m_cancelled = true;
+	for (unique_ptr<WorkerQueue>& queue : m_queues) {
+		lock_guard<mutex> lock(queue->Lock);
+		queue->Tasks.clear();
+	}
+}
+
+DWORD WorkStealingPool::getNumOfThreads() const {
+	return m_numOfThreads;
+}
+
+void WorkStealingPool::workerLoop(DWORD workerIndex) {
+	PoolTask task;
+	while (!m_cancelled && takeTask(workerIndex, task)) {
+		try {
+			task(workerIndex);
+		}
+		catch (...) {
+			lock_guard<mutex> lock(m_errorLock);
+			if (m_error == nullptr) {
+				m_error = std::current_exception();
+			}
+			cancel();
+		}
+	}
+}
+
+bool WorkStealingPool::takeTask(DWORD workerIndex, PoolTask& task) {
+	{
+		WorkerQueue& ownQueue = *m_queues[workerIndex];
+		lock_guard<mutex> lock(ownQueue.Lock);
+		if (!ownQueue.Tasks.empty()) {
+			task = std::move(ownQueue.Tasks.front());
+			ownQueue.Tasks.pop_front();
+			return true;
+		}
+	}
+	// Nothing left of our own, stealing from the next busy worker.
+	for (DWORD i = 1; i < m_numOfThreads; ++i) {
+		WorkerQueue& victimQueue = *m_queues[(workerIndex + i) % m_numOfThreads];
+		lock_guard<mutex> lock(victimQueue.Lock);
+		if (!victimQueue.Tasks.empty()) {
+			task = std::move(victimQueue.Tasks.back());
+			victimQueue.Tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
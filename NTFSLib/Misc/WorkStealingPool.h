@@ -0,0 +1,105 @@
+#ifndef _NTFSLIB_WORK_STEALING_POOL_H
+#define _NTFSLIB_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Defs.h"
+
+using std::atomic;
+using std::deque;
+using std::exception_ptr;
+using std::function;
+using std::mutex;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+/**
+ * A unit of work, invoked with the index of the worker running it (0 .. numOfThreads - 1).
+ */
+typedef function<void(DWORD workerIndex)> PoolTask;
+
+/**
+ * Runs a batch of tasks over a fixed number of threads.
+ * Each worker is handed a contiguous share of the batch, which it runs in order (so neighbouring tasks,
+ * e.g. neighbouring disk ranges, stay on the same thread). Idle workers steal from the far end of the
+ * other workers' shares, so uneven tasks still keep all the threads busy.
+ */
+class WorkStealingPool {
+public:
+	/**
+	 * Creates a pool of <numOfThreads> workers (0 uses the number of hardware threads).
+	 */
+	explicit WorkStealingPool(DWORD numOfThreads);
+
+	/**
+	 * Cancels the pending tasks and waits for the running ones.
+	 */
+	~WorkStealingPool();
+
+	/**
+	 * Starts running <tasks> in the background. Only a single batch may run at a time.
+	 */
+	void start(vector<PoolTask> tasks);
+
+	/**
+	 * Waits for the current batch to end. If a task threw, the rest of the batch is cancelled
+	 * and the first error is rethrown here.
+	 */
+	void wait();
+
+	/**
+	 * Drops all the tasks that have not started yet (running tasks are not interrupted).
+	 */
+	void cancel();
+
+	/**
+	 * Returns the number of workers.
+	 */
+	DWORD getNumOfThreads() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(WorkStealingPool);
+
+	// Tasks owned by a single worker. The owner pops from the front, thieves steal from the back.
+	struct WorkerQueue {
+		mutex Lock;
+		deque<PoolTask> Tasks;
+	};
+
+	/**
+	 * Runs tasks on worker <workerIndex> until none are left.
+	 */
+	void workerLoop(DWORD workerIndex);
+
+	/**
+	 * Takes the next task for worker <workerIndex>, from its own queue or from another worker's.
+	 * Returns false if there is nothing left to run.
+	 */
+	bool takeTask(DWORD workerIndex, PoolTask& task);
+
+	// Number of workers.
+	const DWORD m_numOfThreads;
+
+	// A queue per worker.
+	vector<unique_ptr<WorkerQueue>> m_queues;
+
+	// Threads running the current batch.
+	vector<thread> m_threads;
+
+	// Set once the current batch was cancelled.
+	atomic<bool> m_cancelled;
+
+	// First error thrown by a task of the current batch.
+	mutex m_errorLock;
+	exception_ptr m_error;
+};
+
+#endif // _NTFSLIB_WORK_STEALING_POOL_H
@@ -3,6 +3,15 @@
 
 #include "NTFSParser.h"
 #include "NTFSOutStream.h"
+#include "Device/VolumeDevice.h"
+#include "Device/RawImageDevice.h"
+#include "Device/MappedImageDevice.h"
+#include "Device/SegmentedImageDevice.h"
+#include "Device/PartitionDevice.h"
+#include "Device/PartitionTable.h"
+#include "Device/VirtualDiskDevice.h"
+#include "Device/VhdDevice.h"
+#include "Device/VhdxDevice.h"
 #include "Misc/NTFSLibError.h"
 
 #endif // _NTFSLIB_NTFS_LIB_H
@@ -1,28 +1,58 @@
+#include <algorithm>
 #include <cctype>
 #include <set>
 
 #include "NTFSUtils.h"
 #include "NTFSParser.h"
 #include "Misc\StringResource.h"
+#include "Misc\Readahead.h"
 #include "Attribute\IndexRootAttribute.h"
 #include "Attribute\VolumeNameAttribute.h"
 #include "Attribute\IndexAllocationAttribute.h"
 #include "Attribute\VolumeInformationAttribute.h"
 #include "Attribute\AttributesListAttribute.h"
+#include "Attribute\BitmapAttribute.h"
+#include "Device\VolumeDevice.h"
 
+using std::min;
 using std::set;
 using std::make_shared;
+using std::lock_guard;
 
 NTFSParser::NTFSParser(WCHAR volumeLetter):
-	m_volume(volumeLetter),
-	m_stopFullDirEvent(StringResource::stopFullDirEventName),
-	m_stopFileDumpEvent(StringResource::stopFileDumpEventName) {
-	Buffer mftBuffer(m_volume.getMFTRecordSize());
+	NTFSParser(make_shared<VolumeDevice>(volumeLetter), volumeLetter) {
+	// Left blank.
+}
+
+NTFSParser::NTFSParser(shared_ptr<BlockDevice> device, WCHAR volumeLetter /* = L'C' */):
+	m_volume(device, volumeLetter) {
+	shared_ptr<MFT_RECORD> mftRecordData = allocateMFTRecord();
 	NTFSLIB_ASSERT(
-		m_volume.readMFT(mftBuffer.data()) == mftBuffer.size(),
+		m_volume.readMFT(mftRecordData.get()) == m_volume.getMFTRecordSize(),
 		BadSizeError
 	);
-	m_MFTRecord = finalizeMFTRecord(mftBuffer);
+	m_MFTRecord = finalizeMFTRecord(mftRecordData);
+	// A fragmented MFT keeps the rest of its data runs in extension records, which are read with the first
+	// extent (kept in the MFT record itself). Records beyond the first extent are out of bounds until then.
+	AttributeView firstExtent = MFTRecordView(mftRecordData.get()).findDataStream(L"", 0);
+	NTFSLIB_ASSERT(
+		!firstExtent.isNull() && !firstExtent.isResident(),
+		AttributeNotFoundError
+	);
+	DataStreamAttribute firstMFTData(m_volume, firstExtent.getHeader());
+	const DataRun& lastDataRun = firstMFTData.getDataRuns().back();
+	m_MFTExtents = ExtentMap(firstMFTData.getDataRuns(), m_volume.getClusterSize(),
+		min<ULONGLONG>((lastDataRun.StartVCN + lastDataRun.NumOfClusters) * m_volume.getClusterSize(), firstMFTData.getSize()));
+
+	shared_ptr<DataStreamAttribute> mftData = m_MFTRecord->getDataStream();
+	NTFSLIB_ASSERT(
+		mftData != nullptr,
+		AttributeNotFoundError
+	);
+	m_MFTExtents = ExtentMap(mftData->getDataRuns(), m_volume.getClusterSize(), mftData->getSize());
+	// The MFT record is shared by all the scanning threads, nothing may be loaded lazily from now on.
+	m_MFTRecord->loadExtensionRecords();
+	TRACE(DEBUG_LEVEL::VERBOSE, "MFT is %llu bytes long, stored in %zu data runs", m_MFTExtents.getDataSize(), m_MFTExtents.getDataRuns().size());
 
 	shared_ptr<MFTRecord> volumeFile = readMFTRecord((ULONGLONG)NTFS_SYSTEM_FILES::FILE_Volume);
 	shared_ptr<VolumeInformationAttribute> volumeInfo = volumeFile->findAttribute<VolumeInformationAttribute>(ATTR_TYPE::AT_VOLUME_INFORMATION)[0];
@@ -39,8 +69,10 @@ NTFSParser::NTFSParser(WCHAR volumeLetter):
 	};
 	TRACE(DEBUG_LEVEL::INFO, "Running on NTFS %u.%u volume '%ws' ('%wc'), Serial: %llX", m_volumeAttributes.MajorVersion, m_volumeAttributes.MinorVersion, m_volumeAttributes.Name.c_str(), volumeLetter, m_volumeAttributes.SerialNumber);
 
-	// "Forwarding" Change Journal cursor to this exact moment.
-	m_volume.readChangeJournal(0xffffffff, true);
+	// "Forwarding" Change Journal cursor to this exact moment (images have no Change Journal).
+	if (m_volume.isChangeJournalAvailable()) {
+		m_volume.readChangeJournal(0xffffffff, true);
+	}
 }
 
 shared_ptr<MFTRecord> NTFSParser::findMFTRecord(const wstring& path) {
@@ -97,23 +129,27 @@ shared_ptr<MFTRecord> NTFSParser::findMFTRecord(const wstring& path) {
 	return currentFile;
 }
 
-DiffList NTFSParser::listDiffs(DWORD reason /* = 0xffffffff*/) {
+DiffList NTFSParser::listDiffs(DWORD reason /* = 0xffffffff*/, shared_ptr<const CancellationToken> cancellation /* = nullptr */) {
 	DiffList diffs;
 	map<ULONGLONG, DiffLocalCache> localCache;
-	ChangeJournalRecordList changeList = m_volume.readChangeJournal(reason);
+	ChangeJournalRecordList changeList = m_volume.readChangeJournal(reason, false, cancellation);
 	for (const ChangeJournalRecord& record : changeList) {
-		try {
-			shared_ptr<MFTRecord> relativeFileRecord = readMFTRecord(record.ReferenceNumber);
-			diffs.push_back({
-				record.ChangeReason,
-				(ULONGLONG)record.TimeStamp.QuadPart,
-				resolveFullFilePath(relativeFileRecord, localCache)
-			});
+		// Deleted and renamed files often can not be resolved anymore, no need to throw for every one of them.
+		NTFSLIB_STATUS status = NTFSLIB_STATUS::SUCCESS;
+		wstring fullPath;
+		shared_ptr<MFTRecord> relativeFileRecord = tryReadMFTRecord(record.ReferenceNumber, status);
+		if (relativeFileRecord != nullptr) {
+			status = tryResolveFullFilePath(relativeFileRecord, localCache, fullPath);
 		}
-		catch (NTFSLibError&) {
-			// Something went wrong with this specific record, we should just move on.
-			TRACE(DEBUG_LEVEL::VERBOSE, "Error while adding record %#llx to the DiffList", record.ReferenceNumber);
+		if (status != NTFSLIB_STATUS::SUCCESS) {
+			TRACE(DEBUG_LEVEL::VERBOSE, "Could not add record %#llx to the DiffList (Status: %d)", record.ReferenceNumber, (int)status);
+			continue;
 		}
+		diffs.push_back({
+			record.ChangeReason,
+			(ULONGLONG)record.TimeStamp.QuadPart,
+			fullPath
+		});
 	}
 	return diffs;
 }
@@ -124,53 +160,100 @@ Dir NTFSParser::listFiles(const wstring path /*= L"C:"*/, bool recursive /*= fal
 	return listDirectoryFiles(ourFile, recursive, maxDepth);
 }
 
-void NTFSParser::dumpFullDir(NTFSOutStream& outStream, WORD maxFileRecordsPerFlush) {
+bool NTFSParser::scanMFTRecords(const MFTRecordVisitor& visitor, const MFTScanOptions& options /* = MFTScanOptions() */) {
+	// Everything the scan reads runs at the scan's priority (extension records included), on all of its threads.
+	IOPriorityScope ioPriority(m_volume.getIOPriority(IO_SOURCE::MFT_SCAN));
+	MFTRecordJoiner joiner(m_volume, [this](PMFT_RECORD recordData, bool copyRecord) -> shared_ptr<MFTRecord> {
+		return createMFTRecord(recordData, copyRecord);
+	}, options.MaxPendingJoins);
+	bool scanCompleted = scanRecordData([&](ULONGLONG, PMFT_RECORD recordData) -> bool {
+		JoinedMFTRecords completedRecords;
+		joiner.addRecord(recordData, completedRecords);
+		return visitRecords(visitor, completedRecords);
+	}, options);
+	if (!scanCompleted) {
+		return false;
+	}
+
+	// Base records whose extension records were not all scanned.
+	JoinedMFTRecords completedRecords;
+	joiner.flush(completedRecords);
+	return visitRecords(visitor, completedRecords);
+}
+
+bool NTFSParser::scanMFTRecordViews(const MFTRecordViewVisitor& visitor, const MFTScanOptions& options /* = MFTScanOptions() */) {
+	IOPriorityScope ioPriority(m_volume.getIOPriority(IO_SOURCE::MFT_SCAN));
+	return scanRecordData([&](ULONGLONG, PMFT_RECORD recordData) -> bool {
+		return visitor(MFTRecordView(recordData));
+	}, options);
+}
+
+bool NTFSParser::processMFTRecords(const MFTRecordProcessor& processor, const MFTOutputSink& sink, const MFTScanOptions& options /* = MFTScanOptions() */) {
+	IOPriorityScope ioPriority(m_volume.getIOPriority(IO_SOURCE::MFT_SCAN));
+	return runMFTPipeline(nullptr, processor, sink, options);
+}
+
+void NTFSParser::dumpFullDir(NTFSOutStream& outStream, WORD maxFileRecordsPerFlush, const MFTScanOptions& options /* = MFTScanOptions() */) {
+	IOPriorityScope ioPriority(m_volume.getIOPriority(IO_SOURCE::MFT_SCAN));
+	// Registered first, so stopFullDir stops it whenever it is called once dumpFullDir was.
+	// The pipeline checks the token on all of its threads (see: MFTScanOptions.Cancellation).
+	MFTScanOptions scanOptions = options;
+	scanOptions.Cancellation = startOperation(m_fullDirOperations, options.Cancellation);
 	TRACE(DEBUG_LEVEL::VERBOSE, "Dumping full dir, flushing every %u records at most", maxFileRecordsPerFlush);
 	DWORD maxBufferSize = (_MAX_PATH * 2 + sizeof(b1) + sizeof(b4) + sizeof(b8) * 8) * maxFileRecordsPerFlush;
 	DWORD totalBytesRead = 0;
 	WORD recordsRead = 0;
-	ULONGLONG totalNumberOfRecords = m_MFTRecord->getSize() / m_volume.getMFTRecordSize();
-	
-	bool stopRequested = false;
+
 	Buffer data;
 	data.reserve(maxBufferSize);
-	shared_ptr<MFTRecord> fileRecord = nullptr;
-	for (ULONGLONG i = 0; i < totalNumberOfRecords; ++i) {
-		if (m_stopFullDirEvent.isSignaled()) {
-			TRACE(DEBUG_LEVEL::CRITICAL, "Stop full dir event signaled, stopping");
-			stopRequested = true;
-			break;
+	// Serializing on the scanning threads, only the flushing is left to the calling thread.
+	// Records which can not be serialized (e.g. records without names) are just skipped.
+	bool scanCompleted = runMFTPipeline([](PMFT_RECORD recordData, MFTRecordOutputs& outputs) -> bool {
+		MFTRecordView recordView(recordData);
+		if (!recordView.isBaseRecord() || recordView.hasAttributeList()) {
+			// Needs to be joined with its base or extension records first.
+			return false;
 		}
-		try {
-			fileRecord = readMFTRecord(i);
-			Buffer serizlizedData = fileRecord->serialize();
-			data.insert(data.end(), serizlizedData.begin(), serizlizedData.end());
-			recordsRead++;
-			totalBytesRead += (DWORD)serizlizedData.size();
-
-			if (recordsRead == maxFileRecordsPerFlush) {
-				TRACE(DEBUG_LEVEL::VERBOSE, "Flushing %u records", recordsRead);
-				outStream.write(data.data(), totalBytesRead);
-				data.clear();
-				totalBytesRead = 0;
-				recordsRead = 0;
-			}
+		// Everything is in this record, serializing it in place.
+		if (recordView.trySerialize(outputs.Data) == NTFSLIB_STATUS::SUCCESS) {
+			outputs.RecordEnds.push_back(outputs.Data.size());
 		}
-		catch (NTFSLibError&) {
-			// Something went wring with this record, we should just skip it.
-			TRACE(DEBUG_LEVEL::VERBOSE, "Error while dumping record %#llx", i);
+		return true;
+	}, [](MFTRecord& fileRecord, Buffer& output) -> bool {
+		// Sizes might be kept in extension records which were not scanned, and are only read now.
+		return fileRecord.trySerialize(output) == NTFSLIB_STATUS::SUCCESS;
+	}, [&](PBYTE serizlizedData, DWORD serizlizedDataLength) -> bool {
+		data.insert(data.end(), serizlizedData, serizlizedData + serizlizedDataLength);
+		recordsRead++;
+		totalBytesRead += serizlizedDataLength;
+
+		if (recordsRead == maxFileRecordsPerFlush) {
+			TRACE(DEBUG_LEVEL::VERBOSE, "Flushing %u records", recordsRead);
+			outStream.write(data.data(), totalBytesRead);
+			data.clear();
+			totalBytesRead = 0;
+			recordsRead = 0;
 		}
+		return true;
+	}, scanOptions);
+	if (!scanCompleted) {
+		TRACE(DEBUG_LEVEL::CRITICAL, "Full dir stopped");
 	}
 
 	// Means we got some left overs (Max: maxFileRecordsPerFlush - 1 records).
-	if (!stopRequested && recordsRead > 0) {
+	if (scanCompleted && recordsRead > 0) {
 		TRACE(DEBUG_LEVEL::VERBOSE, "Flushing %u records", recordsRead);
 		outStream.write(data.data(), totalBytesRead);
 		// No need to reset flags again.
 	}
 }
 
-void NTFSParser::dumpFile(NTFSOutStream& outStream, DWORD maxBlockSizePerFlush, const wstring& filePath, const wstring& streamName /*= L""*/, ULONGLONG offset /*= 0*/, DWORD amount /*= 0*/) {
+void NTFSParser::dumpFile(NTFSOutStream& outStream, DWORD maxBlockSizePerFlush, const wstring& filePath, const wstring& streamName /*= L""*/, ULONGLONG offset /*= 0*/, DWORD amount /*= 0*/,
+	shared_ptr<const CancellationToken> cancellation /* = nullptr */) {
+	// The lookup of the file included, and the readahead's reads too.
+	IOPriorityScope ioPriority(m_volume.getIOPriority(IO_SOURCE::DATA_STREAM));
+	// Registered first, so stopFileDump stops it even while the file is looked up.
+	shared_ptr<CancellationToken> operation = startOperation(m_fileDumpOperations, cancellation);
 	TRACE(DEBUG_LEVEL::VERBOSE, "Dumping file: %ws:[%ws], flushing every %lu bytes at most", filePath.c_str(),
 		streamName.length() > 0 ? streamName.c_str() : L"Main Data Stream", maxBlockSizePerFlush);
 	NTFSLIB_ASSERT(
@@ -179,41 +262,181 @@ void NTFSParser::dumpFile(NTFSOutStream& outStream, DWORD maxBlockSizePerFlush,
 	);
 
 	shared_ptr<MFTRecord> ourFile = findMFTRecord(filePath);
+	// Looked up once, the readahead reads the stream from the background (and the record is not thread-safe).
+	shared_ptr<DataStreamAttribute> dataStream = ourFile->getDataStream(streamName);
+	if (dataStream == nullptr) {
+		NTFSLIB_ERROR(AttributeNotFoundError, NTFSLIB_DEFAULT_ERROR_CODE, "Could not read from stream [%ws] since it does not exist", streamName.c_str());
+	}
 
 	bool stopRequested = false;
 	Buffer attrData;
 	attrData.reserve(maxBlockSizePerFlush);
-	DWORD totalSize = amount == 0 ? (DWORD)ourFile->getSize(streamName) : amount;
+	DWORD totalSize = amount == 0 ? (DWORD)dataStream->getSize() : amount;
 	DWORD numOfBlocks = totalSize / maxBlockSizePerFlush;
+	// Nothing beyond the dumped range is read ahead.
+	Readahead readahead([dataStream](PVOID buffer, ULONGLONG readOffset, DWORD length) {
+		dataStream->getData(buffer, readOffset, length);
+	}, offset + totalSize);
 	for (DWORD i = 0; i < numOfBlocks; ++i) {
-		if (m_stopFileDumpEvent.isSignaled()) {
-			TRACE(DEBUG_LEVEL::CRITICAL, "Stop dump file event signaled, stopping");
+		if (operation->isCancelled()) {
+			TRACE(DEBUG_LEVEL::CRITICAL, "File dump stopped");
 			stopRequested = true;
 			break;
 		}
-		ourFile->read(attrData.data(), streamName, offset + (i * maxBlockSizePerFlush), maxBlockSizePerFlush);
+		readahead.read(attrData.data(), offset + ((ULONGLONG)i * maxBlockSizePerFlush), maxBlockSizePerFlush);
 		outStream.write(attrData.data(), maxBlockSizePerFlush);
 	}
 
 	DWORD bytesLeft = totalSize % maxBlockSizePerFlush;
 	if (!stopRequested && bytesLeft > 0) {
-		ourFile->read(attrData.data(), streamName, offset + (numOfBlocks * maxBlockSizePerFlush), bytesLeft);
+		readahead.read(attrData.data(), offset + ((ULONGLONG)numOfBlocks * maxBlockSizePerFlush), bytesLeft);
 		outStream.write(attrData.data(), bytesLeft);
 	}
 }
 
 void NTFSParser::stopFullDir() {
-	m_stopFullDirEvent.signal();
+	cancelOperations(m_fullDirOperations);
 }
 
 void NTFSParser::stopFileDump() {
-	m_stopFileDumpEvent.signal();
+	cancelOperations(m_fileDumpOperations);
 }
 
 const VolumeAttributes& NTFSParser::getVolumeAttributes() const {
 	return m_volumeAttributes;
 }
 
+void NTFSParser::setClusterCacheSize(ULONGLONG byteBudget) {
+	m_volume.setClusterCacheSize(byteBudget);
+}
+
+ClusterCacheStatistics NTFSParser::getClusterCacheStatistics() const {
+	return m_volume.getClusterCacheStatistics();
+}
+
+IOStatisticsSnapshot NTFSParser::getIOStatistics() const {
+	return m_volume.getIOStatistics();
+}
+
+void NTFSParser::resetIOStatistics() {
+	m_volume.resetIOStatistics();
+}
+
+void NTFSParser::startIOStatisticsDump(DWORD intervalMilliseconds, const IOStatisticsSink& sink /* = nullptr */) {
+	m_volume.startIOStatisticsDump(intervalMilliseconds, sink);
+}
+
+void NTFSParser::stopIOStatisticsDump() {
+	m_volume.stopIOStatisticsDump();
+}
+
+void NTFSParser::setIOPriority(IO_SOURCE source, IO_PRIORITY priority) {
+	m_volume.setIOPriority(source, priority);
+}
+
+IO_PRIORITY NTFSParser::getIOPriority(IO_SOURCE source) const {
+	return m_volume.getIOPriority(source);
+}
+
+void NTFSParser::setIORateLimit(IO_PRIORITY priority, const IORateLimit& limit) {
+	m_volume.setIORateLimit(priority, limit);
+}
+
+IORateLimit NTFSParser::getIORateLimit(IO_PRIORITY priority) const {
+	return m_volume.getIORateLimit(priority);
+}
+
+shared_ptr<const Buffer> NTFSParser::readRecordsBitmap(const MFTScanOptions& options) {
+	if (options.IncludeUnusedRecords) {
+		return nullptr;
+	}
+	IOSourceScope ioSource(IO_SOURCE::MFT_SCAN);
+	// Reading the bitmap every scan, since records keep being allocated and freed on a live volume.
+	const vector<shared_ptr<BitmapAttribute>>& mftBitmaps = m_MFTRecord->findAttribute<BitmapAttribute>(ATTR_TYPE::AT_BITMAP, false);
+	if (mftBitmaps.empty()) {
+		// A damaged MFT record (e.g. of an image) might lose its bitmap, every record is scanned then (free ones too).
+		TRACE(DEBUG_LEVEL::INFO, "The MFT has no bitmap, scanning all of its records");
+		return nullptr;
+	}
+	return make_shared<const Buffer>(mftBitmaps[0]->getBitmap());
+}
+
+bool NTFSParser::scanRecordData(const MFTScanVisitor& visitor, const MFTScanOptions& options) {
+	if (options.NumOfThreads == 1) {
+		MFTScanner scanner(m_volume, m_MFTExtents, options.ChunkSize);
+		scanner.setRecordsBitmap(readRecordsBitmap(options));
+		scanner.setCancellation(options.Cancellation);
+		return scanner.scan(visitor);
+	}
+
+	ParallelMFTScanner parallelScanner(m_volume, m_MFTExtents, options);
+	parallelScanner.setRecordsBitmap(readRecordsBitmap(options));
+	parallelScanner.start([&](MFTScanner& scanner, size_t, const MFTRecordRange& range) -> bool {
+		return scanner.scan([&](ULONGLONG recordIndex, PMFT_RECORD recordData) -> bool {
+			// Other workers might have stopped the scan in the middle of our range.
+			return !parallelScanner.isStopped() && visitor(recordIndex, recordData);
+		}, range.FirstRecord, range.LastRecord);
+	});
+	return parallelScanner.wait();
+}
+
+bool NTFSParser::runMFTPipeline(const MFTInPlaceParser& parseInPlace, const MFTRecordProcessor& processor, const MFTOutputSink& sink, const MFTScanOptions& options) {
+	MFTRecordJoiner joiner(m_volume, [this](PMFT_RECORD recordData, bool copyRecord) -> shared_ptr<MFTRecord> {
+		return createMFTRecord(recordData, copyRecord);
+	}, options.MaxPendingJoins);
+	MFTScanPipeline pipeline(m_volume, m_MFTExtents, options);
+	pipeline.setRecordsBitmap(readRecordsBitmap(options));
+	bool scanCompleted = pipeline.run([&](ULONGLONG, PMFT_RECORD recordData, MFTRecordOutputs& outputs) {
+		if (parseInPlace != nullptr && parseInPlace(recordData, outputs)) {
+			return;
+		}
+		JoinedMFTRecords completedRecords;
+		if (joiner.addRecord(recordData, completedRecords)) {
+			// Held back until its extension records are scanned, its output keeps its place.
+			MFTScanPipeline::reserveOutput(outputs, MFTRecordView(recordData).getRecordNumber());
+		}
+		processRecords(pipeline, processor, completedRecords, outputs);
+	}, sink);
+	if (!scanCompleted) {
+		return false;
+	}
+
+	// Base records whose extension records were not all scanned.
+	JoinedMFTRecords completedRecords;
+	joiner.flush(completedRecords);
+	MFTRecordOutputs outputs;
+	processRecords(pipeline, processor, completedRecords, outputs);
+	return pipeline.flushReservedOutputs(sink);
+}
+
+bool NTFSParser::visitRecords(const MFTRecordVisitor& visitor, const JoinedMFTRecords& records) {
+	for (const JoinedMFTRecord& record : records) {
+		if (record.Record != nullptr && !visitor(*record.Record)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void NTFSParser::processRecords(MFTScanPipeline& pipeline, const MFTRecordProcessor& processor, const JoinedMFTRecords& records, MFTRecordOutputs& outputs) {
+	for (const JoinedMFTRecord& record : records) {
+		// Records which were held back fill the output reserved for them.
+		MFTRecordOutputs heldRecordOutputs;
+		MFTRecordOutputs& recordOutputs = record.WasHeld ? heldRecordOutputs : outputs;
+		size_t recordStart = recordOutputs.Data.size();
+		if (record.Record != nullptr && processor(*record.Record, recordOutputs.Data)) {
+			recordOutputs.RecordEnds.push_back(recordOutputs.Data.size());
+		}
+		else {
+			// Nothing to output for this record, dropping whatever it left behind.
+			recordOutputs.Data.resize(recordStart);
+		}
+		if (record.WasHeld) {
+			pipeline.fillReservedOutput(record.RecordNumber, std::move(heldRecordOutputs));
+		}
+	}
+}
+
 shared_ptr<MFTRecord> NTFSParser::findMFTRecordInFolder(shared_ptr<MFTRecord> folder, const wstring& fileName) {
 	shared_ptr<IndexRootAttribute> indexRoot = folder->findAttribute<IndexRootAttribute>(ATTR_TYPE::AT_INDEX_ROOT)[0];
 	Index entries = indexRoot->getIndexEntries();
@@ -252,47 +475,119 @@ shared_ptr<MFTRecord> NTFSParser::findMFTRecordInSubNode(shared_ptr<MFTRecord> r
 }
 
 shared_ptr<MFTRecord> NTFSParser::readMFTRecord(ULONGLONG recordIndex) {
+	NTFSLIB_STATUS status = NTFSLIB_STATUS::SUCCESS;
+	shared_ptr<MFTRecord> record = tryReadMFTRecord(recordIndex, status);
+	NTFSLIB_ASSERT_STATUS(status);
+	return record;
+}
+
+shared_ptr<MFTRecord> NTFSParser::tryReadMFTRecord(ULONGLONG recordIndex, NTFSLIB_STATUS& status) {
+	// Metadata read while loading the record (e.g. a non-resident attribute list) is counted with it.
+	IOSourceScope ioSource(IO_SOURCE::MFT_RECORD);
 	WORD mftRecordSize = m_volume.getMFTRecordSize();
 
 	ULONGLONG fileRecordAddr = (ULONGLONG)mftRecordSize * recordIndex;
-	Buffer recordBuffer(mftRecordSize);
-	m_MFTRecord->read(recordBuffer.data(), L"", fileRecordAddr, mftRecordSize);
-	return finalizeMFTRecord(recordBuffer);
+	if (fileRecordAddr + mftRecordSize > m_MFTExtents.getDataSize()) {
+		status = NTFSLIB_STATUS::OUT_OF_BOUNDS;
+		return nullptr;
+	}
+	ULONGLONG diskAddr = 0;
+	bool isContiguous = m_MFTExtents.translate(fileRecordAddr, mftRecordSize, diskAddr);
+	// The record is read (or copied, if the volume is mapped) once, straight into the record's own data,
+	// and fixed up there (mapped memory is never fixed up).
+	PBYTE mappedRecord = isContiguous ? m_volume.mapBytes(diskAddr, mftRecordSize) : nullptr;
+	shared_ptr<MFT_RECORD> recordData = allocateMFTRecord();
+	if (mappedRecord != nullptr) {
+		NTFSUtils::copyMappedMemory(recordData.get(), mappedRecord, mftRecordSize);
+	}
+	else if (isContiguous) {
+		NTFSLIB_ASSERT(
+			m_volume.readBytes(recordData.get(), diskAddr, mftRecordSize) == mftRecordSize,
+			BadSizeError
+		);
+	}
+	else {
+		// The record crosses data runs (clusters smaller than records), let the attribute stitch it together.
+		m_MFTRecord->read(recordData.get(), L"", fileRecordAddr, mftRecordSize);
+	}
+	return tryFinalizeMFTRecord(recordData, status);
 }
 
-shared_ptr<MFTRecord> NTFSParser::finalizeMFTRecord(Buffer& mftRecordBuffer) {
-	PMFT_RECORD recordData = (PMFT_RECORD)mftRecordBuffer.data();
-	NTFSLIB_ASSERT(
-		CMP_STR((PCHAR)&recordData->RecordHeader.Magic, StringResource::fileRecordSignature),
-		BadRecordHeaderError
-	);
-	NTFSUtils::USARecordFixup(&recordData->RecordHeader, m_volume.getSectorSize());
+shared_ptr<MFT_RECORD> NTFSParser::allocateMFTRecord() const {
+	return shared_ptr<MFT_RECORD>((PMFT_RECORD)new BYTE[m_volume.getMFTRecordSize()], [](PMFT_RECORD record) { delete[] (PBYTE)record; });
+}
 
-	shared_ptr<MFTRecord> record = make_shared<MFTRecord>(m_volume, recordData);
-	vector<shared_ptr<AttributesListAttribute>> attributeLists = record->findAttribute<AttributesListAttribute>(ATTR_TYPE::AT_ATTRIBUTE_LIST, false);
+shared_ptr<MFTRecord> NTFSParser::finalizeMFTRecord(shared_ptr<MFT_RECORD> recordData) {
+	NTFSLIB_STATUS status = NTFSLIB_STATUS::SUCCESS;
+	shared_ptr<MFTRecord> record = tryFinalizeMFTRecord(recordData, status);
+	NTFSLIB_ASSERT_STATUS(status);
+	return record;
+}
+
+shared_ptr<MFTRecord> NTFSParser::tryFinalizeMFTRecord(shared_ptr<MFT_RECORD> recordData, NTFSLIB_STATUS& status) {
+	if (!CMP_STR((PCHAR)&recordData->RecordHeader.Magic, StringResource::fileRecordSignature)) {
+		status = NTFSLIB_STATUS::BAD_RECORD_HEADER;
+		return nullptr;
+	}
+	if (!NTFSUtils::tryUSARecordFixup(&recordData->RecordHeader, m_volume.getSectorSize())) {
+		status = NTFSLIB_STATUS::USA_FIXUP_FAILED;
+		return nullptr;
+	}
+	shared_ptr<MFTRecord> record = createMFTRecord(make_shared<MFTRecord>(m_volume, recordData));
+	status = record->tryLoadMetadata();
+	return status == NTFSLIB_STATUS::SUCCESS ? record : nullptr;
+}
+
+shared_ptr<MFTRecord> NTFSParser::loadMFTRecord(PMFT_RECORD recordData, bool copyRecord) {
+	NTFSLIB_STATUS status = NTFSLIB_STATUS::SUCCESS;
+	shared_ptr<MFTRecord> record = tryLoadMFTRecord(recordData, copyRecord, status);
+	NTFSLIB_ASSERT_STATUS(status);
+	return record;
+}
+
+shared_ptr<MFTRecord> NTFSParser::tryLoadMFTRecord(PMFT_RECORD recordData, bool copyRecord, NTFSLIB_STATUS& status) {
+	shared_ptr<MFTRecord> record = createMFTRecord(recordData, copyRecord);
+	status = record->tryLoadMetadata();
+	return status == NTFSLIB_STATUS::SUCCESS ? record : nullptr;
+}
+
+shared_ptr<MFTRecord> NTFSParser::createMFTRecord(PMFT_RECORD recordData, bool copyRecord) {
+	return createMFTRecord(make_shared<MFTRecord>(m_volume, recordData, copyRecord));
+}
+
+shared_ptr<MFTRecord> NTFSParser::createMFTRecord(shared_ptr<MFTRecord> record) {
+	const vector<shared_ptr<AttributesListAttribute>>& attributeLists = record->findAttribute<AttributesListAttribute>(ATTR_TYPE::AT_ATTRIBUTE_LIST, false);
 	for (const shared_ptr<AttributesListAttribute> attributeList : attributeLists) {
-		AdditionalRecordRefs additionalRecordRefs = attributeList->getAdditionalMFTReferences();
-		for (const ULONGLONG& additionalRecordRef : additionalRecordRefs) {
-			if (additionalRecordRef != record->getRecordNumber()) {
-				record->addAdditionalFileRecord(readMFTRecord(additionalRecordRef));
-			}
-		}
+		// Extension records are only read once one of the attributes they keep is looked up.
+		record->setPendingExtensionRecords(attributeList->getEntries(), [this](ULONGLONG recordNumber, NTFSLIB_STATUS& status) -> shared_ptr<MFTRecord> {
+			return tryReadMFTRecord(recordNumber, status);
+		});
 	}
-	record->loadMetadata();
 	return record;
 }
 
-wstring NTFSParser::resolveFullFilePath(shared_ptr<MFTRecord> leaf, map<ULONGLONG, DiffLocalCache>& localCache) {
+NTFSLIB_STATUS NTFSParser::tryResolveFullFilePath(shared_ptr<MFTRecord> leaf, map<ULONGLONG, DiffLocalCache>& localCache, wstring& fullPath) {
+	NTFSLIB_STATUS status = NTFSLIB_STATUS::SUCCESS;
+	if (leaf->getFileNames().empty()) {
+		return NTFSLIB_STATUS::UNEXPECTED_ACTION;
+	}
 	wstring path = leaf->getFriendlyFileName();
 	shared_ptr<MFTRecord> parent = nullptr;
 	ULONGLONG currentRecordNumber = leaf->getParentRecordNumber();
 	DiffLocalCache cached;
 
-	try {
-		cached = localCache.at(currentRecordNumber);
+	auto cachedParent = localCache.find(currentRecordNumber);
+	if (cachedParent != localCache.end()) {
+		cached = cachedParent->second;
 	}
-	catch (std::out_of_range&) {
-		parent = readMFTRecord(currentRecordNumber);
+	else {
+		parent = tryReadMFTRecord(currentRecordNumber, status);
+		if (parent == nullptr) {
+			return status;
+		}
+		if (parent->getFileNames().empty()) {
+			return NTFSLIB_STATUS::UNEXPECTED_ACTION;
+		}
 		cached = { parent->getParentRecordNumber(), parent->getFriendlyFileName() };
 		localCache[currentRecordNumber] = cached;
 	}
@@ -300,12 +595,19 @@ wstring NTFSParser::resolveFullFilePath(shared_ptr<MFTRecord> leaf, map<ULONGLON
 	WORD depth = 0;
 	while (currentRecordNumber != (ULONGLONG)NTFS_SYSTEM_FILES::FILE_Root) {
 		path = cached.Name + StringResource::windowsPathSeperator + path;
-		try {
-			cached = localCache.at(cached.ParentReferenceNumber);
+		cachedParent = localCache.find(cached.ParentReferenceNumber);
+		if (cachedParent != localCache.end()) {
+			cached = cachedParent->second;
 			currentRecordNumber = cached.ParentReferenceNumber;
 		}
-		catch (std::out_of_range&) {
-			parent = readMFTRecord(cached.ParentReferenceNumber);
+		else {
+			parent = tryReadMFTRecord(cached.ParentReferenceNumber, status);
+			if (parent == nullptr) {
+				return status;
+			}
+			if (parent->getFileNames().empty()) {
+				return NTFSLIB_STATUS::UNEXPECTED_ACTION;
+			}
 			currentRecordNumber = parent->getParentRecordNumber();
 			cached = { currentRecordNumber, parent->getFriendlyFileName() };
 			localCache[parent->getRecordNumber()] = cached;
@@ -313,14 +615,14 @@ wstring NTFSParser::resolveFullFilePath(shared_ptr<MFTRecord> leaf, map<ULONGLON
 
 		// Making sure we are not in an infinite loop.
 		depth++;
-		NTFSLIB_ASSERT(
-			depth < 1024,
-			BadPathError
-		);
+		if (depth >= 1024) {
+			return NTFSLIB_STATUS::BAD_PATH;
+		}
 	}
 
 	// Adding RootFile (Volume letter) to the path.
-	return m_volume.getVolumePrefix() + cached.Name + StringResource::windowsPathSeperator + path;
+	fullPath = m_volume.getVolumePrefix() + cached.Name + StringResource::windowsPathSeperator + path;
+	return NTFSLIB_STATUS::SUCCESS;
 }
 
 Dir NTFSParser::listDirectoryFiles(shared_ptr<MFTRecord> root, bool recursive, int maxDepth) {
@@ -375,4 +677,26 @@ void NTFSParser::listSubNodeRecords(Dir& subNodeRecords, std::shared_ptr<MFTReco
 			listedRefs.push_back(recordRef);
 		}
 	}
+}
+
+shared_ptr<CancellationToken> NTFSParser::startOperation(vector<weak_ptr<CancellationToken>>& operations, shared_ptr<const CancellationToken> cancellation) {
+	shared_ptr<CancellationToken> operation = make_shared<CancellationToken>(cancellation);
+	lock_guard<mutex> lock(m_operationsLock);
+	// Forgetting the operations which already ended.
+	operations.erase(std::remove_if(operations.begin(), operations.end(), [](const weak_ptr<CancellationToken>& endedOperation) {
+		return endedOperation.expired();
+	}), operations.end());
+	operations.push_back(operation);
+	return operation;
+}
+
+void NTFSParser::cancelOperations(vector<weak_ptr<CancellationToken>>& operations) {
+	lock_guard<mutex> lock(m_operationsLock);
+	for (const weak_ptr<CancellationToken>& operation : operations) {
+		shared_ptr<CancellationToken> runningOperation = operation.lock();
+		if (runningOperation != nullptr) {
+			runningOperation->cancel();
+		}
+	}
+	operations.clear();
 }
\ No newline at end of file
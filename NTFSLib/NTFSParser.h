@@ -4,17 +4,28 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <functional>
 
 #include "NTFSVolume.h"
 #include "NTFSOutStream.h"
+#include "MFTScanner.h"
+#include "ParallelMFTScanner.h"
+#include "MFTScanPipeline.h"
+#include "MFTRecordJoiner.h"
 #include "Record\MFTRecord.h"
+#include "Record\MFTRecordView.h"
 #include "Record\IndexRecord.h"
 #include "Types\ChangeJournalTypes.h"
-#include "Misc\Win32\Event.h"
+#include "Misc\CancellationToken.h"
+#include "Misc\ExtentMap.h"
 
 using std::shared_ptr;
 using std::vector;
 using std::map;
+using std::function;
+using std::mutex;
+using std::weak_ptr;
 
 /**
 * Dir product created with NTFSParser Dir methods.
@@ -31,6 +42,30 @@ struct DirProduct {
 	Dir Children;
 };
 
+/**
+ * Invoked by NTFSParser.scanMFTRecords for every record found in the MFT.
+ * The record is parsed in place and is only valid during the call, return false to stop the scan.
+ */
+typedef function<bool(MFTRecord& record)> MFTRecordVisitor;
+
+/**
+ * Invoked by NTFSParser.scanMFTRecordViews for every record found in the MFT.
+ * The view is only valid during the call, return false to stop the scan.
+ */
+typedef function<bool(const MFTRecordView& record)> MFTRecordViewVisitor;
+
+/**
+ * Invoked by NTFSParser.processMFTRecords on the scanning threads for every record found in the MFT.
+ * Appends whatever it makes of <record> to <output>, returns false if it has nothing to output for it.
+ */
+typedef function<bool(MFTRecord& record, Buffer& output)> MFTRecordProcessor;
+
+/**
+ * Invoked by NTFSParser.runMFTPipeline on the scanning threads, to parse a record in place.
+ * Returns false if the record should rather be parsed as a whole MFTRecord.
+ */
+typedef function<bool(PMFT_RECORD record, MFTRecordOutputs& outputs)> MFTInPlaceParser;
+
 /**
  * Supplies a friendly API to deal with NTFS.
  */
@@ -41,6 +76,13 @@ public:
 	 */
 	NTFSParser(WCHAR volumeLetter);
 
+	/**
+	 * Creates a new parser for the volume found on <device> (e.g. a RawImageDevice).
+	 * Paths on this volume are resolved against <volumeLetter>.
+	 * The Change Journal is only available for live volumes.
+	 */
+	NTFSParser(shared_ptr<BlockDevice> device, WCHAR volumeLetter = L'C');
+
 	/**
 	 * Finds the MFT record with the given <path>.
 	 * Throws MFTRecordNotFoundError if not found.
@@ -51,34 +93,69 @@ public:
 	 * Lists all the files changed since the last time queried.
 	 * The parser "starts" to count whenever it is initialized.
 	 * You can specify a change reason mask: https://msdn.microsoft.com/en-us/library/windows/desktop/aa365722(v=vs.85).aspx
+	 * Once <cancellation> (if any) is cancelled, stops reading the journal and returns the diffs of the changes
+	 * read so far. The next call starts right after them (see: NTFSVolume.readChangeJournal).
 	 */
-	DiffList listDiffs(DWORD reason = 0xffffffff);
+	DiffList listDiffs(DWORD reason = 0xffffffff, shared_ptr<const CancellationToken> cancellation = nullptr);
 
 	/**
 	 * Lists files in a given directory.
 	 */
 	Dir listFiles(const wstring path = L"C:", bool recursive = false, int maxDepth = 1);
 
+	/**
+	 * Scans the whole MFT sequentially and calls <visitor> for every valid record.
+	 * Much faster than reading the records one by one (see: MFTScanner and MFTScanOptions).
+	 * If options.NumOfThreads is not 1, <visitor> is called concurrently from several threads,
+	 * in no particular order, and must be thread-safe.
+	 * Extension records are not visited on their own, they are joined with their base record, which is visited
+	 * once all of them were scanned (see: MFTRecordJoiner), so every record is read only once.
+	 * Returns false if the visitor stopped the scan.
+	 */
+	bool scanMFTRecords(const MFTRecordVisitor& visitor, const MFTScanOptions& options = MFTScanOptions());
+
+	/**
+	 * Same as scanMFTRecords, but hands <visitor> a view of the record instead of a parsed MFTRecord,
+	 * so nothing is allocated per record. Attributes kept in extension records are not visible through
+	 * the view (see: MFTRecordView.hasAttributeList), load those records with findMFTRecord when needed.
+	 */
+	bool scanMFTRecordViews(const MFTRecordViewVisitor& visitor, const MFTScanOptions& options = MFTScanOptions());
+
+	/**
+	 * Scans the whole MFT, calling <processor> for every valid record on options.NumOfThreads parser threads,
+	 * and <sink> for every record's output on the calling thread, while the MFT is read ahead on another
+	 * thread (see: MFTScanPipeline). The output is handed over in record order, unless options.OrderedOutput is false.
+	 * Base records with extension records are joined with them first (see: scanMFTRecords). Their output still
+	 * keeps their place in the ordered output, the output following it is held back until they are joined.
+	 * Unordered, they are handed over once their last extension record was scanned.
+	 * Returns false if the sink stopped the scan.
+	 */
+	bool processMFTRecords(const MFTRecordProcessor& processor, const MFTOutputSink& sink, const MFTScanOptions& options = MFTScanOptions());
+
 	/**
 	 * Dumps a full file list of this computer into an NTFSOutStream.
-	 * You can limit the flush size with maxFileRecordsPerFlush.
+	 * You can limit the flush size with maxFileRecordsPerFlush, and control the MFT scan with <options>.
+	 * Stops once options.Cancellation is cancelled, or stopFullDir is called.
 	 */
-	void dumpFullDir(NTFSOutStream& outStream, WORD maxFileRecordsPerFlush);
+	void dumpFullDir(NTFSOutStream& outStream, WORD maxFileRecordsPerFlush, const MFTScanOptions& options = MFTScanOptions());
 
 	/**
 	 * Dumps a specific file's data stream to NTFSOutStream.
 	 * Use <length> = 0 to read the whole stream.
+	 * The stream is read ahead in the background while the blocks are written (see: Readahead).
+	 * Stops once <cancellation> (if any) is cancelled, or stopFileDump is called.
 	 */
-	void dumpFile(NTFSOutStream& outStream, DWORD maxBlockSizePerFlush, const wstring& filePath, const wstring& streamName = L"", ULONGLONG offset = 0, DWORD amount = 0);
+	void dumpFile(NTFSOutStream& outStream, DWORD maxBlockSizePerFlush, const wstring& filePath, const wstring& streamName = L"", ULONGLONG offset = 0, DWORD amount = 0,
+		shared_ptr<const CancellationToken> cancellation = nullptr);
 
 	/**
-	 * Signals dumpFullDir to stop (you can call this from another thread).
+	 * Signals the dumpFullDir calls of this parser which are running to stop (you can call this from another thread).
 	 */
 	void stopFullDir();
 
 	/**
-	* Signals dumpFile to stop (you can call this from another thread).
-	*/
+	 * Signals the dumpFile calls of this parser which are running to stop (you can call this from another thread).
+	 */
 	void stopFileDump();
 
 	/**
@@ -86,7 +163,97 @@ public:
 	 */
 	const VolumeAttributes& getVolumeAttributes() const;
 
+	/**
+	 * Sets the byte budget of the volume's cluster cache, 0 disables it (see: NTFSVolume.setClusterCacheSize).
+	 */
+	void setClusterCacheSize(ULONGLONG byteBudget);
+
+	/**
+	 * Returns the volume's cluster cache counters.
+	 */
+	ClusterCacheStatistics getClusterCacheStatistics() const;
+
+	/**
+	 * Returns the volume's I/O counters: requests, bytes, seeks, cache hits and latencies, by what they were
+	 * read for (MFT scans, MFT records, index walks, data streams or the Change Journal).
+	 * e.g. a listFiles() whose latencies add up to most of its run time is I/O bound.
+	 */
+	IOStatisticsSnapshot getIOStatistics() const;
+
+	/**
+	 * Zeroes the volume's I/O counters.
+	 */
+	void resetIOStatistics();
+
+	/**
+	 * Hands the volume's I/O counters to <sink> every <intervalMilliseconds>, from a background thread,
+	 * until stopIOStatisticsDump is called. By default they are traced.
+	 */
+	void startIOStatisticsDump(DWORD intervalMilliseconds, const IOStatisticsSink& sink = nullptr);
+
+	/**
+	 * Stops the periodic dump of the I/O counters.
+	 */
+	void stopIOStatisticsDump();
+
+	/**
+	 * Sets the priority class of what the volume reads for <source>. By default MFT scans and data streams
+	 * are BACKGROUND, and yield to the INTERACTIVE rest (e.g. findMFTRecord while a dumpFullDir is running).
+	 * Whole operations run at the class of their main source: everything the MFT scans (scanMFTRecords,
+	 * scanMFTRecordViews, processMFTRecords and dumpFullDir) read, on all of their threads, runs at the class
+	 * of MFT_SCAN, and everything dumpFile reads at the class of DATA_STREAM.
+	 */
+	void setIOPriority(IO_SOURCE source, IO_PRIORITY priority);
+
+	/**
+	 * Returns the priority class of what the volume reads for <source>.
+	 */
+	IO_PRIORITY getIOPriority(IO_SOURCE source) const;
+
+	/**
+	 * Caps the bandwidth of the volume's reads of <priority> to <limit> (e.g. keeps a background listFiles()
+	 * from saturating a production disk). Nothing is limited by default.
+	 * Reads of mapped devices (see: BlockDevice.map) are not throttled.
+	 */
+	void setIORateLimit(IO_PRIORITY priority, const IORateLimit& limit);
+
+	/**
+	 * Returns the bandwidth cap of the volume's reads of <priority>.
+	 */
+	IORateLimit getIORateLimit(IO_PRIORITY priority) const;
+
 private:
+	/**
+	 * Returns the MFT's bitmap, or nullptr if <options> asks for the unused records too, or if the MFT has no bitmap
+	 * (every record is scanned then, as with options.IncludeUnusedRecords).
+	 */
+	shared_ptr<const Buffer> readRecordsBitmap(const MFTScanOptions& options);
+
+	/**
+	 * Scans the whole MFT with <visitor>, on the calling thread or on options.NumOfThreads threads.
+	 * Returns false if the visitor stopped the scan.
+	 */
+	bool scanRecordData(const MFTScanVisitor& visitor, const MFTScanOptions& options);
+
+	/**
+	 * Scans the whole MFT through an MFTScanPipeline. Records which <parseInPlace> (if any) does not handle
+	 * are joined with their extension records (see: MFTRecordJoiner), and handed to <processor>.
+	 * Returns false if the sink stopped the scan.
+	 */
+	bool runMFTPipeline(const MFTInPlaceParser& parseInPlace, const MFTRecordProcessor& processor, const MFTOutputSink& sink, const MFTScanOptions& options);
+
+	/**
+	 * Calls <visitor> for every one of <records> which could be loaded.
+	 * Returns false if the visitor stopped.
+	 */
+	static bool visitRecords(const MFTRecordVisitor& visitor, const JoinedMFTRecords& records);
+
+	/**
+	 * Appends the output of every one of <records> to <outputs> (see: MFTRecordProcessor).
+	 * The output of records which were held back fills the output reserved for them in <pipeline> instead.
+	 */
+	static void processRecords(MFTScanPipeline& pipeline, const MFTRecordProcessor& processor, const JoinedMFTRecords& records, MFTRecordOutputs& outputs);
+
 	/**
 	 * Finds <fileName> in a given <folder>.
 	 */
@@ -102,15 +269,59 @@ private:
 	 */
 	shared_ptr<MFTRecord> readMFTRecord(ULONGLONG recordIndex);
 
+	/**
+	 * Same as readMFTRecord, but returns nullptr and sets <status> instead of throwing if the record
+	 * (or one of its external records) is unusable. I/O errors are still thrown.
+	 */
+	shared_ptr<MFTRecord> tryReadMFTRecord(ULONGLONG recordIndex, NTFSLIB_STATUS& status);
+
+	/**
+	 * Returns a buffer of a single MFT record, which a record may own (see: finalizeMFTRecord).
+	 */
+	shared_ptr<MFT_RECORD> allocateMFTRecord() const;
+
 	/**
 	 * Verifies the records magic, fixes USN and resolves external file records.
+	 * <recordData> (see: allocateMFTRecord) is fixed up in place and owned by the record, it is not copied.
+	 */
+	shared_ptr<MFTRecord> finalizeMFTRecord(shared_ptr<MFT_RECORD> recordData);
+
+	/**
+	 * Non-throwing finalizeMFTRecord (see: tryReadMFTRecord).
+	 */
+	shared_ptr<MFTRecord> tryFinalizeMFTRecord(shared_ptr<MFT_RECORD> recordData, NTFSLIB_STATUS& status);
+
+	/**
+	 * Builds a record out of already verified and fixed up <recordData>.
+	 * Its external file records are read on demand, once one of the attributes they keep is looked up
+	 * (see: MFTRecord.setPendingExtensionRecords).
+	 * If <copyRecord> is false, the record refers <recordData> directly, which must outlive it.
+	 */
+	shared_ptr<MFTRecord> loadMFTRecord(PMFT_RECORD recordData, bool copyRecord);
+
+	/**
+	 * Builds a record out of already verified and fixed up <recordData>, without loading its metadata
+	 * (see: MFTRecord.loadMetadata), and sets its external file records to be read on demand.
+	 */
+	shared_ptr<MFTRecord> createMFTRecord(PMFT_RECORD recordData, bool copyRecord);
+
+	/**
+	 * Sets the external file records of the newly created <record> to be read on demand, and returns it.
+	 */
+	shared_ptr<MFTRecord> createMFTRecord(shared_ptr<MFTRecord> record);
+
+	/**
+	 * Non-throwing loadMFTRecord (see: tryReadMFTRecord).
+	 * External records needed by the record's metadata (e.g. names kept in an external record)
+	 * are read right away, and fail the load if they are unusable (see: MFTRecord.tryLoadMetadata).
 	 */
-	shared_ptr<MFTRecord> finalizeMFTRecord(Buffer& mftRecordBuffer);
+	shared_ptr<MFTRecord> tryLoadMFTRecord(PMFT_RECORD recordData, bool copyRecord, NTFSLIB_STATUS& status);
 
 	/**
-	 * Resolves the full path of s single record.
+	 * Resolves the full path of s single record into <fullPath>.
+	 * Returns a failure status if the path can not be resolved (e.g. a deleted parent).
 	 */
-	wstring resolveFullFilePath(shared_ptr<MFTRecord> leaf, map<ULONGLONG, DiffLocalCache>& localCache);
+	NTFSLIB_STATUS tryResolveFullFilePath(shared_ptr<MFTRecord> leaf, map<ULONGLONG, DiffLocalCache>& localCache, wstring& fullPath);
 
 	/**
 	 * Lists all the files in a given directory.
@@ -122,20 +333,37 @@ private:
 	 */
 	void listSubNodeRecords(Dir& subNodeRecords, shared_ptr<MFTRecord> folder, ULONGLONG subNodeVCN, bool recursive, int maxDepth);
 
+	/**
+	 * Returns the token of a new operation, cancelled with <cancellation> (if any) or by cancelOperations(<operations>).
+	 * The operation is tracked in <operations> as long as the token lives.
+	 */
+	shared_ptr<CancellationToken> startOperation(vector<weak_ptr<CancellationToken>>& operations, shared_ptr<const CancellationToken> cancellation);
+
+	/**
+	 * Cancels all the running operations in <operations>.
+	 */
+	void cancelOperations(vector<weak_ptr<CancellationToken>>& operations);
+
 	// Reference to the MFT (which is just another record).
 	shared_ptr<MFTRecord> m_MFTRecord;
 
+	// The MFT's data runs, decoded once. Translates record numbers to disk offsets.
+	ExtentMap m_MFTExtents;
+
 	// Volume attributes.
 	VolumeAttributes m_volumeAttributes;
 
 	// Actual volume handle.
 	NTFSVolume m_volume;
 
-	// Event used to stop FullDir method.
-	Event m_stopFullDirEvent;
+	// Guards the running operations.
+	mutex m_operationsLock;
+
+	// Running dumpFullDir calls (cancelled with stopFullDir).
+	vector<weak_ptr<CancellationToken>> m_fullDirOperations;
 
-	// Event used to stop DumpFile method.
-	Event m_stopFileDumpEvent;
+	// Running dumpFile calls (cancelled with stopFileDump).
+	vector<weak_ptr<CancellationToken>> m_fileDumpOperations;
 };
 
 #endif // _NTFSLIB_NTFS_PARSER_H
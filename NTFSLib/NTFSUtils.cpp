@@ -23,15 +23,46 @@ vector<wstring> NTFSUtils::splitWidePath(const wstring& path) {
 }
 
 void NTFSUtils::USARecordFixup(PNTFS_RECORD ntfsRecord, WORD sectorSize) {
+	NTFSLIB_ASSERT(
+		tryUSARecordFixup(ntfsRecord, sectorSize),
+		USAFixupError
+	);
+}
+
+/**
+ * Copies the mapped memory, returns false if reading it faulted (see: NTFSUtils.copyMappedMemory).
+ * NOTICE: Structured exception handling can not unwind C++ objects, so none are used here.
+ */
+static bool tryCopyMappedMemory(PVOID destination, const PBYTE source, DWORD length) {
+	__try {
+		memcpy(destination, source, length);
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH) {
+		return false;
+	}
+	return true;
+}
+
+void NTFSUtils::copyMappedMemory(PVOID destination, const PBYTE source, DWORD length) {
+	if (!tryCopyMappedMemory(destination, source, length)) {
+		NTFSLIB_ERROR(Win32Error, EXCEPTION_IN_PAGE_ERROR, "Could not read %u bytes of mapped memory at %p", length, source);
+	}
+}
+
+bool NTFSUtils::tryUSARecordFixup(PNTFS_RECORD ntfsRecord, WORD sectorSize) {
 	PWORD usa = (PWORD)((PBYTE)ntfsRecord + ntfsRecord->USAOffset);
 	WORD usn = usa[0];
 
+	// Verifying all the sectors first, so a torn record is left untouched.
+	for (WORD i = 1; i < ntfsRecord->USACount; ++i) {
+		PWORD lastWordOfSector = ((PWORD)((PBYTE)ntfsRecord + (sectorSize * i)) - 1);
+		if (*lastWordOfSector != usn) {
+			return false;
+		}
+	}
 	for (WORD i = 1; i < ntfsRecord->USACount; ++i) {
 		PWORD lastWordOfSector = ((PWORD)((PBYTE)ntfsRecord + (sectorSize * i)) - 1);
-		NTFSLIB_ASSERT(
-			*lastWordOfSector == usn,
-			USAFixupError
-		);
 		*lastWordOfSector = usa[i];
 	}
+	return true;
 }
@@ -54,9 +54,25 @@ public:
 	 * End of sector 1: 12 34 56 AB CD
 	 * End of sector 1: 90 78 56 AB CD
 	 * End of sector 3: AA BB CC AB CD
+	 *
+	 * NOTICE: A record can only be fixed up once, so records handed out in place (see: BlockDevice.map)
+	 * are copied before they are fixed up.
 	 */
 	static void USARecordFixup(PNTFS_RECORD ntfsRecord, WORD sectorSize);
 
+	/**
+	 * Same as USARecordFixup, but returns false instead of throwing a USAFixupError on a torn record.
+	 * The record is only changed if all its sectors are valid.
+	 */
+	static bool tryUSARecordFixup(PNTFS_RECORD ntfsRecord, WORD sectorSize);
+
+	/**
+	 * Copies <length> bytes of mapped memory (see: BlockDevice.map) from <source> to <destination>.
+	 * A mapped file which can not be read (e.g. an image on a disconnected network share) faults on access
+	 * instead of failing a read, the fault is turned into a Win32Error.
+	 */
+	static void copyMappedMemory(PVOID destination, const PBYTE source, DWORD length);
+
 	/**
 	 * Returns true if <element> is in <vec>, false otherwise.
 	 */
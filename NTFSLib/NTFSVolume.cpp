@@ -4,16 +4,32 @@
 #include "NTFSUtils.h"
 #include "Misc\NTFSLibError.h"
 #include "Misc\StringResource.h"
+#include "Device\VolumeDevice.h"
 
 using std::tolower;
+using std::make_shared;
 
 NTFSVolume::NTFSVolume(WCHAR volumeLetter) :
+	NTFSVolume(make_shared<VolumeDevice>(volumeLetter), volumeLetter) {
+	// Left blank.
+}
+
+NTFSVolume::NTFSVolume(shared_ptr<BlockDevice> device, WCHAR volumeLetter) :
 	m_volumePrefix(wstring(1, volumeLetter) + StringResource::volumePrefix),
-	m_volumeFile(volumeLetter), m_lastUSN(0), m_journalAvailable(false) {
+	m_volumeLetter(volumeLetter), m_device(device), m_readGapTolerance(READ_PLAN_DEFAULT_GAP_TOLERANCE), m_lastUSN(0), m_journalAvailable(false) {
+	NTFSLIB_ASSERT(
+		(m_volumeLetter >= 'a' && m_volumeLetter <= 'z') || (m_volumeLetter >= 'A' && m_volumeLetter <= 'Z'),
+		BadVolumeCharacterError
+	);
+	NTFSLIB_ASSERT(
+		m_device != nullptr,
+		UnexpectedActionError
+	);
+
 	// Reading the Boot Sector.
 	NTFS_BOOT_SECTOR bootSector;
 	NTFSLIB_ASSERT(
-		m_volumeFile.read(&bootSector, sizeof(NTFS_BOOT_SECTOR)) == sizeof(NTFS_BOOT_SECTOR),
+		readDevice(&bootSector, 0, sizeof(NTFS_BOOT_SECTOR)) == sizeof(NTFS_BOOT_SECTOR),
 		BadSizeError
 	);
 	NTFSLIB_ASSERT(
@@ -46,6 +62,10 @@ NTFSVolume::NTFSVolume(WCHAR volumeLetter) :
 		bootSector.BPB.MFTLCN,
 		bootSector.BPB.MFTMirrLCN,
 	};
+
+	// Live volumes change under our feet, so only images are cached. Mapped images are already
+	// backed by memory, caching them would only add a copy.
+	setClusterCacheSize(m_device->isImmutable() && m_device->map(0, 0) == nullptr ? CLUSTER_CACHE_DEFAULT_SIZE : 0);
 	
 	// Updating Change Journal current state.
 	updateChangeJournalState();
@@ -57,23 +77,192 @@ DWORD NTFSVolume::readClusters(PVOID buffer, ULONGLONG startCluster, DWORD numOf
 		SecureZeroMemory(buffer, bytesToRead);
 		return bytesToRead;
 	}
-	// Seeking to the desired address.
-	m_volumeFile.seek(startCluster * m_volumeProperties.ClusterSize);
-	// Reading number of specified clusters from the volume.
-	return m_volumeFile.read(buffer, bytesToRead);
+	WORD clusterSize = m_volumeProperties.ClusterSize;
+	if (m_clusterCache == nullptr || numOfClusters > CLUSTER_CACHE_MAX_READ_CLUSTERS) {
+		// Reading number of specified clusters from the volume.
+		return readDevice(buffer, startCluster * clusterSize, bytesToRead);
+	}
+
+	// Serving cached clusters, and reading every sequence of missing clusters with a single read.
+	PBYTE clusters = (PBYTE)buffer;
+	DWORD bytesRead = 0;
+	DWORD hits = 0;
+	DWORD misses = 0;
+	DWORD i = 0;
+	while (i < numOfClusters) {
+		if (m_clusterCache->lookup(startCluster + i, clusters + (ULONGLONG)i * clusterSize)) {
+			bytesRead += clusterSize;
+			++hits;
+			++i;
+			continue;
+		}
+		DWORD firstMissing = i++;
+		while (i < numOfClusters && !m_clusterCache->lookup(startCluster + i, clusters + (ULONGLONG)i * clusterSize)) {
+			++i;
+		}
+		// The loop above stopped on a hit (if any), which has already been copied.
+		bool stoppedOnHit = i < numOfClusters;
+		DWORD missingBytes = (i - firstMissing) * clusterSize;
+		misses += i - firstMissing;
+		DWORD missingBytesRead = readDevice(clusters + (ULONGLONG)firstMissing * clusterSize, (startCluster + firstMissing) * clusterSize, missingBytes);
+		for (DWORD j = 0; j < missingBytesRead / clusterSize; ++j) {
+			m_clusterCache->insert(startCluster + firstMissing + j, clusters + (ULONGLONG)(firstMissing + j) * clusterSize);
+		}
+		bytesRead += missingBytesRead;
+		if (missingBytesRead < missingBytes) {
+			// End of device.
+			break;
+		}
+		if (stoppedOnHit) {
+			bytesRead += clusterSize;
+			++hits;
+			++i;
+		}
+	}
+	m_ioStatistics.recordCacheLookups(hits, misses);
+	return bytesRead;
+}
+
+PBYTE NTFSVolume::mapClusters(ULONGLONG startCluster, DWORD numOfClusters) {
+	return mapBytes(startCluster * m_volumeProperties.ClusterSize, numOfClusters * m_volumeProperties.ClusterSize);
+}
+
+DWORD NTFSVolume::readBytes(PVOID buffer, ULONGLONG offset, DWORD length) {
+	WORD clusterSize = m_volumeProperties.ClusterSize;
+	ULONGLONG startCluster = offset / clusterSize;
+	DWORD numOfClusters = (DWORD)((offset + length + clusterSize - 1) / clusterSize - startCluster);
+	if (m_clusterCache == nullptr || numOfClusters > CLUSTER_CACHE_MAX_READ_CLUSTERS) {
+		return readDevice(buffer, offset, length);
+	}
+
+	// Reading the whole clusters, so they are cached for the next reader.
+	Buffer clusters(numOfClusters * clusterSize);
+	DWORD bytesRead = readClusters(clusters.data(), startCluster, numOfClusters, false);
+	DWORD startIndex = (DWORD)(offset % clusterSize);
+	if (bytesRead <= startIndex) {
+		return 0;
+	}
+	DWORD bytesToCopy = bytesRead - startIndex < length ? bytesRead - startIndex : length;
+	memcpy(buffer, clusters.data() + startIndex, bytesToCopy);
+	return bytesToCopy;
+}
+
+PBYTE NTFSVolume::mapBytes(ULONGLONG offset, DWORD length) {
+	return m_device->map(offset, length);
+}
+
+void NTFSVolume::readPlan(PVOID buffer, const ReadPlan& plan) {
+	PBYTE output = (PBYTE)buffer;
+	WORD clusterSize = m_volumeProperties.ClusterSize;
+	// I/Os which can not be read in place (merged over gaps, or partial clusters) are read into this buffer.
+	size_t intermediateSize = 0;
+	for (const PlannedIO& io : plan) {
+		if (!io.IsZeroFill && !ReadPlanner::isDirect(io)) {
+			intermediateSize += io.Length;
+		}
+	}
+	NTFSLIB_ASSERT(
+		intermediateSize <= MAXDWORD,
+		BadSizeError
+	);
+	// Page aligned, so unbuffered devices read the merged I/Os in place as well.
+	unique_ptr<PooledBuffer> intermediate;
+	if (intermediateSize > 0) {
+		intermediate.reset(new PooledBuffer(m_bufferPool, (DWORD)intermediateSize));
+	}
+
+	DeviceReadList reads;
+	// Reads of clusters missing from the cache (by index in reads), inserted once read.
+	vector<size_t> cachedReads;
+	DWORD hits = 0;
+	DWORD misses = 0;
+	size_t intermediateOffset = 0;
+	for (const PlannedIO& io : plan) {
+		if (io.IsZeroFill) {
+			for (const ReadSegment& segment : io.Segments) {
+				memset(output + segment.BufferOffset, 0, segment.Length);
+			}
+			continue;
+		}
+		PBYTE target = output + io.Segments[0].BufferOffset;
+		if (!ReadPlanner::isDirect(io)) {
+			target = intermediate->data() + intermediateOffset;
+			intermediateOffset += io.Length;
+		}
+		if (m_clusterCache == nullptr || io.Length > CLUSTER_CACHE_MAX_READ_CLUSTERS * clusterSize) {
+			reads.push_back({ target, io.DiskOffset, io.Length, 0 });
+			continue;
+		}
+
+		// Serving cached clusters now, every sequence of missing clusters joins the batch.
+		ULONGLONG startCluster = io.DiskOffset / clusterSize;
+		DWORD numOfClusters = io.Length / clusterSize;
+		DWORD i = 0;
+		while (i < numOfClusters) {
+			if (m_clusterCache->lookup(startCluster + i, target + (ULONGLONG)i * clusterSize)) {
+				++hits;
+				++i;
+				continue;
+			}
+			DWORD firstMissing = i++;
+			while (i < numOfClusters && !m_clusterCache->lookup(startCluster + i, target + (ULONGLONG)i * clusterSize)) {
+				++i;
+			}
+			// The loop above stopped on a hit (if any), which has already been copied.
+			if (i < numOfClusters) {
+				++hits;
+			}
+			misses += i - firstMissing;
+			cachedReads.push_back(reads.size());
+			reads.push_back({ target + (ULONGLONG)firstMissing * clusterSize, (startCluster + firstMissing) * clusterSize, (i - firstMissing) * clusterSize, 0 });
+			if (i < numOfClusters) {
+				++i;
+			}
+		}
+	}
+	if (m_clusterCache != nullptr) {
+		m_ioStatistics.recordCacheLookups(hits, misses);
+	}
+	if (!reads.empty()) {
+		readDeviceBatch(reads);
+	}
+	for (const DeviceRead& read : reads) {
+		NTFSLIB_ASSERT(
+			read.BytesRead == read.Length,
+			BadSizeError
+		);
+	}
+	for (size_t readIndex : cachedReads) {
+		const DeviceRead& read = reads[readIndex];
+		for (DWORD j = 0; j < read.Length / clusterSize; ++j) {
+			m_clusterCache->insert(read.Offset / clusterSize + j, (PBYTE)read.Buffer + (ULONGLONG)j * clusterSize);
+		}
+	}
+
+	// Keeping only the wanted parts of the intermediate I/Os.
+	intermediateOffset = 0;
+	for (const PlannedIO& io : plan) {
+		if (io.IsZeroFill || ReadPlanner::isDirect(io)) {
+			continue;
+		}
+		for (const ReadSegment& segment : io.Segments) {
+			memcpy(output + segment.BufferOffset, intermediate->data() + intermediateOffset + segment.IOOffset, segment.Length);
+		}
+		intermediateOffset += io.Length;
+	}
 }
 
 DWORD NTFSVolume::readMFT(PVOID buffer) {
-	m_volumeFile.seek(m_volumeProperties.MFTAddr);
-	return m_volumeFile.read(buffer, m_volumeProperties.MFTRecordSize);
+	return readDevice(buffer, m_volumeProperties.MFTAddr, m_volumeProperties.MFTRecordSize);
 }
 
-ChangeJournalRecordList NTFSVolume::readChangeJournal(DWORD changeReason, bool onlyForward /* = false*/) {
+ChangeJournalRecordList NTFSVolume::readChangeJournal(DWORD changeReason, bool onlyForward /* = false*/, shared_ptr<const CancellationToken> cancellation /* = nullptr */) {
 	// This won't work if Change Journal is not available.
 	NTFSLIB_ASSERT(
 		m_journalAvailable,
 		UnexpectedActionError
 	);
+	IOSourceScope ioSource(IO_SOURCE::JOURNAL);
 	TRACE(DEBUG_LEVEL::VERBOSE, "%s Change Journal starting from %#016llx, searching for reasons: %#08lx", 
 		onlyForward ? "Forwarding" : "Reading", m_lastUSN, changeReason);
 	ChangeJournalRecordList changes;
@@ -97,7 +286,12 @@ ChangeJournalRecordList NTFSVolume::readChangeJournal(DWORD changeReason, bool o
 	 * The first USN value is used for subsequent read calls.
 	 */
 	while (!pumpCompleted) {
-		bytesRead = m_volumeFile.sendIoctl(FSCTL_READ_USN_JOURNAL, &journalReadDef, sizeof(journalReadDef), usnDataBuffer, JOURNAL_READ_LENGTH);
+		{
+			ScheduledIO scheduledIO(m_ioScheduler, 1, JOURNAL_READ_LENGTH);
+			ULONGLONG startTime = IOStatistics::getTimestamp();
+			bytesRead = m_device->sendIoctl(FSCTL_READ_USN_JOURNAL, &journalReadDef, sizeof(journalReadDef), usnDataBuffer, JOURNAL_READ_LENGTH);
+			m_ioStatistics.recordControl(bytesRead, IOStatistics::getTimestamp() - startTime);
+		}
 		// We're not interested in the first sizeof(USN) bytes currently (see explanation above).
 		actualRecordBytes = bytesRead - sizeof(USN);
 		usnRecord = (PUSN_RECORD)(((PBYTE)usnDataBuffer) + sizeof(USN));
@@ -123,6 +317,11 @@ ChangeJournalRecordList NTFSVolume::readChangeJournal(DWORD changeReason, bool o
 		}
 		// That indicates we've iterated twice without finding new record data, time to go home.
 		pumpCompleted = (pumpedData == true);
+		// Only between reads, so the next USN always follows the last change returned.
+		if (!pumpCompleted && cancellation != nullptr && cancellation->isCancelled()) {
+			TRACE(DEBUG_LEVEL::VERBOSE, "Change Journal read cancelled, stopping");
+			break;
+		}
 		// Anyhow, we've just pumped some data...
 		pumpedData = true;
 	}
@@ -175,11 +374,23 @@ VOLUME_TYPE NTFSVolume::getVolumeType() const {
 	}
 }
 
+void NTFSVolume::setClusterCacheSize(ULONGLONG byteBudget) {
+	TRACE(DEBUG_LEVEL::VERBOSE, "Setting cluster cache size to %llu bytes", byteBudget);
+	m_clusterCache.reset(byteBudget > 0 ? new ClusterCache(m_volumeProperties.ClusterSize, byteBudget) : nullptr);
+}
+
+ClusterCacheStatistics NTFSVolume::getClusterCacheStatistics() const {
+	if (m_clusterCache == nullptr) {
+		return { 0 };
+	}
+	return m_clusterCache->getStatistics();
+}
+
 void NTFSVolume::updateChangeJournalState() {
 	TRACE(DEBUG_LEVEL::VERBOSE, "Updating Change Journal State");
 	try {
 		ZeroMemory(&m_journalData, sizeof(JournalData));
-		m_volumeFile.sendIoctl(FSCTL_QUERY_USN_JOURNAL, NULL, 0, &m_journalData, sizeof(m_journalData));
+		m_device->sendIoctl(FSCTL_QUERY_USN_JOURNAL, NULL, 0, &m_journalData, sizeof(m_journalData));
 		m_journalAvailable = true;
 		TRACE(DEBUG_LEVEL::VERBOSE, "Change Journal is active and ready to use");
 	}
@@ -191,5 +402,69 @@ void NTFSVolume::updateChangeJournalState() {
 }
 
 bool NTFSVolume::isDriveLetter(WCHAR letter) {
-	return tolower(letter) == tolower(m_volumeFile.getVolumeLetter());
+	return tolower(letter) == tolower(m_volumeLetter);
+}
+
+void NTFSVolume::setReadGapTolerance(DWORD gapTolerance) {
+	m_readGapTolerance = gapTolerance;
+}
+
+DWORD NTFSVolume::getReadGapTolerance() const {
+	return m_readGapTolerance;
+}
+
+AlignedBufferPool& NTFSVolume::getBufferPool() {
+	return m_bufferPool;
+}
+
+IOStatisticsSnapshot NTFSVolume::getIOStatistics() const {
+	return m_ioStatistics.getSnapshot();
+}
+
+void NTFSVolume::resetIOStatistics() {
+	m_ioStatistics.reset();
+}
+
+void NTFSVolume::startIOStatisticsDump(DWORD intervalMilliseconds, const IOStatisticsSink& sink /* = nullptr */) {
+	m_ioStatistics.startPeriodicDump(intervalMilliseconds, sink);
+}
+
+void NTFSVolume::stopIOStatisticsDump() {
+	m_ioStatistics.stopPeriodicDump();
+}
+
+void NTFSVolume::setIOPriority(IO_SOURCE source, IO_PRIORITY priority) {
+	m_ioScheduler.setPriority(source, priority);
+}
+
+IO_PRIORITY NTFSVolume::getIOPriority(IO_SOURCE source) const {
+	return m_ioScheduler.getPriority(source);
+}
+
+void NTFSVolume::setIORateLimit(IO_PRIORITY priority, const IORateLimit& limit) {
+	m_ioScheduler.setRateLimit(priority, limit);
+}
+
+IORateLimit NTFSVolume::getIORateLimit(IO_PRIORITY priority) const {
+	return m_ioScheduler.getRateLimit(priority);
+}
+
+DWORD NTFSVolume::readDevice(PVOID buffer, ULONGLONG offset, DWORD length) {
+	// Scheduled before being timed, the latencies are the device's only.
+	ScheduledIO scheduledIO(m_ioScheduler, 1, length);
+	ULONGLONG startTime = IOStatistics::getTimestamp();
+	DWORD bytesRead = m_device->readAt(buffer, offset, length);
+	m_ioStatistics.recordRead(offset, length, bytesRead, IOStatistics::getTimestamp() - startTime);
+	return bytesRead;
+}
+
+void NTFSVolume::readDeviceBatch(DeviceReadList& reads) {
+	ULONGLONG length = 0;
+	for (const DeviceRead& read : reads) {
+		length += read.Length;
+	}
+	ScheduledIO scheduledIO(m_ioScheduler, (DWORD)reads.size(), length);
+	ULONGLONG startTime = IOStatistics::getTimestamp();
+	m_device->readBatch(reads);
+	m_ioStatistics.recordBatch(reads, IOStatistics::getTimestamp() - startTime);
 }
@@ -2,28 +2,74 @@
 #define _NTFSLIB_NTFS_VOLUME_H
 
 #include <string>
+#include <memory>
 
 #include "Misc\Defs.h"
+#include "Misc\AlignedBufferPool.h"
 #include "Misc\Win32\Win32.h"
-#include "Misc\Win32\VolumeFile.h"
+#include "Device\BlockDevice.h"
+#include "Misc\CancellationToken.h"
+#include "Misc\ClusterCache.h"
+#include "Misc\IOScheduler.h"
+#include "Misc\IOStatistics.h"
+#include "Misc\ReadPlanner.h"
 #include "Types\NTFSTypes.h"
 #include "Types\ChangeJournalTypes.h"
 
 using std::wstring;
+using std::shared_ptr;
+using std::unique_ptr;
 
 /**
  * Represents an NTFS volume.
  */
 class NTFSVolume {
 public:
+	/**
+	 * Opens the live volume mounted as <volumeLetter>.
+	 */
 	NTFSVolume(WCHAR volumeLetter);
 
+	/**
+	 * Opens the volume found on <device> (e.g. a raw image), byte 0 of the device being the boot sector.
+	 * Paths on this volume are resolved against <volumeLetter> (e.g. 'C' for "C:\...").
+	 */
+	NTFSVolume(shared_ptr<BlockDevice> device, WCHAR volumeLetter);
+
 	/**
 	 * Reads <numOfClusters> clusters starting from <startCluster> into <buffer>.
 	 * if <isSparse> is true, <buffer> will be filled with 0's.
+	 * Short reads are served from the cluster cache when possible (see: setClusterCacheSize).
 	 */
 	DWORD readClusters(PVOID buffer, ULONGLONG startCluster, DWORD numOfClusters, bool isSparse);
 
+	/**
+	 * Returns a pointer to <numOfClusters> clusters starting from <startCluster>, without copying them.
+	 * Returns nullptr if the underlying device can not hand out pointers (see: BlockDevice.map),
+	 * in which case the caller should fall back to readClusters.
+	 */
+	PBYTE mapClusters(ULONGLONG startCluster, DWORD numOfClusters);
+
+	/**
+	 * Reads <length> bytes starting from the volume offset <offset> into <buffer>.
+	 * Short reads go through the cluster cache, like readClusters.
+	 */
+	DWORD readBytes(PVOID buffer, ULONGLONG offset, DWORD length);
+
+	/**
+	 * Returns a pointer to <length> bytes starting from the volume offset <offset>, without copying them.
+	 * Returns nullptr if the underlying device can not hand out pointers (see: BlockDevice.map).
+	 */
+	PBYTE mapBytes(ULONGLONG offset, DWORD length);
+
+	/**
+	 * Performs <plan> (see: ReadPlanner), placing the planned stream range in <buffer>.
+	 * Short I/Os are served from the cluster cache first, and all the I/Os left (the clusters missing from
+	 * the cache included) are handed to the device as a single batch.
+	 * Throws BadSizeError if any of them is short.
+	 */
+	void readPlan(PVOID buffer, const ReadPlan& plan);
+
 	/**
 	 * Reads the MFT record into <buffer>.
 	 * <buffer> size must at least be MFT_RECORD_SIZE (typically 1024 bytes).
@@ -32,8 +78,9 @@ public:
 
 	/**
 	 * Queries the Change Journal for latest changes.
+	 * Once <cancellation> (if any) is cancelled, returns the changes read so far, the next query goes on from there.
 	 */
-	ChangeJournalRecordList readChangeJournal(DWORD changeReason, bool onlyForward = false);
+	ChangeJournalRecordList readChangeJournal(DWORD changeReason, bool onlyForward = false, shared_ptr<const CancellationToken> cancellation = nullptr);
 
 	/**
 	 * Updates the Change Journal State.
@@ -86,18 +133,116 @@ public:
 	 */
 	VOLUME_TYPE getVolumeType() const;
 
+	/**
+	 * Sets the byte budget of the cluster cache, 0 disables it. Cached clusters are dropped.
+	 * By default, volumes read from an image (see: BlockDevice.isImmutable) which can not be mapped get
+	 * CLUSTER_CACHE_DEFAULT_SIZE. Caching a live volume may serve clusters which were changed since they were read.
+	 * NOTICE: Must not be called while other threads read from the volume.
+	 */
+	void setClusterCacheSize(ULONGLONG byteBudget);
+
+	/**
+	 * Returns the cluster cache counters (all 0's if the cache is disabled).
+	 */
+	ClusterCacheStatistics getClusterCacheStatistics() const;
+
+	/**
+	 * Sets the gap (in bytes) between two data runs on the disk, which stream reads read and discard
+	 * instead of issuing another I/O (see: ReadPlanner). 0 merges only adjacent data runs.
+	 */
+	void setReadGapTolerance(DWORD gapTolerance);
+
+	/**
+	 * Returns the gap tolerance of stream reads (see: setReadGapTolerance).
+	 */
+	DWORD getReadGapTolerance() const;
+
+	/**
+	 * Returns the pool of page aligned buffers of the volume, which large reads should be read into,
+	 * so devices read unbuffered read them in place (see: RawImageDevice).
+	 */
+	AlignedBufferPool& getBufferPool();
+
+	/**
+	 * Returns the I/O counters of the volume, by source (see: IOStatistics).
+	 */
+	IOStatisticsSnapshot getIOStatistics() const;
+
+	/**
+	 * Zeroes the I/O counters of the volume.
+	 */
+	void resetIOStatistics();
+
+	/**
+	 * Hands the I/O counters to <sink> every <intervalMilliseconds> (see: IOStatistics.startPeriodicDump).
+	 */
+	void startIOStatisticsDump(DWORD intervalMilliseconds, const IOStatisticsSink& sink = nullptr);
+
+	/**
+	 * Stops the periodic dump of the I/O counters.
+	 */
+	void stopIOStatisticsDump();
+
+	/**
+	 * Sets the priority class of the reads of <source> (see: IOScheduler.setPriority).
+	 */
+	void setIOPriority(IO_SOURCE source, IO_PRIORITY priority);
+
+	/**
+	 * Returns the priority class of the reads of <source>.
+	 */
+	IO_PRIORITY getIOPriority(IO_SOURCE source) const;
+
+	/**
+	 * Caps the bandwidth of the reads of <priority> to <limit> (see: IOScheduler.setRateLimit).
+	 */
+	void setIORateLimit(IO_PRIORITY priority, const IORateLimit& limit);
+
+	/**
+	 * Returns the bandwidth cap of the reads of <priority>.
+	 */
+	IORateLimit getIORateLimit(IO_PRIORITY priority) const;
+
 private:
 	FORBID_COPY_AND_ASSIGN(NTFSVolume);
 
+	/**
+	 * Reads <length> bytes starting from the volume offset <offset> off the device once scheduled, and counts the read.
+	 */
+	DWORD readDevice(PVOID buffer, ULONGLONG offset, DWORD length);
+
+	/**
+	 * Reads <reads> off the device as a single batch once scheduled, and counts them.
+	 */
+	void readDeviceBatch(DeviceReadList& reads);
+
 	// Volume's prefix.
 	const wstring m_volumePrefix;
 
-	// Volume's file handle.
-	VolumeFile m_volumeFile;
+	// Volume's letter (e.g. 'C').
+	const WCHAR m_volumeLetter;
+
+	// Device the volume is read from.
+	shared_ptr<BlockDevice> m_device;
 
 	// Volume's properties.
 	VolumeProperties m_volumeProperties;
 
+	// Cache of recently read clusters, nullptr if disabled.
+	unique_ptr<ClusterCache> m_clusterCache;
+
+	// Gap between data runs read and discarded by stream reads.
+	DWORD m_readGapTolerance;
+
+	// Page aligned read buffers (see: getBufferPool).
+	AlignedBufferPool m_bufferPool;
+
+	// I/O counters.
+	IOStatistics m_ioStatistics;
+
+	// Priorities and rate limits of the device reads.
+	IOScheduler m_ioScheduler;
+
 	// Current journal data (updated with: updateChangeJournalState).
 	JournalData m_journalData;
 
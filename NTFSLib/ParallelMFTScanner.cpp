@@ -0,0 +1,58 @@
+#include "ParallelMFTScanner.h"
+
+ParallelMFTScanner::ParallelMFTScanner(NTFSVolume& volume, const ExtentMap& mftExtents, const MFTScanOptions& options) :
+	m_stopped(false),
+	m_pool(options.NumOfThreads) {
+	for (DWORD i = 0; i < m_pool.getNumOfThreads(); ++i) {
+		m_scanners.push_back(unique_ptr<MFTScanner>(new MFTScanner(volume, mftExtents, options.ChunkSize)));
+		// A cancelled worker stops the whole scan, like a visitor which returned false.
+		m_scanners.back()->setCancellation(options.Cancellation);
+	}
+	m_ranges = m_scanners[0]->getRecordRanges();
+	TRACE(DEBUG_LEVEL::VERBOSE, "Scanning %zu MFT ranges over %lu threads", m_ranges.size(), m_pool.getNumOfThreads());
+}
+
+void ParallelMFTScanner::setRecordsBitmap(shared_ptr<const Buffer> recordsBitmap) {
+	for (unique_ptr<MFTScanner>& scanner : m_scanners) {
+		scanner->setRecordsBitmap(recordsBitmap);
+	}
+}
+
+const MFTRecordRanges& ParallelMFTScanner::getRecordRanges() const {
+	return m_ranges;
+}
+
+void ParallelMFTScanner::start(const MFTRangeVisitor& visitor) {
+	m_stopped = false;
+	vector<PoolTask> tasks;
+	tasks.reserve(m_ranges.size());
+	// The workers run at the priority class of the operation which started the scan.
+	IOOperationPriority ioPriority = IOPriorityScope::getCurrent();
+	for (size_t i = 0; i < m_ranges.size(); ++i) {
+		tasks.push_back([this, visitor, i, ioPriority](DWORD workerIndex) {
+			IOPriorityScope priorityScope(ioPriority);
+			if (!m_stopped && !visitor(*m_scanners[workerIndex], i, m_ranges[i])) {
+				stop();
+			}
+		});
+	}
+	m_pool.start(std::move(tasks));
+}
+
+bool ParallelMFTScanner::wait() {
+	m_pool.wait();
+	return !m_stopped;
+}
+
+void ParallelMFTScanner::stop() {
+	m_stopped = true;
+	m_pool.cancel();
+}
+
+bool ParallelMFTScanner::isStopped() const {
+	return m_stopped;
+}
+
+DWORD ParallelMFTScanner::getNumOfThreads() const {
+	return m_pool.getNumOfThreads();
+}
@@ -0,0 +1,96 @@
+#ifndef _NTFSLIB_PARALLEL_MFT_SCANNER_H
+#define _NTFSLIB_PARALLEL_MFT_SCANNER_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "MFTScanner.h"
+#include "NTFSVolume.h"
+#include "Misc\Defs.h"
+#include "Misc\ExtentMap.h"
+#include "Misc\IOScheduler.h"
+#include "Misc\WorkStealingPool.h"
+
+using std::atomic;
+using std::function;
+using std::shared_ptr;
+using std::unique_ptr;
+using std::vector;
+
+/**
+ * Invoked on a worker thread for every range of the MFT, with the worker's own scanner.
+ * <rangeIndex> is the index of <range> in ParallelMFTScanner.getRecordRanges.
+ * Return false to stop the whole scan.
+ */
+typedef function<bool(MFTScanner& scanner, size_t rangeIndex, const MFTRecordRange& range)> MFTRangeVisitor;
+
+/**
+ * Spreads a scan of the MFT over several threads.
+ * The MFT is split into record ranges which never cross data runs (see: MFTScanner.getRecordRanges),
+ * and the ranges are distributed over a WorkStealingPool. Every worker owns an MFTScanner (and its read
+ * buffer), so records are read, fixed up and parsed without any locking but the volume's own.
+ */
+class ParallelMFTScanner {
+public:
+	/**
+	 * Creates a scanner for the MFT described by <mftExtents>, running options.NumOfThreads workers.
+	 * The scan is stopped once options.Cancellation (if any) is cancelled.
+	 */
+	ParallelMFTScanner(NTFSVolume& volume, const ExtentMap& mftExtents, const MFTScanOptions& options);
+
+	/**
+	 * Sets the MFT's bitmap for all the workers (see: MFTScanner.setRecordsBitmap).
+	 */
+	void setRecordsBitmap(shared_ptr<const Buffer> recordsBitmap);
+
+	/**
+	 * Returns the ranges the MFT is scanned in.
+	 */
+	const MFTRecordRanges& getRecordRanges() const;
+
+	/**
+	 * Starts calling <visitor> for every range in the background.
+	 * Workers start with neighbouring ranges, so their reads stay mostly sequential.
+	 */
+	void start(const MFTRangeVisitor& visitor);
+
+	/**
+	 * Waits for the scan to end, and rethrows the first error a visitor threw.
+	 * Returns false if the scan was stopped, true otherwise.
+	 */
+	bool wait();
+
+	/**
+	 * Stops the scan: ranges that have not started yet are dropped (you can call this from any thread).
+	 */
+	void stop();
+
+	/**
+	 * Returns true once the scan was stopped.
+	 */
+	bool isStopped() const;
+
+	/**
+	 * Returns the number of workers.
+	 */
+	DWORD getNumOfThreads() const;
+
+private:
+	FORBID_COPY_AND_ASSIGN(ParallelMFTScanner);
+
+	// Ranges the MFT is scanned in.
+	MFTRecordRanges m_ranges;
+
+	// A scanner per worker.
+	vector<unique_ptr<MFTScanner>> m_scanners;
+
+	// Set once the scan was stopped.
+	atomic<bool> m_stopped;
+
+	// Workers. Declared last, so the workers are joined before anything they use is destroyed.
+	WorkStealingPool m_pool;
+};
+
+#endif // _NTFSLIB_PARALLEL_MFT_SCANNER_H
@@ -1,77 +1,97 @@
+#include <algorithm>
+
 #include "MFTRecord.h"
+#include "MFTRecordView.h"
 
 #include "..\NTFSUtils.h"
 #include "..\Misc\Defs.h"
-#include "..\Misc\Serializer.h"
 #include "..\Misc\StringResource.h"
 #include "..\Attribute\FileNameAttribute.h"
 #include "..\Attribute\StandardInformationAttribute.h"
 #include "..\Attribute\IndexAllocationAttribute.h"
 #include "..\Attribute\AttributesListAttribute.h"
 
-MFTRecord::MFTRecord(NTFSVolume& ntfsVolume, const PMFT_RECORD mftRecord):
-	m_fileRecordHeader((PMFT_RECORD)new BYTE[mftRecord->BytesInUse]),
+MFTRecord::MFTRecord(NTFSVolume& ntfsVolume, const PMFT_RECORD mftRecord, bool copyRecord /* = true */):
+	m_fileRecordHeader(copyRecord ?
+		shared_ptr<MFT_RECORD>((PMFT_RECORD)new BYTE[mftRecord->BytesInUse], [](PMFT_RECORD record) { delete[] (PBYTE)record; }) :
+		// A view, nothing to release.
+		shared_ptr<MFT_RECORD>(mftRecord, [](PMFT_RECORD) {})),
+	m_fileExtendedInfo(nullptr),
+	m_recordNumber(mftRecord->RecordNumber),
+	m_parentRecordNumber(0),
+	m_isIndexed(false),
+	m_ntfsVolume(ntfsVolume) {
+	if (copyRecord) {
+		memcpy(m_fileRecordHeader.get(), mftRecord, mftRecord->BytesInUse);
+	}
+}
+
+MFTRecord::MFTRecord(NTFSVolume& ntfsVolume, shared_ptr<MFT_RECORD> mftRecord) :
+	m_fileRecordHeader(mftRecord),
 	m_fileExtendedInfo(nullptr),
 	m_recordNumber(mftRecord->RecordNumber),
 	m_parentRecordNumber(0),
+	m_isIndexed(false),
 	m_ntfsVolume(ntfsVolume) {
-	memcpy(m_fileRecordHeader.get(), mftRecord, mftRecord->BytesInUse);
+	// Left blank.
 }
 
 std::vector<BYTE> MFTRecord::serialize() {
-	NTFSLIB_ASSERT(
-		m_fileExtendedInfo != nullptr, 
-		UnexpectedActionError
-	);
-	std::wstring fileName = getFriendlyFileName();
-	b4 nameLength = (b4)fileName.length();
-	DWORD totalLength = nameLength * 2 + sizeof(b1) + sizeof(b4) + sizeof(b8) * 8;
-	Serializer serializer(totalLength);
-
-	b1 flags = 0;
-	flags |= (isDirectory() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_DIRECTORY : 0);
-	flags |= (isDeleted() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_DELETED : 0);
-	flags |= (m_fileExtendedInfo->isReadOnly() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_READ_ONLY : 0);
-	flags |= (m_fileExtendedInfo->isHidden() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_HIDDEN : 0);
-	flags |= (m_fileExtendedInfo->isSystemFile() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_SYSTEM_FILE : 0);
-	flags |= (m_fileExtendedInfo->isCompressed() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_COMPRESSED : 0);
-	flags |= (m_fileExtendedInfo->isEncrypted() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_ENCRYPTED : 0);
-	flags |= (m_fileExtendedInfo->isArchived() ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_ARCHIVED : 0);
-	serializer.serialize(&flags, sizeof(b1));
-
-	b8 tempValue = 0;
-	tempValue = getSize();
-	serializer.serialize(&tempValue, sizeof(b8));
-	tempValue = getTotalSize();
-	serializer.serialize(&tempValue, sizeof(b8));
-	tempValue = m_fileExtendedInfo->getCreationTime();
-	serializer.serialize(&tempValue, sizeof(b8));
-	tempValue = m_fileExtendedInfo->getLastDataChangeTime();
-	serializer.serialize(&tempValue, sizeof(b8));
-	tempValue = m_fileExtendedInfo->getLastMFTChangeTime();
-	serializer.serialize(&tempValue, sizeof(b8));
-	tempValue = m_fileExtendedInfo->getLastAccessTime();
-	serializer.serialize(&tempValue, sizeof(b8));
-	serializer.serialize(&((b8)m_recordNumber), sizeof(b8));
-	serializer.serialize(&((b8)m_parentRecordNumber), sizeof(b8));
-	serializer.serialize(&nameLength, sizeof(b4));
-	serializer.serialize((PVOID)fileName.c_str(), nameLength * 2);
-	
-	return serializer.getSerializedData();
+	Buffer serializedData;
+	NTFSLIB_ASSERT_STATUS(trySerialize(serializedData));
+	return serializedData;
+}
+
+NTFSLIB_STATUS MFTRecord::trySerialize(Buffer& output) {
+	// Extension records and records without names are expected during scans, no need to throw.
+	// The standard information always lives in the base record.
+	const STANDARD_INFORMATION* standardInformation = MFTRecordView(m_fileRecordHeader.get()).getStandardInformation();
+	if (standardInformation == nullptr || m_fileNames.empty()) {
+		return NTFSLIB_STATUS::UNEXPECTED_ACTION;
+	}
+	if (m_isIndexed) {
+		// The sizes are kept with the first extent of every stream, which might still be pending.
+		NTFSLIB_STATUS status = loadPendingRecords([](const AttributeListEntry& entry) -> bool {
+			return entry.Type == ATTR_TYPE::AT_DATA && entry.LowestVCN == 0;
+		});
+		if (status != NTFSLIB_STATUS::SUCCESS) {
+			return status;
+		}
+	}
+	const wstring& fileName = getFriendlyFileName();
+	MFTRecordView::serializeRecord(output, m_fileRecordHeader->Flags, *standardInformation, getSize(), getTotalSize(),
+		m_recordNumber, m_parentRecordNumber, fileName.c_str(), (DWORD)fileName.length());
+	return NTFSLIB_STATUS::SUCCESS;
 }
 
 void MFTRecord::loadMetadata() {
-	vector<shared_ptr<StandardInformationAttribute>> exInfo = findAttribute<StandardInformationAttribute>(ATTR_TYPE::AT_STANDARD_INFORMATION, false);
+	NTFSLIB_ASSERT_STATUS(tryLoadMetadata());
+}
+
+NTFSLIB_STATUS MFTRecord::tryLoadMetadata() {
+	// The index might have been built by an earlier lookup (e.g. of the attributes lists).
+	buildIndex();
+
+	// Loading whatever the metadata needs up front, so the lookups below never throw.
+	NTFSLIB_STATUS status = loadPendingRecords([](const AttributeListEntry& entry) -> bool {
+		return entry.Type == ATTR_TYPE::AT_STANDARD_INFORMATION || entry.Type == ATTR_TYPE::AT_FILE_NAME;
+	});
+	if (status != NTFSLIB_STATUS::SUCCESS) {
+		return status;
+	}
+
+	const vector<shared_ptr<StandardInformationAttribute>>& exInfo = findAttribute<StandardInformationAttribute>(ATTR_TYPE::AT_STANDARD_INFORMATION, false);
 	if (!exInfo.empty()) {
 		m_fileExtendedInfo = exInfo[0];
 	}
-	vector<shared_ptr<FileNameAttribute>> fileProps = findAttribute<FileNameAttribute>(ATTR_TYPE::AT_FILE_NAME, false);
+	const vector<shared_ptr<FileNameAttribute>>& fileProps = findAttribute<FileNameAttribute>(ATTR_TYPE::AT_FILE_NAME, false);
 	if (!fileProps.empty()) {
 		m_parentRecordNumber = fileProps[0]->getParentMFTReference();
 		for (const shared_ptr<FileNameAttribute> fileProp : fileProps) {
 			m_fileNames.push_back(fileProp->getFileName());
 		}
 	}
+	return NTFSLIB_STATUS::SUCCESS;
 }
 
 void MFTRecord::read(PVOID buffer, const wstring& streamName /*= L""*/, ULONGLONG offset /*= 0*/, DWORD length /*= 0*/) {
@@ -87,18 +107,48 @@ void MFTRecord::read(PVOID buffer, const wstring& streamName /*= L""*/, ULONGLON
 }
 
 const shared_ptr<DataStreamAttribute> MFTRecord::getDataStream(const wstring& streamName /*= L""*/) const {
-	vector<shared_ptr<DataStreamAttribute>> streams = findAttribute<DataStreamAttribute>(ATTR_TYPE::AT_DATA, false);
-	for (const shared_ptr<DataStreamAttribute> dataStream : streams) {
-		if (streamName == dataStream->getStreamName()) {
-			return dataStream;
+	if (m_isIndexed) {
+		IndexedDataStream* dataStream = findIndexedDataStream(streamName, true);
+		if (dataStream == nullptr) {
+			return nullptr;
+		}
+		lock_guard<mutex> lock(m_instancesLock);
+		if (dataStream->Stream == nullptr) {
+			dataStream->Stream = make_shared<DataStreamAttribute>(m_ntfsVolume, dataStream->Extents);
 		}
+		return dataStream->Stream;
 	}
 
-	return nullptr;
+	vector<PCOMMON_ATTR_RECORD> dataAttributes;
+	collectAttributes(ATTR_TYPE::AT_DATA, dataAttributes);
+	vector<PCOMMON_ATTR_RECORD> extents;
+	bool hasFirstExtent = false;
+	for (PCOMMON_ATTR_RECORD dataAttribute : dataAttributes) {
+		AttributeView extent(dataAttribute);
+		if (extent.hasName(streamName.c_str(), streamName.length())) {
+			extents.push_back(dataAttribute);
+			hasFirstExtent |= extent.isFirstExtent();
+		}
+	}
+
+	return hasFirstExtent ? make_shared<DataStreamAttribute>(m_ntfsVolume, extents) : nullptr;
 }
 
 vector<wstring> MFTRecord::listStreams() const {
-	vector<shared_ptr<DataStreamAttribute>> streams = findAttribute<DataStreamAttribute>(ATTR_TYPE::AT_DATA, false);
+	if (m_isIndexed) {
+		NTFSLIB_ASSERT_STATUS(loadPendingRecords([](const AttributeListEntry& entry) -> bool {
+			return entry.Type == ATTR_TYPE::AT_DATA && entry.LowestVCN == 0;
+		}));
+		vector<wstring> streamNames;
+		for (const auto& dataStream : m_dataStreamIndex) {
+			if (!dataStream.first.empty() && AttributeView(dataStream.second.Extents.front()).isFirstExtent()) {
+				streamNames.push_back(dataStream.first);
+			}
+		}
+		return streamNames;
+	}
+
+	const vector<shared_ptr<DataStreamAttribute>>& streams = findAttribute<DataStreamAttribute>(ATTR_TYPE::AT_DATA, false);
 	vector<wstring> streamNames;
 
 	for (const std::shared_ptr<DataStreamAttribute> stream : streams) {
@@ -146,9 +196,21 @@ ULONGLONG MFTRecord::getParentRecordNumber() const {
 }
 
 ULONGLONG MFTRecord::getSize(const wstring& streamName /* = L"" */) {
-	const shared_ptr<DataStreamAttribute> mainStream = getDataStream(streamName);
-	if (mainStream != nullptr) {
-		return mainStream->getSize();
+	if (m_isIndexed) {
+		IndexedDataStream* dataStream = findIndexedDataStream(streamName, false);
+		return dataStream != nullptr ? AttributeView(dataStream->Extents.front()).getDataSize() : 0;
+	}
+
+	// Looking the stream up in place, the stat path should not allocate an attribute per stream.
+	AttributeView dataStream = MFTRecordView(m_fileRecordHeader.get()).findDataStream(streamName.c_str(), streamName.length());
+	if (!dataStream.isNull()) {
+		return dataStream.getDataSize();
+	}
+	for (shared_ptr<MFTRecord> fileReference : m_additionalRecords) {
+		dataStream = MFTRecordView(fileReference->m_fileRecordHeader.get()).findDataStream(streamName.c_str(), streamName.length());
+		if (!dataStream.isNull()) {
+			return dataStream.getDataSize();
+		}
 	}
 	return 0;
 }
@@ -159,11 +221,21 @@ ULONGLONG MFTRecord::getTotalSize() {
 	//	mkdir my_directory
 	//	echo batman > my_directory:awesome_stream
 	//  more < my_directory:awesome_stream => "batman"
-	ULONGLONG totalSize = 0;
-	vector<shared_ptr<DataStreamAttribute>> streams = findAttribute<DataStreamAttribute>(ATTR_TYPE::AT_DATA, false);
-	for (const shared_ptr<DataStreamAttribute> stream : streams) {
-		totalSize += stream->getSize();
+	if (m_isIndexed) {
+		NTFSLIB_ASSERT_STATUS(loadPendingRecords([](const AttributeListEntry& entry) -> bool {
+			return entry.Type == ATTR_TYPE::AT_DATA && entry.LowestVCN == 0;
+		}));
+		ULONGLONG totalSize = 0;
+		for (const auto& dataStream : m_dataStreamIndex) {
+			AttributeView firstExtent(dataStream.second.Extents.front());
+			if (firstExtent.isFirstExtent()) {
+				totalSize += firstExtent.getDataSize();
+			}
+		}
+		return totalSize;
 	}
+
+	ULONGLONG totalSize = MFTRecordView(m_fileRecordHeader.get()).getTotalSize();
 	for (shared_ptr<MFTRecord> fileReference : m_additionalRecords) {
 		totalSize += fileReference->getTotalSize();
 	}
@@ -185,4 +257,135 @@ bool MFTRecord::isDeleted() const {
 
 void MFTRecord::addAdditionalFileRecord(std::shared_ptr<MFTRecord> fileRecord) {
 	m_additionalRecords.push_back(fileRecord);
+	if (m_isIndexed) {
+		indexAttributes(*fileRecord);
+	}
+}
+
+void MFTRecord::setPendingExtensionRecords(const AttributeListEntries& entries, const ExtensionRecordLoader& loader) {
+	m_extensionRecordLoader = loader;
+	for (const AttributeListEntry& entry : entries) {
+		// The list also describes the attributes kept in this very record.
+		if (entry.RecordNumber != getRecordNumber()) {
+			m_pendingAttributes.push_back(entry);
+		}
+	}
+}
+
+void MFTRecord::loadExtensionRecords() {
+	NTFSLIB_ASSERT_STATUS(tryLoadExtensionRecords());
+}
+
+NTFSLIB_STATUS MFTRecord::tryLoadExtensionRecords() {
+	return loadPendingRecords([](const AttributeListEntry&) -> bool { return true; });
+}
+
+bool MFTRecord::attachExtensionRecord(shared_ptr<MFTRecord> extensionRecord) {
+	ULONGLONG recordNumber = extensionRecord->getRecordNumber();
+	bool isPending = std::any_of(m_pendingAttributes.begin(), m_pendingAttributes.end(), [&](const AttributeListEntry& entry) -> bool {
+		return entry.RecordNumber == recordNumber;
+	});
+	if (isPending) {
+		attachPendingRecord(extensionRecord);
+	}
+	return isPending;
+}
+
+bool MFTRecord::hasPendingExtensionRecords() const {
+	return !m_pendingAttributes.empty();
+}
+
+NTFSLIB_STATUS MFTRecord::loadPendingRecords(const function<bool(const AttributeListEntry& entry)>& isNeeded) const {
+	for (size_t i = 0; i < m_pendingAttributes.size(); ) {
+		if (!isNeeded(m_pendingAttributes[i])) {
+			++i;
+			continue;
+		}
+		NTFSLIB_STATUS status = NTFSLIB_STATUS::SUCCESS;
+		shared_ptr<MFTRecord> extensionRecord = m_extensionRecordLoader(m_pendingAttributes[i].RecordNumber, status);
+		if (extensionRecord == nullptr) {
+			return status;
+		}
+		attachPendingRecord(extensionRecord);
+		i = 0;
+	}
+	return NTFSLIB_STATUS::SUCCESS;
+}
+
+void MFTRecord::attachPendingRecord(shared_ptr<MFTRecord> extensionRecord) const {
+	ULONGLONG recordNumber = extensionRecord->getRecordNumber();
+	m_additionalRecords.push_back(extensionRecord);
+	if (m_isIndexed) {
+		indexAttributes(*extensionRecord);
+	}
+	// All the attributes kept in the extension record are now available.
+	m_pendingAttributes.erase(
+		std::remove_if(m_pendingAttributes.begin(), m_pendingAttributes.end(), [&](const AttributeListEntry& entry) -> bool {
+			return entry.RecordNumber == recordNumber;
+		}),
+		m_pendingAttributes.end());
+}
+
+void MFTRecord::indexAttributes(const MFTRecord& record) const {
+	for (AttributeView attribute : MFTRecordView(record.m_fileRecordHeader.get())) {
+		m_attributeIndex[attribute.getType()].Records.push_back(attribute.getHeader());
+		if (attribute.getType() == ATTR_TYPE::AT_DATA) {
+			IndexedDataStream& dataStream = m_dataStreamIndex[wstring(attribute.getName(), attribute.getNameLength())];
+			// Only the first extent carries the stream's size, so it's kept in front.
+			dataStream.Extents.insert(attribute.isFirstExtent() ? dataStream.Extents.begin() : dataStream.Extents.end(), attribute.getHeader());
+			// Built again out of all the extents by the next lookup.
+			dataStream.Stream = nullptr;
+		}
+	}
+	for (const shared_ptr<MFTRecord>& additionalRecord : record.m_additionalRecords) {
+		indexAttributes(*additionalRecord);
+	}
+}
+
+void MFTRecord::buildIndex() const {
+	if (!m_isIndexed) {
+		indexAttributes(*this);
+		m_isIndexed = true;
+	}
+}
+
+MFTRecord::IndexedAttributes* MFTRecord::findIndexedAttributes(ATTR_TYPE attributeType) const {
+	buildIndex();
+	NTFSLIB_ASSERT_STATUS(loadPendingRecords([&](const AttributeListEntry& entry) -> bool {
+		return entry.Type == attributeType;
+	}));
+	auto indexedAttributes = m_attributeIndex.find(attributeType);
+	return indexedAttributes != m_attributeIndex.end() ? &indexedAttributes->second : nullptr;
+}
+
+void MFTRecord::collectAttributes(ATTR_TYPE attributeType, vector<PCOMMON_ATTR_RECORD>& attributes) const {
+	if (m_isIndexed) {
+		IndexedAttributes* indexedAttributes = findIndexedAttributes(attributeType);
+		if (indexedAttributes != nullptr) {
+			attributes.insert(attributes.end(), indexedAttributes->Records.begin(), indexedAttributes->Records.end());
+		}
+		return;
+	}
+
+	for (AttributeView attribute : MFTRecordView(m_fileRecordHeader.get())) {
+		if (attribute.getType() == attributeType) {
+			attributes.push_back(attribute.getHeader());
+		}
+	}
+	// Search in additional attached file records.
+	for (const shared_ptr<MFTRecord>& additionalRecord : m_additionalRecords) {
+		additionalRecord->collectAttributes(attributeType, attributes);
+	}
+}
+
+MFTRecord::IndexedDataStream* MFTRecord::findIndexedDataStream(const wstring& streamName, bool allExtents) const {
+	NTFSLIB_ASSERT_STATUS(loadPendingRecords([&](const AttributeListEntry& entry) -> bool {
+		return entry.Type == ATTR_TYPE::AT_DATA && (allExtents || entry.LowestVCN == 0) && entry.Name == streamName;
+	}));
+	auto dataStream = m_dataStreamIndex.find(streamName);
+	if (dataStream == m_dataStreamIndex.end() || !AttributeView(dataStream->second.Extents.front()).isFirstExtent()) {
+		// Extents without their first one are of no use (e.g. a partly overwritten deleted record).
+		return nullptr;
+	}
+	return &dataStream->second;
 }
@@ -1,7 +1,12 @@
 #ifndef _NTFSLIB_FILE_RECORD_H
 #define _NTFSLIB_FILE_RECORD_H
 
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <typeindex>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -12,9 +17,15 @@
 #include "..\Attribute\Base\AttributeRecord.h"
 #include "..\Attribute\StandardInformationAttribute.h"
 #include "..\Attribute\DataStreamAttribute.h"
+#include "..\Attribute\AttributesListAttribute.h"
 #include "IndexRecord.h"
 
+using std::function;
+using std::map;
+using std::mutex;
 using std::shared_ptr;
+using std::type_index;
+using std::unordered_map;
 using std::vector;
 using std::wstring;
 
@@ -32,15 +43,38 @@ enum class MFT_RECORD_SERIALIZATION_ATTRS {
 
 #define DOS_NAME_LENGTH 8
 
+class MFTRecord;
+
+/**
+ * Reads extension record number <recordNumber> on behalf of a record which needs its attributes.
+ * Returns nullptr and sets <status> if the record is unusable (see: NTFSParser.tryReadMFTRecord).
+ * I/O errors are still thrown.
+ */
+typedef function<shared_ptr<MFTRecord>(ULONGLONG recordNumber, NTFSLIB_STATUS& status)> ExtensionRecordLoader;
+
 /**
  * NTFS MFT Record. Every MFT record is limited in its size to one 
  * specified in the boot sector. Each MFT record contains attributes, which
  * define the record and contain its data. Relate to "MFTRecord" as "GeneralRecord"
  * because everything in NTFS is a MFT Record - Files and Directories.
+ * Records are not thread-safe: while some of its extension records are pending (see: setPendingExtensionRecords),
+ * even the const lookups of a record may read them and change the record. A record shared between threads
+ * must have all its extension records loaded first (see: loadExtensionRecords).
  */
 class MFTRecord {
 public:
-	MFTRecord(NTFSVolume& ntfsVolume, const PMFT_RECORD mftRecord);
+	/**
+	 * Creates a record from the fixed-up <mftRecord>. By default the record data is copied.
+	 * If <copyRecord> is false, the record references <mftRecord> in place, which must then outlive
+	 * this object (e.g. memory handed out by BlockDevice.map).
+	 */
+	MFTRecord(NTFSVolume& ntfsVolume, const PMFT_RECORD mftRecord, bool copyRecord = true);
+
+	/**
+	 * Creates a record from the fixed-up <mftRecord>, which it shares instead of copying
+	 * (e.g. a record read or copied straight into its own allocation, see: NTFSParser.tryReadMFTRecord).
+	 */
+	MFTRecord(NTFSVolume& ntfsVolume, shared_ptr<MFT_RECORD> mftRecord);
 
 	/**
 	* Returns the standard information related to this record.
@@ -49,6 +83,8 @@ public:
 
 	/**
 	 * Returns the specified data stream in the record, or nullptr if not found.
+	 * Streams too fragmented for a single record are merged out of all their extents (see: NonResidentAttribute).
+	 * Once the record is indexed (see: loadMetadata), the stream is built once and shared by all the lookups.
 	 */
 	const shared_ptr<DataStreamAttribute> MFTRecord::getDataStream(const wstring& streamName = L"") const;
 
@@ -96,6 +132,14 @@ public:
 	 */
 	Buffer serialize();
 
+	/**
+	 * Same as serialize, but appends the serialized data to <output>.
+	 * Returns a failure status instead of throwing if the record can not be serialized
+	 * (e.g. an extension record, which has no standard information nor names, or an unusable
+	 * extension record keeping one of the sizes). I/O errors are still thrown.
+	 */
+	NTFSLIB_STATUS trySerialize(Buffer& output);
+
 	/**
 	 * Returns this record's record number.
 	 * Throws an NTFSLibError if extended information is not available for this record.
@@ -130,9 +174,17 @@ public:
 	/**
 	* Loads the record meta data. You should invoke this function after you read
 	* all the "Attributes List" attributes.
+	* Also indexes the attributes of this record and its additional records, so later
+	* lookups do not walk the records again.
 	*/
 	void loadMetadata();
 
+	/**
+	 * Same as loadMetadata, but returns a failure status instead of throwing if a pending extension record
+	 * keeping the names or the standard information is unusable. I/O errors are still thrown.
+	 */
+	NTFSLIB_STATUS tryLoadMetadata();
+
 	/**
 	* Reads bytes from a specific data stream in the MFT record.
 	* Use <length> = 0 to read the whole data stream.
@@ -144,26 +196,132 @@ public:
 
 	/**
 	 * Adds additional file record to be referenced while parsing file record's attributes.
+	 * If the record was already indexed (see: loadMetadata), the additional record's attributes are indexed too.
 	 */
 	void addAdditionalFileRecord(shared_ptr<MFTRecord> fileRecord);
 
+	/**
+	 * Defers reading the extension records listed in <entries> (the record's attributes lists), until one of
+	 * the attributes they keep is looked up. They are then read with <loader>, and attached to this record.
+	 * Lookups throw the error matching the loader's status if one of them is unusable (it is tried again
+	 * by the next lookup). Until all the extension records are loaded (see: loadExtensionRecords), lookups
+	 * change the record and must not run concurrently.
+	 */
+	void setPendingExtensionRecords(const AttributeListEntries& entries, const ExtensionRecordLoader& loader);
+
+	/**
+	 * Loads all the extension records which were not loaded yet.
+	 */
+	void loadExtensionRecords();
+
+	/**
+	 * Same as loadExtensionRecords, but returns a failure status instead of throwing if one of them is unusable.
+	 * I/O errors are still thrown.
+	 */
+	NTFSLIB_STATUS tryLoadExtensionRecords();
+
+	/**
+	 * Attaches <extensionRecord>, already read by someone else (e.g. a scan), if it is one of the
+	 * pending extension records. Returns false (and leaves it alone) otherwise.
+	 */
+	bool attachExtensionRecord(shared_ptr<MFTRecord> extensionRecord);
+
+	/**
+	 * Returns true if some of the extension records were not loaded yet.
+	 */
+	bool hasPendingExtensionRecords() const;
+
 	/**
 	 * Finds an all the attribute instances in the record.
+	 * The attributes are built once (on the first lookup of their type) and kept with the attribute index, which
+	 * is built by the first lookup if the record was not indexed yet (see: loadMetadata). The returned vector is
+	 * valid as long as the record, but grows when the lookup loads more extension records keeping <attributeType>.
 	 */
 	template <class Attribute>
-	vector<shared_ptr<Attribute>> findAttribute(ATTR_TYPE attributeType, bool throwIfNotFound = true) const;
+	const vector<shared_ptr<Attribute>>& findAttribute(ATTR_TYPE attributeType, bool throwIfNotFound = true) const;
 
 private:
 	FORBID_COPY_AND_ASSIGN(MFTRecord);
 
-	// Reference to the record header.
+	/**
+	 * Attributes of a single type, of this record and of its additional records.
+	 */
+	struct IndexedAttributes {
+		// The attributes, in record order.
+		vector<PCOMMON_ATTR_RECORD> Records;
+
+		// Attributes built out of the records (see: findAttribute), by the class they were built as.
+		// Each one is a vector<shared_ptr<Attribute>>, which follows the order of the records.
+		unordered_map<type_index, shared_ptr<void>> Instances;
+	};
+
+	/**
+	 * Extents of a single data stream.
+	 */
+	struct IndexedDataStream {
+		// The extents, first extent first.
+		vector<PCOMMON_ATTR_RECORD> Extents;
+
+		// The stream built out of all its extents (see: getDataStream), nullptr until then.
+		shared_ptr<DataStreamAttribute> Stream;
+	};
+
+	/**
+	 * Adds the attributes of <record> (and of its additional records) to the attribute indexes.
+	 */
+	void indexAttributes(const MFTRecord& record) const;
+
+	/**
+	 * Builds the attribute indexes, unless they were already built.
+	 */
+	void buildIndex() const;
+
+	/**
+	 * Returns the indexed attributes of <attributeType>, or nullptr if there are none.
+	 * Builds the index, and loads the pending extension records keeping such attributes, first.
+	 */
+	IndexedAttributes* findIndexedAttributes(ATTR_TYPE attributeType) const;
+
+	/**
+	 * Loads (and indexes) the pending extension records which keep an attribute matching <isNeeded>.
+	 * Returns the loader's status once one of them is unusable, which is then left pending.
+	 */
+	NTFSLIB_STATUS loadPendingRecords(const function<bool(const AttributeListEntry& entry)>& isNeeded) const;
+
+	/**
+	 * Attaches the pending <extensionRecord>, and drops the pending attributes it keeps.
+	 */
+	void attachPendingRecord(shared_ptr<MFTRecord> extensionRecord) const;
+
+	/**
+	 * Appends all the instances of <attributeType>, in this record and in its additional records, to <attributes>.
+	 * Served by the attribute index once it is built, by walking the records otherwise.
+	 */
+	void collectAttributes(ATTR_TYPE attributeType, vector<PCOMMON_ATTR_RECORD>& attributes) const;
+
+	/**
+	 * Returns the data stream named <streamName>, or nullptr if there is no such stream.
+	 * Loads the pending extension records keeping all the extents if <allExtents> is true,
+	 * only the one keeping the first extent (enough for the stream's size) otherwise.
+	 * The record must be indexed.
+	 */
+	IndexedDataStream* findIndexedDataStream(const wstring& streamName, bool allExtents) const;
+
+	// Reference to the record header (either a private copy or a view of the volume's memory).
 	const shared_ptr<MFT_RECORD> m_fileRecordHeader;
 
 	// Extended information about this record, if available.
 	shared_ptr<StandardInformationAttribute> m_fileExtendedInfo;
 
 	// Additional MFT records related to this record (derived from "Attributes List" attribute).
-	vector <shared_ptr<MFTRecord>> m_additionalRecords;
+	// Mutable, as extension records are loaded when their attributes are first looked up.
+	mutable vector <shared_ptr<MFTRecord>> m_additionalRecords;
+
+	// Attributes lists entries of the extension records which were not loaded yet.
+	mutable AttributeListEntries m_pendingAttributes;
+
+	// Reads the pending extension records.
+	ExtensionRecordLoader m_extensionRecordLoader;
 
 	// All record names.
 	vector<wstring> m_fileNames;
@@ -174,6 +332,18 @@ private:
 	// Parent's record number.
 	ULONGLONG m_parentRecordNumber;
 
+	// Attributes of this record and of its additional records, by type.
+	mutable unordered_map<ATTR_TYPE, IndexedAttributes> m_attributeIndex;
+
+	// Every data stream, by stream name ("" for the main data stream).
+	mutable unordered_map<wstring, IndexedDataStream> m_dataStreamIndex;
+
+	// Protects the attributes built by lookups, a record with all its extension records loaded is shared between threads.
+	mutable mutex m_instancesLock;
+
+	// Were the attribute indexes built?
+	mutable bool m_isIndexed;
+
 	// Reference to the related NTFS volume.
 	NTFSVolume& m_ntfsVolume;
 };
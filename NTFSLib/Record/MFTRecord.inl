@@ -1,27 +1,27 @@
+using std::lock_guard;
 using std::make_shared;
+using std::static_pointer_cast;
 
 template<class Attribute>
-vector<shared_ptr<Attribute>> MFTRecord::findAttribute(ATTR_TYPE attributeType, bool throwIfNotFound /* = true */) const {
-	vector<shared_ptr<Attribute>> attrInstances;
-	PCOMMON_ATTR_RECORD attrBounds = (PCOMMON_ATTR_RECORD)((PBYTE)m_fileRecordHeader.get() + m_fileRecordHeader->BytesInUse);
-	PCOMMON_ATTR_RECORD currentAttribute = (PCOMMON_ATTR_RECORD)((PBYTE)m_fileRecordHeader.get() + m_fileRecordHeader->AttributeOffset);
-	while (currentAttribute->Type != (DWORD)END_OF_ATTRIBUTES && 
-		currentAttribute <= attrBounds) {
-		if (currentAttribute->Type == (DWORD)attributeType) {
-			attrInstances.push_back(make_shared<Attribute>(m_ntfsVolume, currentAttribute));
+const vector<shared_ptr<Attribute>>& MFTRecord::findAttribute(ATTR_TYPE attributeType, bool throwIfNotFound /* = true */) const {
+	static const vector<shared_ptr<Attribute>> noAttributes;
+	IndexedAttributes* indexedAttributes = findIndexedAttributes(attributeType);
+	if (indexedAttributes == nullptr) {
+		if (throwIfNotFound) {
+			NTFSLIB_ERROR(AttributeNotFoundError, NTFSLIB_DEFAULT_ERROR_CODE, "Attribute %#x was not found in record: %#llx", attributeType, m_recordNumber);
 		}
-		currentAttribute = (PCOMMON_ATTR_RECORD)((PBYTE)currentAttribute + currentAttribute->Length);
+		return noAttributes;
 	}
 
-	// Search in additional attached file records.
-	for (shared_ptr<MFTRecord> additionalFile : m_additionalRecords) {
-		vector<shared_ptr<Attribute>> tempAttrs = additionalFile->findAttribute<Attribute>(attributeType);
-		attrInstances.insert(attrInstances.end(), tempAttrs.begin(), tempAttrs.end());
+	lock_guard<mutex> lock(m_instancesLock);
+	shared_ptr<void>& instances = indexedAttributes->Instances[type_index(typeid(Attribute))];
+	if (instances == nullptr) {
+		instances = make_shared<vector<shared_ptr<Attribute>>>();
 	}
-
-	if (throwIfNotFound && attrInstances.empty()) {
-		NTFSLIB_ERROR(AttributeNotFoundError, NTFSLIB_DEFAULT_ERROR_CODE, "Attribute %#x was not found in record: %#llx", attributeType, m_recordNumber);
+	vector<shared_ptr<Attribute>>& attrInstances = *static_pointer_cast<vector<shared_ptr<Attribute>>>(instances);
+	// Only the attributes indexed since the last lookup (e.g. of a newly loaded extension record) are built.
+	for (size_t i = attrInstances.size(); i < indexedAttributes->Records.size(); ++i) {
+		attrInstances.push_back(make_shared<Attribute>(m_ntfsVolume, indexedAttributes->Records[i]));
 	}
-	
 	return attrInstances;
 }
\ No newline at end of file
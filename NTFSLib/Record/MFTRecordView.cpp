@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstddef>
+
+#include "MFTRecordView.h"
+#include "MFTRecord.h"
+
+using std::min;
+
+// $STANDARD_INFORMATION of NTFS 1.2 volumes ends right after the flags.
+#define STANDARD_INFORMATION_MIN_LENGTH offsetof(STANDARD_INFORMATION, MaximumVersions)
+
+AttributeView::AttributeView() :
+	m_attribute(nullptr) {
+}
+
+AttributeView::AttributeView(PCOMMON_ATTR_RECORD attribute) :
+	m_attribute(attribute) {
+}
+
+bool AttributeView::isNull() const {
+	return m_attribute == nullptr;
+}
+
+PCOMMON_ATTR_RECORD AttributeView::getHeader() const {
+	return m_attribute;
+}
+
+ATTR_TYPE AttributeView::getType() const {
+	return (ATTR_TYPE)m_attribute->Type;
+}
+
+bool AttributeView::isResident() const {
+	return m_attribute->NonResident == 0;
+}
+
+const WCHAR* AttributeView::getName() const {
+	return (const WCHAR*)((PBYTE)m_attribute + m_attribute->NameOffset);
+}
+
+BYTE AttributeView::getNameLength() const {
+	// A name running past the attribute is treated as no name at all.
+	if (m_attribute->NameOffset + m_attribute->NameLength * sizeof(WCHAR) > m_attribute->Length) {
+		return 0;
+	}
+	return m_attribute->NameLength;
+}
+
+bool AttributeView::hasName(const WCHAR* name, size_t nameLength) const {
+	return getNameLength() == nameLength && wmemcmp(getName(), name, nameLength) == 0;
+}
+
+PBYTE AttributeView::getValue() const {
+	if (!isResident()) {
+		return nullptr;
+	}
+	PRESIDENT_ATTR_RECORD residentAttribute = (PRESIDENT_ATTR_RECORD)m_attribute;
+	if ((ULONGLONG)residentAttribute->ValueOffset + residentAttribute->ValueLength > m_attribute->Length) {
+		return nullptr;
+	}
+	return (PBYTE)m_attribute + residentAttribute->ValueOffset;
+}
+
+DWORD AttributeView::getValueLength() const {
+	return getValue() != nullptr ? ((PRESIDENT_ATTR_RECORD)m_attribute)->ValueLength : 0;
+}
+
+ULONGLONG AttributeView::getDataSize() const {
+	if (isResident()) {
+		return getValueLength();
+	}
+	return ((PNONRESIDENT_ATTR_RECORD)m_attribute)->DataSize;
+}
+
+bool AttributeView::isFirstExtent() const {
+	return isResident() || ((PNONRESIDENT_ATTR_RECORD)m_attribute)->LowestLCN == 0;
+}
+
+PBYTE AttributeView::getRunList() const {
+	if (isResident() || ((PNONRESIDENT_ATTR_RECORD)m_attribute)->DataRunOffset >= m_attribute->Length) {
+		return nullptr;
+	}
+	return (PBYTE)m_attribute + ((PNONRESIDENT_ATTR_RECORD)m_attribute)->DataRunOffset;
+}
+
+DWORD AttributeView::getRunListLength() const {
+	return getRunList() != nullptr ? m_attribute->Length - ((PNONRESIDENT_ATTR_RECORD)m_attribute)->DataRunOffset : 0;
+}
+
+const STANDARD_INFORMATION* AttributeView::getStandardInformation() const {
+	if (getType() != ATTR_TYPE::AT_STANDARD_INFORMATION || getValueLength() < STANDARD_INFORMATION_MIN_LENGTH) {
+		return nullptr;
+	}
+	return (const STANDARD_INFORMATION*)getValue();
+}
+
+const FILE_NAME* AttributeView::getFileName() const {
+	if (getType() != ATTR_TYPE::AT_FILE_NAME || getValueLength() < offsetof(FILE_NAME, Name)) {
+		return nullptr;
+	}
+	const FILE_NAME* fileName = (const FILE_NAME*)getValue();
+	if (offsetof(FILE_NAME, Name) + fileName->NameLength * sizeof(WCHAR) > getValueLength()) {
+		return nullptr;
+	}
+	return fileName;
+}
+
+MFTRecordView::Iterator::Iterator(PBYTE position, PBYTE end) :
+	m_position(position),
+	m_end(end) {
+	m_position = validate(m_position);
+}
+
+AttributeView MFTRecordView::Iterator::operator*() const {
+	return AttributeView((PCOMMON_ATTR_RECORD)m_position);
+}
+
+MFTRecordView::Iterator& MFTRecordView::Iterator::operator++() {
+	m_position = validate(m_position + ((PCOMMON_ATTR_RECORD)m_position)->Length);
+	return *this;
+}
+
+bool MFTRecordView::Iterator::operator==(const Iterator& other) const {
+	return m_position == other.m_position;
+}
+
+bool MFTRecordView::Iterator::operator!=(const Iterator& other) const {
+	return !(*this == other);
+}
+
+PBYTE MFTRecordView::Iterator::validate(PBYTE position) const {
+	if (position >= m_end || (size_t)(m_end - position) < sizeof(b4)) {
+		return m_end;
+	}
+	PCOMMON_ATTR_RECORD attribute = (PCOMMON_ATTR_RECORD)position;
+	if (attribute->Type == END_OF_ATTRIBUTES ||
+		(size_t)(m_end - position) < sizeof(COMMON_ATTR_RECORD) ||
+		attribute->Length < sizeof(COMMON_ATTR_RECORD) ||
+		attribute->Length > (size_t)(m_end - position)) {
+		return m_end;
+	}
+	return position;
+}
+
+MFTRecordView::MFTRecordView(const PMFT_RECORD record) :
+	m_record(record) {
+}
+
+MFTRecordView::Iterator MFTRecordView::begin() const {
+	PBYTE recordEnd = (PBYTE)m_record + min(m_record->BytesInUse, m_record->BytesAllocated);
+	return Iterator((PBYTE)m_record + m_record->AttributeOffset, recordEnd);
+}
+
+MFTRecordView::Iterator MFTRecordView::end() const {
+	PBYTE recordEnd = (PBYTE)m_record + min(m_record->BytesInUse, m_record->BytesAllocated);
+	return Iterator(recordEnd, recordEnd);
+}
+
+AttributeView MFTRecordView::findAttribute(ATTR_TYPE attributeType) const {
+	for (AttributeView attribute : *this) {
+		if (attribute.getType() == attributeType) {
+			return attribute;
+		}
+	}
+	return AttributeView();
+}
+
+AttributeView MFTRecordView::findDataStream(const WCHAR* streamName, size_t nameLength) const {
+	for (AttributeView attribute : *this) {
+		if (attribute.getType() == ATTR_TYPE::AT_DATA && attribute.isFirstExtent() && attribute.hasName(streamName, nameLength)) {
+			return attribute;
+		}
+	}
+	return AttributeView();
+}
+
+const STANDARD_INFORMATION* MFTRecordView::getStandardInformation() const {
+	AttributeView attribute = findAttribute(ATTR_TYPE::AT_STANDARD_INFORMATION);
+	return attribute.isNull() ? nullptr : attribute.getStandardInformation();
+}
+
+const FILE_NAME* MFTRecordView::getFriendlyFileName() const {
+	const FILE_NAME* firstName = nullptr;
+	for (AttributeView attribute : *this) {
+		const FILE_NAME* fileName = attribute.getFileName();
+		if (fileName == nullptr) {
+			continue;
+		}
+		// Same rule as MFTRecord.getFriendlyFileName: a name longer than a DOS name is the "user-friendly" one.
+		if (fileName->NameLength > DOS_NAME_LENGTH) {
+			return fileName;
+		}
+		if (firstName == nullptr) {
+			firstName = fileName;
+		}
+	}
+	return firstName;
+}
+
+ULONGLONG MFTRecordView::getParentRecordNumber() const {
+	for (AttributeView attribute : *this) {
+		const FILE_NAME* fileName = attribute.getFileName();
+		if (fileName != nullptr) {
+			return MFT_REF(fileName->ParentMFTReference);
+		}
+	}
+	return 0;
+}
+
+ULONGLONG MFTRecordView::getSize() const {
+	AttributeView mainStream = findDataStream(L"", 0);
+	return mainStream.isNull() ? 0 : mainStream.getDataSize();
+}
+
+ULONGLONG MFTRecordView::getTotalSize() const {
+	ULONGLONG totalSize = 0;
+	for (AttributeView attribute : *this) {
+		if (attribute.getType() == ATTR_TYPE::AT_DATA && attribute.isFirstExtent()) {
+			totalSize += attribute.getDataSize();
+		}
+	}
+	return totalSize;
+}
+
+ULONGLONG MFTRecordView::getRecordNumber() const {
+	return m_record->RecordNumber;
+}
+
+bool MFTRecordView::hasAttributeList() const {
+	return !findAttribute(ATTR_TYPE::AT_ATTRIBUTE_LIST).isNull();
+}
+
+bool MFTRecordView::isBaseRecord() const {
+	return m_record->BaseFileRecord == 0;
+}
+
+bool MFTRecordView::isDirectory() const {
+	return (m_record->Flags & (b2)MFT_RECORD_FLAGS::MFT_RECORD_IS_DIRECTORY) != 0;
+}
+
+bool MFTRecordView::isDeleted() const {
+	return (m_record->Flags & (b2)MFT_RECORD_FLAGS::MFT_RECORD_IN_USE) == 0;
+}
+
+NTFSLIB_STATUS MFTRecordView::trySerialize(Buffer& output) const {
+	const STANDARD_INFORMATION* standardInformation = getStandardInformation();
+	const FILE_NAME* fileName = getFriendlyFileName();
+	if (standardInformation == nullptr || fileName == nullptr) {
+		return NTFSLIB_STATUS::UNEXPECTED_ACTION;
+	}
+	serializeRecord(output, m_record->Flags, *standardInformation, getSize(), getTotalSize(),
+		getRecordNumber(), getParentRecordNumber(), (const WCHAR*)fileName->Name, fileName->NameLength);
+	return NTFSLIB_STATUS::SUCCESS;
+}
+
+void MFTRecordView::serializeRecord(Buffer& output, WORD recordFlags, const STANDARD_INFORMATION& standardInformation,
+	ULONGLONG size, ULONGLONG totalSize, ULONGLONG recordNumber, ULONGLONG parentRecordNumber,
+	const WCHAR* name, DWORD nameLength) {
+	b1 flags = 0;
+	flags |= ((recordFlags & (b2)MFT_RECORD_FLAGS::MFT_RECORD_IS_DIRECTORY) != 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_DIRECTORY : 0);
+	flags |= ((recordFlags & (b2)MFT_RECORD_FLAGS::MFT_RECORD_IN_USE) == 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_DELETED : 0);
+	flags |= ((standardInformation.Flags & (b4)FILE_ATTR::ATTR_READ_ONLY) != 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_READ_ONLY : 0);
+	flags |= ((standardInformation.Flags & (b4)FILE_ATTR::ATTR_HIDDEN) != 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_HIDDEN : 0);
+	flags |= ((standardInformation.Flags & (b4)FILE_ATTR::ATTR_SYSTEM) != 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_SYSTEM_FILE : 0);
+	flags |= ((standardInformation.Flags & (b4)FILE_ATTR::ATTR_COMPRESSED) != 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_COMPRESSED : 0);
+	flags |= ((standardInformation.Flags & (b4)FILE_ATTR::ATTR_ENCRYPTED) != 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_ENCRYPTED : 0);
+	flags |= ((standardInformation.Flags & (b4)FILE_ATTR::ATTR_ARCHIVE) != 0 ? (b1)MFT_RECORD_SERIALIZATION_ATTRS::IS_ARCHIVED : 0);
+
+	b8 fields[] = {
+		size,
+		totalSize,
+		standardInformation.CreationTime,
+		standardInformation.LastDataChangeTime,
+		standardInformation.LastMFTChangeTime,
+		standardInformation.LastAccessTime,
+		recordNumber,
+		parentRecordNumber
+	};
+	b4 serializedNameLength = nameLength;
+
+	// Grows <output> once, and writes the fields in place.
+	size_t position = output.size();
+	output.resize(position + sizeof(flags) + sizeof(fields) + sizeof(serializedNameLength) + nameLength * sizeof(WCHAR));
+	PBYTE target = output.data() + position;
+	memcpy(target, &flags, sizeof(flags));
+	target += sizeof(flags);
+	memcpy(target, fields, sizeof(fields));
+	target += sizeof(fields);
+	memcpy(target, &serializedNameLength, sizeof(serializedNameLength));
+	target += sizeof(serializedNameLength);
+	memcpy(target, name, nameLength * sizeof(WCHAR));
+}
@@ -0,0 +1,238 @@
+#ifndef _NTFSLIB_MFT_RECORD_VIEW_H
+#define _NTFSLIB_MFT_RECORD_VIEW_H
+
+#include "..\Misc\Defs.h"
+#include "..\Misc\NTFSLibError.h"
+#include "..\Types\NTFSTypes.h"
+
+/**
+ * Non-owning view of a single attribute, in place inside its record.
+ * Nothing is decoded nor copied, every getter reads straight from the attribute header.
+ */
+class AttributeView {
+public:
+	/**
+	 * Creates a null view (e.g. an attribute that was not found).
+	 */
+	AttributeView();
+
+	/**
+	 * Creates a view of <attribute>, which must outlive it.
+	 */
+	explicit AttributeView(PCOMMON_ATTR_RECORD attribute);
+
+	/**
+	 * Returns true if this view refers no attribute.
+	 */
+	bool isNull() const;
+
+	/**
+	 * Returns the attribute's header.
+	 */
+	PCOMMON_ATTR_RECORD getHeader() const;
+
+	/**
+	 * Returns the attribute's type.
+	 */
+	ATTR_TYPE getType() const;
+
+	/**
+	 * Returns true of the attribute is resident, false otherwise.
+	 */
+	bool isResident() const;
+
+	/**
+	 * Returns the attribute's name (not null terminated), see getNameLength.
+	 */
+	const WCHAR* getName() const;
+
+	/**
+	 * Returns the length in characters of the attribute's name, 0 if unnamed.
+	 */
+	BYTE getNameLength() const;
+
+	/**
+	 * Returns true if the attribute is named <name> (<nameLength> characters long, case sensitive).
+	 */
+	bool hasName(const WCHAR* name, size_t nameLength) const;
+
+	/**
+	 * Returns a pointer to the value of a resident attribute, or nullptr if it is non-resident
+	 * (or its value exceeds the attribute).
+	 */
+	PBYTE getValue() const;
+
+	/**
+	 * Returns the length of a resident attribute's value, 0 if it is non-resident.
+	 */
+	DWORD getValueLength() const;
+
+	/**
+	 * Returns the size of the attribute's data.
+	 * Non-resident attributes split over several extents only carry the size in their first extent.
+	 */
+	ULONGLONG getDataSize() const;
+
+	/**
+	 * Returns true if this is the first (or only) extent of the attribute.
+	 */
+	bool isFirstExtent() const;
+
+	/**
+	 * Returns a pointer to the encoded data runs of a non-resident attribute, nullptr if it is resident.
+	 */
+	PBYTE getRunList() const;
+
+	/**
+	 * Returns the length in bytes of the encoded data runs, 0 if resident.
+	 */
+	DWORD getRunListLength() const;
+
+	/**
+	 * Returns the value of a $STANDARD_INFORMATION attribute, nullptr if this is not a valid one.
+	 */
+	const STANDARD_INFORMATION* getStandardInformation() const;
+
+	/**
+	 * Returns the value of a $FILE_NAME attribute, nullptr if this is not a valid one.
+	 */
+	const FILE_NAME* getFileName() const;
+
+private:
+	// The attribute, nullptr for a null view.
+	PCOMMON_ATTR_RECORD m_attribute;
+};
+
+/**
+ * Non-owning view of a fixed-up MFT record, for hot paths that can not afford an MFTRecord
+ * (which allocates an object per attribute, and a string per name).
+ * Attributes are walked in place, and the walk stops at the first malformed attribute header.
+ * Only the attributes of this very record are visible: attributes kept in extension records
+ * (see: hasAttributeList) need the full MFTRecord.
+ */
+class MFTRecordView {
+public:
+	/**
+	 * Walks the attributes of a record in place.
+	 */
+	class Iterator {
+	public:
+		Iterator(PBYTE position, PBYTE end);
+
+		AttributeView operator*() const;
+
+		Iterator& operator++();
+
+		bool operator==(const Iterator& other) const;
+
+		bool operator!=(const Iterator& other) const;
+
+	private:
+		/**
+		 * Returns <position> if a valid attribute starts there, the end of the record otherwise.
+		 */
+		PBYTE validate(PBYTE position) const;
+
+		// Current attribute (or m_end).
+		PBYTE m_position;
+
+		// End of the record's used bytes.
+		PBYTE m_end;
+	};
+
+	/**
+	 * Creates a view of the fixed-up <record>, which must outlive it.
+	 */
+	explicit MFTRecordView(const PMFT_RECORD record);
+
+	/**
+	 * Returns the first attribute of the record.
+	 */
+	Iterator begin() const;
+
+	/**
+	 * Returns the end of the record's attributes.
+	 */
+	Iterator end() const;
+
+	/**
+	 * Returns the first attribute of type <attributeType>, or a null view if there is none.
+	 */
+	AttributeView findAttribute(ATTR_TYPE attributeType) const;
+
+	/**
+	 * Returns the first extent of the $DATA attribute named <streamName> (<nameLength> characters long,
+	 * empty for the main data stream), or a null view if there is none.
+	 */
+	AttributeView findDataStream(const WCHAR* streamName, size_t nameLength) const;
+
+	/**
+	 * Returns the record's standard information, nullptr if it has none (e.g. extension records).
+	 */
+	const STANDARD_INFORMATION* getStandardInformation() const;
+
+	/**
+	 * Returns the file name shown to the user (see: MFTRecord.getFriendlyFileName), nullptr if there is none.
+	 */
+	const FILE_NAME* getFriendlyFileName() const;
+
+	/**
+	 * Returns the record number of the parent (taken from the first file name), 0 if there is none.
+	 */
+	ULONGLONG getParentRecordNumber() const;
+
+	/**
+	 * Returns the size of the main data stream, 0 if there is none.
+	 */
+	ULONGLONG getSize() const;
+
+	/**
+	 * Returns the sum of all the data stream sizes.
+	 */
+	ULONGLONG getTotalSize() const;
+
+	/**
+	 * Returns the record's number.
+	 */
+	ULONGLONG getRecordNumber() const;
+
+	/**
+	 * Returns true if some of the record's attributes are kept in extension records.
+	 */
+	bool hasAttributeList() const;
+
+	/**
+	 * Returns true if this is a base record (and not an extension of another record).
+	 */
+	bool isBaseRecord() const;
+
+	/**
+	 * Is this record referencing a directory?
+	 */
+	bool isDirectory() const;
+
+	/**
+	 * Has this record been marked for deletion?
+	 */
+	bool isDeleted() const;
+
+	/**
+	 * Appends the record to <output>, in the format of MFTRecord.serialize, without any allocation
+	 * but <output>'s growth. Returns a failure status if the record has no standard information or no names.
+	 */
+	NTFSLIB_STATUS trySerialize(Buffer& output) const;
+
+	/**
+	 * Appends a record to <output> in the format of MFTRecord.serialize.
+	 * <recordFlags> are the record header's flags (see: MFT_RECORD_FLAGS).
+	 */
+	static void serializeRecord(Buffer& output, WORD recordFlags, const STANDARD_INFORMATION& standardInformation,
+		ULONGLONG size, ULONGLONG totalSize, ULONGLONG recordNumber, ULONGLONG parentRecordNumber,
+		const WCHAR* name, DWORD nameLength);
+
+private:
+	// The record.
+	PMFT_RECORD m_record;
+};
+
+#endif // _NTFSLIB_MFT_RECORD_VIEW_H
@@ -0,0 +1,148 @@
+#ifndef _NTFSLIB_PARTITION_TYPES_H
+#define _NTFSLIB_PARTITION_TYPES_H
+
+#include <vector>
+#include <string>
+
+#include "NTFSTypes.h"
+
+using std::vector;
+using std::wstring;
+
+// Partition tables are read assuming this sector size, unless the GPT header is found elsewhere.
+#define PARTITION_DEFAULT_SECTOR_SIZE 512
+// Sector sizes the GPT header is looked for with (it is always found on LBA 1).
+#define PARTITION_GPT_SECTOR_SIZES { 512, 4096 }
+// Sanity limits of corrupted (or hostile) partition tables.
+#define PARTITION_MAX_LOGICAL_PARTITIONS 128
+#define PARTITION_MAX_GPT_ENTRIES 1024
+
+#define MBR_SIGNATURE 0xaa55
+#define MBR_NUM_OF_PARTITIONS 4
+#define MBR_FIRST_LOGICAL_PARTITION_NUMBER 5
+
+// MBR partition types of interest.
+#define MBR_TYPE_EMPTY 0x00
+#define MBR_TYPE_EXTENDED_CHS 0x05
+#define MBR_TYPE_EXTENDED_LBA 0x0f
+#define MBR_TYPE_EXTENDED_LINUX 0x85
+#define MBR_TYPE_GPT_PROTECTIVE 0xee
+
+#pragma pack(1)
+
+//////////////////////////////////////////////////////////////////////////
+// System defined data structures                                       //
+//////////////////////////////////////////////////////////////////////////
+
+/**
+ * A partition entry of an MBR (or of an EBR, the boot record of a logical partition).
+ */
+typedef struct {
+	// 0x80 = bootable.
+	b1 BootIndicator;
+	// Irrelevant.
+	b1 StartingCHS[3];
+	// Partition type (e.g. 0x07 = NTFS / exFAT, 0x05 = extended partition).
+	b1 PartitionType;
+	// Irrelevant.
+	b1 EndingCHS[3];
+	// First sector of the partition.
+	b4 StartingLBA;
+	// Size of the partition in sectors.
+	b4 SizeInSectors;
+} MBR_PARTITION_ENTRY, *PMBR_PARTITION_ENTRY;
+
+/**
+ * Master Boot Record, found on sector 0 of the disk.
+ * Extended partitions chain EBRs of the same layout, one per logical partition: the first entry of an EBR
+ * is the logical partition (relative to the EBR), the second one is the next EBR (relative to the extended partition).
+ */
+typedef struct {
+	// Boot up code.
+	b1 Bootstrap[440];
+	// Irrelevant.
+	b4 DiskSignature;
+	// 0.
+	b2 Reserved;
+	MBR_PARTITION_ENTRY Partitions[MBR_NUM_OF_PARTITIONS];
+	// Always 0xaa55, little endian.
+	b2 Signature;
+} MASTER_BOOT_RECORD, *PMASTER_BOOT_RECORD;
+
+/**
+ * GPT header, found on LBA 1 (the MBR holding a single protective partition).
+ */
+typedef struct {
+	// "EFI PART".
+	b1 Signature[8];
+	b4 Revision;
+	b4 HeaderSize;
+	b4 HeaderCRC32;
+	// 0.
+	b4 Reserved;
+	// LBA of this header.
+	b8 MyLBA;
+	// LBA of the backup header.
+	b8 AlternateLBA;
+	b8 FirstUsableLBA;
+	b8 LastUsableLBA;
+	b1 DiskGUID[16];
+	// First LBA of the partition entries array.
+	b8 PartitionEntryLBA;
+	b4 NumberOfPartitionEntries;
+	// Size of a single entry (128 or more).
+	b4 SizeOfPartitionEntry;
+	b4 PartitionEntryArrayCRC32;
+} GPT_HEADER, *PGPT_HEADER;
+
+/**
+ * A partition entry of the GPT partition entries array. Unused entries have a zero type.
+ */
+typedef struct {
+	b1 PartitionTypeGUID[16];
+	b1 UniquePartitionGUID[16];
+	// First sector of the partition.
+	b8 StartingLBA;
+	// Last sector of the partition (inclusive).
+	b8 EndingLBA;
+	b8 Attributes;
+	// UTF-16, null terminated unless all 36 characters are used.
+	WCHAR PartitionName[36];
+} GPT_PARTITION_ENTRY, *PGPT_PARTITION_ENTRY;
+
+#pragma pack()
+
+//////////////////////////////////////////////////////////////////////////
+// Library defined data structures                                      //
+//////////////////////////////////////////////////////////////////////////
+
+// How a disk is partitioned.
+enum class PARTITION_SCHEME {
+	// Not partitioned, the disk is a single volume (e.g. an image of a volume).
+	NONE,
+	MBR,
+	GPT
+};
+
+/**
+ * A partition found on a disk.
+ */
+typedef struct {
+	// 1-based partition number (MBR logical partitions start at 5).
+	DWORD Number;
+	// Partition's offset on the disk in bytes.
+	ULONGLONG Offset;
+	// Partition's size in bytes.
+	ULONGLONG Size;
+	// MBR partition type (0 on GPT disks).
+	BYTE MBRType;
+	// GPT partition type (all 0's on MBR disks).
+	GUID GPTType;
+	// GPT partition name (empty on MBR disks).
+	wstring Name;
+	// Does the partition start with an NTFS boot sector?
+	bool IsNTFS;
+} PartitionInfo;
+typedef vector<PartitionInfo> PartitionList;
+
+#endif // _NTFSLIB_PARTITION_TYPES_H
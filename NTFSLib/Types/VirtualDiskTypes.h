@@ -0,0 +1,220 @@
+#ifndef _NTFSLIB_VIRTUAL_DISK_TYPES_H
+#define _NTFSLIB_VIRTUAL_DISK_TYPES_H
+
+#include "NTFSTypes.h"
+
+//////////////////////////////////////////////////////////////////////////
+// VHD (all fields are big endian)                                      //
+//////////////////////////////////////////////////////////////////////////
+
+#define VHD_SECTOR_SIZE 512
+#define VHD_FOOTER_SIZE 512
+// Data offset of fixed disks (which have no dynamic header).
+#define VHD_NO_DATA_OFFSET 0xffffffffffffffffULL
+// BAT entry of an unallocated block.
+#define VHD_UNALLOCATED_BLOCK 0xffffffff
+#define VHD_NUM_OF_PARENT_LOCATORS 8
+
+// Disk types.
+#define VHD_DISK_TYPE_FIXED 2
+#define VHD_DISK_TYPE_DYNAMIC 3
+#define VHD_DISK_TYPE_DIFFERENCING 4
+
+// Parent locator platform codes ("W2ru", "W2ku"): UTF-16 relative / absolute Windows paths.
+#define VHD_PLATFORM_CODE_RELATIVE_PATH 0x57327275
+#define VHD_PLATFORM_CODE_ABSOLUTE_PATH 0x57326b75
+
+//////////////////////////////////////////////////////////////////////////
+// VHDX (all fields are little endian)                                  //
+//////////////////////////////////////////////////////////////////////////
+
+#define VHDX_HEADER_OFFSET_1 (64 * 1024)
+#define VHDX_HEADER_OFFSET_2 (128 * 1024)
+#define VHDX_REGION_TABLE_OFFSET (192 * 1024)
+#define VHDX_REGION_TABLE_SIZE (64 * 1024)
+#define VHDX_METADATA_TABLE_SIZE (64 * 1024)
+#define VHDX_MAX_REGION_ENTRIES 2047
+#define VHDX_MAX_METADATA_ENTRIES 2047
+// File offsets in the BAT are in units of 1MB.
+#define VHDX_FILE_OFFSET_UNIT (1024 * 1024)
+// A sector bitmap block covers this many sectors.
+#define VHDX_SECTORS_PER_BITMAP_BLOCK (1ULL << 23)
+
+// BAT entry states.
+#define VHDX_BAT_STATE_MASK 0x7
+#define VHDX_BAT_FILE_OFFSET_SHIFT 20
+#define VHDX_PAYLOAD_BLOCK_NOT_PRESENT 0
+#define VHDX_PAYLOAD_BLOCK_UNDEFINED 1
+#define VHDX_PAYLOAD_BLOCK_ZERO 2
+#define VHDX_PAYLOAD_BLOCK_UNMAPPED 3
+#define VHDX_PAYLOAD_BLOCK_FULLY_PRESENT 6
+#define VHDX_PAYLOAD_BLOCK_PARTIALLY_PRESENT 7
+#define VHDX_SB_BLOCK_PRESENT 6
+
+// Region table entries flags.
+#define VHDX_REGION_IS_REQUIRED 0x1
+
+// File parameters flags.
+#define VHDX_HAS_PARENT 0x2
+
+#pragma pack(1)
+
+//////////////////////////////////////////////////////////////////////////
+// System defined data structures                                       //
+//////////////////////////////////////////////////////////////////////////
+
+/**
+ * VHD footer, found on the last 512 bytes of the file (and copied to its first 512 bytes on dynamic disks).
+ */
+typedef struct {
+	// "conectix".
+	b1 Cookie[8];
+	b4 Features;
+	b4 FileFormatVersion;
+	// Offset of the dynamic disk header, VHD_NO_DATA_OFFSET on fixed disks.
+	b8 DataOffset;
+	b4 TimeStamp;
+	b4 CreatorApplication;
+	b4 CreatorVersion;
+	b4 CreatorHostOS;
+	b8 OriginalSize;
+	// Size of the virtual disk in bytes.
+	b8 CurrentSize;
+	b4 DiskGeometry;
+	b4 DiskType;
+	b4 Checksum;
+	b1 UniqueId[16];
+	b1 SavedState;
+	b1 Reserved[427];
+} VHD_FOOTER, *PVHD_FOOTER;
+
+/**
+ * Locates the parent of a differencing VHD.
+ */
+typedef struct {
+	b4 PlatformCode;
+	// Space reserved for the locator, in sectors.
+	b4 PlatformDataSpace;
+	// Length of the locator in bytes.
+	b4 PlatformDataLength;
+	b4 Reserved;
+	// File offset of the locator.
+	b8 PlatformDataOffset;
+} VHD_PARENT_LOCATOR, *PVHD_PARENT_LOCATOR;
+
+/**
+ * Header of a dynamic (or differencing) VHD.
+ */
+typedef struct {
+	// "cxsparse".
+	b1 Cookie[8];
+	// Unused, 0xffffffffffffffff.
+	b8 DataOffset;
+	// File offset of the BAT.
+	b8 TableOffset;
+	b4 HeaderVersion;
+	// Number of BAT entries.
+	b4 MaxTableEntries;
+	// Size of a block in bytes (sector bitmap excluded).
+	b4 BlockSize;
+	b4 Checksum;
+	b1 ParentUniqueId[16];
+	b4 ParentTimeStamp;
+	b4 Reserved;
+	// UTF-16 (big endian).
+	b1 ParentUnicodeName[512];
+	VHD_PARENT_LOCATOR ParentLocators[VHD_NUM_OF_PARENT_LOCATORS];
+	b1 Reserved2[256];
+} VHD_DYNAMIC_HEADER, *PVHD_DYNAMIC_HEADER;
+
+/**
+ * VHDX file type identifier, found at offset 0.
+ */
+typedef struct {
+	// "vhdxfile".
+	b1 Signature[8];
+	WCHAR Creator[256];
+} VHDX_FILE_IDENTIFIER, *PVHDX_FILE_IDENTIFIER;
+
+/**
+ * VHDX header. There are two copies, the one with the greater sequence number is current.
+ */
+typedef struct {
+	// "head".
+	b1 Signature[4];
+	b4 Checksum;
+	b8 SequenceNumber;
+	GUID FileWriteGuid;
+	GUID DataWriteGuid;
+	// All 0's unless the log has to be replayed.
+	GUID LogGuid;
+	b2 LogVersion;
+	b2 Version;
+	b4 LogLength;
+	b8 LogOffset;
+} VHDX_HEADER, *PVHDX_HEADER;
+
+/**
+ * VHDX region table header, followed by its entries.
+ */
+typedef struct {
+	// "regi".
+	b1 Signature[4];
+	b4 Checksum;
+	b4 EntryCount;
+	b4 Reserved;
+} VHDX_REGION_TABLE_HEADER, *PVHDX_REGION_TABLE_HEADER;
+
+typedef struct {
+	GUID Guid;
+	b8 FileOffset;
+	b4 Length;
+	b4 Required;
+} VHDX_REGION_TABLE_ENTRY, *PVHDX_REGION_TABLE_ENTRY;
+
+/**
+ * VHDX metadata table header, followed by its entries.
+ */
+typedef struct {
+	// "metadata".
+	b1 Signature[8];
+	b2 Reserved;
+	b2 EntryCount;
+	b4 Reserved2[5];
+} VHDX_METADATA_TABLE_HEADER, *PVHDX_METADATA_TABLE_HEADER;
+
+typedef struct {
+	GUID ItemId;
+	// Offset of the item, relative to the metadata region.
+	b4 Offset;
+	b4 Length;
+	b4 Flags;
+	b4 Reserved;
+} VHDX_METADATA_TABLE_ENTRY, *PVHDX_METADATA_TABLE_ENTRY;
+
+typedef struct {
+	b4 BlockSize;
+	b4 Flags;
+} VHDX_FILE_PARAMETERS, *PVHDX_FILE_PARAMETERS;
+
+/**
+ * VHDX parent locator metadata item, followed by its key-value entries.
+ */
+typedef struct {
+	GUID LocatorType;
+	b2 Reserved;
+	b2 KeyValueCount;
+} VHDX_PARENT_LOCATOR_HEADER, *PVHDX_PARENT_LOCATOR_HEADER;
+
+typedef struct {
+	// Offsets of the UTF-16 key and value, relative to the parent locator item.
+	b4 KeyOffset;
+	b4 ValueOffset;
+	// Lengths in bytes.
+	b2 KeyLength;
+	b2 ValueLength;
+} VHDX_PARENT_LOCATOR_ENTRY, *PVHDX_PARENT_LOCATOR_ENTRY;
+
+#pragma pack()
+
+#endif // _NTFSLIB_VIRTUAL_DISK_TYPES_H
@@ -0,0 +1,45 @@
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\AlignedBufferPool.h"
+
+#define TEST_PAGE_SIZE 4096
+
+// Buffers are aligned, sized to a power of two, and reused once released.
+TEST(AlignedBufferPoolTest, AcquireAndReuse) {
+	try {
+		AlignedBufferPool pool;
+		PBYTE firstData = nullptr;
+		{
+			PooledBuffer buffer(pool, ALIGNED_BUFFER_POOL_MIN_SIZE + 1);
+			ASSERT_EQ(buffer.size(), 2 * ALIGNED_BUFFER_POOL_MIN_SIZE);
+			ASSERT_EQ((ULONG_PTR)buffer.data() % TEST_PAGE_SIZE, 0);
+			firstData = buffer.data();
+		}
+		ASSERT_EQ(pool.getFreeBytes(), 2 * ALIGNED_BUFFER_POOL_MIN_SIZE);
+
+		PooledBuffer buffer(pool, 2 * ALIGNED_BUFFER_POOL_MIN_SIZE);
+		ASSERT_EQ(buffer.data(), firstData);
+		ASSERT_EQ(pool.getFreeBytes(), 0);
+
+		PooledBuffer smallBuffer(pool, 1);
+		ASSERT_EQ(smallBuffer.size(), ALIGNED_BUFFER_POOL_MIN_SIZE);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Released buffers beyond the budget are freed.
+TEST(AlignedBufferPoolTest, FreeBytesBudget) {
+	try {
+		AlignedBufferPool pool(ALIGNED_BUFFER_POOL_MIN_SIZE);
+		{
+			PooledBuffer firstBuffer(pool, ALIGNED_BUFFER_POOL_MIN_SIZE);
+			PooledBuffer secondBuffer(pool, ALIGNED_BUFFER_POOL_MIN_SIZE);
+		}
+		ASSERT_EQ(pool.getFreeBytes(), ALIGNED_BUFFER_POOL_MIN_SIZE);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
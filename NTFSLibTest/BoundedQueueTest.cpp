@@ -0,0 +1,73 @@
+#include <atomic>
+#include <thread>
+
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\BoundedQueue.h"
+
+using std::atomic;
+using std::thread;
+
+#define TEST_NUM_OF_ITEMS 100000
+
+// Items come out in the order they went in, and a full queue refuses more.
+TEST(BoundedQueueTest, FirstInFirstOut) {
+	try {
+		BoundedQueue<int> queue(4);
+		for (int i = 0; i < 4; ++i) {
+			ASSERT_TRUE(queue.tryPush(i));
+		}
+		ASSERT_FALSE(queue.tryPush(4));
+		int item = 0;
+		for (int i = 0; i < 4; ++i) {
+			ASSERT_TRUE(queue.tryPop(item));
+			ASSERT_EQ(item, i);
+		}
+		ASSERT_FALSE(queue.tryPop(item));
+
+		// Closed queues are drained, but take no more items.
+		ASSERT_TRUE(queue.push(42));
+		queue.close();
+		ASSERT_FALSE(queue.push(43));
+		ASSERT_TRUE(queue.pop(item));
+		ASSERT_EQ(item, 42);
+		ASSERT_FALSE(queue.pop(item));
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Producers are held back by a small queue, but no item is lost nor duplicated.
+TEST(BoundedQueueTest, ConcurrentProducersAndConsumers) {
+	try {
+		BoundedQueue<ULONGLONG> queue(8);
+		atomic<ULONGLONG> sum(0);
+		vector<thread> producers;
+		vector<thread> consumers;
+		for (int i = 0; i < 2; ++i) {
+			producers.push_back(thread([&queue] {
+				for (ULONGLONG item = 1; item <= TEST_NUM_OF_ITEMS; ++item) {
+					queue.push(item);
+				}
+			}));
+			consumers.push_back(thread([&queue, &sum] {
+				ULONGLONG item = 0;
+				while (queue.pop(item)) {
+					sum += item;
+				}
+			}));
+		}
+		for (thread& producer : producers) {
+			producer.join();
+		}
+		queue.close();
+		for (thread& consumer : consumers) {
+			consumer.join();
+		}
+		ASSERT_EQ(sum, 2ULL * TEST_NUM_OF_ITEMS * (TEST_NUM_OF_ITEMS + 1) / 2);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
@@ -0,0 +1,56 @@
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\CancellationToken.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+
+TEST(CancellationTokenTest, Cancel) {
+	try {
+		CancellationToken token;
+		ASSERT_FALSE(token.isCancelled());
+		std::thread cancellingThread([&token]() {
+			token.cancel();
+		});
+		cancellingThread.join();
+		ASSERT_TRUE(token.isCancelled());
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// The earliest deadline wins.
+TEST(CancellationTokenTest, Deadline) {
+	try {
+		CancellationToken token;
+		token.cancelAfter(20);
+		token.cancelAfter(60 * 1000);
+		ASSERT_FALSE(token.isCancelled());
+		std::this_thread::sleep_for(std::chrono::milliseconds(40));
+		ASSERT_TRUE(token.isCancelled());
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Cancelling a parent cancels its children, never the other way around.
+TEST(CancellationTokenTest, Parent) {
+	try {
+		shared_ptr<CancellationToken> parent = std::make_shared<CancellationToken>();
+		CancellationToken child(parent);
+		CancellationToken otherChild(parent);
+		otherChild.cancel();
+		ASSERT_FALSE(parent->isCancelled());
+		ASSERT_FALSE(child.isCancelled());
+
+		parent->cancel();
+		ASSERT_TRUE(child.isCancelled());
+	}
+	catch (...) {
+		FAIL();
+	}
+}
@@ -0,0 +1,47 @@
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\ClusterCache.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+
+#define TEST_CLUSTER_SIZE 4096
+
+// Hits after insertion, misses otherwise.
+TEST(ClusterCacheTest, LookupAfterInsert) {
+	try {
+		ClusterCache cache(TEST_CLUSTER_SIZE, TEST_CLUSTER_SIZE * 64, 4);
+		Buffer cluster(TEST_CLUSTER_SIZE, 0x42);
+		Buffer output(TEST_CLUSTER_SIZE, 0);
+		ASSERT_FALSE(cache.lookup(1337, output.data()));
+		cache.insert(1337, cluster.data());
+		ASSERT_TRUE(cache.lookup(1337, output.data()));
+		ASSERT_EQ(cluster, output);
+
+		ClusterCacheStatistics statistics = cache.getStatistics();
+		ASSERT_EQ(statistics.Hits, 1);
+		ASSERT_EQ(statistics.Misses, 1);
+		ASSERT_EQ(statistics.CachedBytes, TEST_CLUSTER_SIZE);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// The cache never grows beyond its budget.
+TEST(ClusterCacheTest, EvictionKeepsBudget) {
+	try {
+		ClusterCache cache(TEST_CLUSTER_SIZE, TEST_CLUSTER_SIZE * 16, 4);
+		Buffer cluster(TEST_CLUSTER_SIZE, 0);
+		for (ULONGLONG lcn = 0; lcn < 1024; ++lcn) {
+			cache.insert(lcn, cluster.data());
+		}
+		ClusterCacheStatistics statistics = cache.getStatistics();
+		ASSERT_LE(statistics.CachedBytes, statistics.BudgetBytes);
+		ASSERT_EQ(statistics.Evictions, 1024 - statistics.CachedBytes / TEST_CLUSTER_SIZE);
+
+		cache.clear();
+		ASSERT_EQ(cache.getStatistics().CachedBytes, 0);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
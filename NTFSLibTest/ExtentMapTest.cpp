@@ -0,0 +1,62 @@
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\ExtentMap.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+
+#define TEST_CLUSTER_SIZE 4096
+
+// [VCN 0-9 @ LCN 100] [VCN 10-14 sparse] [VCN 15-19 @ LCN 50]. Given out of order on purpose.
+static const DataRunList testDataRuns = {
+	{ false, 50, 15, 5 },
+	{ false, 100, 0, 10 },
+	{ true, 0, 10, 5 }
+};
+
+// Finds the data run holding a VCN.
+TEST(ExtentMapTest, FindDataRun) {
+	try {
+		ExtentMap extentMap(testDataRuns, TEST_CLUSTER_SIZE, 20 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(extentMap.findDataRun(0)->StartLCN, 100);
+		ASSERT_EQ(extentMap.findDataRun(9)->StartLCN, 100);
+		ASSERT_TRUE(extentMap.findDataRun(12)->IsSparse);
+		ASSERT_EQ(extentMap.findDataRun(19)->StartLCN, 50);
+		ASSERT_EQ(extentMap.findDataRun(20), nullptr);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Translates stream offsets to disk offsets.
+TEST(ExtentMapTest, Translate) {
+	try {
+		ExtentMap extentMap(testDataRuns, TEST_CLUSTER_SIZE, 20 * TEST_CLUSTER_SIZE);
+		ULONGLONG diskOffset = 0;
+		ASSERT_TRUE(extentMap.translate(TEST_CLUSTER_SIZE * 2 + 1024, 1024, diskOffset));
+		ASSERT_EQ(diskOffset, 102 * TEST_CLUSTER_SIZE + 1024);
+		ASSERT_TRUE(extentMap.translate(TEST_CLUSTER_SIZE * 16, 1024, diskOffset));
+		ASSERT_EQ(diskOffset, 51 * TEST_CLUSTER_SIZE);
+		// Crossing data runs, or a sparse data run.
+		ASSERT_FALSE(extentMap.translate(TEST_CLUSTER_SIZE * 10 - 512, 1024, diskOffset));
+		ASSERT_FALSE(extentMap.translate(TEST_CLUSTER_SIZE * 11, 1024, diskOffset));
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Translating beyond the end of the stream.
+TEST(ExtentMapTest, BadTranslate) {
+	try {
+		ExtentMap extentMap(testDataRuns, TEST_CLUSTER_SIZE, 20 * TEST_CLUSTER_SIZE);
+		ULONGLONG diskOffset = 0;
+		extentMap.translate(TEST_CLUSTER_SIZE * 20, 1024, diskOffset);
+		FAIL();
+	}
+	catch (OutOfBoundsError&) {
+		// Good!
+	}
+	catch (...) {
+		FAIL();
+	}
+}
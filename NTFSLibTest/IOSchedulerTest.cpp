@@ -0,0 +1,184 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\IOScheduler.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+
+TEST(IOSchedulerTest, DefaultPriorities) {
+	try {
+		IOScheduler scheduler;
+		ASSERT_EQ(scheduler.getPriority(IO_SOURCE::MFT_SCAN), IO_PRIORITY::BACKGROUND);
+		ASSERT_EQ(scheduler.getPriority(IO_SOURCE::DATA_STREAM), IO_PRIORITY::BACKGROUND);
+		ASSERT_EQ(scheduler.getPriority(IO_SOURCE::MFT_RECORD), IO_PRIORITY::INTERACTIVE);
+		ASSERT_EQ(scheduler.getPriority(IO_SOURCE::OTHER), IO_PRIORITY::INTERACTIVE);
+		ASSERT_EQ(scheduler.getRateLimit(IO_PRIORITY::BACKGROUND).BytesPerSecond, 0);
+
+		IOSourceScope scanScope(IO_SOURCE::MFT_SCAN);
+		ScheduledIO scheduledIO(scheduler, 1, 4096);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Past the burst, a limited class is held to its rate, while the other class is not.
+TEST(IOSchedulerTest, RateLimit) {
+	try {
+		IOScheduler scheduler;
+		// A burst of 10 requests, then one every 10ms.
+		scheduler.setRateLimit(IO_PRIORITY::BACKGROUND, { 0, 100 });
+
+		ULONGLONG startTime = IOStatistics::getTimestamp();
+		for (DWORD i = 0; i < 100; ++i) {
+			ScheduledIO scheduledIO(scheduler, 1, 4096);
+		}
+		ASSERT_LT(IOStatistics::getTimestamp() - startTime, 50000);
+
+		{
+			IOSourceScope scanScope(IO_SOURCE::MFT_SCAN);
+			startTime = IOStatistics::getTimestamp();
+			for (DWORD i = 0; i < 30; ++i) {
+				ScheduledIO scheduledIO(scheduler, 1, 4096);
+			}
+			ASSERT_GE(IOStatistics::getTimestamp() - startTime, 180000);
+		}
+
+		// Lifting the limit takes effect at once.
+		scheduler.setRateLimit(IO_PRIORITY::BACKGROUND, { 0, 0 });
+		IOSourceScope scanScope(IO_SOURCE::MFT_SCAN);
+		startTime = IOStatistics::getTimestamp();
+		for (DWORD i = 0; i < 100; ++i) {
+			ScheduledIO scheduledIO(scheduler, 1, 4096);
+		}
+		ASSERT_LT(IOStatistics::getTimestamp() - startTime, 50000);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A request larger than the burst goes through, the following ones pay its debt back.
+TEST(IOSchedulerTest, ByteDebt) {
+	try {
+		IOScheduler scheduler;
+		scheduler.setRateLimit(IO_PRIORITY::INTERACTIVE, { 1024 * 1024, 0 });
+
+		ULONGLONG startTime = IOStatistics::getTimestamp();
+		{
+			ScheduledIO scheduledIO(scheduler, 1, 256 * 1024);
+		}
+		ASSERT_LT(IOStatistics::getTimestamp() - startTime, 50000);
+		{
+			ScheduledIO scheduledIO(scheduler, 1, 1);
+		}
+		// 256KB - 100KB of burst, at 1MB per second.
+		ASSERT_GE(IOStatistics::getTimestamp() - startTime, 140000);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// BACKGROUND requests wait for INTERACTIVE requests in flight, but not forever.
+TEST(IOSchedulerTest, BackgroundYields) {
+	try {
+		IOScheduler scheduler;
+		std::atomic<bool> admitted(false);
+		std::thread backgroundThread;
+		{
+			ScheduledIO interactiveIO(scheduler, 1, 4096);
+			backgroundThread = std::thread([&scheduler, &admitted]() {
+				IOSourceScope streamScope(IO_SOURCE::DATA_STREAM);
+				ScheduledIO backgroundIO(scheduler, 1, 4096);
+				admitted = true;
+			});
+			std::this_thread::sleep_for(std::chrono::milliseconds(IO_SCHEDULER_MAX_YIELD_MILLISECONDS / 5));
+			EXPECT_FALSE(admitted);
+		}
+		backgroundThread.join();
+		ASSERT_TRUE(admitted);
+
+		// Starving INTERACTIVE requests only delay it.
+		ScheduledIO interactiveIO(scheduler, 1, 4096);
+		IOSourceScope streamScope(IO_SOURCE::DATA_STREAM);
+		ULONGLONG startTime = IOStatistics::getTimestamp();
+		{
+			ScheduledIO backgroundIO(scheduler, 1, 4096);
+		}
+		ASSERT_GE(IOStatistics::getTimestamp() - startTime, IO_SCHEDULER_MAX_YIELD_MILLISECONDS * 1000);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// The class of an operation wins over the source of its requests, and the outermost operation wins.
+TEST(IOSchedulerTest, OperationPriority) {
+	try {
+		IOScheduler scheduler;
+		// A burst of 10 requests, then one every 10ms.
+		scheduler.setRateLimit(IO_PRIORITY::BACKGROUND, { 0, 100 });
+		ASSERT_FALSE(IOPriorityScope::getCurrent().IsSet);
+
+		IOPriorityScope scanPriority(IO_PRIORITY::BACKGROUND);
+		{
+			IOPriorityScope innerPriority(IO_PRIORITY::INTERACTIVE);
+			ASSERT_TRUE(IOPriorityScope::getCurrent().IsSet);
+			ASSERT_EQ(IOPriorityScope::getCurrent().Priority, IO_PRIORITY::BACKGROUND);
+		}
+		ASSERT_TRUE(IOPriorityScope::getCurrent().IsSet);
+
+		// Extension records read by the scan are held to its rate.
+		IOSourceScope recordScope(IO_SOURCE::MFT_RECORD);
+		ULONGLONG startTime = IOStatistics::getTimestamp();
+		for (DWORD i = 0; i < 30; ++i) {
+			ScheduledIO scheduledIO(scheduler, 1, 4096);
+		}
+		ASSERT_GE(IOStatistics::getTimestamp() - startTime, 180000);
+	}
+	catch (...) {
+		FAIL();
+	}
+	ASSERT_FALSE(IOPriorityScope::getCurrent().IsSet);
+}
+
+// Threads working for an operation take its class along.
+TEST(IOSchedulerTest, OperationPriorityOnOtherThreads) {
+	try {
+		IOScheduler scheduler;
+		scheduler.setRateLimit(IO_PRIORITY::BACKGROUND, { 0, 100 });
+
+		IOPriorityScope streamPriority(IO_PRIORITY::BACKGROUND);
+		IOOperationPriority operationPriority = IOPriorityScope::getCurrent();
+		ULONGLONG elapsed = 0;
+		std::thread workerThread([&scheduler, &operationPriority, &elapsed]() {
+			IOPriorityScope workerPriority(operationPriority);
+			IOSourceScope otherScope(IO_SOURCE::OTHER);
+			ULONGLONG startTime = IOStatistics::getTimestamp();
+			for (DWORD i = 0; i < 30; ++i) {
+				ScheduledIO scheduledIO(scheduler, 1, 4096);
+			}
+			elapsed = IOStatistics::getTimestamp() - startTime;
+		});
+		workerThread.join();
+		ASSERT_GE(elapsed, 180000);
+
+		// Not on threads which do not take it.
+		std::thread otherThread([&scheduler, &elapsed]() {
+			IOSourceScope otherScope(IO_SOURCE::OTHER);
+			ULONGLONG startTime = IOStatistics::getTimestamp();
+			for (DWORD i = 0; i < 30; ++i) {
+				ScheduledIO scheduledIO(scheduler, 1, 4096);
+			}
+			elapsed = IOStatistics::getTimestamp() - startTime;
+		});
+		otherThread.join();
+		ASSERT_LT(elapsed, 50000);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
@@ -0,0 +1,123 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\IOStatistics.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+
+// Requests are counted under the outermost scope of the calling thread.
+TEST(IOStatisticsTest, SourceAttribution) {
+	try {
+		IOStatistics statistics;
+		statistics.recordRead(0, 4096, 4096, 10);
+		{
+			IOSourceScope scanScope(IO_SOURCE::MFT_SCAN);
+			statistics.recordRead(4096, 8192, 8192, 20);
+			IOSourceScope streamScope(IO_SOURCE::DATA_STREAM);
+			ASSERT_EQ(IOSourceScope::getCurrent(), IO_SOURCE::MFT_SCAN);
+			statistics.recordCacheLookups(3, 1);
+		}
+		ASSERT_EQ(IOSourceScope::getCurrent(), IO_SOURCE::OTHER);
+		{
+			IOSourceScope journalScope(IO_SOURCE::JOURNAL);
+			statistics.recordControl(512, 5);
+		}
+
+		IOStatisticsSnapshot snapshot = statistics.getSnapshot();
+		const IOSourceStatistics& other = snapshot.Sources[(size_t)IO_SOURCE::OTHER];
+		const IOSourceStatistics& scan = snapshot.Sources[(size_t)IO_SOURCE::MFT_SCAN];
+		const IOSourceStatistics& journal = snapshot.Sources[(size_t)IO_SOURCE::JOURNAL];
+		ASSERT_EQ(other.Reads, 1);
+		ASSERT_EQ(scan.Reads, 1);
+		ASSERT_EQ(scan.BytesRead, 8192);
+		ASSERT_EQ(IOStatistics::getCacheHitRatio(scan), 0.75);
+		ASSERT_EQ(journal.BytesRead, 512);
+		ASSERT_EQ(snapshot.Sources[(size_t)IO_SOURCE::DATA_STREAM].Reads, 0);
+
+		IOSourceStatistics total = IOStatistics::getTotal(snapshot);
+		ASSERT_EQ(total.Reads, 3);
+		ASSERT_EQ(total.Calls, 3);
+		ASSERT_EQ(total.MaxLatency, 20);
+		ASSERT_EQ(IOStatistics::getAverageRequestSize(total), (4096 + 8192 + 512) / 3);
+
+		statistics.reset();
+		ASSERT_EQ(IOStatistics::getTotal(statistics.getSnapshot()).Reads, 0);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Distances are measured from where the previous request ended, batches count every read.
+TEST(IOStatisticsTest, SeekDistance) {
+	try {
+		IOStatistics statistics;
+		statistics.recordRead(0, 4096, 4096, 1);
+		statistics.recordRead(4096, 4096, 4096, 1);
+		DeviceReadList reads = {
+			{ nullptr, 1024 * 1024, 4096, 4096 },
+			{ nullptr, 8192, 4096, 4096 }
+		};
+		statistics.recordBatch(reads, 100);
+
+		IOSourceStatistics other = statistics.getSnapshot().Sources[(size_t)IO_SOURCE::OTHER];
+		ASSERT_EQ(other.Reads, 4);
+		ASSERT_EQ(other.Calls, 3);
+		ASSERT_EQ(other.SeekDistance, (1024 * 1024 - 8192) + (1024 * 1024 + 4096 - 8192));
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Buckets cover every latency once, with a bounded relative error.
+TEST(IOStatisticsTest, LatencyBuckets) {
+	try {
+		for (DWORD bucket = 1; bucket < IO_LATENCY_NUM_OF_BUCKETS; ++bucket) {
+			ULONGLONG lowerBound = IOStatistics::getBucketLowerBound(bucket);
+			ULONGLONG previousLowerBound = IOStatistics::getBucketLowerBound(bucket - 1);
+			ASSERT_GT(lowerBound, previousLowerBound);
+			ASSERT_LE(lowerBound - previousLowerBound, previousLowerBound / 4 + 1);
+		}
+
+		IOStatistics statistics;
+		for (ULONGLONG latency = 1; latency <= 1000; ++latency) {
+			statistics.recordRead(0, 0, 0, latency);
+		}
+		IOSourceStatistics other = statistics.getSnapshot().Sources[(size_t)IO_SOURCE::OTHER];
+		ASSERT_EQ(other.Calls, 1000);
+		ASSERT_EQ(other.TotalLatency, 1000 * 1001 / 2);
+		ULONGLONG median = IOStatistics::getLatencyPercentile(other, 50);
+		ASSERT_GE(median, 500);
+		ASSERT_LE(median, 500 * 5 / 4);
+		ASSERT_EQ(IOStatistics::getLatencyPercentile(other, 100), 1000);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+TEST(IOStatisticsTest, PeriodicDump) {
+	try {
+		IOStatistics statistics;
+		statistics.recordRead(0, 4096, 4096, 1);
+		std::atomic<DWORD> dumps(0);
+		statistics.startPeriodicDump(1, [&dumps](const IOStatisticsSnapshot& snapshot) {
+			if (snapshot.Sources[(size_t)IO_SOURCE::OTHER].Reads == 1) {
+				dumps++;
+			}
+		});
+		while (dumps < 3) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		statistics.stopPeriodicDump();
+		DWORD dumpsAfterStop = dumps;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		ASSERT_EQ(dumps, dumpsAfterStop);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
@@ -1,10 +1,15 @@
 #include <gtest\gtest.h>
+#include <map>
 #include <memory>
 #include <vector>
 #include <string>
 
 #include "..\NTFSLib\NTFSLib.h"
+#include "..\NTFSLib\Attribute\Base\NonResidentAttribute.h"
+#include "..\NTFSLib\Attribute\FileNameAttribute.h"
+#include "..\NTFSLib\Attribute\IndexRootAttribute.h"
 
+using std::map;
 using std::shared_ptr;
 using std::string;
 using std::wstring;
@@ -18,6 +23,53 @@ using std::sort;
 #define DUMP_DIR L"C:\\NTFSLibTestingGrounds\\Dumps"
 #define BIG_FILE_NAME L"BigFile.bin"
 
+/**
+ * Fabricates an extent of a non-resident attribute of <dataSize> bytes, covering VCNs [<lowestVCN>, <highestVCN>]
+ * with the encoded <dataRuns> (see: DataRun).
+ */
+static Buffer makeExtent(ULONGLONG lowestVCN, ULONGLONG highestVCN, ULONGLONG dataSize, const Buffer& dataRuns) {
+	Buffer extent(sizeof(NONRESIDENT_ATTR_RECORD) + dataRuns.size() + 1, 0);
+	PNONRESIDENT_ATTR_RECORD record = (PNONRESIDENT_ATTR_RECORD)extent.data();
+	record->CommonRecord.Type = (b4)ATTR_TYPE::AT_DATA;
+	record->CommonRecord.Length = (b4)extent.size();
+	record->CommonRecord.NonResident = 1;
+	record->LowestLCN = lowestVCN;
+	record->HighestVCN = highestVCN;
+	record->DataRunOffset = sizeof(NONRESIDENT_ATTR_RECORD);
+	record->DataSize = dataSize;
+	record->InitializedSize = dataSize;
+	memcpy(extent.data() + sizeof(NONRESIDENT_ATTR_RECORD), dataRuns.data(), dataRuns.size());
+	return extent;
+}
+
+/**
+ * Fabricates MFT record number <recordNumber>, an extension record of <baseRecordNumber> (0 for a base record),
+ * which keeps a single resident data stream named <streamName>, of <dataSize> bytes.
+ */
+static Buffer makeRecord(DWORD recordNumber, ULONGLONG baseRecordNumber, const wstring& streamName, DWORD dataSize) {
+	Buffer record(1024, 0);
+	PMFT_RECORD header = (PMFT_RECORD)record.data();
+	memcpy(&header->RecordHeader.Magic, "FILE", sizeof(header->RecordHeader.Magic));
+	header->AttributeOffset = (b2)((sizeof(MFT_RECORD) + 7) & ~7);
+	header->Flags = (b2)MFT_RECORD_FLAGS::MFT_RECORD_IN_USE;
+	header->BytesAllocated = (b4)record.size();
+	header->BaseFileRecord = baseRecordNumber;
+	header->RecordNumber = recordNumber;
+
+	PRESIDENT_ATTR_RECORD attribute = (PRESIDENT_ATTR_RECORD)(record.data() + header->AttributeOffset);
+	DWORD nameSize = (DWORD)(streamName.length() * sizeof(WCHAR));
+	attribute->CommonRecord.Type = (b4)ATTR_TYPE::AT_DATA;
+	attribute->CommonRecord.NameLength = (b1)streamName.length();
+	attribute->CommonRecord.NameOffset = sizeof(RESIDENT_ATTR_RECORD);
+	attribute->ValueLength = dataSize;
+	attribute->ValueOffset = (b2)((sizeof(RESIDENT_ATTR_RECORD) + nameSize + 7) & ~7);
+	attribute->CommonRecord.Length = (b4)((attribute->ValueOffset + dataSize + 7) & ~7);
+	memcpy((PBYTE)attribute + attribute->CommonRecord.NameOffset, streamName.c_str(), nameSize);
+	*(PDWORD)((PBYTE)attribute + attribute->CommonRecord.Length) = END_OF_ATTRIBUTES;
+	header->BytesInUse = header->AttributeOffset + attribute->CommonRecord.Length + sizeof(DWORD);
+	return record;
+}
+
 #define BAD_FILE L"C:\\If\\You\\Create\\This\\File\\You\\Ruin\\The\\Tests\\Think\\About\\The\\Unicorns.please"
 
 // Lists file named streams.
@@ -103,6 +155,241 @@ TEST(MFTRecordTest, ReadPartOfFileToBuffer) {
 	}
 }
 
+// Views a record in place, and compares it with the parsed record.
+TEST(MFTRecordTest, RecordView) {
+	try {
+		NTFSParser ntfsParser('C');
+		shared_ptr<MFTRecord> record = ntfsParser.findMFTRecord(wstring(TEST_DIR) + L"\\" + wstring(STREAMS_FILE));
+		bool found = false;
+		ASSERT_FALSE(ntfsParser.scanMFTRecordViews([&](const MFTRecordView& recordView) -> bool {
+			if (recordView.getRecordNumber() != record->getRecordNumber()) {
+				return true;
+			}
+			found = true;
+			EXPECT_EQ(recordView.getParentRecordNumber(), record->getParentRecordNumber());
+			EXPECT_EQ(recordView.getSize(), record->getSize());
+			EXPECT_EQ(recordView.getTotalSize(), record->getTotalSize());
+			EXPECT_EQ(recordView.isDirectory(), record->isDirectory());
+			EXPECT_EQ(recordView.findDataStream(L"stream1", 7).isNull(), false);
+			EXPECT_EQ(recordView.findDataStream(L"stream9001", 10).isNull(), false);
+			EXPECT_EQ(recordView.findDataStream(L"missing", 7).isNull(), true);
+			// Prefixes of a stream's name do not match it.
+			EXPECT_EQ(recordView.findDataStream(L"stream", 6).isNull(), true);
+			EXPECT_EQ(recordView.findDataStream(L"stream9001", 7).isNull(), true);
+			Buffer serializedView;
+			EXPECT_EQ(recordView.trySerialize(serializedView), NTFSLIB_STATUS::SUCCESS);
+			EXPECT_EQ(serializedView, record->serialize());
+			return false;
+		}));
+		ASSERT_TRUE(found);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Looks attributes and streams up in the record's index, and compares them with a walk over the record in place.
+TEST(MFTRecordTest, IndexedLookups) {
+	try {
+		NTFSParser ntfsParser('C');
+		shared_ptr<MFTRecord> record = ntfsParser.findMFTRecord(wstring(TEST_DIR) + L"\\" + wstring(STREAMS_FILE));
+		bool found = false;
+		ASSERT_FALSE(ntfsParser.scanMFTRecordViews([&](const MFTRecordView& recordView) -> bool {
+			if (recordView.getRecordNumber() != record->getRecordNumber()) {
+				return true;
+			}
+			found = true;
+			map<ATTR_TYPE, size_t> numOfAttributes;
+			for (AttributeView attribute : recordView) {
+				numOfAttributes[attribute.getType()]++;
+				if (attribute.getType() != ATTR_TYPE::AT_DATA) {
+					continue;
+				}
+				wstring streamName(attribute.getName(), attribute.getNameLength());
+				shared_ptr<DataStreamAttribute> dataStream = record->getDataStream(streamName);
+				EXPECT_NE(dataStream, nullptr);
+				if (dataStream != nullptr) {
+					EXPECT_EQ(dataStream->getStreamName(), streamName);
+					EXPECT_EQ(dataStream->getSize(), attribute.getDataSize());
+					// Built once, and shared by the next lookups.
+					EXPECT_EQ(record->getDataStream(streamName), dataStream);
+				}
+			}
+			EXPECT_EQ(record->getDataStream(L"missing"), nullptr);
+			EXPECT_EQ(record->getDataStream(L"stream"), nullptr);
+
+			const vector<shared_ptr<FileNameAttribute>>& fileNames = record->findAttribute<FileNameAttribute>(ATTR_TYPE::AT_FILE_NAME, false);
+			EXPECT_EQ(fileNames.size(), numOfAttributes[ATTR_TYPE::AT_FILE_NAME]);
+			// Built once, and shared by the next lookups.
+			EXPECT_EQ(&record->findAttribute<FileNameAttribute>(ATTR_TYPE::AT_FILE_NAME, false), &fileNames);
+			EXPECT_EQ(record->findAttribute<DataStreamAttribute>(ATTR_TYPE::AT_DATA, false).size(), numOfAttributes[ATTR_TYPE::AT_DATA]);
+			EXPECT_EQ(record->findAttribute<StandardInformationAttribute>(ATTR_TYPE::AT_STANDARD_INFORMATION, false).size(),
+				numOfAttributes[ATTR_TYPE::AT_STANDARD_INFORMATION]);
+			EXPECT_EQ(numOfAttributes[ATTR_TYPE::AT_INDEX_ROOT], 0);
+			EXPECT_TRUE(record->findAttribute<IndexRootAttribute>(ATTR_TYPE::AT_INDEX_ROOT, false).empty());
+			EXPECT_THROW(record->findAttribute<IndexRootAttribute>(ATTR_TYPE::AT_INDEX_ROOT), AttributeNotFoundError);
+			return false;
+		}));
+		ASSERT_TRUE(found);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A stream kept in an extension record is only read once it is looked up, and then joined with the base record.
+TEST(MFTRecordTest, LazyExtensionRecord) {
+	try {
+		NTFSVolume volume('C');
+		Buffer baseData = makeRecord(100, 0, L"", 4);
+		Buffer extensionData = makeRecord(101, 100, L"stream1", 6);
+		shared_ptr<MFTRecord> record = std::make_shared<MFTRecord>(volume, (PMFT_RECORD)baseData.data());
+		DWORD numOfLoads = 0;
+		record->setPendingExtensionRecords({ { ATTR_TYPE::AT_DATA, L"stream1", 0, 101 } },
+			[&](ULONGLONG recordNumber, NTFSLIB_STATUS&) -> shared_ptr<MFTRecord> {
+			EXPECT_EQ(recordNumber, 101);
+			numOfLoads++;
+			return std::make_shared<MFTRecord>(volume, (PMFT_RECORD)extensionData.data());
+		});
+		ASSERT_TRUE(record->hasPendingExtensionRecords());
+
+		// Neither the metadata nor the base record's own stream need the extension record.
+		ASSERT_EQ(record->tryLoadMetadata(), NTFSLIB_STATUS::SUCCESS);
+		ASSERT_EQ(record->getSize(), 4);
+		ASSERT_EQ(numOfLoads, 0);
+
+		shared_ptr<DataStreamAttribute> dataStream = record->getDataStream(L"stream1");
+		ASSERT_NE(dataStream, nullptr);
+		ASSERT_EQ(dataStream->getSize(), 6);
+		ASSERT_EQ(numOfLoads, 1);
+		ASSERT_FALSE(record->hasPendingExtensionRecords());
+		ASSERT_EQ(record->getTotalSize(), 10);
+		ASSERT_EQ(numOfLoads, 1);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// An unusable extension record (corrupt, or beyond the end of the MFT) fails the lookups which need it with
+// the loader's status, and is left pending for the next lookup. The rest of the record is still usable.
+TEST(MFTRecordTest, UnusableExtensionRecord) {
+	try {
+		NTFSVolume volume('C');
+		Buffer baseData = makeRecord(100, 0, L"", 4);
+		shared_ptr<MFTRecord> record = std::make_shared<MFTRecord>(volume, (PMFT_RECORD)baseData.data());
+		NTFSLIB_STATUS loaderStatus = NTFSLIB_STATUS::BAD_RECORD_HEADER;
+		DWORD numOfLoads = 0;
+		record->setPendingExtensionRecords({ { ATTR_TYPE::AT_DATA, L"stream1", 0, 101 } },
+			[&](ULONGLONG, NTFSLIB_STATUS& status) -> shared_ptr<MFTRecord> {
+			numOfLoads++;
+			status = loaderStatus;
+			return nullptr;
+		});
+		ASSERT_EQ(record->tryLoadMetadata(), NTFSLIB_STATUS::SUCCESS);
+		ASSERT_EQ(record->getSize(), 4);
+
+		ASSERT_EQ(record->tryLoadExtensionRecords(), NTFSLIB_STATUS::BAD_RECORD_HEADER);
+		ASSERT_THROW(record->getDataStream(L"stream1"), BadRecordHeaderError);
+		ASSERT_EQ(numOfLoads, 2);
+		ASSERT_TRUE(record->hasPendingExtensionRecords());
+
+		// An extension record beyond the end of the MFT (see: NTFSParser.tryReadMFTRecord).
+		loaderStatus = NTFSLIB_STATUS::OUT_OF_BOUNDS;
+		ASSERT_EQ(record->tryLoadExtensionRecords(), NTFSLIB_STATUS::OUT_OF_BOUNDS);
+		ASSERT_THROW(record->getDataStream(L"stream1"), OutOfBoundsError);
+		ASSERT_TRUE(record->hasPendingExtensionRecords());
+		ASSERT_EQ(record->getDataStream(L"")->getSize(), 4);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Checks that the data runs of a big file (merged out of all its extents) cover the whole file, in order.
+TEST(MFTRecordTest, MergedDataRuns) {
+	try {
+		NTFSParser ntfsParser('C');
+		shared_ptr<MFTRecord> record = ntfsParser.findMFTRecord(std::wstring(DUMP_DIR) + L"\\" + std::wstring(BIG_FILE_NAME));
+		shared_ptr<DataStreamAttribute> dataStream = record->getDataStream();
+		ASSERT_NE(dataStream, nullptr);
+		ULONGLONG nextVCN = 0;
+		for (const DataRun& dataRun : dataStream->getDataRuns()) {
+			ASSERT_EQ(dataRun.StartVCN, nextVCN);
+			nextVCN += dataRun.NumOfClusters;
+		}
+		ASSERT_GT(nextVCN, 0);
+		// The last bytes are found through the merged data runs.
+		BYTE lastByte = 0;
+		record->read(&lastByte, L"", dataStream->getSize() - 1, 1);
+		ASSERT_EQ(lastByte, '9');
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Merges fabricated extents given out of order, and reads across their boundaries.
+TEST(MFTRecordTest, MergedExtents) {
+	try {
+		NTFSVolume volume('C');
+		WORD clusterSize = volume.getClusterSize();
+		ULONGLONG dataSize = 14 * clusterSize - 100;
+		// [VCN 0-3 @ LCN 100] [VCN 4-6 @ LCN 300], the LCN of the second run being relative to the first.
+		Buffer firstExtent = makeExtent(0, 6, dataSize, { 0x11, 0x04, 0x64, 0x21, 0x03, 0xc8, 0x00 });
+		// [VCN 7-8 sparse] [VCN 9-13 @ LCN 200], relative to LCN 0 again.
+		Buffer secondExtent = makeExtent(7, 13, dataSize, { 0x01, 0x02, 0x21, 0x05, 0xc8, 0x00 });
+		NonResidentAttribute attribute(volume, { (PCOMMON_ATTR_RECORD)secondExtent.data(), (PCOMMON_ATTR_RECORD)firstExtent.data() });
+		ASSERT_EQ(attribute.getDataSize(), dataSize);
+
+		const DataRunList& dataRuns = attribute.getDataRuns();
+		ASSERT_EQ(dataRuns.size(), 4);
+		LONGLONG expectedLCNs[] = { 100, 300, 0, 200 };
+		ULONGLONG expectedLengths[] = { 4, 3, 2, 5 };
+		ULONGLONG nextVCN = 0;
+		for (size_t i = 0; i < dataRuns.size(); ++i) {
+			ASSERT_EQ(dataRuns[i].StartVCN, nextVCN);
+			ASSERT_EQ(dataRuns[i].IsSparse, i == 2);
+			ASSERT_EQ(dataRuns[i].StartLCN, expectedLCNs[i]);
+			ASSERT_EQ(dataRuns[i].NumOfClusters, expectedLengths[i]);
+			nextVCN += dataRuns[i].NumOfClusters;
+		}
+
+		Buffer expected(14 * clusterSize, 0);
+		volume.readClusters(expected.data(), 100, 4, false);
+		volume.readClusters(expected.data() + 4 * clusterSize, 300, 3, false);
+		volume.readClusters(expected.data() + 9 * clusterSize, 200, 5, false);
+		// Across the runs of the first extent, and across both extents and the sparse run between them.
+		Buffer actual(5 * clusterSize);
+		attribute.getData(actual.data(), 3 * clusterSize + 10, 2 * clusterSize);
+		ASSERT_EQ(memcmp(actual.data(), expected.data() + 3 * clusterSize + 10, 2 * clusterSize), 0);
+		attribute.getData(actual.data(), 6 * clusterSize + 10, 4 * clusterSize);
+		ASSERT_EQ(memcmp(actual.data(), expected.data() + 6 * clusterSize + 10, 4 * clusterSize), 0);
+		// Up to the end of the data.
+		attribute.getData(actual.data(), 12 * clusterSize, clusterSize - 100);
+		ASSERT_EQ(memcmp(actual.data(), expected.data() + 12 * clusterSize, clusterSize - 100), 0);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Reads a range starting and ending in the middle of clusters, and compares it with an aligned read.
+TEST(MFTRecordTest, ReadUnalignedRange) {
+	try {
+		NTFSParser ntfsParser('C');
+		shared_ptr<MFTRecord> record = ntfsParser.findMFTRecord(std::wstring(DUMP_DIR) + L"\\" + std::wstring(BIG_FILE_NAME));
+		Buffer alignedBuffer(1024 * 64, 0);
+		record->read(alignedBuffer.data(), L"", 0, (DWORD)alignedBuffer.size());
+		Buffer unalignedBuffer(alignedBuffer.size() - 1000, 0);
+		record->read(unalignedBuffer.data(), L"", 7, (DWORD)unalignedBuffer.size());
+		ASSERT_EQ(memcmp(alignedBuffer.data() + 7, unalignedBuffer.data(), unalignedBuffer.size()), 0);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
 #ifndef LIGHT_TESTS
 // Reads a bug file to buffer.
 TEST(MFTRecordTest, ReadBigFileToBuffer) {
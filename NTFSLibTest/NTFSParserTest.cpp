@@ -1,4 +1,7 @@
 #include <gtest\gtest.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
 
 #include "..\NTFSLib\NTFSLib.h"
 #include "..\NTFSLib\Misc\Defs.h"
@@ -6,6 +9,9 @@
 
 using std::wstring;
 using std::string;
+using std::atomic;
+using std::is_sorted;
+using std::shared_ptr;
 
 #define MY_VOLUME_NAME L"Destiny"
 
@@ -187,4 +193,260 @@ TEST(NTFSParserTest, DumpFullDir) {
 		FAIL();
 	}
 }
+
+// A throttled "Dir" dump stays within its cap, extension records and attribute lists included.
+TEST(NTFSParserTest, ThrottledDumpFullDir) {
+	try {
+		NTFSParser ntfsParser('C');
+		const DWORD requestsPerSecond = 200;
+		ntfsParser.setIORateLimit(IO_PRIORITY::BACKGROUND, { 0, requestsPerSecond });
+		ntfsParser.resetIOStatistics();
+		NTFSFileWriter fileWriter(wstring(DUMP_DIR) + L"\\" + wstring(TEMP_OUTPUT));
+		ntfsParser.dumpFullDir(fileWriter, 2000);
+
+		IOStatisticsSnapshot statistics = ntfsParser.getIOStatistics();
+		ULONGLONG totalReads = 0;
+		for (const IOSourceStatistics& source : statistics.Sources) {
+			totalReads += source.Reads;
+		}
+		ASSERT_GT(totalReads, 0);
+		// A burst, the rate since, and a request which may have gone over it.
+		ULONGLONG maxReads = requestsPerSecond * IO_SCHEDULER_BURST_MILLISECONDS / 1000 +
+			requestsPerSecond * statistics.ElapsedMicroseconds / 1000000 + 1;
+		ASSERT_LE(totalReads, maxReads);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Scans the MFT with different read sizes, both should see the same records.
+TEST(NTFSParserTest, ScanMFTRecords) {
+	try {
+		NTFSParser ntfsParser('C');
+		MFTScanOptions smallChunks;
+		smallChunks.ChunkSize = 64 * 1024;
+		MFTScanOptions bigChunks;
+		bigChunks.ChunkSize = MFT_SCAN_MAX_CHUNK_SIZE;
+		ULONGLONG smallChunkRecords = 0;
+		bool foundRoot = false;
+		ASSERT_TRUE(ntfsParser.scanMFTRecords([&](MFTRecord& record) -> bool {
+			foundRoot |= record.getRecordNumber() == (ULONGLONG)NTFS_SYSTEM_FILES::FILE_Root;
+			smallChunkRecords++;
+			return true;
+		}, smallChunks));
+		ASSERT_TRUE(foundRoot);
+
+		ULONGLONG bigChunkRecords = 0;
+		ASSERT_TRUE(ntfsParser.scanMFTRecords([&](MFTRecord&) -> bool {
+			bigChunkRecords++;
+			return true;
+		}, bigChunks));
+		ASSERT_EQ(smallChunkRecords, bigChunkRecords);
+
+		// Without joins, extension records are read from the disk instead of taken from the scan.
+		MFTScanOptions noJoins;
+		noJoins.MaxPendingJoins = 0;
+		ULONGLONG unjoinedRecords = 0;
+		ASSERT_TRUE(ntfsParser.scanMFTRecords([&](MFTRecord&) -> bool {
+			unjoinedRecords++;
+			return true;
+		}, noJoins));
+		ASSERT_EQ(smallChunkRecords, unjoinedRecords);
+
+		// Free records are only visited on demand, and are never in use.
+		MFTScanOptions unusedRecords;
+		unusedRecords.IncludeUnusedRecords = true;
+		ULONGLONG allRecords = 0;
+		ULONGLONG freeRecords = 0;
+		ASSERT_TRUE(ntfsParser.scanMFTRecords([&](MFTRecord& record) -> bool {
+			allRecords++;
+			freeRecords += record.isDeleted() ? 1 : 0;
+			return true;
+		}, unusedRecords));
+		ASSERT_GE(allRecords, smallChunkRecords);
+		ASSERT_LE(allRecords - smallChunkRecords, freeRecords);
+
+		// Stopping after the first record.
+		ASSERT_FALSE(ntfsParser.scanMFTRecords([](MFTRecord&) -> bool { return false; }));
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Scans the MFT over several threads, the same records should be seen in the same order.
+TEST(NTFSParserTest, ParallelMFTScan) {
+	try {
+		NTFSParser ntfsParser('C');
+		vector<ULONGLONG> sequentialRecords;
+		ASSERT_TRUE(ntfsParser.processMFTRecords([](MFTRecord& record, Buffer& output) -> bool {
+			ULONGLONG recordNumber = record.getRecordNumber();
+			output.insert(output.end(), (PBYTE)&recordNumber, (PBYTE)&recordNumber + sizeof(recordNumber));
+			return true;
+		}, [&](PBYTE output, DWORD outputLength) -> bool {
+			EXPECT_EQ(outputLength, sizeof(ULONGLONG));
+			sequentialRecords.push_back(*(ULONGLONG*)output);
+			return true;
+		}));
+
+		MFTScanOptions parallelScan;
+		parallelScan.NumOfThreads = 4;
+		parallelScan.ChunkSize = 64 * 1024;
+		vector<ULONGLONG> parallelRecords;
+		ASSERT_TRUE(ntfsParser.processMFTRecords([](MFTRecord& record, Buffer& output) -> bool {
+			ULONGLONG recordNumber = record.getRecordNumber();
+			output.insert(output.end(), (PBYTE)&recordNumber, (PBYTE)&recordNumber + sizeof(recordNumber));
+			return true;
+		}, [&](PBYTE output, DWORD) -> bool {
+			parallelRecords.push_back(*(ULONGLONG*)output);
+			return true;
+		}, parallelScan));
+		// Records joined with their extension records keep their base record's place.
+		ASSERT_TRUE(is_sorted(sequentialRecords.begin(), sequentialRecords.end()));
+		ASSERT_EQ(sequentialRecords, parallelRecords);
+
+		// Unordered, straight from the workers.
+		atomic<ULONGLONG> unorderedRecords(0);
+		ASSERT_TRUE(ntfsParser.scanMFTRecords([&](MFTRecord&) -> bool {
+			unorderedRecords++;
+			return true;
+		}, parallelScan));
+		ASSERT_EQ(unorderedRecords, sequentialRecords.size());
+
+		// Stopping after the first record.
+		ASSERT_FALSE(ntfsParser.scanMFTRecords([](MFTRecord&) -> bool { return false; }, parallelScan));
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Scans cancelled in the middle, on a single thread, on several threads and through the pipeline.
+TEST(NTFSParserTest, CancelMFTScan) {
+	try {
+		NTFSParser ntfsParser('C');
+		ULONGLONG allRecords = 0;
+		ASSERT_TRUE(ntfsParser.scanMFTRecordViews([&](const MFTRecordView&) -> bool {
+			allRecords++;
+			return true;
+		}));
+
+		for (DWORD numOfThreads : { 1, 4 }) {
+			MFTScanOptions options;
+			options.NumOfThreads = numOfThreads;
+			shared_ptr<CancellationToken> cancellation = std::make_shared<CancellationToken>();
+			options.Cancellation = cancellation;
+			atomic<ULONGLONG> visitedRecords(0);
+			ASSERT_FALSE(ntfsParser.scanMFTRecords([&](MFTRecord&) -> bool {
+				if (++visitedRecords == 100) {
+					cancellation->cancel();
+				}
+				return true;
+			}, options));
+			ASSERT_GE(visitedRecords.load(), 100);
+			ASSERT_LT(visitedRecords.load(), allRecords);
+		}
+
+		MFTScanOptions options;
+		options.NumOfThreads = 4;
+		shared_ptr<CancellationToken> cancellation = std::make_shared<CancellationToken>();
+		options.Cancellation = cancellation;
+		ULONGLONG outputs = 0;
+		ASSERT_FALSE(ntfsParser.processMFTRecords([](MFTRecord&, Buffer& output) -> bool {
+			output.push_back(0);
+			return true;
+		}, [&](PBYTE, DWORD) -> bool {
+			if (++outputs == 100) {
+				cancellation->cancel();
+			}
+			return true;
+		}, options));
+		ASSERT_GE(outputs, 100);
+		ASSERT_LT(outputs, allRecords);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A scan stops once the deadline of its token passes.
+TEST(NTFSParserTest, CancelMFTScanAfterDeadline) {
+	try {
+		NTFSParser ntfsParser('C');
+		MFTScanOptions options;
+		shared_ptr<CancellationToken> cancellation = std::make_shared<CancellationToken>();
+		cancellation->cancelAfter(100);
+		options.Cancellation = cancellation;
+		// A millisecond per record would take minutes.
+		ULONGLONG visitedRecords = 0;
+		ASSERT_FALSE(ntfsParser.scanMFTRecordViews([&](const MFTRecordView&) -> bool {
+			visitedRecords++;
+			Sleep(1);
+			return true;
+		}, options));
+		ASSERT_TRUE(cancellation->isCancelled());
+		ASSERT_GT(visitedRecords, 0);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+/**
+ * Counts the writes of a dump, and hands each one to a callback.
+ */
+class CountingOutStream : public NTFSOutStream {
+public:
+	CountingOutStream(const std::function<void()>& callback = nullptr) :
+		Callback(callback),
+		NumOfWrites(0) {
+		// Left blank.
+	}
+
+	virtual void write(PBYTE, DWORD) override {
+		++NumOfWrites;
+		if (Callback != nullptr) {
+			Callback();
+		}
+	}
+
+	std::function<void()> Callback;
+	DWORD NumOfWrites;
+};
+
+// stopFullDir stops the dumps of the parser it is called on, and only those.
+TEST(NTFSParserTest, StopFullDir) {
+	try {
+		NTFSParser ntfsParser('C');
+		NTFSParser otherParser('C');
+		CountingOutStream fullDump;
+		ntfsParser.dumpFullDir(fullDump, 100);
+
+		// Stopping the other parser while dumping.
+		CountingOutStream otherStopped([&]() {
+			otherParser.stopFullDir();
+		});
+		ntfsParser.dumpFullDir(otherStopped, 100);
+		// The volume is live, a record more or less may have been written since.
+		ASSERT_NEAR(otherStopped.NumOfWrites, fullDump.NumOfWrites, 1);
+
+		// Stopping this one after the first flush, while the other parser dumps on its own.
+		CountingOutStream otherDump;
+		std::thread otherThread([&]() {
+			otherParser.dumpFullDir(otherDump, 100);
+		});
+		CountingOutStream stopped([&]() {
+			ntfsParser.stopFullDir();
+		});
+		ntfsParser.dumpFullDir(stopped, 100);
+		otherThread.join();
+		// The batch being handed over when stopped is still flushed.
+		ASSERT_LT(stopped.NumOfWrites, fullDump.NumOfWrites / 2);
+		ASSERT_NEAR(otherDump.NumOfWrites, fullDump.NumOfWrites, 1);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
 #endif
\ No newline at end of file
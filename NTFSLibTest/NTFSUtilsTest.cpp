@@ -59,4 +59,39 @@ TEST(NTFSUtilsTest, ExpandEnvironmentVariable) {
 	catch (...) {
 		FAIL();
 	}
-}
\ No newline at end of file
+}
+
+// A torn record is reported without throwing, and is left untouched.
+TEST(NTFSUtilsTest, TryUSARecordFixup) {
+	try {
+		// Two sectors of 512 bytes, the USA right after the header.
+		Buffer record(1024, 0);
+		PNTFS_RECORD header = (PNTFS_RECORD)record.data();
+		header->USAOffset = sizeof(NTFS_RECORD);
+		header->USACount = 3;
+		PWORD usa = (PWORD)(record.data() + header->USAOffset);
+		usa[0] = 0x1337;
+		usa[1] = 0x4242;
+		usa[2] = 0x2424;
+		*(PWORD)(record.data() + 510) = 0x1337;
+		*(PWORD)(record.data() + 1022) = 0x1338;
+
+		Buffer tornRecord = record;
+		ASSERT_FALSE(NTFSUtils::tryUSARecordFixup((PNTFS_RECORD)tornRecord.data(), 512));
+		ASSERT_EQ(tornRecord, record);
+		ASSERT_THROW(NTFSUtils::USARecordFixup((PNTFS_RECORD)tornRecord.data(), 512), USAFixupError);
+
+		*(PWORD)(record.data() + 1022) = 0x1337;
+		ASSERT_TRUE(NTFSUtils::tryUSARecordFixup(header, 512));
+		ASSERT_EQ(*(PWORD)(record.data() + 510), 0x4242);
+		ASSERT_EQ(*(PWORD)(record.data() + 1022), 0x2424);
+
+		// A record which was already fixed up looks torn.
+		Buffer fixedUpRecord = record;
+		ASSERT_FALSE(NTFSUtils::tryUSARecordFixup((PNTFS_RECORD)fixedUpRecord.data(), 512));
+		ASSERT_EQ(fixedUpRecord, record);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
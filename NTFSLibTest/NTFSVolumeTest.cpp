@@ -1,10 +1,48 @@
+#include <algorithm>
+
 #include <gtest\gtest.h>
 
 #include "..\NTFSLib\NTFSLib.h"
 #include "..\NTFSLib\NTFSVolume.h"
 
+using std::shared_ptr;
+using std::vector;
 using std::wstring;
 
+/**
+ * Counts the single reads and the batches handed to a device.
+ */
+class CountingDevice : public BlockDevice {
+public:
+	CountingDevice(shared_ptr<BlockDevice> device) :
+		Device(device),
+		NumOfReads(0),
+		NumOfBatches(0) {
+		// Left blank.
+	}
+
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override {
+		++NumOfReads;
+		return Device->readAt(buffer, offset, bytesToRead);
+	}
+
+	virtual void readBatch(DeviceReadList& reads) override {
+		++NumOfBatches;
+		Device->readBatch(reads);
+	}
+
+	virtual ULONGLONG getSize() const override {
+		return Device->getSize();
+	}
+
+	shared_ptr<BlockDevice> Device;
+	DWORD NumOfReads;
+	DWORD NumOfBatches;
+};
+
+#define BAD_IMAGE L"C:\\If\\You\\Create\\This\\Image\\You\\Ruin\\The\\Tests.dd"
+#define BATCH_IMAGE L"C:\\NTFSLibTestingGrounds\\Dumps\\BigFile.bin"
+
 // Valid volume constructor.
 TEST(NTFSVolumeTest, NTFSVolumeConstructor) {
 	try {
@@ -32,6 +70,201 @@ TEST(NTFSVolumeTest, ValidBootSector) {
 	}
 }
 
+// Opening a volume through an explicit block device.
+TEST(NTFSVolumeTest, BlockDeviceConstructor) {
+	try {
+		NTFSVolume letterVolume('C');
+		NTFSVolume deviceVolume(std::make_shared<VolumeDevice>(L'C'), L'C');
+		ASSERT_EQ(letterVolume.getVolumeSerialNumber(), deviceVolume.getVolumeSerialNumber());
+		ASSERT_EQ(letterVolume.getClusterSize(), deviceVolume.getClusterSize());
+		ASSERT_TRUE(deviceVolume.isDriveLetter(L'c'));
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Opening an image that does not exist.
+TEST(NTFSVolumeTest, BadImageConstructor) {
+	try {
+		NTFSVolume volume(std::make_shared<RawImageDevice>(BAD_IMAGE), L'C');
+		FAIL();
+	}
+	catch (Win32Error&) {
+		// Good!
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Reads a batch with more reads than the queue depth, and compares it with single reads.
+TEST(NTFSVolumeTest, RawImageReadBatch) {
+	try {
+		// Any file will do as an image.
+		RawImageDevice device(BATCH_IMAGE, 4);
+		DeviceReadList reads;
+		vector<Buffer> buffers(16, Buffer(4096));
+		for (size_t i = 0; i < buffers.size(); ++i) {
+			reads.push_back({ buffers[i].data(), (buffers.size() - i) * 3 * 4096, 4096, 0 });
+		}
+		// Past the end of the image.
+		Buffer pastEnd(4096);
+		reads.push_back({ pastEnd.data(), device.getSize() + 4096, 4096, 0 });
+		device.readBatch(reads);
+
+		Buffer expected(4096);
+		for (size_t i = 0; i < buffers.size(); ++i) {
+			ASSERT_EQ(reads[i].BytesRead, 4096);
+			ASSERT_EQ(device.readAt(expected.data(), reads[i].Offset, 4096), 4096);
+			ASSERT_EQ(buffers[i], expected);
+		}
+		ASSERT_EQ(reads.back().BytesRead, 0);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Unaligned reads from an unbuffered image, compared with the same reads from a buffered one.
+TEST(NTFSVolumeTest, RawImageUnbufferedRead) {
+	try {
+		RawImageDevice bufferedDevice(BATCH_IMAGE);
+		RawImageDevice unbufferedDevice(BATCH_IMAGE, RAW_IMAGE_DEFAULT_QUEUE_DEPTH, true);
+		ASSERT_TRUE(unbufferedDevice.isUnbuffered());
+
+		Buffer expected(10000);
+		Buffer actual(10000);
+		ASSERT_EQ(bufferedDevice.readAt(expected.data(), 1234, 10000), 10000);
+		ASSERT_EQ(unbufferedDevice.readAt(actual.data() + 1, 1234, 9999), 9999);
+		ASSERT_TRUE(std::equal(expected.begin(), expected.end() - 1, actual.begin() + 1));
+
+		DeviceReadList reads;
+		reads.push_back({ actual.data(), 1234, 10000, 0 });
+		// The last bytes of the image.
+		Buffer tail(1000);
+		reads.push_back({ tail.data(), unbufferedDevice.getSize() - 100, 1000, 0 });
+		unbufferedDevice.readBatch(reads);
+		ASSERT_EQ(reads[0].BytesRead, 10000);
+		ASSERT_EQ(reads[1].BytesRead, 100);
+		ASSERT_EQ(actual, expected);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Mapped and copied bytes of a mapped image, compared with the same reads from a raw image.
+TEST(NTFSVolumeTest, MappedImageRead) {
+	try {
+		RawImageDevice rawDevice(BATCH_IMAGE);
+		MappedImageDevice mappedDevice(BATCH_IMAGE);
+		ASSERT_EQ(mappedDevice.getSize(), rawDevice.getSize());
+		ASSERT_EQ(rawDevice.map(0, 4096), nullptr);
+
+		ULONGLONG offsets[] = { 0, 1234, rawDevice.getSize() / 2, rawDevice.getSize() - 4096 };
+		Buffer expected(4096);
+		Buffer actual(4096);
+		for (ULONGLONG offset : offsets) {
+			ASSERT_EQ(rawDevice.readAt(expected.data(), offset, 4096), 4096);
+			ASSERT_EQ(mappedDevice.readAt(actual.data(), offset, 4096), 4096);
+			ASSERT_EQ(actual, expected);
+			PBYTE mapped = mappedDevice.map(offset, 4096);
+			ASSERT_NE(mapped, nullptr);
+			ASSERT_TRUE(std::equal(expected.begin(), expected.end(), mapped));
+		}
+
+		// Past the end of the image.
+		ASSERT_EQ(mappedDevice.readAt(actual.data(), mappedDevice.getSize() - 100, 4096), 100);
+		ASSERT_EQ(mappedDevice.readAt(actual.data(), mappedDevice.getSize(), 4096), 0);
+		ASSERT_THROW(mappedDevice.map(mappedDevice.getSize() - 100, 4096), OutOfBoundsError);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Reads crossing the boundaries of a segmented image.
+TEST(NTFSVolumeTest, SegmentedImageRead) {
+	try {
+		// The same file three times over.
+		RawImageDevice segment(BATCH_IMAGE);
+		SegmentedImageDevice device({ BATCH_IMAGE, BATCH_IMAGE, BATCH_IMAGE });
+		ASSERT_EQ(device.getNumOfSegments(), 3);
+		ASSERT_EQ(device.getSize(), 3 * segment.getSize());
+		ASSERT_EQ(SegmentedImageDevice::findSegments(BATCH_IMAGE).size(), 1);
+
+		Buffer expected(8192);
+		ASSERT_EQ(segment.readAt(expected.data(), segment.getSize() - 4096, 4096), 4096);
+		ASSERT_EQ(segment.readAt(expected.data() + 4096, 0, 4096), 4096);
+
+		Buffer actual(8192);
+		ASSERT_EQ(device.readAt(actual.data(), segment.getSize() - 4096, 8192), 8192);
+		ASSERT_EQ(actual, expected);
+
+		Buffer batchActual(8192);
+		DeviceReadList reads;
+		reads.push_back({ batchActual.data(), 2 * segment.getSize() - 4096, 8192, 0 });
+		reads.push_back({ actual.data(), device.getSize(), 4096, 0 });
+		device.readBatch(reads);
+		ASSERT_EQ(reads[0].BytesRead, 8192);
+		ASSERT_EQ(reads[1].BytesRead, 0);
+		ASSERT_EQ(batchActual, expected);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A fragmented plan is read with a single batch with the cluster cache on, and then served by the cache.
+TEST(NTFSVolumeTest, ReadPlanSingleBatch) {
+	try {
+		shared_ptr<CountingDevice> device = std::make_shared<CountingDevice>(std::make_shared<VolumeDevice>(L'C'));
+		NTFSVolume volume(device, L'C');
+		volume.setClusterCacheSize(CLUSTER_CACHE_DEFAULT_SIZE);
+		WORD clusterSize = volume.getClusterSize();
+
+		// [VCN 0-3 @ LCN 0] [VCN 4-7 @ LCN 100] [VCN 8-9 @ LCN 50] [VCN 10-11 @ LCN 200], short and far apart.
+		DataRunList dataRuns = {
+			{ false, 0, 0, 4 },
+			{ false, 100, 4, 4 },
+			{ false, 50, 8, 2 },
+			{ false, 200, 10, 2 }
+		};
+		ExtentMap extentMap(dataRuns, clusterSize, 12 * clusterSize);
+		ReadPlanner planner(extentMap, clusterSize, 0);
+		ReadPlan plan = planner.plan(0, 12 * clusterSize);
+		ASSERT_EQ(plan.size(), 4);
+
+		// Part of it cached beforehand.
+		Buffer cached(2 * clusterSize);
+		ASSERT_EQ(volume.readClusters(cached.data(), 101, 2, false), 2 * clusterSize);
+		device->NumOfReads = 0;
+		device->NumOfBatches = 0;
+		Buffer actual(12 * clusterSize);
+		volume.readPlan(actual.data(), plan);
+		ASSERT_EQ(device->NumOfReads, 0);
+		ASSERT_EQ(device->NumOfBatches, 1);
+
+		Buffer expected(12 * clusterSize);
+		for (const DataRun& dataRun : dataRuns) {
+			ASSERT_EQ(device->Device->readAt(expected.data() + dataRun.StartVCN * clusterSize, dataRun.StartLCN * clusterSize,
+				(DWORD)dataRun.NumOfClusters * clusterSize), dataRun.NumOfClusters * clusterSize);
+		}
+		ASSERT_EQ(actual, expected);
+
+		// Everything is cached now.
+		Buffer cachedActual(12 * clusterSize);
+		volume.readPlan(cachedActual.data(), plan);
+		ASSERT_EQ(device->NumOfReads, 0);
+		ASSERT_EQ(device->NumOfBatches, 1);
+		ASSERT_EQ(cachedActual, expected);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
 #ifndef LIGHT_TESTS
 TEST(NTFSVolumeTest, ReadChnageJournal) {
 	try {
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <memory>
+
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Device\PartitionTable.h"
+#include "..\NTFSLib\Device\PartitionDevice.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+#include "..\NTFSLib\Misc\StringResource.h"
+
+using std::make_shared;
+using std::shared_ptr;
+
+#define TEST_SECTOR_SIZE 512
+#define TEST_DISK_SECTORS 4096
+
+/**
+ * A disk held in memory.
+ */
+class MemoryDevice : public BlockDevice {
+public:
+	MemoryDevice() :
+		Data(TEST_DISK_SECTORS * TEST_SECTOR_SIZE) {
+		// Left blank.
+	}
+
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override {
+		if (offset >= Data.size()) {
+			return 0;
+		}
+		DWORD bytesRead = (DWORD)std::min<ULONGLONG>(bytesToRead, Data.size() - offset);
+		memcpy(buffer, Data.data() + offset, bytesRead);
+		return bytesRead;
+	}
+
+	virtual ULONGLONG getSize() const override {
+		return Data.size();
+	}
+
+	PBYTE sector(ULONGLONG lba) {
+		return Data.data() + lba * TEST_SECTOR_SIZE;
+	}
+
+	void writeBootSector(ULONGLONG lba) {
+		memcpy(&((PNTFS_BOOT_SECTOR)sector(lba))->OEMID, StringResource::ntfsSignature, strlen(StringResource::ntfsSignature));
+	}
+
+	void writeMBR(ULONGLONG lba, const MBR_PARTITION_ENTRY& first, const MBR_PARTITION_ENTRY& second) {
+		PMASTER_BOOT_RECORD mbr = (PMASTER_BOOT_RECORD)sector(lba);
+		mbr->Partitions[0] = first;
+		mbr->Partitions[1] = second;
+		mbr->Signature = MBR_SIGNATURE;
+	}
+
+	Buffer Data;
+};
+
+// [1: LBA 64, NTFS] [Extended: LBA 1024 [5: LBA 1088] [6: LBA 1600, NTFS]]
+TEST(PartitionTableTest, MBRWithExtendedPartition) {
+	try {
+		shared_ptr<MemoryDevice> disk = make_shared<MemoryDevice>();
+		disk->writeMBR(0, { 0x80, {}, 0x07, {}, 64, 512 }, { 0, {}, MBR_TYPE_EXTENDED_LBA, {}, 1024, 2048 });
+		disk->writeBootSector(64);
+		disk->writeMBR(1024, { 0, {}, 0x83, {}, 64, 256 }, { 0, {}, MBR_TYPE_EXTENDED_CHS, {}, 512, 512 });
+		disk->writeMBR(1536, { 0, {}, 0x07, {}, 64, 256 }, {});
+		disk->writeBootSector(1600);
+
+		PartitionTable table(disk);
+		ASSERT_EQ(table.getScheme(), PARTITION_SCHEME::MBR);
+		const PartitionList& partitions = table.getPartitions();
+		ASSERT_EQ(partitions.size(), 3);
+		ASSERT_EQ(partitions[0].Number, 1);
+		ASSERT_TRUE(partitions[0].IsNTFS);
+		ASSERT_EQ(partitions[1].Number, 5);
+		ASSERT_EQ(partitions[1].Offset, 1088 * TEST_SECTOR_SIZE);
+		ASSERT_FALSE(partitions[1].IsNTFS);
+		ASSERT_EQ(partitions[2].Number, 6);
+		ASSERT_EQ(partitions[2].Offset, 1600 * TEST_SECTOR_SIZE);
+		ASSERT_EQ(partitions[2].Size, 256 * TEST_SECTOR_SIZE);
+		ASSERT_TRUE(partitions[2].IsNTFS);
+		ASSERT_EQ(table.getNTFSPartitions().size(), 2);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A GPT disk, with a partition ending beyond the end of the disk.
+TEST(PartitionTableTest, GPT) {
+	try {
+		shared_ptr<MemoryDevice> disk = make_shared<MemoryDevice>();
+		disk->writeMBR(0, { 0, {}, MBR_TYPE_GPT_PROTECTIVE, {}, 1, 0xffffffff }, {});
+		PGPT_HEADER header = (PGPT_HEADER)disk->sector(1);
+		memcpy(header->Signature, StringResource::gptSignature, sizeof(header->Signature));
+		header->PartitionEntryLBA = 2;
+		header->NumberOfPartitionEntries = 4;
+		header->SizeOfPartitionEntry = sizeof(GPT_PARTITION_ENTRY);
+		PGPT_PARTITION_ENTRY entries = (PGPT_PARTITION_ENTRY)disk->sector(2);
+		entries[0] = { { 0xa2, 0xa0, 0xd0, 0xeb }, {}, 34, 545, 0, L"Basic data partition" };
+		entries[2] = { { 0xa2, 0xa0, 0xd0, 0xeb }, {}, 3000, 9999, 0, {} };
+		disk->writeBootSector(34);
+
+		PartitionTable table(disk);
+		ASSERT_EQ(table.getScheme(), PARTITION_SCHEME::GPT);
+		ASSERT_EQ(table.getSectorSize(), TEST_SECTOR_SIZE);
+		const PartitionList& partitions = table.getPartitions();
+		ASSERT_EQ(partitions.size(), 2);
+		ASSERT_EQ(partitions[0].Offset, 34 * TEST_SECTOR_SIZE);
+		ASSERT_EQ(partitions[0].Size, 512 * TEST_SECTOR_SIZE);
+		ASSERT_STREQ(partitions[0].Name.c_str(), L"Basic data partition");
+		ASSERT_TRUE(partitions[0].IsNTFS);
+		ASSERT_EQ(partitions[1].Number, 3);
+		ASSERT_EQ(partitions[1].Size, (TEST_DISK_SECTORS - 3000) * TEST_SECTOR_SIZE);
+		ASSERT_FALSE(partitions[1].IsNTFS);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// An image of a single volume.
+TEST(PartitionTableTest, Unpartitioned) {
+	try {
+		shared_ptr<MemoryDevice> disk = make_shared<MemoryDevice>();
+		disk->writeBootSector(0);
+		PartitionTable table(disk);
+		ASSERT_EQ(table.getScheme(), PARTITION_SCHEME::NONE);
+		ASSERT_EQ(table.getNTFSPartitions().size(), 1);
+		ASSERT_EQ(table.getPartitions()[0].Size, disk->getSize());
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Partition devices read their own part of the disk only.
+TEST(PartitionTableTest, PartitionDevice) {
+	try {
+		shared_ptr<MemoryDevice> disk = make_shared<MemoryDevice>();
+		disk->sector(10)[0] = 0xab;
+		PartitionDevice partition(disk, 10 * TEST_SECTOR_SIZE, 2 * TEST_SECTOR_SIZE);
+		Buffer buffer(3 * TEST_SECTOR_SIZE);
+		ASSERT_EQ(partition.readAt(buffer.data(), 0, 1), 1);
+		ASSERT_EQ(buffer[0], 0xab);
+		ASSERT_EQ(partition.readAt(buffer.data(), TEST_SECTOR_SIZE, 3 * TEST_SECTOR_SIZE), TEST_SECTOR_SIZE);
+		ASSERT_EQ(partition.readAt(buffer.data(), 2 * TEST_SECTOR_SIZE, 1), 0);
+
+		DeviceReadList reads = { { buffer.data(), 0, TEST_SECTOR_SIZE, 0 }, { buffer.data(), 5 * TEST_SECTOR_SIZE, 1, 0 } };
+		partition.readBatch(reads);
+		ASSERT_EQ(reads[0].BytesRead, TEST_SECTOR_SIZE);
+		ASSERT_EQ(reads[1].BytesRead, 0);
+
+		// The disk might change (e.g. a live disk), so the partition might too.
+		ASSERT_FALSE(partition.isImmutable());
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A partition table which is not one.
+TEST(PartitionTableTest, BadPartitionTable) {
+	try {
+		PartitionTable table(make_shared<MemoryDevice>());
+		FAIL();
+	}
+	catch (BadRecordHeaderError&) {
+		// Good!
+	}
+	catch (...) {
+		FAIL();
+	}
+}
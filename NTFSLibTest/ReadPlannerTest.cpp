@@ -0,0 +1,92 @@
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\ReadPlanner.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+
+#define TEST_CLUSTER_SIZE 4096
+
+// [VCN 0-9 @ LCN 100] [VCN 10-14 @ LCN 110] [VCN 15-16 @ LCN 116] [VCN 17-19 sparse] [VCN 20-519 @ LCN 1000] [VCN 520-521 @ LCN 5000]
+static const DataRunList testDataRuns = {
+	{ false, 100, 0, 10 },
+	{ false, 110, 10, 5 },
+	{ false, 116, 15, 2 },
+	{ true, 0, 17, 3 },
+	{ false, 1000, 20, 500 },
+	{ false, 5000, 520, 2 }
+};
+
+// Adjacent data runs are read with a single I/O, straight into the output buffer.
+TEST(ReadPlannerTest, MergeAdjacent) {
+	try {
+		ExtentMap extentMap(testDataRuns, TEST_CLUSTER_SIZE, 522 * TEST_CLUSTER_SIZE);
+		ReadPlanner planner(extentMap, TEST_CLUSTER_SIZE, 0);
+		ReadPlan plan = planner.plan(0, 15 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan.size(), 1);
+		ASSERT_TRUE(ReadPlanner::isDirect(plan[0]));
+		ASSERT_EQ(plan[0].DiskOffset, 100 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan[0].Length, 15 * TEST_CLUSTER_SIZE);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Data runs close on the disk are merged, and the gap between them is discarded.
+TEST(ReadPlannerTest, MergeOverGap) {
+	try {
+		ExtentMap extentMap(testDataRuns, TEST_CLUSTER_SIZE, 522 * TEST_CLUSTER_SIZE);
+		ReadPlanner planner(extentMap, TEST_CLUSTER_SIZE, TEST_CLUSTER_SIZE);
+		ReadPlan plan = planner.plan(10 * TEST_CLUSTER_SIZE, 7 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan.size(), 1);
+		ASSERT_FALSE(ReadPlanner::isDirect(plan[0]));
+		ASSERT_EQ(plan[0].Length, 8 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan[0].Segments.size(), 2);
+		ASSERT_EQ(plan[0].Segments[1].IOOffset, 6 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan[0].Segments[1].BufferOffset, 5 * TEST_CLUSTER_SIZE);
+
+		// Without a gap tolerance, both are read on their own.
+		ReadPlanner strictPlanner(extentMap, TEST_CLUSTER_SIZE, 0);
+		ASSERT_EQ(strictPlanner.plan(10 * TEST_CLUSTER_SIZE, 7 * TEST_CLUSTER_SIZE).size(), 2);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Sparse data runs are zero filled, and partial clusters of long reads are planned on their own.
+TEST(ReadPlannerTest, SparseAndPartialClusters) {
+	try {
+		ExtentMap extentMap(testDataRuns, TEST_CLUSTER_SIZE, 522 * TEST_CLUSTER_SIZE);
+		ReadPlanner planner(extentMap, TEST_CLUSTER_SIZE);
+		ReadPlan plan = planner.plan(17 * TEST_CLUSTER_SIZE + 100, 503 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan.size(), 3);
+		ASSERT_TRUE(plan[0].IsZeroFill);
+		ASSERT_EQ(plan[0].Length, 3 * TEST_CLUSTER_SIZE - 100);
+		ASSERT_TRUE(ReadPlanner::isDirect(plan[1]));
+		ASSERT_EQ(plan[1].DiskOffset, 1000 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan[1].Segments[0].BufferOffset, 3 * TEST_CLUSTER_SIZE - 100);
+		// The last 100 bytes, too far from the rest.
+		ASSERT_EQ(plan[2].DiskOffset, 5000 * TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan[2].Length, TEST_CLUSTER_SIZE);
+		ASSERT_EQ(plan[2].Segments[0].Length, 100);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// Planning beyond the end of the stream.
+TEST(ReadPlannerTest, BadPlan) {
+	try {
+		ExtentMap extentMap(testDataRuns, TEST_CLUSTER_SIZE, 522 * TEST_CLUSTER_SIZE);
+		ReadPlanner planner(extentMap, TEST_CLUSTER_SIZE);
+		planner.plan(521 * TEST_CLUSTER_SIZE, TEST_CLUSTER_SIZE + 1);
+		FAIL();
+	}
+	catch (OutOfBoundsError&) {
+		// Good!
+	}
+	catch (...) {
+		FAIL();
+	}
+}
@@ -0,0 +1,67 @@
+#include <gtest\gtest.h>
+#include <atomic>
+
+#include "..\NTFSLib\Misc\Readahead.h"
+
+using std::atomic;
+
+#define TEST_STREAM_SIZE (4 * 1024 * 1024)
+#define TEST_BLOCK_SIZE (64 * 1024)
+
+// Byte <offset> of the test stream.
+static BYTE streamByte(ULONGLONG offset) {
+	return (BYTE)(offset * 7 + offset / 4096);
+}
+
+// Reads the test stream, and counts the reads.
+static StreamReader countingReader(atomic<DWORD>& numOfReads) {
+	return [&numOfReads](PVOID buffer, ULONGLONG offset, DWORD length) {
+		for (DWORD i = 0; i < length; ++i) {
+			((PBYTE)buffer)[i] = streamByte(offset + i);
+		}
+		numOfReads++;
+	};
+}
+
+// Sequential reads are served from the windows read ahead, which keep growing.
+TEST(ReadaheadTest, SequentialReads) {
+	try {
+		atomic<DWORD> numOfReads(0);
+		Readahead readahead(countingReader(numOfReads), TEST_STREAM_SIZE, 1024 * 1024);
+		Buffer block(TEST_BLOCK_SIZE);
+		DWORD previousWindow = 0;
+		for (ULONGLONG offset = 0; offset < TEST_STREAM_SIZE; offset += TEST_BLOCK_SIZE) {
+			readahead.read(block.data(), offset, TEST_BLOCK_SIZE);
+			for (DWORD i = 0; i < TEST_BLOCK_SIZE; ++i) {
+				ASSERT_EQ(block[i], streamByte(offset + i));
+			}
+			ASSERT_GE(readahead.getWindow(), previousWindow);
+			previousWindow = readahead.getWindow();
+		}
+		ASSERT_EQ(previousWindow, 1024 * 1024);
+		ASSERT_LT(numOfReads, TEST_STREAM_SIZE / TEST_BLOCK_SIZE);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A random read collapses the window, and is still served correctly.
+TEST(ReadaheadTest, RandomReadCollapses) {
+	try {
+		atomic<DWORD> numOfReads(0);
+		Readahead readahead(countingReader(numOfReads), TEST_STREAM_SIZE);
+		Buffer block(TEST_BLOCK_SIZE);
+		readahead.read(block.data(), 0, TEST_BLOCK_SIZE);
+		readahead.read(block.data(), TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+		ASSERT_GT(readahead.getWindow(), 0);
+		readahead.read(block.data(), TEST_STREAM_SIZE / 2 + 100, TEST_BLOCK_SIZE);
+		ASSERT_EQ(readahead.getWindow(), 0);
+		for (DWORD i = 0; i < TEST_BLOCK_SIZE; ++i) {
+			ASSERT_EQ(block[i], streamByte(TEST_STREAM_SIZE / 2 + 100 + i));
+		}
+	}
+	catch (...) {
+		FAIL();
+	}
+}
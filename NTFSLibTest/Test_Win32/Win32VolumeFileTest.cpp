@@ -1,8 +1,14 @@
+#include <thread>
+#include <vector>
+
 #include <gtest\gtest.h>
 
 #include "..\..\NTFSLib\Misc\Win32\VolumeFile.h"
 #include "..\..\NTFSLib\NTFSLib.h"
 
+using std::thread;
+using std::vector;
+
 // Opening a valid volume.
 TEST(Win32VolumeFileTest, GoodVolumeFileConstructor) {
 	try {
@@ -39,4 +45,33 @@ TEST(Win32VolumeFileTest, BadPathVolumeFileConstructor) {
 	catch (...) {
 		FAIL();
 	}
+}
+
+// Positional reads from several threads at once, compared with reads from the caret.
+TEST(Win32VolumeFileTest, ConcurrentReadAt) {
+	try {
+		VolumeFile volume(L'C');
+		ASSERT_GT(volume.seek(0, SEEK_METHOD::END), 0);
+		ASSERT_EQ(volume.seek(0), 0);
+		Buffer expected(16 * 4096);
+		ASSERT_EQ(volume.read(expected.data(), (DWORD)expected.size()), expected.size());
+		ASSERT_EQ(volume.seek(0, SEEK_METHOD::CURRENT), expected.size());
+
+		Buffer actual(expected.size());
+		vector<thread> readers;
+		for (DWORD i = 0; i < 16; ++i) {
+			readers.push_back(thread([&volume, &actual, i]() {
+				volume.readAt(actual.data() + i * 4096, i * 4096, 4096);
+			}));
+		}
+		for (thread& reader : readers) {
+			reader.join();
+		}
+		ASSERT_EQ(actual, expected);
+		// Positional reads leave the caret as is.
+		ASSERT_EQ(volume.seek(0, SEEK_METHOD::CURRENT), expected.size());
+	}
+	catch (...) {
+		FAIL();
+	}
 }
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <memory>
+
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Device\VhdDevice.h"
+#include "..\NTFSLib\Device\VhdxDevice.h"
+#include "..\NTFSLib\Misc\NTFSLibError.h"
+#include "..\NTFSLib\Misc\StringResource.h"
+
+using std::make_shared;
+using std::shared_ptr;
+
+#define TEST_BLOCK_SIZE 4096
+#define TEST_NUM_OF_BLOCKS 4
+#define TEST_VHDX_BLOCK_SIZE (1024 * 1024)
+
+/**
+ * A container file held in memory.
+ */
+class MemoryFile : public BlockDevice {
+public:
+	explicit MemoryFile(size_t size) :
+		Data(size) {
+		// Left blank.
+	}
+
+	virtual DWORD readAt(PVOID buffer, ULONGLONG offset, DWORD bytesToRead) override {
+		if (offset >= Data.size()) {
+			return 0;
+		}
+		DWORD bytesRead = (DWORD)std::min<ULONGLONG>(bytesToRead, Data.size() - offset);
+		memcpy(buffer, Data.data() + offset, bytesRead);
+		return bytesRead;
+	}
+
+	virtual ULONGLONG getSize() const override {
+		return Data.size();
+	}
+
+	/**
+	 * Fills <length> bytes at <offset> with <value>.
+	 */
+	void fill(ULONGLONG offset, DWORD length, BYTE value) {
+		memset(Data.data() + offset, value, length);
+	}
+
+	template <typename T>
+	T* at(ULONGLONG offset) {
+		return (T*)(Data.data() + offset);
+	}
+
+	Buffer Data;
+};
+
+/**
+ * Builds a dynamic (or differencing) VHD of TEST_NUM_OF_BLOCKS blocks, whose blocks are stored in order of
+ * <allocatedBlocks>, each right after the BAT.
+ */
+static shared_ptr<MemoryFile> makeVhd(bool isDifferencing, const vector<DWORD>& allocatedBlocks) {
+	const DWORD headerOffset = VHD_FOOTER_SIZE;
+	const DWORD tableOffset = headerOffset + sizeof(VHD_DYNAMIC_HEADER);
+	const DWORD firstBlockSector = tableOffset / VHD_SECTOR_SIZE + 1;
+	const DWORD blockSectors = 1 + TEST_BLOCK_SIZE / VHD_SECTOR_SIZE;
+	ULONGLONG fileSize = ((ULONGLONG)firstBlockSector + allocatedBlocks.size() * blockSectors) * VHD_SECTOR_SIZE +
+		VHD_FOOTER_SIZE;
+	shared_ptr<MemoryFile> file = make_shared<MemoryFile>((size_t)fileSize);
+
+	PVHD_FOOTER footer = file->at<VHD_FOOTER>(fileSize - VHD_FOOTER_SIZE);
+	memcpy(footer->Cookie, StringResource::vhdFooterCookie, sizeof(footer->Cookie));
+	footer->DataOffset = _byteswap_uint64(headerOffset);
+	footer->CurrentSize = _byteswap_uint64(TEST_NUM_OF_BLOCKS * TEST_BLOCK_SIZE);
+	footer->DiskType = _byteswap_ulong(isDifferencing ? VHD_DISK_TYPE_DIFFERENCING : VHD_DISK_TYPE_DYNAMIC);
+	memcpy(file->at<VHD_FOOTER>(0), footer, VHD_FOOTER_SIZE);
+
+	PVHD_DYNAMIC_HEADER header = file->at<VHD_DYNAMIC_HEADER>(headerOffset);
+	memcpy(header->Cookie, StringResource::vhdDynamicHeaderCookie, sizeof(header->Cookie));
+	header->TableOffset = _byteswap_uint64(tableOffset);
+	header->MaxTableEntries = _byteswap_ulong(TEST_NUM_OF_BLOCKS);
+	header->BlockSize = _byteswap_ulong(TEST_BLOCK_SIZE);
+
+	PDWORD blockTable = file->at<DWORD>(tableOffset);
+	std::fill(blockTable, blockTable + TEST_NUM_OF_BLOCKS, VHD_UNALLOCATED_BLOCK);
+	for (size_t i = 0; i < allocatedBlocks.size(); ++i) {
+		blockTable[allocatedBlocks[i]] = _byteswap_ulong((DWORD)(firstBlockSector + i * blockSectors));
+	}
+	return file;
+}
+
+// Returns the file offset of the <i>th stored block of a VHD made by makeVhd (its sector bitmap precedes it).
+static ULONGLONG vhdBlockOffset(size_t i) {
+	return ((VHD_FOOTER_SIZE + sizeof(VHD_DYNAMIC_HEADER)) / VHD_SECTOR_SIZE + 1 +
+		i * (1 + TEST_BLOCK_SIZE / VHD_SECTOR_SIZE) + 1) * VHD_SECTOR_SIZE;
+}
+
+TEST(VirtualDiskTest, DynamicVhd) {
+	try {
+		shared_ptr<MemoryFile> file = makeVhd(false, { 2 });
+		file->fill(vhdBlockOffset(0), TEST_BLOCK_SIZE, 0xab);
+		ASSERT_TRUE(VhdDevice::isVhd(*file));
+		ASSERT_FALSE(VhdxDevice::isVhdx(*file));
+
+		VhdDevice disk(file);
+		ASSERT_EQ(disk.getSize(), TEST_NUM_OF_BLOCKS * TEST_BLOCK_SIZE);
+		ASSERT_EQ(disk.getBlockSize(), TEST_BLOCK_SIZE);
+		ASSERT_FALSE(disk.isDifferencing());
+
+		// Reads across unallocated block 1 into block 2.
+		Buffer data(2 * TEST_BLOCK_SIZE);
+		memset(data.data(), 0xff, data.size());
+		ASSERT_EQ(disk.readAt(data.data(), TEST_BLOCK_SIZE, data.size()), data.size());
+		for (DWORD i = 0; i < data.size(); ++i) {
+			ASSERT_EQ(data[i], i < TEST_BLOCK_SIZE ? 0 : 0xab);
+		}
+
+		// Reads past the end are truncated.
+		Buffer first(100);
+		Buffer last(TEST_BLOCK_SIZE);
+		DeviceReadList reads = {
+			{ first.data(), 2 * TEST_BLOCK_SIZE + 10, (DWORD)first.size(), 0 },
+			{ last.data(), 3 * TEST_BLOCK_SIZE + 100, (DWORD)last.size(), 0 }
+		};
+		disk.readBatch(reads);
+		ASSERT_EQ(reads[0].BytesRead, first.size());
+		ASSERT_EQ(reads[1].BytesRead, TEST_BLOCK_SIZE - 100);
+		ASSERT_EQ(first[0], 0xab);
+		ASSERT_EQ(last[0], 0);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+TEST(VirtualDiskTest, DifferencingVhd) {
+	try {
+		shared_ptr<MemoryFile> parent = make_shared<MemoryFile>(TEST_NUM_OF_BLOCKS * TEST_BLOCK_SIZE);
+		parent->fill(0, TEST_NUM_OF_BLOCKS * TEST_BLOCK_SIZE, 0x11);
+		shared_ptr<MemoryFile> file = makeVhd(true, { 1 });
+		file->fill(vhdBlockOffset(0), TEST_BLOCK_SIZE, 0x22);
+		// Sectors 0 and 2 of block 1 are held by the child.
+		*file->at<BYTE>(vhdBlockOffset(0) - VHD_SECTOR_SIZE) = 0xa0;
+
+		VhdDevice disk(file);
+		ASSERT_TRUE(disk.isDifferencing());
+		Buffer data(TEST_NUM_OF_BLOCKS * TEST_BLOCK_SIZE);
+		ASSERT_THROW(disk.readAt(data.data(), 0, data.size()), UnexpectedActionError);
+		disk.setParent(parent);
+
+		DeviceReadList reads = { { data.data(), 0, (DWORD)data.size(), 0 } };
+		disk.readBatch(reads);
+		ASSERT_EQ(reads[0].BytesRead, data.size());
+		for (DWORD i = 0; i < data.size(); ++i) {
+			DWORD sector = (i - TEST_BLOCK_SIZE) / VHD_SECTOR_SIZE;
+			bool isChild = i >= TEST_BLOCK_SIZE && i < 2 * TEST_BLOCK_SIZE && (sector == 0 || sector == 2);
+			ASSERT_EQ(data[i], isChild ? 0x22 : 0x11);
+		}
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+TEST(VirtualDiskTest, DifferencingVhdx) {
+	try {
+		const GUID batRegionGuid = { 0x2dc27766, 0xf623, 0x4200, { 0x9d, 0x64, 0x11, 0x5e, 0x9b, 0xfd, 0x4a, 0x08 } };
+		const GUID metadataRegionGuid = { 0x8b7ca206, 0x4790, 0x4b9a, { 0xb8, 0xfe, 0x57, 0x5f, 0x05, 0x0f, 0x88, 0x6e } };
+		const GUID fileParametersGuid = { 0xcaa16737, 0xfa36, 0x4d43, { 0xb3, 0xb6, 0x33, 0xf0, 0xaa, 0x44, 0xe7, 0x6b } };
+		const GUID virtualDiskSizeGuid = { 0x2fa54224, 0xcd1b, 0x4876, { 0xb2, 0x11, 0x5d, 0xbe, 0xd8, 0x3b, 0xf4, 0xb8 } };
+		const ULONGLONG metadataOffset = 1 * VHDX_FILE_OFFSET_UNIT;
+		const ULONGLONG batOffset = 2 * VHDX_FILE_OFFSET_UNIT;
+		const DWORD chunkRatio = (DWORD)(VHDX_SECTORS_PER_BITMAP_BLOCK * VHD_SECTOR_SIZE / TEST_VHDX_BLOCK_SIZE);
+
+		// [Block 0: 3MB, fully present] [Block 1: 4MB, partially present] [Block 2: in the parent] [Block 3: zero]
+		// Sector bitmaps: 5MB.
+		shared_ptr<MemoryFile> file = make_shared<MemoryFile>(6 * VHDX_FILE_OFFSET_UNIT);
+		memcpy(file->Data.data(), StringResource::vhdxFileSignature, 8);
+		PVHDX_HEADER header = file->at<VHDX_HEADER>(VHDX_HEADER_OFFSET_2);
+		memcpy(header->Signature, StringResource::vhdxHeaderSignature, sizeof(header->Signature));
+		header->SequenceNumber = 1;
+
+		PVHDX_REGION_TABLE_HEADER regionTable = file->at<VHDX_REGION_TABLE_HEADER>(VHDX_REGION_TABLE_OFFSET);
+		memcpy(regionTable->Signature, StringResource::vhdxRegionTableSignature, sizeof(regionTable->Signature));
+		regionTable->EntryCount = 2;
+		PVHDX_REGION_TABLE_ENTRY regions = (PVHDX_REGION_TABLE_ENTRY)(regionTable + 1);
+		regions[0] = { batRegionGuid, batOffset, (DWORD)((chunkRatio + 1) * sizeof(ULONGLONG)), VHDX_REGION_IS_REQUIRED };
+		regions[1] = { metadataRegionGuid, metadataOffset, VHDX_FILE_OFFSET_UNIT, VHDX_REGION_IS_REQUIRED };
+
+		PVHDX_METADATA_TABLE_HEADER metadataTable = file->at<VHDX_METADATA_TABLE_HEADER>(metadataOffset);
+		memcpy(metadataTable->Signature, StringResource::vhdxMetadataSignature, sizeof(metadataTable->Signature));
+		metadataTable->EntryCount = 2;
+		PVHDX_METADATA_TABLE_ENTRY items = (PVHDX_METADATA_TABLE_ENTRY)(metadataTable + 1);
+		items[0] = { fileParametersGuid, VHDX_METADATA_TABLE_SIZE, sizeof(VHDX_FILE_PARAMETERS), 0, 0 };
+		items[1] = { virtualDiskSizeGuid, VHDX_METADATA_TABLE_SIZE + 8, sizeof(ULONGLONG), 0, 0 };
+		*file->at<VHDX_FILE_PARAMETERS>(metadataOffset + VHDX_METADATA_TABLE_SIZE) = { TEST_VHDX_BLOCK_SIZE, VHDX_HAS_PARENT };
+		*file->at<ULONGLONG>(metadataOffset + VHDX_METADATA_TABLE_SIZE + 8) = 4 * TEST_VHDX_BLOCK_SIZE;
+
+		PULONGLONG blockTable = file->at<ULONGLONG>(batOffset);
+		blockTable[0] = (3ULL << VHDX_BAT_FILE_OFFSET_SHIFT) | VHDX_PAYLOAD_BLOCK_FULLY_PRESENT;
+		blockTable[1] = (4ULL << VHDX_BAT_FILE_OFFSET_SHIFT) | VHDX_PAYLOAD_BLOCK_PARTIALLY_PRESENT;
+		blockTable[2] = VHDX_PAYLOAD_BLOCK_NOT_PRESENT;
+		blockTable[3] = VHDX_PAYLOAD_BLOCK_ZERO;
+		blockTable[chunkRatio] = (5ULL << VHDX_BAT_FILE_OFFSET_SHIFT) | VHDX_SB_BLOCK_PRESENT;
+		file->fill(3 * VHDX_FILE_OFFSET_UNIT, 2 * TEST_VHDX_BLOCK_SIZE, 0x22);
+		// Sectors 0 and 2 of block 1 are held by the child (the bitmap of block 0 comes first).
+		*file->at<BYTE>(5 * VHDX_FILE_OFFSET_UNIT + TEST_VHDX_BLOCK_SIZE / VHD_SECTOR_SIZE / 8) = 0x05;
+
+		ASSERT_TRUE(VhdxDevice::isVhdx(*file));
+		VhdxDevice disk(file);
+		ASSERT_EQ(disk.getSize(), 4 * TEST_VHDX_BLOCK_SIZE);
+		ASSERT_TRUE(disk.isDifferencing());
+		shared_ptr<MemoryFile> parent = make_shared<MemoryFile>(4 * TEST_VHDX_BLOCK_SIZE);
+		parent->fill(0, 4 * TEST_VHDX_BLOCK_SIZE, 0x11);
+		disk.setParent(parent);
+
+		Buffer data(4 * TEST_VHDX_BLOCK_SIZE);
+		ASSERT_EQ(disk.readAt(data.data(), 0, data.size()), data.size());
+		for (DWORD i = 0; i < data.size(); i += VHD_SECTOR_SIZE) {
+			DWORD block = i / TEST_VHDX_BLOCK_SIZE;
+			DWORD sector = (i % TEST_VHDX_BLOCK_SIZE) / VHD_SECTOR_SIZE;
+			BYTE expected = block == 0 || (block == 1 && (sector == 0 || sector == 2)) ? 0x22 :
+				block == 3 ? 0 : 0x11;
+			ASSERT_EQ(data[i], expected);
+			ASSERT_EQ(data[i + VHD_SECTOR_SIZE - 1], expected);
+		}
+
+		// A pending log can not be replayed read-only.
+		header->LogGuid = batRegionGuid;
+		ASSERT_THROW(VhdxDevice pendingDisk(file), UnexpectedActionError);
+	}
+	catch (...) {
+		FAIL();
+	}
+}
@@ -0,0 +1,55 @@
+#include <atomic>
+#include <stdexcept>
+
+#include <gtest\gtest.h>
+
+#include "..\NTFSLib\Misc\WorkStealingPool.h"
+
+using std::atomic;
+
+#define TEST_NUM_OF_TASKS 1000
+
+// Every task runs exactly once, on one of the pool's workers.
+TEST(WorkStealingPoolTest, RunsAllTasks) {
+	try {
+		WorkStealingPool pool(4);
+		vector<atomic<int>> runs(TEST_NUM_OF_TASKS);
+		vector<PoolTask> tasks;
+		for (size_t i = 0; i < TEST_NUM_OF_TASKS; ++i) {
+			runs[i] = 0;
+			tasks.push_back([&runs, &pool, i](DWORD workerIndex) {
+				ASSERT_LT(workerIndex, pool.getNumOfThreads());
+				runs[i]++;
+			});
+		}
+		pool.start(tasks);
+		pool.wait();
+		for (size_t i = 0; i < TEST_NUM_OF_TASKS; ++i) {
+			ASSERT_EQ(runs[i], 1);
+		}
+	}
+	catch (...) {
+		FAIL();
+	}
+}
+
+// A throwing task cancels the batch, and its error reaches wait().
+TEST(WorkStealingPoolTest, RethrowsTaskError) {
+	WorkStealingPool pool(2);
+	vector<PoolTask> tasks;
+	for (size_t i = 0; i < TEST_NUM_OF_TASKS; ++i) {
+		tasks.push_back([i](DWORD) {
+			if (i == 0) {
+				throw std::runtime_error("Task failed");
+			}
+		});
+	}
+	pool.start(tasks);
+	ASSERT_THROW(pool.wait(), std::runtime_error);
+
+	// The pool can run another batch afterwards.
+	atomic<int> runs(0);
+	pool.start(vector<PoolTask>(TEST_NUM_OF_TASKS, [&runs](DWORD) { runs++; }));
+	pool.wait();
+	ASSERT_EQ(runs, TEST_NUM_OF_TASKS);
+}